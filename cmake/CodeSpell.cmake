@@ -8,6 +8,8 @@ set(CODESPELL_WHITELIST
   ${PROJECT_SOURCE_DIR}/cmake
   ${PROJECT_SOURCE_DIR}/src/CMakeLists.txt
   ${PROJECT_SOURCE_DIR}/src/lib_misc.c
+  ${PROJECT_SOURCE_DIR}/src/lj_gcthread.c
+  ${PROJECT_SOURCE_DIR}/src/lj_gcthread.h
   ${PROJECT_SOURCE_DIR}/src/lj_mapi.c
   ${PROJECT_SOURCE_DIR}/src/lj_memprof.c
   ${PROJECT_SOURCE_DIR}/src/lj_memprof.h
@@ -17,6 +19,7 @@ set(CODESPELL_WHITELIST
   ${PROJECT_SOURCE_DIR}/src/lj_sysprof.h
   ${PROJECT_SOURCE_DIR}/src/lj_utils.h
   ${PROJECT_SOURCE_DIR}/src/lj_utils_leb128.c
+  ${PROJECT_SOURCE_DIR}/src/lj_utils_time.c
   ${PROJECT_SOURCE_DIR}/src/lj_wbuf.c
   ${PROJECT_SOURCE_DIR}/src/lj_wbuf.h
   ${PROJECT_SOURCE_DIR}/src/lmisclib.h
@@ -0,0 +1,59 @@
+-- Benchmark of the huge page modes of the bundled allocator: the
+-- TLB-sensitive workloads on a large heap.
+--
+-- Usage: luajit perf/alloc-hugepages.lua [off|thp|hugetlb] [heap size in MB]
+--
+-- The heap consists of small tables, which are accessed in a random
+-- order, and traversed by the full GC cycles. The memory mapped by
+-- the allocator with huge pages is reported from the
+-- alloc_hugepages_size metric, the resident size of the transparent
+-- huge pages is reported from /proc/self/smaps_rollup (Linux 4.14+). Note that the heap is limited to 2 GB of the address
+-- space without LJ_GC64, so the larger heaps may run out of memory.
+
+local mode = arg and arg[1] or 'off'
+local heapmb = tonumber(arg and arg[2]) or 512
+
+local oldmode, err = misc.hugepages(mode)
+assert(oldmode, err)
+
+local function anonhuge()
+  local f = io.open('/proc/self/smaps_rollup')
+  if not f then return 0 end
+  local kb = f:read('*a'):match('AnonHugePages:%s*(%d+)')
+  f:close()
+  return tonumber(kb) or 0
+end
+
+-- Fill the heap with small tables.
+local heap = {}
+local n = 0
+while collectgarbage('count') < heapmb * 1024 do
+  for _ = 1, 1e5 do
+    n = n + 1
+    heap[n] = {n, n + 1}
+  end
+end
+
+-- Random lookups.
+local t0 = os.clock()
+local seed, sum = 1, 0
+for _ = 1, 2e7 do
+  seed = seed * 16807 % 2147483647
+  sum = sum + heap[seed % n + 1][1]
+end
+local tlookup = os.clock() - t0
+assert(sum > 0)
+
+-- Full GC cycles: the mark phase traverses all the tables.
+collectgarbage()
+t0 = os.clock()
+for _ = 1, 5 do
+  collectgarbage()
+end
+local tgc = (os.clock() - t0) / 5
+
+print(('mode %-8s heap %5d MB  mapped huge %5d MB  AnonHugePages %5d MB')
+  :format(mode, heapmb, misc.getmetrics().alloc_hugepages_size / 2^20,
+          anonhuge() / 1024))
+print(('random lookups %8.2f M/s'):format(2e7 / tlookup / 1e6))
+print(('full GC cycle  %8.3f s'):format(tgc))
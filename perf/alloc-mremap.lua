@@ -0,0 +1,56 @@
+-- Benchmark of the growth of the large objects: the array part of a
+-- table and the string buffer, which are grown by the doubling of
+-- their size.
+--
+-- Usage: luajit perf/alloc-mremap.lua [array|arrays|string] [size in MB]
+--
+-- The time, the number of the mremap() calls made by the allocator
+-- and the peak resident set size (Linux only) are reported. Run the
+-- modes in separate processes to get the peak of each one. Note that
+-- the heap is limited to 2 GB of the address space without LJ_GC64.
+
+local mode = arg and arg[1] or 'array'
+local sizemb = tonumber(arg and arg[2]) or 256
+
+local function hwm()
+  local f = io.open('/proc/self/status')
+  if not f then return 0 end
+  local kb = f:read('*a'):match('VmHWM:%s*(%d+)')
+  f:close()
+  return tonumber(kb) / 1024
+end
+
+local old = misc.getmetrics()
+local t0 = os.clock()
+if mode == 'array' then
+  -- The array part is grown by the rehashing on each power of two.
+  local t = {}
+  for i = 1, sizemb * 2^20 / 8 do
+    t[i] = i
+  end
+elseif mode == 'arrays' then
+  -- Two arrays of the half size are grown in turn, so the mapping of
+  -- each one is likely to be followed by the mapping of the other.
+  local t1, t2 = {}, {}
+  for i = 1, sizemb * 2^20 / 16 do
+    t1[i] = i
+    t2[i] = i
+  end
+elseif mode == 'string' then
+  -- The string buffer is grown on each power of two while the pieces
+  -- are appended to it.
+  local piece = ('x'):rep(1024)
+  local t = {}
+  for i = 1, sizemb * 2^10 do
+    t[i] = piece
+  end
+  local s = table.concat(t)
+  assert(#s == sizemb * 2^20)
+else
+  error('unknown mode ' .. mode)
+end
+local t = os.clock() - t0
+local new = misc.getmetrics()
+
+print(('%-6s %5d MB  time %6.3f s  mremap %4d  peak RSS %7.1f MB'):format(
+  mode, sizemb, t, new.alloc_mremap - old.alloc_mremap, hwm()))
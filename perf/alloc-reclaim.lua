@@ -0,0 +1,32 @@
+-- Benchmark of the reclaim thread of the bundled allocator: the
+-- large strings are freed by the full GC cycles, which unmap them.
+--
+-- Usage: luajit perf/alloc-reclaim.lua [on|off] [string size in MB]
+--
+-- The time of the GC cycles on the thread running Lua and the
+-- latency of the reclaim queue are reported. Note that the reclaim
+-- thread competes with the Lua one on a single CPU.
+
+local mode = arg and arg[1] or 'off'
+local sizemb = tonumber(arg and arg[2]) or 64
+local N = 50
+
+local _, err = misc.alloc_reclaim(mode == 'on')
+assert(not err, err)
+
+local total, max = 0, 0
+for i = 1, N do
+  local s = ('x'):rep(sizemb * 2^20) .. i -- luacheck: no unused
+  s = nil
+  local t0 = os.clock()
+  collectgarbage()
+  local t = os.clock() - t0
+  total = total + t
+  if t > max then max = t end
+end
+
+misc.alloc_reclaim(false)
+local m = misc.getmetrics()
+print(('reclaim %-3s  string %4d MB  GC avg %7.3f ms  max %7.3f ms' ..
+       '  queue latency max %7.3f ms'):format(mode, sizemb,
+       total / N * 1e3, max * 1e3, m.alloc_reclaimq_latency_max / 1e6))
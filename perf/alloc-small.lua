@@ -0,0 +1,79 @@
+-- Benchmark of the small object allocations: the throughput of
+-- allocation and freeing of small GC objects and the memory
+-- overhead of the allocator (fragmentation report).
+--
+-- Usage: luajit perf/alloc-small.lua [number of live objects]
+--
+-- The throughput part keeps a fixed working set of small tables,
+-- closures and strings and replaces its random elements, so each
+-- iteration allocates a new object and makes an old one garbage.
+-- The fragmentation part fills the heap with small objects, frees
+-- the most of them in a random order and reports the resident set
+-- size against the memory used by the live objects (gc_total) after
+-- each phase. The resident set size is available on Linux only.
+
+local nlive = tonumber(arg and arg[1]) or 1e6
+
+jit.off()
+
+local function rss()
+  local f = io.open('/proc/self/status')
+  if not f then return nil end
+  local kb = f:read('*a'):match('VmRSS:%s*(%d+)')
+  f:close()
+  return tonumber(kb) * 1024
+end
+
+local function report(phase)
+  collectgarbage()
+  collectgarbage()
+  local total = misc.getmetrics().gc_total
+  local res = rss()
+  if res then
+    print(('%-24s gc_total %8.1f MB  RSS %8.1f MB  overhead %5.1f%%'):format(
+      phase, total / 2^20, res / 2^20, (res - total) / total * 100))
+  else
+    print(('%-24s gc_total %8.1f MB'):format(phase, total / 2^20))
+  end
+end
+
+-- Throughput: replace random elements of the working set.
+local function churn(name, new, n)
+  local set = {}
+  for i = 1, 2^16 do set[i] = new(i) end
+  collectgarbage()
+  local t0 = os.clock()
+  local seed = 1
+  for i = 1, n do
+    seed = seed * 16807 % 2147483647
+    set[seed % 2^16 + 1] = new(i)
+  end
+  local t = os.clock() - t0
+  print(('%-24s %8.2f Mops/s'):format(name, n / t / 1e6))
+end
+
+local N = 1e7
+churn('tables {}', function() return {} end, N)
+churn('tables {x, y}', function(i) return {i, i} end, N)
+churn('closures', function(i) return function() return i end end, N)
+churn('strings', function(i) return 'str' .. i end, N)
+
+-- Fragmentation: allocate, free the most in a random order, refill.
+report('start')
+local live = {}
+for i = 1, nlive do
+  live[i] = i % 2 == 0 and {i} or 'fragment' .. i
+end
+report('filled')
+local seed = 1
+for _ = 1, nlive * 0.9 do
+  seed = seed * 16807 % 2147483647
+  live[seed % nlive + 1] = nil
+end
+report('90% freed')
+for i = 1, nlive do
+  if not live[i] then live[i] = function() return i end end
+end
+report('refilled with closures')
+live = nil -- luacheck: no unused
+report('all freed')
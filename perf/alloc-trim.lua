@@ -0,0 +1,53 @@
+-- Benchmark of the trimming policies of the bundled allocator: an
+-- oscillating workload with the bursts of allocations followed by
+-- freeing all of them.
+--
+-- Usage: luajit perf/alloc-trim.lua [decay in ms] [number of bursts]
+--
+-- The decay time 0 selects the default eager trimming, the positive
+-- one selects the lazy trimming. The syscalls made by the allocator
+-- and the resident set size (Linux only) are reported after the
+-- bursts and after the explicit trimming.
+
+local decay = tonumber(arg and arg[1]) or 0
+local nbursts = tonumber(arg and arg[2]) or 200
+
+local ok, err = misc.alloc_decay(decay * 1e3)
+assert(ok, err)
+
+local function rss()
+  local f = io.open('/proc/self/status')
+  if not f then return 0 end
+  local kb = f:read('*a'):match('VmRSS:%s*(%d+)')
+  f:close()
+  return tonumber(kb) / 1024
+end
+
+local function report(phase, t)
+  local m = misc.getmetrics()
+  print(('%-16s mmap %6d  munmap %6d  madvise %6d  mapped %7.1f MB' ..
+         '  RSS %7.1f MB%s'):format(phase, m.alloc_mmap, m.alloc_munmap,
+         m.alloc_madvise, m.alloc_mapped / 2^20, rss(),
+         t and ('  time %6.3f s'):format(t) or ''))
+end
+
+-- The strings are served from the segments, the tables are served
+-- from the slabs.
+local function burst(n)
+  local t = {}
+  for i = 1, n do
+    t[i] = {('x'):rep(512) .. i}
+  end
+  return t
+end
+
+local t0 = os.clock()
+for i = 1, nbursts do
+  local t = burst(i % 2 == 0 and 5e4 or 1e4) -- luacheck: no unused
+  t = nil
+  collectgarbage()
+end
+report('bursts', os.clock() - t0)
+
+misc.alloc_trim()
+report('trimmed')
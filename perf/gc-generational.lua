@@ -0,0 +1,72 @@
+-- Benchmark of the generational mode of the GC: the GC time and
+-- the memory usage of the generational mode against the
+-- incremental one.
+--
+-- Usage: luajit perf/gc-generational.lua [old heap size in MB]
+--
+-- The heap consists of the long-lived part (trees of small tables
+-- with strings, like configs and caches) and the request loop,
+-- which allocates short-lived tables and strings and sometimes
+-- updates the long-lived part. The GC time is taken from the
+-- gc_steps_time metric, the peak of the memory usage is sampled
+-- from gc_total between the requests.
+
+local heapmb = tonumber(arg and arg[1]) or 256
+
+jit.off()
+
+local function tree(depth)
+  if depth == 0 then
+    return {1, 2, 3, 'leaf', function() return depth end}
+  end
+  local t = {}
+  for i = 1, 8 do
+    t[i] = tree(depth - 1)
+  end
+  return t
+end
+
+local old = {}
+while collectgarbage('count') < heapmb * 1024 do
+  old[#old + 1] = tree(4)
+end
+
+-- A request allocates ~2 KB of garbage and updates the long-lived
+-- heap once per 64 requests.
+local function request(i)
+  local t = {}
+  for j = 1, 16 do
+    t[j] = {id = i, name = 'item' .. j}
+  end
+  if i % 64 == 0 then
+    old[i % #old + 1][1] = {i, 'updated' .. i}
+  end
+  return #t
+end
+
+local function run(mode, n)
+  collectgarbage(mode)
+  collectgarbage()
+  local m = misc.getmetrics()
+  local time, cycles = m.gc_steps_time, m.gc_cycles
+  local peak = 0
+  local t0 = os.clock()
+  for i = 1, n do
+    request(i)
+    if i % 1024 == 0 then
+      local total = collectgarbage('count')
+      if total > peak then peak = total end
+    end
+  end
+  local t = os.clock() - t0
+  m = misc.getmetrics()
+  print(('%-12s total %7.2f s  GC %7.2f s  cycles %5d  peak %8.1f MB'):format(
+    mode, t, (m.gc_steps_time - time) / 1e9, m.gc_cycles - cycles,
+    peak / 1024))
+end
+
+local N = 1e6
+print(('old heap: %d MB'):format(collectgarbage('count') / 1024))
+run('incremental', N)
+run('generational', N)
+collectgarbage('incremental')
@@ -0,0 +1,74 @@
+-- Benchmark of the parallel marking: the mark throughput of the
+-- incremental GC with 1 to 8 markers.
+--
+-- Usage: luajit perf/gc-parallel-mark.lua [heap size in MB]
+--
+-- The heap consists of trees of small tables with strings and
+-- closures. The mark phase is timed from the start of a GC cycle
+-- until its atomic step by the gc_steps_time metric, so the
+-- sweep phase (which is not parallel) is not counted. The speedup
+-- is bounded by the number of CPUs available to the process, which
+-- is reported first. There is no speedup with a single CPU.
+
+local heapmb = tonumber(arg and arg[1]) or 256
+
+jit.off()
+
+-- Fill the heap with the given amount of live objects.
+local function tree(depth)
+  if depth == 0 then
+    return {1, 2, 3, 'leaf', function() return depth end}
+  end
+  local t = {}
+  for i = 1, 8 do
+    t[i] = tree(depth - 1)
+  end
+  return t
+end
+
+local heap = {}
+while collectgarbage('count') < heapmb * 1024 do
+  heap[#heap + 1] = tree(4)
+end
+
+-- Returns the time (ns) of the mark phase of a new GC cycle.
+local function mark_time()
+  collectgarbage()
+  local m = misc.getmetrics()
+  local atomic, time = m.gc_steps_atomic, m.gc_steps_time
+  repeat
+    collectgarbage('step', 0)
+    m = misc.getmetrics()
+  until m.gc_steps_atomic ~= atomic
+  return m.gc_steps_time - time
+end
+
+-- The number of CPUs the process may run on (nproc is from GNU
+-- coreutils).
+local function ncpus()
+  local f = io.popen('nproc 2>/dev/null')
+  local n = f and tonumber(f:read('*l'))
+  if f then f:close() end
+  return n
+end
+
+local bytes = collectgarbage('count') * 1024
+print(('heap: %d MB, CPUs: %s'):format(bytes / 2^20, ncpus() or 'unknown'))
+local base
+for _, n in ipairs({1, 2, 4, 8}) do
+  local markers = collectgarbage('markers', n)
+  markers = collectgarbage('markers', n)
+  if markers ~= n then
+    print(('%d markers: not supported (%d)'):format(n, markers))
+    break
+  end
+  local best = math.huge
+  for _ = 1, 3 do
+    local t = mark_time()
+    if t < best then best = t end
+  end
+  base = base or best
+  print(('%d markers: %8.1f ms, %7.1f MB/s, speedup %.2f'):format(
+    n, best / 1e6, bytes / 2^20 / (best / 1e9), base / best))
+end
+collectgarbage('markers', 1)
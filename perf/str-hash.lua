@@ -0,0 +1,40 @@
+-- Benchmark of the string interning with the different string hash
+-- functions: build LuaJIT with the default options, with
+-- LUAJIT_SMART_STRINGS=OFF and with LUAJIT_SEEDED_STRHASH=ON and
+-- compare the results.
+--
+-- Usage: luajit perf/str-hash.lua [number of strings]
+--
+-- Each workload interns the new strings (misses) and then interns
+-- the same strings again (hits). The URL-like keys share the long
+-- prefix and suffix, so they collide with the sampling hash function.
+
+local nstrings = tonumber(arg and arg[1]) or 5e5
+
+local workloads = {
+  {'short', function(i) return 'k' .. i end},
+  {'url', function(i)
+    return 'https://api.example.com/v1/users/' .. i ..
+           '/profile?fields=name,email,avatar&lang=en'
+  end},
+  {'long', function(i)
+    return ('x'):rep(500) .. i .. ('y'):rep(500)
+  end},
+}
+
+collectgarbage('stop')
+for _, w in ipairs(workloads) do
+  local name, gen = w[1], w[2]
+  local keep = {}
+  local t0 = os.clock()
+  for i = 1, nstrings do keep[i] = gen(i) end
+  local tmiss = os.clock() - t0
+  t0 = os.clock()
+  for i = 1, nstrings do keep[i] = gen(i) end
+  local thit = os.clock() - t0
+  print(('%-6s miss %8.3f Mstr/s  hit %8.3f Mstr/s'):format(
+    name, nstrings / tmiss / 1e6, nstrings / thit / 1e6))
+  keep = nil -- luacheck: no unused
+  collectgarbage()
+  collectgarbage('stop')
+end
@@ -0,0 +1,34 @@
+-- Benchmark of the uninterned long strings: the workloads producing
+-- many large strings, which are never used as the table keys.
+--
+-- Usage: luajit perf/str-nointern.lua [threshold] [number of strings]
+--
+-- The threshold 0 interns all the strings (the default), the positive
+-- one leaves the strings of at least the given length uninterned.
+
+local threshold = tonumber(arg and arg[1]) or 0
+local nstrings = tonumber(arg and arg[2]) or 2e5
+
+local _, err = misc.strnointern(threshold)
+assert(not err, err)
+
+local chunk = ('x'):rep(1000)
+local workloads = {
+  {'concat', function(i) return chunk .. i end},
+  {'rep', function(i) return ('%d'):format(i):rep(200) end},
+  {'format', function(i) return ('%s:%d'):format(chunk, i) end},
+  {'tconcat', function(i) return table.concat({chunk, i, chunk}) end},
+}
+
+for _, w in ipairs(workloads) do
+  local name, gen = w[1], w[2]
+  local keep = {}
+  collectgarbage()
+  local t0 = os.clock()
+  for i = 1, nstrings do keep[i % 1000 + 1] = gen(i) end
+  local t = os.clock() - t0
+  print(('%-8s %8.3f s'):format(name, t))
+end
+
+local m = misc.getmetrics()
+print(('uninterned %d  interned %d'):format(m.strhash_nointern, m.gc_strnum))
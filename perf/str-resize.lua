@@ -0,0 +1,27 @@
+-- Benchmark of the string hash table growth: the latency of the string
+-- interning while the number of live strings grows.
+--
+-- Usage: luajit perf/str-resize.lua [number of strings] [batch size]
+--
+-- The strings are interned in batches, and the slowest batch is reported
+-- along with the total time. The GC is stopped, so the batch time includes
+-- the resizes of the string hash table but not the GC steps.
+
+local nstrings = tonumber(arg and arg[1]) or 4e6
+local batch = tonumber(arg and arg[2]) or 100
+
+collectgarbage('stop')
+local keep = require('table.new')(nstrings, 0)
+local maxt, total = 0, 0
+local clock = os.clock
+for i = 1, nstrings, batch do
+  local t0 = clock()
+  for j = i, i + batch - 1 do
+    keep[j] = 'str' .. j
+  end
+  local t = clock() - t0
+  total = total + t
+  if t > maxt then maxt = t end
+end
+print(('strings %9d  total %7.3f s  max batch of %d %8.3f ms'):format(
+  nstrings, total, batch, maxt * 1e3))
@@ -0,0 +1,83 @@
+-- Microbenchmarks of the string kernels: the interning of a string
+-- equal to an existing one, the ordered comparison, the plain
+-- substring search and the pattern search with a literal first
+-- character, for the strings from 16 bytes to 1 MB.
+--
+-- Usage: luajit perf/str-simd.lua [eq|cmp|find|scan]...
+--
+-- The throughput is reported in MB/s of the scanned string data. The
+-- JIT compiler is turned off, since it hoists the loop-invariant
+-- operations out of the loops.
+
+jit.off()
+
+local kernels = {}
+for i = 1, arg and #arg or 0 do kernels[arg[i]] = true end
+if next(kernels) == nil then
+  kernels = {eq = true, cmp = true, find = true, scan = true}
+end
+
+local seed = 1
+local function randstr(len, alphabet)
+  local t = {}
+  for i = 1, len do
+    seed = seed * 16807 % 2147483647
+    local k = seed % #alphabet + 1
+    t[i] = alphabet:sub(k, k)
+  end
+  return table.concat(t)
+end
+
+local function bench(name, len, f)
+  local n = math.max(100, math.floor(2^28 / len))
+  local t0 = os.clock()
+  f(n)
+  local t = os.clock() - t0
+  print(('%-5s %8d B  %10.1f MB/s'):format(name, len, n * len / t / 2^20))
+end
+
+local sizes = {16, 64, 256, 1024, 16384, 2^20}
+
+for _, len in ipairs(sizes) do
+  local a = randstr(len, 'abcdefgh')
+  if kernels.eq then
+    -- The concatenation is interned to the existing string, the data
+    -- is compared once the hashes are equal.
+    local h1, h2 = a:sub(1, len / 2), a:sub(len / 2 + 1)
+    bench('eq', len, function(n)
+      for _ = 1, n do
+        local s = h1 .. h2
+        assert(s == a)
+      end
+    end)
+  end
+  if kernels.cmp then
+    -- The strings differ in the last byte only.
+    local b = a:sub(1, -2) .. 'z'
+    bench('cmp', len, function(n)
+      local r = 0
+      for _ = 1, n do
+        if a < b then r = r + 1 end
+      end
+      assert(r == n)
+    end)
+  end
+  if kernels.find then
+    -- The first character of the pattern is frequent, the last one
+    -- is absent.
+    local p = 'abcz'
+    bench('find', len, function(n)
+      for _ = 1, n do
+        assert(a:find(p, 1, true) == nil)
+      end
+    end)
+  end
+  if kernels.scan then
+    -- The first character of the pattern is absent.
+    bench('scan', len, function(n)
+      for _ = 1, n do
+        assert(a:find('z%d') == nil)
+      end
+    end)
+  end
+end
@@ -0,0 +1,63 @@
+-- Benchmark of the small record-like tables: the creation and the
+-- field access of the tables with a few string keys.
+--
+-- Usage: luajit perf/tab-records.lua [number of records] [rounds]
+--
+-- The records are created by the table constructors, so their hash
+-- parts are sized in advance. The memory of the live records is
+-- reported as well: both the GC accounted one and the growth of the
+-- resident set size (Linux only), which includes the overhead of the
+-- allocator.
+
+local nrecords = tonumber(arg and arg[1]) or 1e6
+local rounds = tonumber(arg and arg[2]) or 10
+
+local clock = os.clock
+
+local function rss()
+  local f = io.open('/proc/self/status')
+  if not f then return 0 end
+  local kb = f:read('*a'):match('VmRSS:%s*(%d+)')
+  f:close()
+  return tonumber(kb)
+end
+
+local function create(n)
+  local records = {}
+  for i = 1, n do
+    records[i] = {id = i, x = i + 1, y = i + 2, name = 'r'}
+  end
+  return records
+end
+
+local function access(records)
+  local sum = 0
+  for i = 1, #records do
+    local r = records[i]
+    sum = sum + r.id + r.x + r.y
+  end
+  return sum
+end
+
+collectgarbage()
+local mem0, rss0 = collectgarbage('count'), rss()
+local records = create(nrecords)
+collectgarbage()
+local mem, memrss = collectgarbage('count') - mem0, rss() - rss0
+
+local t0 = clock()
+for _ = 1, rounds do
+  records = nil
+  records = create(nrecords)
+end
+local tcreate = clock() - t0
+
+t0 = clock()
+for _ = 1, rounds do assert(access(records) > 0) end
+local taccess = clock() - t0
+
+print(('records %d  create %7.2f M/s  access %7.2f M/s' ..
+       '  GC %6.1f bytes/record  RSS %6.1f bytes/record'):format(
+  nrecords, nrecords * rounds / tcreate / 1e6,
+  nrecords * rounds / taccess / 1e6, mem * 1024 / nrecords,
+  memrss * 1024 / nrecords))
@@ -0,0 +1,34 @@
+-- Benchmark of the hash part resizing: the latency of the inserts
+-- into a growing table.
+--
+-- Usage: luajit perf/tab-resize.lua [number of keys] [batch size]
+--
+-- The keys are inserted in batches, and the slowest batch is
+-- reported along with the total time. Without the incremental
+-- resize the slowest batch includes the rehash of the whole hash
+-- part.
+
+local nkeys = tonumber(arg and arg[1]) or 4e6
+local batch = tonumber(arg and arg[2]) or 1e3
+
+local clock = os.clock
+local keys = {}
+for i = 1, nkeys do keys[i] = 'key' .. i end
+
+collectgarbage()
+collectgarbage('stop')
+
+local t = {}
+local worst, total = 0, 0
+for i = 1, nkeys, batch do
+  local t0 = clock()
+  for j = i, math.min(i + batch - 1, nkeys) do
+    t[keys[j]] = j
+  end
+  local dt = clock() - t0
+  total = total + dt
+  if dt > worst then worst = dt end
+end
+
+print(('keys %d  batch %d  total %7.3f s  slowest batch %8.3f ms'):format(
+  nkeys, batch, total, worst * 1e3))
@@ -0,0 +1,45 @@
+-- Benchmark of the table functions, which shift the array part:
+-- table.insert() and table.remove() at the front of the array and
+-- table.move() of the whole array.
+--
+-- Usage: luajit perf/tab-shift.lua [array size] [number of operations]
+--
+-- The loops with these functions are compiled, unless the JIT
+-- compiler is turned off with -joff.
+
+local size = tonumber(arg and arg[1]) or 1000
+local nops = tonumber(arg and arg[2]) or 1e6
+
+local clock = os.clock
+local tinsert, tremove, tmove = table.insert, table.remove, table.move
+
+local function seq(n)
+  local t = {}
+  for i = 1, n do t[i] = i end
+  return t
+end
+
+local function bench(name, f)
+  local t = seq(size)
+  local t0 = clock()
+  f(t)
+  local dt = clock() - t0
+  print(('%-22s %9.3f M/s  %9.1f Melem/s'):format(
+    name, nops / dt / 1e6, nops * size / dt / 1e6))
+end
+
+bench('insert/remove front', function(t)
+  for i = 1, nops / 2 do
+    tinsert(t, 1, i)
+    tremove(t, 1)
+  end
+end)
+
+bench('rotate', function(t)
+  for _ = 1, nops do tinsert(t, 1, tremove(t)) end
+end)
+
+bench('move to another table', function(t)
+  local d = {}
+  for _ = 1, nops do tmove(t, 1, size, 1, d) end
+end)
@@ -0,0 +1,60 @@
+-- Benchmark of the table constructors with constant keys: the
+-- creation of the tables from the large templates, which are only
+-- read or written after the creation.
+--
+-- Usage: luajit perf/tab-template.lua [number of tables]
+--
+-- The allocated memory per table is reported along with the rate
+-- of the creation. The tables created on traces are always copied
+-- from the template, so the interpreter is measured.
+
+jit.off()
+
+local ntables = tonumber(arg and arg[1]) or 1e6
+
+local clock = os.clock
+
+local function config()
+  return {
+    host = 'localhost', port = 3301, user = 'guest', timeout = 0.5,
+    retries = 3, backlog = 128, readahead = 16320, log_level = 5,
+    memtx_memory = 268435456, wal_mode = 'write', checkpoint_count = 2,
+    net_msg_max = 768, worker_pool_threads = 4, too_long_threshold = 0.5,
+  }
+end
+
+local function primes()
+  return {2, 3, 5, 7, 11, 13, 17, 19, 23, 29, 31, 37, 41, 43, 47, 53, 59, 61,
+          67, 71, 73, 79, 83, 89, 97}
+end
+
+local function bench(name, make, write)
+  collectgarbage()
+  collectgarbage('stop')
+  local mem0 = collectgarbage('count')
+  for _ = 1, 1e4 do
+    local t = make()
+    if write then write(t) end
+  end
+  local mem = (collectgarbage('count') - mem0) * 1024 / 1e4
+  collectgarbage('restart')
+  local sum = 0
+  local t0 = clock()
+  for _ = 1, ntables do
+    local t = make()
+    if write then write(t) end
+    sum = sum + #t
+  end
+  local dt = clock() - t0
+  print(('%-22s %7.2f M/s  %7.1f bytes/table'):format(
+    name, ntables / dt / 1e6, mem))
+  return sum
+end
+
+local function setport(t) t.port = 3302 end
+local function setprime(t) t[1] = 1 end
+
+bench('hash part, read', config)
+bench('hash part, written', config, setport)
+bench('array part, read', primes)
+bench('array part, written', primes, setprime)
@@ -447,7 +447,9 @@ LJLIB_CF(gcinfo)
 LJLIB_CF(collectgarbage)
 {
   int opt = lj_lib_checkopt(L, 1, LUA_GCCOLLECT,  /* ORDER LUA_GC* */
-    "\4stop\7restart\7collect\5count\1\377\4step\10setpause\12setstepmul\1\377\11isrunning");
+    "\4stop\7restart\7collect\5count\1\377\4step\10setpause\12setstepmul"
+    "\1\377\11isrunning\14generational\13incremental\6budget\7bgsweep\7markers"
+    "\11finbudget");
   int32_t data = lj_lib_optint(L, 2, 0);
   if (opt == LUA_GCCOUNT) {
     setnumV(L->top, (lua_Number)G(L)->gc.total/1024.0);
@@ -455,6 +457,9 @@ LJLIB_CF(collectgarbage)
     int res = lua_gc(L, opt, data);
     if (opt == LUA_GCSTEP || opt == LUA_GCISRUNNING)
       setboolV(L->top, res);
+    else if (opt == LUA_GCGEN || opt == LUA_GCINC)  /* Return previous mode. */
+      setstrV(L, L->top, res == LUA_GCGEN ? lj_str_newlit(L, "generational") :
+					    lj_str_newlit(L, "incremental"));
     else
       setintV(L->top, res);
   }
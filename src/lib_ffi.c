@@ -799,6 +799,13 @@ LJLIB_CF(ffi_gc)	LJLIB_REC(.)
   if (!(ctype_isptr(ct->info) || ctype_isstruct(ct->info) ||
 	ctype_isrefarray(ct->info)))
     lj_err_arg(L, 1, LJ_ERR_FFI_INVTYPE);
+  if (L->base+2 < L->top && tvistruecond(L->base+2)) {
+    /* Batch finalizer: called for several cdata objects at once. */
+    if (!tvisfunc(fin))
+      lj_err_argt(L, 2, LUA_TFUNCTION);
+    setboolV(lj_tab_set(L, cts->finbatch, fin), 1);
+    lj_gc_anybarriert(L, cts->finbatch);
+  }
   lj_cdata_setfin(L, cd, gcval(fin), itype(fin));
   L->top = L->base+1;  /* Pass through the cdata object. */
   return 1;
@@ -822,12 +829,11 @@ LJLIB_PUSH(top-2) LJLIB_SET(arch)
 
 /* ------------------------------------------------------------------------ */
 
-/* Create special weak-keyed finalizer table. */
-static GCtab *ffi_finalizer(lua_State *L)
+/* Create weak-keyed table, which is its own metatable. */
+static GCtab *ffi_weakkeys(lua_State *L)
 {
   /* NOBARRIER: The table is new (marked white). */
   GCtab *t = lj_tab_new(L, 0, 1);
-  settabV(L, L->top++, t);
   setgcref(t->metatable, obj2gco(t));
   setstrV(L, lj_tab_setstr(L, t, lj_str_newlit(L, "__mode")),
 	  lj_str_newlit(L, "k"));
@@ -835,6 +841,23 @@ static GCtab *ffi_finalizer(lua_State *L)
   return t;
 }
 
+/* Create special weak-keyed finalizer table. */
+static GCtab *ffi_finalizer(lua_State *L)
+{
+  GCtab *t = ffi_weakkeys(L);
+  settabV(L, L->top++, t);
+  return t;
+}
+
+/* Create weak-keyed set of batch finalizers. It's anchored in miscmap. */
+static GCtab *ffi_finbatch(lua_State *L, CTState *cts)
+{
+  GCtab *t = ffi_weakkeys(L);
+  /* NOBARRIER: miscmap is new (marked white). */
+  settabV(L, lj_tab_setstr(L, cts->miscmap, lj_str_newlit(L, "finbatch")), t);
+  return t;
+}
+
 /* Register FFI module as loaded. */
 static void ffi_register_module(lua_State *L)
 {
@@ -851,6 +874,7 @@ LUALIB_API int luaopen_ffi(lua_State *L)
   CTState *cts = lj_ctype_init(L);
   settabV(L, L->top++, (cts->miscmap = lj_tab_new(L, 0, 1)));
   cts->finalizer = ffi_finalizer(L);
+  cts->finbatch = ffi_finbatch(L, cts);
   LJ_LIB_REG(L, NULL, ffi_meta);
   /* NOBARRIER: basemt is a GC root. */
   setgcref(basemt_it(G(L), LJ_TCDATA), obj2gco(tabV(L->top-1)));
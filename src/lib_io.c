@@ -152,7 +152,7 @@ static int io_file_readline(lua_State *L, FILE *fp, MSize chop)
     if (n && buf[n-1] == '\n') { n -= chop; break; }
     if (n >= m - 64) m += m;
   }
-  setstrV(L, L->top++, lj_str_new(L, buf, (size_t)n));
+  setstrV(L, L->top++, lj_str_newdata(L, buf, (size_t)n));
   lj_gc_check(L);
   return (int)ok;
 }
@@ -164,7 +164,7 @@ static void io_file_readall(lua_State *L, FILE *fp)
     char *buf = lj_buf_tmp(L, m);
     n += (MSize)fread(buf+n, 1, m-n, fp);
     if (n != m) {
-      setstrV(L, L->top++, lj_str_new(L, buf, (size_t)n));
+      setstrV(L, L->top++, lj_str_newdata(L, buf, (size_t)n));
       lj_gc_check(L);
       return;
     }
@@ -176,7 +176,7 @@ static int io_file_readlen(lua_State *L, FILE *fp, MSize m)
   if (m) {
     char *buf = lj_buf_tmp(L, m);
     MSize n = (MSize)fread(buf, 1, m, fp);
-    setstrV(L, L->top++, lj_str_new(L, buf, (size_t)n));
+    setstrV(L, L->top++, lj_str_newdata(L, buf, (size_t)n));
     lj_gc_check(L);
     return (n > 0 || m == 0);
   } else {
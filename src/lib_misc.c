@@ -18,6 +18,7 @@
 #include "lj_lib.h"
 #include "lj_gc.h"
 #include "lj_err.h"
+#include "lj_utils.h"
 
 #include "lj_memprof.h"
 
@@ -37,12 +38,25 @@ static LJ_AINLINE void setnumfield(struct lua_State *L, GCtab *t,
 
 #define LJLIB_MODULE_misc
 
+/* Sets the histogram array, the i-th bucket is at the index i + 1. */
+static void sethistfield(lua_State *L, const char *name,
+			 const size_t *hist, int n)
+{
+  GCtab *t;
+  int i;
+  lua_createtable(L, n, 0);
+  t = tabV(L->top - 1);
+  for (i = 0; i < n; i++)
+    setnumV(lj_tab_setint(L, t, i + 1), (double)hist[i]);
+  lua_setfield(L, -2, name);
+}
+
 LJLIB_CF(misc_getmetrics)
 {
   struct luam_Metrics metrics;
   GCtab *m;
 
-  lua_createtable(L, 0, 19);
+  lua_createtable(L, 0, 58);
   m = tabV(L->top - 1);
 
   luaM_metrics(L, &metrics);
@@ -71,9 +85,185 @@ LJLIB_CF(misc_getmetrics)
   setnumfield(L, m, "jit_mcode_size", metrics.jit_mcode_size);
   setnumfield(L, m, "jit_trace_num", metrics.jit_trace_num);
 
+  setnumfield(L, m, "gc_steps_time", metrics.gc_steps_time);
+  setnumfield(L, m, "gc_steps_time_max", metrics.gc_steps_time_max);
+  setnumfield(L, m, "gc_steps_remark", metrics.gc_steps_remark);
+
+  setnumfield(L, m, "gc_finq_len", metrics.gc_finq_len);
+  setnumfield(L, m, "gc_finalized", metrics.gc_finalized);
+  setnumfield(L, m, "gc_finq_latency", metrics.gc_finq_latency);
+  setnumfield(L, m, "gc_finq_latency_max", metrics.gc_finq_latency_max);
+
+  setnumfield(L, m, "gc_time_pause", metrics.gc_time_pause);
+  setnumfield(L, m, "gc_time_propagate", metrics.gc_time_propagate);
+  setnumfield(L, m, "gc_time_remark", metrics.gc_time_remark);
+  setnumfield(L, m, "gc_time_atomic", metrics.gc_time_atomic);
+  setnumfield(L, m, "gc_time_sweepstring", metrics.gc_time_sweepstring);
+  setnumfield(L, m, "gc_time_sweep", metrics.gc_time_sweep);
+  setnumfield(L, m, "gc_time_finalize", metrics.gc_time_finalize);
+  setnumfield(L, m, "gc_cycles", metrics.gc_cycles);
+  setnumfield(L, m, "gc_marked", metrics.gc_marked);
+  setnumfield(L, m, "gc_swept", metrics.gc_swept);
+
+  sethistfield(L, "gc_pause_hist", metrics.gc_pause_hist, LUAM_GC_PAUSE_HIST);
+
+  setnumfield(L, m, "alloc_mapped", metrics.alloc_mapped);
+  setnumfield(L, m, "alloc_mmap", metrics.alloc_mmap);
+  setnumfield(L, m, "alloc_munmap", metrics.alloc_munmap);
+  setnumfield(L, m, "alloc_mremap", metrics.alloc_mremap);
+  setnumfield(L, m, "alloc_madvise", metrics.alloc_madvise);
+  setnumfield(L, m, "alloc_released", metrics.alloc_released);
+
+  setnumfield(L, m, "alloc_segments", metrics.alloc_segments);
+  setnumfield(L, m, "alloc_segments_size", metrics.alloc_segments_size);
+  setnumfield(L, m, "alloc_free", metrics.alloc_free);
+  setnumfield(L, m, "alloc_direct", metrics.alloc_direct);
+  setnumfield(L, m, "alloc_direct_size", metrics.alloc_direct_size);
+  setnumfield(L, m, "alloc_slabs_size", metrics.alloc_slabs_size);
+  setnumfield(L, m, "alloc_slabs_used", metrics.alloc_slabs_used);
+  sethistfield(L, "alloc_size_hist", metrics.alloc_size_hist,
+	       LUAM_ALLOC_SIZE_HIST);
+
+  setnumfield(L, m, "gc_emergency", metrics.gc_emergency);
+
+  setnumfield(L, m, "alloc_reclaimq_len", metrics.alloc_reclaimq_len);
+  setnumfield(L, m, "alloc_reclaimq_size", metrics.alloc_reclaimq_size);
+  setnumfield(L, m, "alloc_reclaimed", metrics.alloc_reclaimed);
+  setnumfield(L, m, "alloc_reclaimq_latency", metrics.alloc_reclaimq_latency);
+  setnumfield(L, m, "alloc_reclaimq_latency_max",
+	      metrics.alloc_reclaimq_latency_max);
+
+  setnumfield(L, m, "strhash_nointern", metrics.strhash_nointern);
+  setnumfield(L, m, "alloc_hugepages_size", metrics.alloc_hugepages_size);
+
+  return 1;
+}
+
+/* local finished = misc.gc_idle(timeout_us) */
+LJLIB_CF(misc_gc_idle)
+{
+  lua_Number timeout = lj_lib_checknum(L, 1);
+  uint64_t deadline = lj_utils_time_ns();
+  if (timeout > 0) {
+    /* Clamp the huge timeouts to avoid the overflow of the conversion. */
+    if (timeout >= 1.8e16 || (uint64_t)(timeout * 1000) > ~deadline)
+      deadline = ~(uint64_t)0;
+    else
+      deadline += (uint64_t)(timeout * 1000);
+  }
+  lua_pushboolean(L, luaM_gc_idle(L, deadline));
   return 1;
 }
 
+/* misc.setmemlimit(soft, hard, flush) */
+LJLIB_CF(misc_setmemlimit)
+{
+  lua_Number soft = luaL_optnumber(L, 1, 0);
+  lua_Number hard = luaL_optnumber(L, 2, 0);
+  int flags = lua_toboolean(L, 3) ? LUAM_MEMLIMIT_FLUSH : 0;
+  if (!(soft >= 0 && hard >= 0) || (hard != 0 && soft > hard))
+    luaL_argerror(L, 1, "bad memory limits");
+  /* The limits above LJ_MAX_MEM mean no limit. Clamp them before the cast. */
+  if (soft > (lua_Number)LJ_MAX_MEM)
+    soft = (lua_Number)LJ_MAX_MEM;
+  if (hard > (lua_Number)LJ_MAX_MEM)
+    hard = (lua_Number)LJ_MAX_MEM;
+  if (luaM_setmemlimit(L, (size_t)soft, (size_t)hard, flags) != 0)
+    luaL_argerror(L, 1, "bad memory limits");
+  return 0;
+}
+
+/* local ok, err = misc.alloc_decay(decay_us) */
+LJLIB_CF(misc_alloc_decay)
+{
+  lua_Number decay = lj_lib_checknum(L, 1);
+  uint64_t decay_ns = 0;
+  if (decay > 0)  /* Clamp the huge decays to avoid the overflow of the cast. */
+    decay_ns = decay >= 1.8e16 ? ~(uint64_t)0 : (uint64_t)(decay * 1000);
+  if (luaM_alloc_decay(L, decay_ns) != 0) {
+    lua_pushnil(L);
+    lua_pushliteral(L, "lazy trimming is not supported");
+    return 2;
+  }
+  lua_pushboolean(L, 1);
+  return 1;
+}
+
+/* local released = misc.alloc_trim() */
+LJLIB_CF(misc_alloc_trim)
+{
+  lua_pushnumber(L, (lua_Number)luaM_alloc_trim(L));
+  return 1;
+}
+
+/* local old, err = misc.alloc_reclaim(enable) */
+LJLIB_CF(misc_alloc_reclaim)
+{
+  int old;
+  lj_lib_checkany(L, 1);
+  old = luaM_alloc_reclaim(L, lua_toboolean(L, 1));
+  if (old < 0) {
+    lua_pushnil(L);
+    lua_pushliteral(L, "reclaim thread is not supported");
+    return 2;
+  }
+  lua_pushboolean(L, old);
+  return 1;
+}
+
+/* local oldmode, err = misc.hugepages([mode]) */
+LJLIB_CF(misc_hugepages)
+{
+  static const char *const modes[] = {"off", "thp", "hugetlb"};
+  int mode = -1;  /* Only query the mode without the argument. */
+  int omode;
+  if (L->base < L->top && !tvisnil(L->base))
+    mode = lj_lib_checkopt(L, 1, -1, "\3off\3thp\7hugetlb");
+  omode = luaM_hugepages(L, mode);
+  if (omode < 0) {
+    lua_pushnil(L);
+    lua_pushliteral(L, "huge pages are not supported");
+    return 2;
+  }
+  lua_pushstring(L, modes[omode]);
+  return 1;
+}
+
+/* local oldthreshold, err = misc.strnointern(threshold) */
+LJLIB_CF(misc_strnointern)
+{
+  int32_t threshold = lj_lib_checkint(L, 1);
+  long old = luaM_strnointern(L, threshold > 0 ? (size_t)threshold : 0);
+  if (old < 0) {
+    lua_pushnil(L);
+    lua_pushliteral(L, "uninterned strings are not supported");
+    return 2;
+  }
+  lua_pushinteger(L, (lua_Integer)old);
+  return 1;
+}
+
+#if !LJ_TARGET_WINDOWS
+static int heapdump_file(lua_State *L, const char *fname);
+#endif
+
+/* local dumped, err, errno = misc.heapdump(fname) */
+LJLIB_CF(misc_heapdump)
+{
+  const char *fname = strdata(lj_lib_checkstr(L, 1));
+#if !LJ_TARGET_WINDOWS
+  int nres = heapdump_file(L, fname);
+  if (nres != 0)
+    return nres;
+#else
+  UNUSED(fname);
+#endif /* !LJ_TARGET_WINDOWS */
+  lua_pushnil(L);
+  lua_pushstring(L, err2msg(LJ_ERR_PROF_MISUSE));
+  lua_pushinteger(L, EINVAL);
+  return 3;
+}
+
 /* ------------------------------------------------------------------------ */
 
 #include "lj_libdef.h"
@@ -157,6 +347,45 @@ static int on_stop_cb_default(void *opt, uint8_t *buf)
   return close(fd);
 }
 
+/* Dump the heap to the file. Returns 0 on misuse. */
+static int heapdump_file(lua_State *L, const char *fname)
+{
+  struct luam_Heapdump_Options opt = {0};
+  struct profile_ctx *ctx;
+  int status, saved_errno;
+
+  /* Throws in case of OOM. */
+  ctx = lj_mem_new(L, sizeof(*ctx));
+  ctx->g = G(L);
+  ctx->fd = open(fname, O_CREAT | O_WRONLY | O_TRUNC, 0644);
+  if (ctx->fd == -1) {
+    lj_mem_free(ctx->g, ctx, sizeof(*ctx));
+    return luaL_fileresult(L, 0, fname);
+  }
+  opt.writer = buffer_writer_default;
+  opt.ctx = ctx;
+  opt.buf = ctx->buf;
+  opt.len = STREAM_BUFFER_SIZE;
+
+  status = luaM_heapdump(L, &opt);
+  /* Closing the file may change errno value. */
+  saved_errno = errno;
+  if (on_stop_cb_default(ctx, opt.buf) != 0 && status == PROFILE_SUCCESS)
+    status = PROFILE_ERRIO;
+  else
+    errno = saved_errno;
+
+  switch (status) {
+  case PROFILE_SUCCESS:
+    lua_pushboolean(L, 1);
+    return 1;
+  case PROFILE_ERRIO:
+    return luaL_fileresult(L, 0, fname);
+  default:
+    return 0;
+  }
+}
+
 /* ----- misc.sysprof module ---------------------------------------------- */
 
 #define LJLIB_MODULE_misc_sysprof
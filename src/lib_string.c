@@ -98,7 +98,7 @@ LJLIB_CF(string_rep)		LJLIB_REC(.)
     rep--;
   }
   sb = lj_buf_putstr_rep(sb, s, rep);
-  setstrV(L, L->top-1, lj_buf_str(L, sb));
+  setstrV(L, L->top-1, lj_buf_strdata(L, sb));
   lj_gc_check(L);
   return 1;
 }
@@ -128,7 +128,7 @@ LJLIB_CF(string_dump)
   L->top = L->base+1;
   if (!isluafunc(fn) || lj_bcwrite(L, funcproto(fn), writer_buf, sb, strip))
     lj_err_caller(L, LJ_ERR_STRDUMP);
-  setstrV(L, L->top-1, lj_buf_str(L, sb));
+  setstrV(L, L->top-1, lj_buf_strdata(L, sb));
   lj_gc_check(L);
   return 1;
 }
@@ -447,6 +447,16 @@ static int push_captures(MatchState *ms, const char *s, const char *e)
   return nlevels;  /* number of strings pushed */
 }
 
+/* Get the literal char every match of a pattern starts with or -1. */
+static int match_firstchar(const char *p)
+{
+  int c = uchar(*p);
+  if (c == '\0' || strchr("^$*+?.([%-)", c) ||
+      p[1] == '*' || p[1] == '?' || p[1] == '-')
+    return -1;
+  return c;
+}
+
 static int str_find_aux(lua_State *L, int find)
 {
   GCstr *s = lj_lib_checkstr(L, 1);
@@ -476,13 +486,18 @@ static int str_find_aux(lua_State *L, int find)
     MatchState ms;
     const char *pstr = strdata(p);
     const char *sstr = strdata(s) + st;
-    int anchor = 0;
+    int anchor = 0, c;
     if (*pstr == '^') { pstr++; anchor = 1; }
+    c = anchor ? -1 : match_firstchar(pstr);
     ms.L = L;
     ms.src_init = strdata(s);
     ms.src_end = strdata(s) + s->len;
     do {  /* Loop through string and try to match the pattern. */
       const char *q;
+      if (c >= 0) {  /* Skip to the next possible start of a match. */
+	sstr = (const char *)memchr(sstr, c, (size_t)(ms.src_end - sstr));
+	if (sstr == NULL) break;
+      }
       ms.level = ms.depth = 0;
       q = match(&ms, sstr, pstr);
       if (q) {
@@ -517,12 +532,17 @@ LJLIB_NOREG LJLIB_CF(string_gmatch_aux)
   const char *s = strdata(str);
   TValue *tvpos = lj_lib_upvalue(L, 3);
   const char *src = s + tvpos->u32.lo;
+  int c = match_firstchar(p);
   MatchState ms;
   ms.L = L;
   ms.src_init = s;
   ms.src_end = s + str->len;
   for (; src <= ms.src_end; src++) {
     const char *e;
+    if (c >= 0) {  /* Skip to the next possible start of a match. */
+      src = (const char *)memchr(src, c, (size_t)(ms.src_end - src));
+      if (src == NULL) break;
+    }
     ms.level = ms.depth = 0;
     if ((e = match(&ms, src, p)) != NULL) {
       int32_t pos = (int32_t)(e - s);
@@ -723,7 +743,7 @@ again:
     }
   }
   if (retry++ == 1) goto again;
-  setstrV(L, L->top-1, lj_buf_str(L, sb));
+  setstrV(L, L->top-1, lj_buf_strdata(L, sb));
   lj_gc_check(L);
   return 1;
 }
@@ -72,6 +72,14 @@ LJLIB_CF(table_maxn)
       lua_Number n = numberVnum(&node[i].key);
       if (n > m) m = n;
     }
+  if (tabresizing(t)) {  /* Old hash part of an incremental resize. */
+    node = noderef(t->oldnode);
+    for (i = (ptrdiff_t)t->oldhmask; i >= 0; i--)
+      if (!tvisnil(&node[i].val) && tvisnumber(&node[i].key)) {
+	lua_Number n = numberVnum(&node[i].key);
+	if (n > m) m = n;
+      }
+  }
   setnumV(L->top-1, m);
   return 1;
 }
@@ -84,70 +92,48 @@ LJLIB_CF(table_insert)		LJLIB_REC(.)
   if (nargs != 2*sizeof(TValue)) {
     if (nargs != 3*sizeof(TValue))
       lj_err_caller(L, LJ_ERR_TABINS);
-    /* NOBARRIER: This just moves existing elements around. */
-    for (n = lj_lib_checkint(L, 2); i > n; i--) {
-      /* The set may invalidate the get pointer, so need to do it first! */
-      TValue *dst = lj_tab_setint(L, t, i);
-      cTValue *src = lj_tab_getint(t, i-1);
-      if (src) {
-	copyTV(L, dst, src);
-      } else {
-	setnilV(dst);
-      }
-    }
-    i = n;
+    n = lj_lib_checkint(L, 2);
+    if (n > i) i = n;
+  } else {
+    n = i;
   }
   {
     TValue *dst = lj_tab_setint(L, t, i);
     copyTV(L, dst, L->top-1);  /* Set new value. */
     lj_gc_barriert(L, t, dst);
   }
+  if (n < i)  /* Insert in the middle: rotate the new value into place. */
+    lj_tab_rotate(L, t, n, i, 1);
   return 0;
 }
 
-LJLIB_LUA(table_remove) /*
-  function(t, pos)
-    CHECK_tab(t)
-    local len = #t
-    if pos == nil then
-      if len ~= 0 then
-	local old = t[len]
-	t[len] = nil
-	return old
-      end
-    else
-      CHECK_int(pos)
-      if pos >= 1 and pos <= len then
-	local old = t[pos]
-	for i=pos+1,len do
-	  t[i-1] = t[i]
-	end
-	t[len] = nil
-	return old
-      end
-    end
-  end
-*/
+LJLIB_CF(table_remove)		LJLIB_REC(.)
+{
+  GCtab *t = lj_lib_checktab(L, 1);
+  int32_t e = (int32_t)lj_tab_len(t);
+  int32_t pos = lj_lib_optint(L, 2, e);
+  if (pos >= 1 && pos <= e) {
+    TValue *o = lj_tab_setint(L, t, pos);
+    copyTV(L, L->top++, o);  /* Return the old value. */
+    setnilV(o);
+    lj_tab_rotate(L, t, pos, e, -1);  /* Close the gap. */
+    return 1;
+  }
+  return 0;
+}
 
-LJLIB_LUA(table_move) /*
-  function(a1, f, e, t, a2)
-    CHECK_tab(a1)
-    CHECK_int(f)
-    CHECK_int(e)
-    CHECK_int(t)
-    if a2 == nil then a2 = a1 end
-    CHECK_tab(a2)
-    if e >= f then
-      local d = t - f
-      if t > e or t <= f or a2 ~= a1 then
-	for i=f,e do a2[i+d] = a1[i] end
-      else
-	for i=e,f,-1 do a2[i+d] = a1[i] end
-      end
-    end
-    return a2
-  end
-*/
+LJLIB_CF(table_move)		LJLIB_REC(.)
+{
+  GCtab *st = lj_lib_checktab(L, 1);
+  int32_t f = lj_lib_checkint(L, 2);
+  int32_t e = lj_lib_checkint(L, 3);
+  int32_t t = lj_lib_checkint(L, 4);
+  GCtab *dt = (L->base+4 < L->top && !tvisnil(L->base+4)) ?
+	      lj_lib_checktab(L, 5) : st;
+  lj_tab_move(L, dt, st, f, e, t);
+  settabV(L, L->top++, dt);
+  return 1;
+}
 
 LJLIB_CF(table_concat)		LJLIB_REC(.)
 {
@@ -164,7 +150,7 @@ LJLIB_CF(table_concat)		LJLIB_REC(.)
     lj_err_callerv(L, LJ_ERR_TABCAT,
 		   lj_obj_itypename[o ? itypemap(o) : ~LJ_TNIL], idx);
   }
-  setstrV(L, L->top-1, lj_buf_str(L, sbx));
+  setstrV(L, L->top-1, lj_buf_strdata(L, sbx));
   lj_gc_check(L);
   return 1;
 }
@@ -295,7 +281,7 @@ LJLIB_NOREG LJLIB_CF(table_new)		LJLIB_REC(.)
 
 LJLIB_NOREG LJLIB_CF(table_clear)	LJLIB_REC(.)
 {
-  lj_tab_clear(lj_lib_checktab(L, 1));
+  lj_tab_clear(L, lj_lib_checktab(L, 1));
   return 0;
 }
 
@@ -31,6 +31,7 @@
 #include "lj_def.h"
 #include "lj_arch.h"
 #include "lj_alloc.h"
+#include "lj_utils.h"
 
 #ifndef LUAJIT_USE_SYSMALLOC
 
@@ -40,8 +41,13 @@
 #define DEFAULT_GRANULARITY	((size_t)128U * (size_t)1024U)
 #define DEFAULT_TRIM_THRESHOLD	((size_t)2U * (size_t)1024U * (size_t)1024U)
 #define DEFAULT_MMAP_THRESHOLD	((size_t)128U * (size_t)1024U)
+#define RECLAIM_THRESHOLD	((size_t)1024U * (size_t)1024U)
 #define MAX_RELEASE_CHECK_RATE	255
 
+#ifndef LUAJIT_DISABLE_SLAB
+#define LJ_ALLOC_SLAB		1
+#endif
+
 /* ------------------- size_t and alignment properties -------------------- */
 
 /* The byte and bit size of a size_t */
@@ -112,8 +118,21 @@
 #define LJ_ALLOC_MMAP32		1
 #endif
 
+#if defined(MADV_DONTNEED)
+#define LJ_ALLOC_MADVISE	1
+#endif
+
+#if LJ_HASGCTHREAD
+#define LJ_ALLOC_RECLAIM	1
+#include <pthread.h>
+#include <signal.h>
+#endif
+
 #if LJ_TARGET_LINUX
 #define LJ_ALLOC_MREMAP		1
+#if defined(MADV_HUGEPAGE)
+#define LJ_ALLOC_HUGEPAGES	1
+#endif
 #endif
 
 #endif
@@ -245,10 +264,11 @@ static uintptr_t mmap_probe_seed(void)
   return 1;  /* Punt. */
 }
 
+/* Hint for next allocation. Doesn't need to be thread-safe. */
+static uintptr_t hint_addr = 0;
+
 static void *mmap_probe(size_t size)
 {
-  /* Hint for next allocation. Doesn't need to be thread-safe. */
-  static uintptr_t hint_addr = 0;
   static uintptr_t hint_prng = 0;
   int olderr = errno;
   int retry;
@@ -381,11 +401,73 @@ static void *CALL_MREMAP_(void *ptr, size_t osz, size_t nsz, int flags)
 #define CALL_MREMAP_MAYMOVE	1
 #if LJ_64 && (!LJ_GC64 || LJ_TARGET_ARM64)
 #define CALL_MREMAP_MV		CALL_MREMAP_NOMOVE
+#if defined(MREMAP_FIXED)
+/* The pages are moved to a mapping within the allowed address range. */
+#define LJ_ALLOC_MREMAP_FIXED	1
+#endif
 #else
 #define CALL_MREMAP_MV		CALL_MREMAP_MAYMOVE
 #endif
 #endif
 
+#if LJ_ALLOC_HUGEPAGES
+#define HUGEPAGE_SIZE		((size_t)2U * (size_t)1024U * (size_t)1024U)
+#define huge_align(S)\
+ (((S) + (HUGEPAGE_SIZE - SIZE_T_ONE)) & ~(HUGEPAGE_SIZE - SIZE_T_ONE))
+
+/* Map huge-page-backed memory. The size must be a multiple of the huge page
+** size. Tries hugetlbfs pages first (if requested), then falls back to a
+** regular mapping aligned to the huge page size, which is advised to be
+** backed by transparent huge pages. The mapping is over-allocated and
+** trimmed only if the plain one is misaligned, since the holes left by the
+** trimming waste the address space, which is scarce without LJ_GC64. The kind
+** of the pages is returned in *kind.
+*/
+static void *huge_mmap(int mode, size_t size, int *kind)
+{
+  int olderr = errno;
+  char *p;
+  if (mode == LJ_ALLOC_HUGE_HUGETLB) {
+#if LJ_ALLOC_MMAP32
+    int flags = MMAP_FLAGS|MAP_HUGETLB|MAP_32BIT;
+#else
+    int flags = MMAP_FLAGS|MAP_HUGETLB;
+#endif
+    p = (char *)mmap(NULL, size, MMAP_PROT, flags, -1, 0);
+#ifdef LJ_ALLOC_MBITS
+    if (p != CMFAIL && (((uintptr_t)p + size) >> LJ_ALLOC_MBITS) != 0) {
+      munmap(p, size);  /* Outside of the allowed address range. */
+      p = CMFAIL;
+    }
+#endif
+    if (p != CMFAIL) {
+      errno = olderr;
+      *kind = LJ_ALLOC_HUGE_HUGETLB;
+      return p;
+    }
+  }
+  p = (char *)CALL_MMAP(size);
+  if (p != CMFAIL && ((uintptr_t)p & (HUGEPAGE_SIZE - SIZE_T_ONE)) != 0) {
+    char *q = (char *)CALL_MMAP(size + HUGEPAGE_SIZE);
+    if (q != CMFAIL) {  /* Trim the mapping to the aligned part. */
+      size_t head = huge_align((uintptr_t)q) - (uintptr_t)q;
+      CALL_MUNMAP(p, size);
+      if (head != 0)
+	CALL_MUNMAP(q, head);
+      CALL_MUNMAP(q + head + size, HUGEPAGE_SIZE - head);
+      p = q + head;
+#if LJ_ALLOC_MMAP_PROBE
+      hint_addr = (uintptr_t)p + size;  /* Continue with aligned addresses. */
+#endif
+    }  /* Otherwise keep the misaligned mapping: only its inner part gains. */
+  }
+  if (p != CMFAIL && madvise(p, size, MADV_HUGEPAGE) == 0)
+    *kind = LJ_ALLOC_HUGE_THP;
+  errno = olderr;
+  return p;
+}
+#endif
+
 #endif
 
 
@@ -524,11 +606,66 @@ struct malloc_segment {
   char        *base;             /* base address */
   size_t       size;             /* allocated size */
   struct malloc_segment *next;   /* ptr to next segment */
+  size_t       huge;             /* Kind of huge pages, LJ_ALLOC_HUGE_*. */
 };
 
 typedef struct malloc_segment  msegment;
 typedef struct malloc_segment *msegmentptr;
 
+/* ------------------------------- Slabs --------------------------------- */
+
+#if LJ_ALLOC_SLAB
+/*
+  Small requests are served from segregated size-class slabs instead of
+  the bins. A slab page holds objects of a single size class only, so no
+  boundary tags are needed: the page header is found by aligning down
+  the object address, and the class is taken from the page header. The
+  size passed to lj_alloc_f() on free and realloc only tells the slab
+  objects from the chunks in the bins. So it may be inexact, as long as
+  it stays on the same side of SLAB_MAX.
+
+  Pages are carved from spans mapped directly from the system. Pages
+  with free objects are linked per class. A page, which gets empty, is
+  moved to the list of empty pages shared by all classes, unless it is
+  the only page of its class with free objects. A span with all pages
+  empty is unmapped, unless there are few other empty pages.
+*/
+struct slab_page {
+  struct slab_page *next;      /* Next page in the class or empty list. */
+  struct slab_page *prev;      /* Previous page in the list. */
+  void             *free;      /* List of freed objects. */
+  char             *bump;      /* First object never allocated. */
+  struct slab_page *span;      /* First page of the span. */
+  struct slab_page *nextspan;  /* Next span (first page only). */
+  struct slab_page *prevspan;  /* Previous span (first page only). */
+  uint16_t          cls;       /* Size class. */
+  uint16_t          nlive;     /* Number of allocated objects. */
+  uint16_t          cap;       /* Capacity of the page. */
+  uint16_t          nused;     /* Non-empty pages of the span (first only). */
+  uint16_t          npages;    /* Number of pages of the span (first only). */
+  uint16_t          huge;      /* Kind of huge pages (first only). */
+};
+
+typedef struct slab_page  spage;
+typedef struct slab_page *spageptr;
+
+#define SLAB_PAGE		((size_t)4096U)
+#define SLAB_SPAN		((size_t)256U * (size_t)1024U)
+/* Number of empty pages kept mapped, when a span gets empty. */
+#define SLAB_KEEP		(SLAB_SPAN / SLAB_PAGE)
+#define SLAB_HEAD\
+  ((sizeof(spage) + CHUNK_ALIGN_MASK) & ~CHUNK_ALIGN_MASK)
+
+/* Classes are 8 bytes apart up to 128 bytes and 16 bytes apart above. */
+#define SLAB_MAX		((size_t)256U)
+#define NSLABCLASSES		(24U)
+#define slab_index(s)\
+  ((s) <= 128 ? ((s) + 7) / 8 - 1 : ((s) + 15) / 16 + 7)
+#define slab_index2size(i)	((i) < 16 ? ((i) + 1) * 8 : ((i) - 7) * 16)
+#define slab_page_of(mem)\
+  ((spageptr)((uintptr_t)(mem) & ~(uintptr_t)(SLAB_PAGE - SIZE_T_ONE)))
+#endif
+
 /* ---------------------------- malloc_state ----------------------------- */
 
 /* Bin types, widths and sizes */
@@ -541,6 +678,32 @@ typedef struct malloc_segment *msegmentptr;
 #define MAX_SMALL_SIZE		(MIN_LARGE_SIZE - SIZE_T_ONE)
 #define MAX_SMALL_REQUEST  (MAX_SMALL_SIZE - CHUNK_ALIGN_MASK - CHUNK_OVERHEAD)
 
+#if LJ_ALLOC_RECLAIM
+/* Direct mapping queued for unmapping. The node is kept in the mapping. */
+struct reclaim_chunk {
+  struct reclaim_chunk *next;
+  size_t size;			/* Size of the mapping. */
+  uint64_t time;		/* Time of the queueing. */
+};
+
+typedef struct reclaim_chunk *rchunkptr;
+
+/* State shared with the reclaim thread. It's protected by the lock. */
+struct alloc_reclaim {
+  pthread_t thread;		/* Reclaim thread. */
+  pthread_mutex_t lock;
+  pthread_cond_t wake;		/* Signalled when a mapping is queued. */
+  pthread_cond_t idle;		/* Signalled when the queue is drained. */
+  rchunkptr head;		/* Queued mappings not taken by the thread. */
+  int quit;			/* Terminate after draining the queue. */
+  size_t qlen;			/* Number of the mappings to unmap. */
+  size_t qsize;			/* Bytes of the mappings to unmap. */
+  size_t nreclaimed;		/* Number of the unmapped mappings. */
+  uint64_t latency;		/* Total time from queueing to unmapping. */
+  uint64_t latency_max;		/* Max. time from queueing to unmapping. */
+};
+#endif
+
 struct malloc_state {
   binmap_t   smallmap;
   binmap_t   treemap;
@@ -553,10 +716,210 @@ struct malloc_state {
   mchunkptr  smallbins[(NSMALLBINS+1)*2];
   tbinptr    treebins[NTREEBINS];
   msegment   seg;
+#if LJ_ALLOC_SLAB
+  spageptr   slabpages[NSLABCLASSES];  /* Pages with free objects. */
+  spageptr   slabempty;                /* Empty pages of any class. */
+  spageptr   slabspans;                /* All mapped spans. */
+  size_t     slabnempty;               /* Number of empty pages. */
+#endif
+#if LJ_ALLOC_HUGEPAGES
+  int        hugepages;                /* Huge page mode of new mappings. */
+#endif
+  uint64_t   decay;                    /* Decay time of lazy trimming. */
+  uint64_t   trimtime;                 /* Time of the last trimming. */
+  size_t     mapped;                   /* Bytes mapped from the system. */
+  size_t     hugemapped;               /* Bytes of them with huge pages. */
+  size_t     nmmap;                    /* Number of mmap() calls. */
+  size_t     nmunmap;                  /* Number of munmap() calls. */
+  size_t     nmremap;                  /* Number of mremap() calls. */
+  size_t     nmadvise;                 /* Number of madvise() calls. */
+  size_t     released;                 /* Total bytes released by madvise(). */
+  size_t     topclean;                 /* Released part of the top from here. */
+  size_t     binned;                   /* Bytes of the chunks in the bins. */
+  size_t     ndirect;                  /* Number of direct chunks. */
+  size_t     direct;                   /* Bytes of the direct chunks. */
+#if LJ_ALLOC_SLAB
+  size_t     slabmapped;               /* Bytes of the slab spans. */
+  size_t     slabused;                 /* Bytes of the slab objects. */
+#endif
+  size_t     sizehist[ALLOC_SIZEHIST]; /* Allocation size histogram. */
+#if LJ_ALLOC_RECLAIM
+  int        reclaimon;                /* Reclaim thread is running. */
+  struct alloc_reclaim reclaim;        /* Deferred unmapping. */
+#endif
 };
 
 typedef struct malloc_state *mstate;
 
+#if LJ_ALLOC_RECLAIM
+/* --------------------------- deferred unmapping ------------------------- */
+
+/*
+** The kernel tears down the page tables of a big mapping for milliseconds.
+** With the reclaim thread enabled, the large direct chunks are queued and
+** unmapped on that thread instead. The queue node is kept in the freed
+** mapping, so no memory is allocated for it. The reclaim thread only
+** unmaps the queued mappings and never touches the rest of the allocator
+** state. The queued mappings still occupy the address space, so a failed
+** mmap() waits until the queue is drained and retries.
+*/
+
+static void *reclaim_main(void *arg)
+{
+  struct alloc_reclaim *rc = (struct alloc_reclaim *)arg;
+  pthread_mutex_lock(&rc->lock);
+  for (;;) {
+    rchunkptr q;
+    while (rc->head == NULL && !rc->quit)
+      pthread_cond_wait(&rc->wake, &rc->lock);
+    if (rc->head == NULL)
+      break;  /* Quit only after draining the queue. */
+    q = rc->head;
+    rc->head = NULL;
+    pthread_mutex_unlock(&rc->lock);
+    while (q != NULL) {
+      rchunkptr next = q->next;
+      size_t size = q->size;
+      uint64_t start = q->time, lat;
+      CALL_MUNMAP(q, size);
+      lat = lj_utils_time_ns() - start;
+      pthread_mutex_lock(&rc->lock);
+      rc->qlen--;
+      rc->qsize -= size;
+      rc->nreclaimed++;
+      rc->latency += lat;
+      if (lat > rc->latency_max)
+	rc->latency_max = lat;
+      if (rc->qlen == 0)
+	pthread_cond_broadcast(&rc->idle);
+      pthread_mutex_unlock(&rc->lock);
+      q = next;
+    }
+    pthread_mutex_lock(&rc->lock);
+  }
+  pthread_mutex_unlock(&rc->lock);
+  return NULL;
+}
+
+static int reclaim_start(mstate m)
+{
+  struct alloc_reclaim *rc = &m->reclaim;
+  sigset_t all, old;
+  int err;
+  pthread_mutex_init(&rc->lock, NULL);
+  pthread_cond_init(&rc->wake, NULL);
+  pthread_cond_init(&rc->idle, NULL);
+  rc->quit = 0;
+  /* Profiler signals must be delivered to the mutator thread only. */
+  sigfillset(&all);
+  pthread_sigmask(SIG_SETMASK, &all, &old);
+  err = pthread_create(&rc->thread, NULL, reclaim_main, rc);
+  pthread_sigmask(SIG_SETMASK, &old, NULL);
+  if (err) {
+    pthread_cond_destroy(&rc->idle);
+    pthread_cond_destroy(&rc->wake);
+    pthread_mutex_destroy(&rc->lock);
+    return 0;
+  }
+  m->reclaimon = 1;
+  return 1;
+}
+
+/* Stop the reclaim thread. The queued mappings are unmapped first. */
+static void reclaim_stop(mstate m)
+{
+  struct alloc_reclaim *rc = &m->reclaim;
+  pthread_mutex_lock(&rc->lock);
+  rc->quit = 1;
+  pthread_cond_signal(&rc->wake);
+  pthread_mutex_unlock(&rc->lock);
+  pthread_join(rc->thread, NULL);
+  pthread_cond_destroy(&rc->idle);
+  pthread_cond_destroy(&rc->wake);
+  pthread_mutex_destroy(&rc->lock);
+  m->reclaimon = 0;
+}
+
+/* Queue a mapping to be unmapped by the reclaim thread. */
+static void reclaim_push(mstate m, void *p, size_t size)
+{
+  struct alloc_reclaim *rc = &m->reclaim;
+  rchunkptr q = (rchunkptr)p;
+  q->size = size;
+  q->time = lj_utils_time_ns();
+  pthread_mutex_lock(&rc->lock);
+  q->next = rc->head;
+  rc->head = q;
+  rc->qlen++;
+  rc->qsize += size;
+  pthread_cond_signal(&rc->wake);
+  pthread_mutex_unlock(&rc->lock);
+  m->mapped -= size;
+}
+
+/* Wait until the queue is drained. Returns 1 if it was not empty. */
+static int reclaim_flush(mstate m)
+{
+  struct alloc_reclaim *rc = &m->reclaim;
+  int pending;
+  if (!m->reclaimon)
+    return 0;
+  pthread_mutex_lock(&rc->lock);
+  pending = rc->qlen != 0;
+  while (rc->qlen != 0)
+    pthread_cond_wait(&rc->idle, &rc->lock);
+  pthread_mutex_unlock(&rc->lock);
+  return pending;
+}
+#endif
+
+#if LJ_ALLOC_HUGEPAGES
+#define alloc_granularity(M)\
+  ((M)->hugepages ? HUGEPAGE_SIZE : DEFAULT_GRANULARITY)
+#else
+#define alloc_granularity(M)	DEFAULT_GRANULARITY
+#endif
+
+/* Map the memory of segments and slab spans. The kind of huge pages backing
+** the mapping is returned in *huge.
+*/
+static void *alloc_mmap(mstate m, size_t size, int *huge)
+{
+  void *p;
+  *huge = LJ_ALLOC_HUGE_OFF;
+#if LJ_ALLOC_HUGEPAGES
+  if (m->hugepages)
+    p = huge_mmap(m->hugepages, size, huge);
+  else
+#endif
+  p = CALL_MMAP(size);
+  m->nmmap++;
+#if LJ_ALLOC_RECLAIM
+  if (p == CMFAIL && reclaim_flush(m))
+    return alloc_mmap(m, size, huge);  /* Retry with the address space freed. */
+#endif
+  if (p != CMFAIL) {
+    m->mapped += size;
+    if (*huge != LJ_ALLOC_HUGE_OFF) {
+      m->hugemapped += size;
+      if (*huge == LJ_ALLOC_HUGE_THP)
+	m->nmadvise++;  /* MADV_HUGEPAGE. */
+    }
+  }
+  return p;
+}
+
+static int alloc_munmap(mstate m, void *p, size_t size, int huge)
+{
+  m->nmunmap++;
+  if (CALL_MUNMAP(p, size) != 0)
+    return -1;
+  m->mapped -= size;
+  if (huge != LJ_ALLOC_HUGE_OFF)
+    m->hugemapped -= size;
+  return 0;
+}
+
 #define is_initialized(M)	((M)->top != 0)
 
 /* -------------------------- system alloc setup ------------------------- */
@@ -697,6 +1060,7 @@ static int has_segment_link(mstate m, msegmentptr ss)
   F->bk = P;\
   P->fd = F;\
   P->bk = B;\
+  M->binned += S;\
 }
 
 /* Unlink a chunk from a smallbin  */
@@ -710,6 +1074,7 @@ static int has_segment_link(mstate m, msegmentptr ss)
     F->bk = B;\
     B->fd = F;\
   }\
+  M->binned -= S;\
 }
 
 /* Unlink the first chunk from a smallbin */
@@ -721,6 +1086,7 @@ static int has_segment_link(mstate m, msegmentptr ss)
     B->fd = F;\
     F->bk = B;\
   }\
+  M->binned -= small_index2size(I);\
 }
 
 /* Replace dv node, binning the old one */
@@ -743,6 +1109,7 @@ static int has_segment_link(mstate m, msegmentptr ss)
   bindex_t I;\
   compute_tree_index(S, I);\
   H = treebin_at(M, I);\
+  M->binned += S;\
   X->index = I;\
   X->child[0] = X->child[1] = 0;\
   if (!treemap_is_marked(M, I)) {\
@@ -780,6 +1147,7 @@ static int has_segment_link(mstate m, msegmentptr ss)
 #define unlink_large_chunk(M, X) {\
   tchunkptr XP = X->parent;\
   tchunkptr R;\
+  M->binned -= chunksize(X);\
   if (X->bk != X) {\
     tchunkptr F = X->fd;\
     R = X->bk;\
@@ -835,11 +1203,18 @@ static int has_segment_link(mstate m, msegmentptr ss)
 
 /* -----------------------  Direct-mmapping chunks ----------------------- */
 
-static void *direct_alloc(size_t nb)
+static void *direct_alloc(mstate m, size_t nb)
 {
   size_t mmsize = mmap_align(nb + SIX_SIZE_T_SIZES + CHUNK_ALIGN_MASK);
   if (LJ_LIKELY(mmsize > nb)) {     /* Check for wrap around 0 */
     char *mm = (char *)(DIRECT_MMAP(mmsize));
+    m->nmmap++;
+#if LJ_ALLOC_RECLAIM
+    if (mm == CMFAIL && reclaim_flush(m)) {
+      mm = (char *)(DIRECT_MMAP(mmsize));
+      m->nmmap++;
+    }
+#endif
     if (mm != CMFAIL) {
       size_t offset = align_offset(chunk2mem(mm));
       size_t psize = mmsize - offset - DIRECT_FOOT_PAD;
@@ -848,13 +1223,54 @@ static void *direct_alloc(size_t nb)
       p->head = psize|CINUSE_BIT;
       chunk_plus_offset(p, psize)->head = FENCEPOST_HEAD;
       chunk_plus_offset(p, psize+SIZE_T_SIZE)->head = 0;
+#if LJ_ALLOC_HUGEPAGES
+      /* The size is not aligned, so only transparent huge pages are used. */
+      if (m->hugepages && mmsize >= HUGEPAGE_SIZE &&
+	  madvise(mm, mmsize, MADV_HUGEPAGE) == 0)
+	m->nmadvise++;
+#endif
+      m->mapped += mmsize;
+      m->ndirect++;
+      m->direct += mmsize;
       return chunk2mem(p);
     }
   }
   return NULL;
 }
 
-static mchunkptr direct_resize(mchunkptr oldp, size_t nb)
+#if LJ_ALLOC_MREMAP_FIXED
+/* Move a direct mapping, which can't be extended in place, to a new one
+** without copying: the new mapping is reserved within the allowed address
+** range first and then atomically replaced by the pages of the old one.
+*/
+static char *direct_move(mstate m, char *mm, size_t oldmmsize,
+			 size_t newmmsize)
+{
+  char *cp = (char *)DIRECT_MMAP(newmmsize);
+  m->nmmap++;
+#if LJ_ALLOC_RECLAIM
+  if (cp == CMFAIL && reclaim_flush(m)) {
+    cp = (char *)DIRECT_MMAP(newmmsize);  /* Retry with the address space freed. */
+    m->nmmap++;
+  }
+#endif
+  if (cp != CMFAIL) {
+    int olderr = errno;
+    char *np = (char *)mremap(mm, oldmmsize, newmmsize,
+			      MREMAP_MAYMOVE|MREMAP_FIXED, cp);
+    m->nmremap++;
+    if (np == CMFAIL) {
+      m->nmunmap++;
+      CALL_MUNMAP(cp, newmmsize);
+    }
+    errno = olderr;
+    return np;
+  }
+  return CMFAIL;
+}
+#endif
+
+static mchunkptr direct_resize(mstate m, mchunkptr oldp, size_t nb)
 {
   size_t oldsize = chunksize(oldp);
   if (is_small(nb)) /* Can't shrink direct regions below small size */
@@ -869,8 +1285,17 @@ static mchunkptr direct_resize(mchunkptr oldp, size_t nb)
     size_t newmmsize = mmap_align(nb + SIX_SIZE_T_SIZES + CHUNK_ALIGN_MASK);
     char *cp = (char *)CALL_MREMAP((char *)oldp - offset,
 				   oldmmsize, newmmsize, CALL_MREMAP_MV);
+#if LJ_ALLOC_MREMAP
+    m->nmremap++;
+#endif
+#if LJ_ALLOC_MREMAP_FIXED
+    if (cp == CMFAIL && newmmsize > oldmmsize)
+      cp = direct_move(m, (char *)oldp - offset, oldmmsize, newmmsize);
+#endif
     if (cp != CMFAIL) {
       mchunkptr newp = (mchunkptr)(cp + offset);
+      m->mapped += newmmsize - oldmmsize;
+      m->direct += newmmsize - oldmmsize;
       size_t psize = newmmsize - offset - DIRECT_FOOT_PAD;
       newp->head = psize|CINUSE_BIT;
       chunk_plus_offset(newp, psize)->head = FENCEPOST_HEAD;
@@ -883,6 +1308,15 @@ static mchunkptr direct_resize(mchunkptr oldp, size_t nb)
 
 /* -------------------------- mspace management -------------------------- */
 
+#if LJ_ALLOC_MADVISE
+/* The top chunk is split at P, so the memory below it is used again. */
+#define top_used(M, P) \
+  { size_t s_ = (size_t)(P) + sizeof(struct malloc_tree_chunk); \
+    if (s_ > (M)->topclean) (M)->topclean = page_align(s_); }
+#else
+#define top_used(M, P)		((void)0)
+#endif
+
 /* Initialize top chunk and its size */
 static void init_top(mstate m, mchunkptr p, size_t psize)
 {
@@ -897,6 +1331,11 @@ static void init_top(mstate m, mchunkptr p, size_t psize)
   /* set size of fake trailing chunk holding overhead space only once */
   chunk_plus_offset(p, psize)->head = TOP_FOOT_SIZE;
   m->trim_check = DEFAULT_TRIM_THRESHOLD; /* reset on each update */
+#if LJ_ALLOC_MADVISE
+  /* Keep the released part of the top, unless the top is moved. */
+  if (m->topclean < (size_t)p || m->topclean > (size_t)p + psize)
+    m->topclean = (size_t)p + psize;
+#endif
 }
 
 /* Initialize bins for a new mstate that is otherwise zeroed out */
@@ -944,7 +1383,7 @@ static void *prepend_alloc(mstate m, char *newbase, char *oldbase, size_t nb)
 }
 
 /* Add a segment to hold a new noncontiguous region */
-static void add_segment(mstate m, char *tbase, size_t tsize)
+static void add_segment(mstate m, char *tbase, size_t tsize, int huge)
 {
   /* Determine locations and sizes of segment, fenceposts, old top */
   char *old_top = (char *)m->top;
@@ -969,6 +1408,7 @@ static void add_segment(mstate m, char *tbase, size_t tsize)
   m->seg.base = tbase;
   m->seg.size = tsize;
   m->seg.next = ss;
+  m->seg.huge = (size_t)huge;
 
   /* Insert trailing fenceposts */
   for (;;) {
@@ -996,19 +1436,21 @@ static void *alloc_sys(mstate m, size_t nb)
 {
   char *tbase = CMFAIL;
   size_t tsize = 0;
+  int huge = LJ_ALLOC_HUGE_OFF;
 
   /* Directly map large chunks */
   if (LJ_UNLIKELY(nb >= DEFAULT_MMAP_THRESHOLD)) {
-    void *mem = direct_alloc(nb);
+    void *mem = direct_alloc(m, nb);
     if (mem != 0)
       return mem;
   }
 
   {
     size_t req = nb + TOP_FOOT_SIZE + SIZE_T_ONE;
-    size_t rsize = granularity_align(req);
+    size_t unit = alloc_granularity(m);
+    size_t rsize = (req + (unit - SIZE_T_ONE)) & ~(unit - SIZE_T_ONE);
     if (LJ_LIKELY(rsize > nb)) { /* Fail if wraps around zero */
-      char *mp = (char *)(CALL_MMAP(rsize));
+      char *mp = (char *)(alloc_mmap(m, rsize, &huge));
       if (mp != CMFAIL) {
 	tbase = mp;
 	tsize = rsize;
@@ -1018,23 +1460,24 @@ static void *alloc_sys(mstate m, size_t nb)
 
   if (tbase != CMFAIL) {
     msegmentptr sp = &m->seg;
-    /* Try to merge with an existing segment */
+    /* Try to merge with an existing segment of the same kind of pages */
     while (sp != 0 && tbase != sp->base + sp->size)
       sp = sp->next;
-    if (sp != 0 && segment_holds(sp, m->top)) { /* append */
+    if (sp != 0 && sp->huge == (size_t)huge &&
+	segment_holds(sp, m->top)) { /* append */
       sp->size += tsize;
       init_top(m, m->top, m->topsize + tsize);
     } else {
       sp = &m->seg;
       while (sp != 0 && sp->base != tbase + tsize)
 	sp = sp->next;
-      if (sp != 0) {
+      if (sp != 0 && sp->huge == (size_t)huge) {
 	char *oldbase = sp->base;
 	sp->base = tbase;
 	sp->size += tsize;
 	return prepend_alloc(m, tbase, oldbase, nb);
       } else {
-	add_segment(m, tbase, tsize);
+	add_segment(m, tbase, tsize, huge);
       }
     }
 
@@ -1043,6 +1486,7 @@ static void *alloc_sys(mstate m, size_t nb)
       mchunkptr p = m->top;
       mchunkptr r = m->top = chunk_plus_offset(p, nb);
       r->head = rsize | PINUSE_BIT;
+      top_used(m, r);
       set_size_and_pinuse_of_inuse_chunk(m, p, nb);
       return chunk2mem(p);
     }
@@ -1053,8 +1497,10 @@ static void *alloc_sys(mstate m, size_t nb)
 
 /* -----------------------  system deallocation -------------------------- */
 
-/* Unmap and unlink any mmapped segments that don't contain used chunks */
-static size_t release_unused_segments(mstate m)
+/* Unmap and unlink any mmapped segments that don't contain used chunks.
+** Only the segments with huge pages are unmapped, if hugeonly is set.
+*/
+static size_t release_unused_segments(mstate m, int hugeonly)
 {
   size_t released = 0;
   size_t nsegs = 0;
@@ -1063,13 +1509,15 @@ static size_t release_unused_segments(mstate m)
   while (sp != 0) {
     char *base = sp->base;
     size_t size = sp->size;
+    int huge = (int)sp->huge;
     msegmentptr next = sp->next;
     nsegs++;
     {
       mchunkptr p = align_as_chunk(base);
       size_t psize = chunksize(p);
       /* Can unmap if first chunk holds entire segment and not pinned */
-      if (!cinuse(p) && (char *)p + psize >= base + size - TOP_FOOT_SIZE) {
+      if (!cinuse(p) && (char *)p + psize >= base + size - TOP_FOOT_SIZE &&
+	  !(hugeonly && huge == LJ_ALLOC_HUGE_OFF)) {
 	tchunkptr tp = (tchunkptr)p;
 	if (p == m->dv) {
 	  m->dv = 0;
@@ -1077,7 +1525,7 @@ static size_t release_unused_segments(mstate m)
 	} else {
 	  unlink_large_chunk(m, tp);
 	}
-	if (CALL_MUNMAP(base, size) == 0) {
+	if (alloc_munmap(m, base, size, huge) == 0) {
 	  released += size;
 	  /* unlink obsoleted record */
 	  sp = pred;
@@ -1104,7 +1552,7 @@ static int alloc_trim(mstate m, size_t pad)
 
     if (m->topsize > pad) {
       /* Shrink top space in granularity-size units, keeping at least one */
-      size_t unit = DEFAULT_GRANULARITY;
+      size_t unit = alloc_granularity(m);
       size_t extra = ((m->topsize - pad + (unit - SIZE_T_ONE)) / unit -
 		      SIZE_T_ONE) * unit;
       msegmentptr sp = segment_holding(m, (char *)m->top);
@@ -1113,8 +1561,16 @@ static int alloc_trim(mstate m, size_t pad)
 	  !has_segment_link(m, sp)) { /* can't shrink if pinned */
 	size_t newsize = sp->size - extra;
 	/* Prefer mremap, fall back to munmap */
-	if ((CALL_MREMAP(sp->base, sp->size, newsize, CALL_MREMAP_NOMOVE) != MFAIL) ||
-	    (CALL_MUNMAP(sp->base + newsize, extra) == 0)) {
+#if LJ_ALLOC_MREMAP
+	m->nmremap++;
+#endif
+	if (CALL_MREMAP(sp->base, sp->size, newsize, CALL_MREMAP_NOMOVE) != MFAIL) {
+	  m->mapped -= extra;
+	  if (sp->huge != LJ_ALLOC_HUGE_OFF)
+	    m->hugemapped -= extra;
+	  released = extra;
+	} else if (alloc_munmap(m, sp->base + newsize, extra,
+			       (int)sp->huge) == 0) {
 	  released = extra;
 	}
       }
@@ -1126,7 +1582,7 @@ static int alloc_trim(mstate m, size_t pad)
     }
 
     /* Unmap any unused mmapped segments */
-    released += release_unused_segments(m);
+    released += release_unused_segments(m, 0);
 
     /* On failure, disable autotrim to avoid repeated failed future calls */
     if (released == 0 && m->topsize > m->trim_check)
@@ -1233,6 +1689,296 @@ static void *tmalloc_small(mstate m, size_t nb)
   return chunk2mem(v);
 }
 
+/* ------------------------- slab allocation ---------------------------- */
+
+#if LJ_ALLOC_SLAB
+static LJ_AINLINE void slab_link(spageptr *list, spageptr pg)
+{
+  pg->prev = NULL;
+  pg->next = *list;
+  if (*list != NULL)
+    (*list)->prev = pg;
+  *list = pg;
+}
+
+static LJ_AINLINE void slab_unlink(spageptr *list, spageptr pg)
+{
+  if (pg->prev != NULL)
+    pg->prev->next = pg->next;
+  else
+    *list = pg->next;
+  if (pg->next != NULL)
+    pg->next->prev = pg->prev;
+}
+
+/* Get an empty page (mapping a new span if needed) for the given class. */
+static spageptr slab_newpage(mstate m, bindex_t i)
+{
+  spageptr pg = m->slabempty;
+  if (pg == NULL) {  /* Map a new span and put its pages to the empty list. */
+#if LJ_ALLOC_HUGEPAGES
+    size_t size = m->hugepages ? HUGEPAGE_SIZE : SLAB_SPAN;
+#else
+    size_t size = SLAB_SPAN;
+#endif
+    int huge;
+    char *base = (char *)alloc_mmap(m, size, &huge);
+    char *p = base + size;
+    if (base == CMFAIL)
+      return NULL;
+    while (p != base) {
+      p -= SLAB_PAGE;
+      ((spageptr)p)->span = (spageptr)base;
+      slab_link(&m->slabempty, (spageptr)p);
+    }
+    m->slabnempty += size / SLAB_PAGE;
+    m->slabmapped += size;
+    pg = (spageptr)base;
+    pg->nused = 0;
+    pg->npages = (uint16_t)(size / SLAB_PAGE);
+    pg->huge = (uint16_t)huge;
+    pg->prevspan = NULL;
+    pg->nextspan = m->slabspans;
+    if (m->slabspans != NULL)
+      m->slabspans->prevspan = pg;
+    m->slabspans = pg;
+  }
+  slab_unlink(&m->slabempty, pg);
+  m->slabnempty--;
+  pg->span->nused++;
+  pg->free = NULL;
+  pg->bump = (char *)pg + SLAB_HEAD;
+  pg->cls = (uint16_t)i;
+  pg->nlive = 0;
+  pg->cap = (uint16_t)((SLAB_PAGE - SLAB_HEAD) / slab_index2size(i));
+  slab_link(&m->slabpages[i], pg);
+  return pg;
+}
+
+/* Unmap a span with all pages empty. */
+static void slab_unmap(mstate m, spageptr span)
+{
+  size_t size = span->npages * SLAB_PAGE;
+  char *p;
+  for (p = (char *)span; p != (char *)span + size; p += SLAB_PAGE)
+    slab_unlink(&m->slabempty, (spageptr)p);
+  m->slabnempty -= span->npages;
+  m->slabmapped -= size;
+  if (span->prevspan != NULL)
+    span->prevspan->nextspan = span->nextspan;
+  else
+    m->slabspans = span->nextspan;
+  if (span->nextspan != NULL)
+    span->nextspan->prevspan = span->prevspan;
+  alloc_munmap(m, span, size, span->huge);
+}
+
+static void *slab_malloc(mstate m, size_t nsize)
+{
+  bindex_t i = slab_index(nsize);
+  spageptr pg = m->slabpages[i];
+  void *mem;
+  if (LJ_UNLIKELY(pg == NULL) && (pg = slab_newpage(m, i)) == NULL)
+    return NULL;
+  if (pg->free != NULL) {
+    mem = pg->free;
+    pg->free = *(void **)mem;
+  } else {
+    mem = pg->bump;
+    pg->bump += slab_index2size(i);
+  }
+  if (++pg->nlive == pg->cap)  /* Page is full, unlink it. */
+    slab_unlink(&m->slabpages[i], pg);
+  m->slabused += slab_index2size(i);
+  return mem;
+}
+
+static void slab_free(mstate m, void *ptr)
+{
+  spageptr pg = slab_page_of(ptr);
+  bindex_t i = pg->cls;
+  *(void **)ptr = pg->free;
+  pg->free = ptr;
+  m->slabused -= slab_index2size(i);
+  if (pg->nlive-- == pg->cap) {  /* Full page gets free objects. */
+    slab_link(&m->slabpages[i], pg);
+  } else if (pg->nlive == 0 && (pg->prev != NULL || pg->next != NULL)) {
+    /* Move the empty page to the shared list. Keep the last one. */
+    spageptr span = pg->span;
+    slab_unlink(&m->slabpages[i], pg);
+    slab_link(&m->slabempty, pg);
+    m->slabnempty++;
+    /* The lazy trimming unmaps the spans on the decay only. */
+    if (--span->nused == 0 && m->decay == 0 &&
+	m->slabnempty >= SLAB_KEEP + span->npages)
+      slab_unmap(m, span);
+  }
+}
+
+/* Unmap the empty spans, which exceed the kept empty pages. */
+static void slab_trim(mstate m)
+{
+  spageptr span = m->slabspans;
+  while (span != NULL) {
+    spageptr next = span->nextspan;
+    if (span->nused == 0 && m->slabnempty >= SLAB_KEEP + span->npages)
+      slab_unmap(m, span);
+    span = next;
+  }
+}
+#endif
+
+/* ---------------------------- Lazy trimming ---------------------------- */
+
+/*
+  The eager trimming (the default) unmaps the free memory at the top of the
+  segments and the unused segments as soon as there is enough of it. With
+  the oscillating workloads the same memory is mapped again shortly after,
+  which costs the syscalls and the page faults. The lazy trimming keeps the
+  free memory mapped and releases its pages with madvise() at most once per
+  the decay time, so the bursts of allocations reuse the mappings (and even
+  the pages with MADV_FREE, unless the kernel has reclaimed them). Only the
+  free chunks of at least DEFAULT_GRANULARITY bytes are released to bound
+  the number of syscalls. The released chunks are stamped and the released
+  part of the top chunk is tracked, so the pages are released again only
+  after they have been used. The memory is unmapped on explicit trim only,
+  except for the free segments with huge pages, see below.
+
+  The decay time is checked on frees and on luaM_gc_idle(), so the pages
+  freed last are released by the next idle GC, even if nothing is freed
+  after them. Huge pages are never split: the pages of hugetlbfs segments
+  are not released and the released ranges of the segments with
+  transparent huge pages are rounded to whole huge pages. Since the chunk
+  headers at the ends of a segment keep its first and last huge pages, the
+  free segments with huge pages are unmapped instead.
+*/
+
+#if LJ_ALLOC_MADVISE
+/* Release the pages of the free memory. */
+static void alloc_madvise(mstate m, size_t start, size_t end)
+{
+  int olderr = errno;
+  int res;
+#if LJ_ALLOC_HUGEPAGES
+  msegmentptr sp = segment_holding(m, (char *)start);
+  if (sp != 0 && sp->huge == LJ_ALLOC_HUGE_HUGETLB)
+    return;
+  if (sp != 0 && sp->huge == LJ_ALLOC_HUGE_THP) {
+    start = (start + HUGEPAGE_SIZE - 1) & ~(size_t)(HUGEPAGE_SIZE - 1);
+    end &= ~(size_t)(HUGEPAGE_SIZE - 1);
+    if (start >= end)
+      return;
+  }
+#endif
+#ifdef MADV_FREE
+  res = madvise((void *)start, end - start, MADV_FREE);
+  if (res != 0)  /* MADV_FREE is not supported before Linux 4.5. */
+#endif
+  res = madvise((void *)start, end - start, MADV_DONTNEED);
+  if (res == 0) {
+    m->nmadvise++;
+    m->released += end - start;
+  }
+  errno = olderr;
+}
+
+/* Stamp of a released free chunk. It's kept after the chunk header, so the
+** chunk isn't released again until it's split, merged or reused.
+*/
+#define RELEASE_MAGIC		((size_t)0x5eeded5au)
+#define release_stamp(p, psize)	((size_t)(p) ^ (psize) ^ RELEASE_MAGIC)
+
+/* Release the pages of a free chunk, but keep the chunk header. */
+static void alloc_release(mstate m, mchunkptr p, size_t psize)
+{
+  size_t *stamp = (size_t *)((char *)p + sizeof(struct malloc_tree_chunk));
+  if (*stamp != release_stamp(p, psize)) {
+    size_t start = page_align((size_t)(stamp + 1));
+    size_t end = ((size_t)p + psize) & ~(LJ_PAGESIZE - SIZE_T_ONE);
+    if (start < end)
+      alloc_madvise(m, start, end);
+    *stamp = release_stamp(p, psize);
+  }
+}
+
+/* Release the pages of the top chunk, which aren't released yet. */
+static void release_top(mstate m)
+{
+  size_t start = page_align((size_t)m->top + sizeof(struct malloc_tree_chunk));
+  size_t end = ((size_t)m->top + m->topsize) & ~(LJ_PAGESIZE - SIZE_T_ONE);
+  if (end > m->topclean)
+    end = m->topclean;
+  if (start < end)
+    alloc_madvise(m, start, end);
+  if (start < m->topclean)
+    m->topclean = start;
+}
+
+static void release_tree(mstate m, tchunkptr t)
+{
+  while (t != 0) {
+    tchunkptr u = t;
+    do {  /* All the chunks of the same size. */
+      if (chunksize(u) >= DEFAULT_GRANULARITY)
+	alloc_release(m, (mchunkptr)u, chunksize(u));
+      u = u->fd;
+    } while (u != t);
+    release_tree(m, t->child[0]);
+    t = t->child[1];
+  }
+}
+
+/* Release the pages of all the large free chunks. */
+static void release_free_chunks(mstate m)
+{
+  bindex_t i;
+  compute_tree_index(DEFAULT_GRANULARITY, i);
+  for (; i < NTREEBINS; i++)
+    release_tree(m, *treebin_at(m, i));
+  if (m->dvsize >= DEFAULT_GRANULARITY)
+    alloc_release(m, m->dv, m->dvsize);
+  release_top(m);
+#if LJ_ALLOC_HUGEPAGES
+  /* The pages of the free segments are released only by unmapping them. */
+  if (m->hugemapped != 0)
+    release_unused_segments(m, 1);
+#endif
+#if LJ_ALLOC_SLAB
+  slab_trim(m);
+#endif
+}
+#endif
+
+#if LJ_ALLOC_MADVISE
+/* Release the free memory, if the decay time has passed since the last time. */
+static void alloc_decay(mstate m)
+{
+  uint64_t now = lj_utils_time_ns();
+  if (now - m->trimtime >= m->decay) {
+    m->trimtime = now;
+    release_free_chunks(m);
+  }
+}
+#endif
+
+/* Trim the free memory on free: see above. */
+static void alloc_autotrim(mstate m, int top)
+{
+#if LJ_ALLOC_MADVISE
+  if (m->decay != 0) {
+    alloc_decay(m);
+    /* Check again, when the top grows or after the next release checks. */
+    m->trim_check = m->topsize + DEFAULT_TRIM_THRESHOLD;
+    m->release_checks = MAX_RELEASE_CHECK_RATE;
+    return;
+  }
+#endif
+  if (top)
+    alloc_trim(m, 0);
+  else
+    release_unused_segments(m, 0);
+}
+
 /* ----------------------------------------------------------------------- */
 
 void *lj_alloc_create(void)
@@ -1251,6 +1997,8 @@ void *lj_alloc_create(void)
     m->seg.base = tbase;
     m->seg.size = tsize;
     m->release_checks = MAX_RELEASE_CHECK_RATE;
+    m->mapped = tsize;
+    m->nmmap = 1;
     init_bins(m);
     mn = next_chunk(mem2chunk(m));
     init_top(m, mn, (size_t)((tbase + tsize) - (char *)mn) - TOP_FOOT_SIZE);
@@ -1263,6 +2011,18 @@ void lj_alloc_destroy(void *msp)
 {
   mstate ms = (mstate)msp;
   msegmentptr sp = &ms->seg;
+#if LJ_ALLOC_RECLAIM
+  if (ms->reclaimon)
+    reclaim_stop(ms);
+#endif
+#if LJ_ALLOC_SLAB
+  spageptr span = ms->slabspans;
+  while (span != NULL) {
+    spageptr next = span->nextspan;
+    CALL_MUNMAP(span, span->npages * SLAB_PAGE);
+    span = next;
+  }
+#endif
   while (sp != 0) {
     char *base = sp->base;
     size_t size = sp->size;
@@ -1347,6 +2107,7 @@ static LJ_NOINLINE void *lj_alloc_malloc(void *msp, size_t nsize)
     mchunkptr p = ms->top;
     mchunkptr r = ms->top = chunk_plus_offset(p, nb);
     r->head = rsize | PINUSE_BIT;
+    top_used(ms, r);
     set_size_and_pinuse_of_inuse_chunk(ms, p, nb);
     mem = chunk2mem(p);
     return mem;
@@ -1366,7 +2127,14 @@ static LJ_NOINLINE void *lj_alloc_free(void *msp, void *ptr)
       if ((prevsize & IS_DIRECT_BIT) != 0) {
 	prevsize &= ~IS_DIRECT_BIT;
 	psize += prevsize + DIRECT_FOOT_PAD;
-	CALL_MUNMAP((char *)p - prevsize, psize);
+#if LJ_ALLOC_RECLAIM
+	if (fm->reclaimon && psize >= RECLAIM_THRESHOLD)
+	  reclaim_push(fm, (char *)p - prevsize, psize);
+	else
+#endif
+	alloc_munmap(fm, (char *)p - prevsize, psize, LJ_ALLOC_HUGE_OFF);
+	fm->ndirect--;
+	fm->direct -= psize;
 	return NULL;
       } else {
 	mchunkptr prev = chunk_minus_offset(p, prevsize);
@@ -1392,7 +2160,7 @@ static LJ_NOINLINE void *lj_alloc_free(void *msp, void *ptr)
 	  fm->dvsize = 0;
 	}
 	if (tsize > fm->trim_check)
-	  alloc_trim(fm, 0);
+	  alloc_autotrim(fm, 1);
 	return NULL;
       } else if (next == fm->dv) {
 	size_t dsize = fm->dvsize += psize;
@@ -1419,7 +2187,7 @@ static LJ_NOINLINE void *lj_alloc_free(void *msp, void *ptr)
       tchunkptr tp = (tchunkptr)p;
       insert_large_chunk(fm, tp, psize);
       if (--fm->release_checks == 0)
-	release_unused_segments(fm);
+	alloc_autotrim(fm, 0);
     }
   }
   return NULL;
@@ -1439,7 +2207,7 @@ static LJ_NOINLINE void *lj_alloc_realloc(void *msp, void *ptr, size_t nsize)
 
     /* Try to either shrink or extend into top. Else malloc-copy-free */
     if (is_direct(oldp)) {
-      newp = direct_resize(oldp, nb);  /* this may return NULL. */
+      newp = direct_resize(m, oldp, nb);  /* this may return NULL. */
     } else if (oldsize >= nb) { /* already big enough */
       size_t rsize = oldsize - nb;
       newp = oldp;
@@ -1458,6 +2226,7 @@ static LJ_NOINLINE void *lj_alloc_realloc(void *msp, void *ptr, size_t nsize)
       newtop->head = newtopsize |PINUSE_BIT;
       m->top = newtop;
       m->topsize = newtopsize;
+      top_used(m, newtop);
       newp = oldp;
     }
 
@@ -1475,8 +2244,167 @@ static LJ_NOINLINE void *lj_alloc_realloc(void *msp, void *ptr, size_t nsize)
   }
 }
 
+int lj_alloc_hugepages(void *msp, int mode)
+{
+#if LJ_ALLOC_HUGEPAGES
+  mstate ms = (mstate)msp;
+  int omode = ms->hugepages;
+  if (mode >= 0)
+    ms->hugepages = mode;
+  return omode;
+#else
+  UNUSED(msp); UNUSED(mode);
+  return -1;
+#endif
+}
+
+void lj_alloc_idle(void *msp)
+{
+#if LJ_ALLOC_MADVISE
+  mstate ms = (mstate)msp;
+  if (ms->decay != 0)
+    alloc_decay(ms);
+#else
+  UNUSED(msp);
+#endif
+}
+
+int lj_alloc_setdecay(void *msp, uint64_t decay)
+{
+#if LJ_ALLOC_MADVISE
+  mstate ms = (mstate)msp;
+  ms->decay = decay;
+  ms->trimtime = lj_utils_time_ns();
+  return 0;
+#else
+  UNUSED(msp); UNUSED(decay);
+  return -1;
+#endif
+}
+
+int lj_alloc_setreclaim(void *msp, int enable)
+{
+#if LJ_ALLOC_RECLAIM
+  mstate ms = (mstate)msp;
+  int old = ms->reclaimon;
+  if (enable && !old) {
+    if (!reclaim_start(ms))
+      return -1;
+  } else if (!enable && old) {
+    reclaim_stop(ms);
+  }
+  return old;
+#else
+  UNUSED(msp); UNUSED(enable);
+  return -1;
+#endif
+}
+
+size_t lj_alloc_trim(void *msp)
+{
+  mstate ms = (mstate)msp;
+  size_t mapped = ms->mapped;
+  size_t released = ms->released;
+#if LJ_ALLOC_SLAB
+  slab_trim(ms);
+#endif
+  alloc_trim(ms, 0);
+#if LJ_ALLOC_MADVISE
+  if (ms->decay != 0) {  /* Release the rest, which can't be unmapped. */
+    ms->trimtime = lj_utils_time_ns();
+    release_free_chunks(ms);
+  }
+#endif
+  return (mapped - ms->mapped) + (ms->released - released);
+}
+
+void lj_alloc_getstats(void *msp, AllocStats *st)
+{
+  mstate ms = (mstate)msp;
+  msegmentptr sp;
+  st->mapped = ms->mapped;
+  st->hugemapped = ms->hugemapped;
+  st->nmmap = ms->nmmap;
+  st->nmunmap = ms->nmunmap;
+  st->nmremap = ms->nmremap;
+  st->nmadvise = ms->nmadvise;
+  st->released = ms->released;
+  st->nsegs = 0;
+  st->segsize = 0;
+  for (sp = &ms->seg; sp != 0; sp = sp->next) {
+    st->nsegs++;
+    st->segsize += sp->size;
+  }
+  st->free = ms->binned + ms->dvsize + ms->topsize;
+  st->ndirect = ms->ndirect;
+  st->direct = ms->direct;
+#if LJ_ALLOC_SLAB
+  st->slabmapped = ms->slabmapped;
+  st->slabused = ms->slabused;
+#else
+  st->slabmapped = 0;
+  st->slabused = 0;
+#endif
+  memcpy(st->sizehist, ms->sizehist, sizeof(ms->sizehist));
+#if LJ_ALLOC_RECLAIM
+  if (ms->reclaimon)
+    pthread_mutex_lock(&ms->reclaim.lock);
+  st->reclaimqlen = ms->reclaim.qlen;
+  st->reclaimqsize = ms->reclaim.qsize;
+  st->reclaimed = ms->reclaim.nreclaimed;
+  st->reclaimlat = ms->reclaim.latency;
+  st->reclaimlat_max = ms->reclaim.latency_max;
+  if (ms->reclaimon)
+    pthread_mutex_unlock(&ms->reclaim.lock);
+#else
+  st->reclaimqlen = 0;
+  st->reclaimqsize = 0;
+  st->reclaimed = 0;
+  st->reclaimlat = 0;
+  st->reclaimlat_max = 0;
+#endif
+}
+
 void *lj_alloc_f(void *msp, void *ptr, size_t osize, size_t nsize)
 {
+  if (nsize != 0)
+    ((mstate)msp)->sizehist[(nsize >> (ALLOC_SIZEHIST - 1)) != 0 ?
+			   ALLOC_SIZEHIST - 1 : lj_fls((uint32_t)nsize)]++;
+#if LJ_ALLOC_SLAB
+  /* The size of the object determines whether it belongs to a slab. */
+  if (nsize == 0) {
+    if (osize <= SLAB_MAX) {
+      if (ptr != NULL)
+	slab_free((mstate)msp, ptr);
+      return NULL;
+    }
+    return lj_alloc_free(msp, ptr);
+  } else if (ptr == NULL) {
+    return nsize <= SLAB_MAX ? slab_malloc((mstate)msp, nsize) :
+			       lj_alloc_malloc(msp, nsize);
+  } else if (osize > SLAB_MAX && nsize > SLAB_MAX) {
+    return lj_alloc_realloc(msp, ptr, nsize);
+  } else {
+    void *nptr;
+    if (osize <= SLAB_MAX) {
+      bindex_t i = slab_page_of(ptr)->cls;
+      if (nsize <= SLAB_MAX && slab_index(nsize) == i)
+	return ptr;  /* Same class. */
+      osize = slab_index2size(i);
+    }
+    /* Move between a slab and the bins or between two slabs. */
+    nptr = nsize <= SLAB_MAX ? slab_malloc((mstate)msp, nsize) :
+			       lj_alloc_malloc(msp, nsize);
+    if (nptr != NULL) {
+      memcpy(nptr, ptr, osize < nsize ? osize : nsize);
+      if (osize <= SLAB_MAX)
+	slab_free((mstate)msp, ptr);
+      else
+	lj_alloc_free(msp, ptr);
+    }
+    return nptr;
+  }
+#else
   (void)osize;
   if (nsize == 0) {
     return lj_alloc_free(msp, ptr);
@@ -1485,6 +2413,7 @@ void *lj_alloc_f(void *msp, void *ptr, size_t osize, size_t nsize)
   } else {
     return lj_alloc_realloc(msp, ptr, nsize);
   }
+#endif
 }
 
 #endif
@@ -9,8 +9,47 @@
 #include "lj_def.h"
 
 #ifndef LUAJIT_USE_SYSMALLOC
+/* Huge page modes of the new mappings. */
+#define LJ_ALLOC_HUGE_OFF	0
+#define LJ_ALLOC_HUGE_THP	1	/* Transparent huge pages. */
+#define LJ_ALLOC_HUGE_HUGETLB	2	/* Pages from hugetlbfs (or THP). */
+
+/* Buckets of the allocation size histogram. */
+#define ALLOC_SIZEHIST		32
+
+/* Statistics of the memory mapped by the allocator. */
+typedef struct AllocStats {
+  size_t mapped;	/* Bytes mapped from the system. */
+  size_t hugemapped;	/* Bytes of segments and slab spans in huge pages. */
+  size_t nmmap;		/* Number of mmap() calls. */
+  size_t nmunmap;	/* Number of munmap() calls. */
+  size_t nmremap;	/* Number of mremap() calls. */
+  size_t nmadvise;	/* Number of madvise() calls. */
+  size_t released;	/* Total bytes released by madvise(). */
+  size_t nsegs;		/* Number of segments. */
+  size_t segsize;	/* Bytes of the segments. */
+  size_t free;		/* Bytes of the free chunks in the bins and top. */
+  size_t ndirect;	/* Number of directly mapped chunks. */
+  size_t direct;	/* Bytes of the directly mapped chunks. */
+  size_t slabmapped;	/* Bytes of the slab spans. */
+  size_t slabused;	/* Bytes of the objects in the slabs. */
+  /* Number of allocations of [2^i, 2^(i+1)) bytes, the last one is open. */
+  size_t sizehist[ALLOC_SIZEHIST];
+  size_t reclaimqlen;	/* Number of mappings queued for unmapping. */
+  size_t reclaimqsize;	/* Bytes of mappings queued for unmapping. */
+  size_t reclaimed;	/* Number of mappings unmapped by the thread. */
+  uint64_t reclaimlat;	/* Total time from queueing to unmapping. */
+  uint64_t reclaimlat_max;	/* Max. time from queueing to unmapping. */
+} AllocStats;
+
 LJ_FUNC void *lj_alloc_create(void);
 LJ_FUNC void lj_alloc_destroy(void *msp);
+LJ_FUNC int lj_alloc_hugepages(void *msp, int mode);
+LJ_FUNC int lj_alloc_setdecay(void *msp, uint64_t decay);
+LJ_FUNC void lj_alloc_idle(void *msp);
+LJ_FUNC int lj_alloc_setreclaim(void *msp, int enable);
+LJ_FUNC size_t lj_alloc_trim(void *msp);
+LJ_FUNC void lj_alloc_getstats(void *msp, AllocStats *st);
 LJ_FUNC void *lj_alloc_f(void *msp, void *ptr, size_t osize, size_t nsize);
 #endif
 
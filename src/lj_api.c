@@ -25,6 +25,9 @@
 #include "lj_vm.h"
 #include "lj_strscan.h"
 #include "lj_strfmt.h"
+#if LJ_HASGCTHREAD
+#include "lj_gcthread.h"
+#endif
 
 /* -- Common helper functions --------------------------------------------- */
 
@@ -317,6 +320,8 @@ LUA_API int lua_equal(lua_State *L, int idx1, int idx2)
 #endif
   } else if (gcrefeq(o1->gcr, o2->gcr)) {
     return 1;
+  } else if (tvisstr(o1)) {
+    return lj_str_equal(strV(o1), strV(o2));
   } else if (!tvistabud(o1)) {
     return 0;
   } else {
@@ -537,8 +542,10 @@ LUA_API uint32_t lua_hashstring(lua_State *L, int idx)
   TValue *o = index2adr(L, idx);
   lj_checkapi(tvisstr(o), "stack slot %d is not a string", idx);
   GCstr *s = strV(o);
-  if (! strsmart(s))
+#if !LUAJIT_SEEDED_STRHASH
+  if (!strsmart(s) && !strnointern(s))
     return s->hash;
+#endif
   return lua_hash(strdata(s), s->len);
 }
 
@@ -672,7 +679,7 @@ LUA_API void lua_pushlstring(lua_State *L, const char *str, size_t len)
 {
   GCstr *s;
   lj_gc_check(L);
-  s = lj_str_new(L, str, len);
+  s = lj_str_newdata(L, str, len);
   setstrV(L, L->top, s);
   incr_top(L);
 }
@@ -1305,16 +1312,9 @@ LUA_API int lua_gc(lua_State *L, int what, int data)
   case LUA_GCCOUNTB:
     res = (int)(g->gc.total & 0x3ff);
     break;
-  case LUA_GCSTEP: {
-    GCSize a = (GCSize)data << 10;
-    g->gc.threshold = (a <= g->gc.total) ? (g->gc.total - a) : 0;
-    while (g->gc.total >= g->gc.threshold)
-      if (lj_gc_step(L) > 0) {
-	res = 1;
-	break;
-      }
+  case LUA_GCSTEP:
+    res = lj_gc_stepsize(L, (GCSize)data << 10);
     break;
-  }
   case LUA_GCSETPAUSE:
     res = (int)(g->gc.pause);
     g->gc.pause = (MSize)data;
@@ -1326,6 +1326,38 @@ LUA_API int lua_gc(lua_State *L, int what, int data)
   case LUA_GCISRUNNING:
     res = (g->gc.threshold != LJ_MAX_MEM);
     break;
+  case LUA_GCGEN:
+  case LUA_GCINC:
+    res = g->gc.mode == GCMgen ? LUA_GCGEN : LUA_GCINC;
+    g->gc.mode = what == LUA_GCGEN ? GCMgen : GCMinc;
+    break;
+  case LUA_GCBUDGET:
+    res = (int)(g->gc.budget);
+    g->gc.budget = (MSize)data;
+    break;
+  case LUA_GCBGSWEEP:
+    res = (int)(g->gc.bgsweep);
+#if LJ_HASGCTHREAD
+    if (data && !gcthread(g))
+      lj_gcthread_start(L);  /* Stays disabled if the thread can't start. */
+    g->gc.bgsweep = (data && gcthread(g));
+#endif
+    break;
+  case LUA_GCMARKERS:
+#if LJ_HASGCTHREAD
+    res = gcthread(g) ? (int)gcthread(g)->nmarkers + 1 : 1;
+    if (data > 1 && !gcthread(g))
+      lj_gcthread_start(L);  /* Stays at 1 if the thread can't start. */
+    if (gcthread(g))
+      lj_gcthread_markers(gcthread(g), data);
+#else
+    res = 1;
+#endif
+    break;
+  case LUA_GCFINBUDGET:
+    res = (int)(g->gc.finbudget);
+    g->gc.finbudget = (MSize)data;
+    break;
   default:
     res = -1;  /* Invalid option. */
   }
@@ -670,4 +670,37 @@ extern void *LJ_WIN_LOADLIBA(const char *path);
 #else
 #define LJ_HASSYSPROF		1
 #endif
+
+/* Disable or enable the helper thread of the garbage collector. */
+#if defined(LUAJIT_DISABLE_GCTHREAD) || !LJ_TARGET_POSIX || !defined(__GNUC__)
+#define LJ_HASGCTHREAD		0
+#else
+#define LJ_HASGCTHREAD		1
+#endif
+
+/* Incremental table resize is handled by the x86/x64 interpreters only. */
+#if LJ_TARGET_X86ORX64
+#define LJ_HASTABINCR		1
+#else
+#define LJ_HASTABINCR		0
+#endif
+
+/* Copy-on-write tables are handled by the x86/x64 interpreters only. */
+#if LJ_TARGET_X86ORX64
+#define LJ_HASTABCOW		1
+#else
+#define LJ_HASTABCOW		0
+#endif
+
+/* Uninterned strings are handled by the x86/x64 interpreters only. */
+#if LJ_TARGET_X86ORX64
+#define LJ_HASSTRNOINTERN	1
+#else
+#define LJ_HASSTRNOINTERN	0
+#endif
+
+/* The seeded string hash covers all bytes, so it needs no fallback hash. */
+#if LUAJIT_SEEDED_STRHASH && LUAJIT_SMART_STRINGS
+#error "LUAJIT_SEEDED_STRHASH and LUAJIT_SMART_STRINGS are mutually exclusive"
+#endif
 #endif
@@ -100,4 +100,10 @@ static LJ_AINLINE GCstr *lj_buf_str(lua_State *L, SBuf *sb)
   return lj_str_new(L, sbufB(sb), sbuflen(sb));
 }
 
+/* Same for the results of string operations, see lj_str_newdata(). */
+static LJ_AINLINE GCstr *lj_buf_strdata(lua_State *L, SBuf *sb)
+{
+  return lj_str_newdata(L, sbufB(sb), sbuflen(sb));
+}
+
 #endif
@@ -1588,7 +1588,7 @@ void LJ_FASTCALL recff_clib_index(jit_State *J, RecordFFData *rd)
     GCstr *name = strV(&rd->argv[1]);
     CType *ct;
     CTypeID id = lj_ctype_getname(cts, &ct, name, CLNS_INDEX);
-    cTValue *tv = lj_tab_getstr(cl->cache, name);
+    cTValue *tv = lj_tab_get(J->L, cl->cache, &rd->argv[1]);
     rd->nres = rd->data;
     if (id && tv && !tvisnil(tv)) {
       /* Specialize to the symbol name and make the result a constant. */
@@ -1761,6 +1761,8 @@ void LJ_FASTCALL recff_ffi_gc(jit_State *J, RecordFFData *rd)
   argv2cdata(J, J->base[0], &rd->argv[0]);
   if (!J->base[1])
     lj_trace_err(J, LJ_TRERR_BADTYPE);
+  if (J->base[2])  /* NYI: batch finalizers. */
+    lj_trace_err(J, LJ_TRERR_NYIFFU);
   crec_finalizer(J, J->base[0], J->base[1], &rd->argv[1]);
 }
 
@@ -235,7 +235,11 @@ void lj_ctype_addname(CTState *cts, CType *ct, CTypeID id)
 /* Get a C type by name, matching the type mask. */
 CTypeID lj_ctype_getname(CTState *cts, CType **ctp, GCstr *name, uint32_t tmask)
 {
-  CTypeID id = cts->hash[ct_hashname(name)];
+  CTypeID id = 0;
+  /* The names are interned, an uninterned one matches only its copy. */
+  if (LJ_UNLIKELY(strnointern(name)) && !(name = lj_str_lookup(cts->g, name)))
+    goto notfound;
+  id = cts->hash[ct_hashname(name)];
   while (id) {
     CType *ct = ctype_get(cts, id);
     if (gcref(ct->name) == obj2gco(name) &&
@@ -245,6 +249,7 @@ CTypeID lj_ctype_getname(CTState *cts, CType **ctp, GCstr *name, uint32_t tmask)
     }
     id = ct->next;
   }
+notfound:
   *ctp = &cts->tab[0];  /* Simplify caller logic. ctype_get() would assert. */
   return 0;
 }
@@ -253,6 +258,8 @@ CTypeID lj_ctype_getname(CTState *cts, CType **ctp, GCstr *name, uint32_t tmask)
 CType *lj_ctype_getfieldq(CTState *cts, CType *ct, GCstr *name, CTSize *ofs,
 			  CTInfo *qual)
 {
+  if (LJ_UNLIKELY(strnointern(name)) && !(name = lj_str_lookup(cts->g, name)))
+    return NULL;  /* See lj_ctype_getname(). */
   while (ct->sib) {
     ct = ctype_get(cts, ct->sib);
     if (gcref(ct->name) == obj2gco(name)) {
@@ -1024,6 +1024,10 @@ static void LJ_FASTCALL recff_string_format(jit_State *J, RecordFFData *rd)
 
 /* -- Table library fast functions ---------------------------------------- */
 
+/* The loads and stores of table.insert() and table.remove() are recorded
+** before the call that moves the slots, since a guard after this call would
+** exit to the snapshot before the fast function and re-execute it.
+*/
 static void LJ_FASTCALL recff_table_insert(jit_State *J, RecordFFData *rd)
 {
   RecordIndex ix;
@@ -1031,21 +1035,86 @@ static void LJ_FASTCALL recff_table_insert(jit_State *J, RecordFFData *rd)
   ix.val = J->base[1];
   rd->nres = 0;
   if (tref_istab(ix.tab) && ix.val) {
+    TRef trlen = lj_ir_call(J, IRCALL_lj_tab_len, ix.tab);
+    GCtab *t = tabV(&rd->argv[0]);
+    int32_t len = (int32_t)lj_tab_len(t);
+    ix.key = emitir(IRTI(IR_ADD), trlen, lj_ir_kint(J, 1));
+    settabV(J->L, &ix.tabv, t);
+    setintV(&ix.keyv, len + 1);
+    ix.idxchain = 0;
     if (!J->base[2]) {  /* Simple push: t[#t+1] = v */
-      TRef trlen = lj_ir_call(J, IRCALL_lj_tab_len, ix.tab);
-      GCtab *t = tabV(&rd->argv[0]);
-      ix.key = emitir(IRTI(IR_ADD), trlen, lj_ir_kint(J, 1));
-      settabV(J->L, &ix.tabv, t);
-      setintV(&ix.keyv, lj_tab_len(t) + 1);
-      ix.idxchain = 0;
       lj_record_idx(J, &ix);  /* Set new value. */
-    } else {  /* Complex case: insert in the middle. */
-      recff_nyiu(J, rd);
-      return;
+    } else {  /* Insert in the middle: push v and rotate it into place. */
+      int32_t pos = argv2int(J, &rd->argv[1]);
+      TRef trpos = lj_opt_narrow_toint(J, J->base[1]);
+      ix.val = J->base[2];
+      if (pos <= len + 1) {
+	emitir(IRTGI(IR_LE), trpos, ix.key);
+	lj_record_idx(J, &ix);  /* Set new value. */
+	lj_ir_call(J, IRCALL_lj_tab_rotate, ix.tab, trpos, ix.key,
+		   lj_ir_kint(J, 1));
+      } else {  /* Beyond the border: t[pos] = v */
+	emitir(IRTGI(IR_GT), trpos, ix.key);
+	ix.key = trpos;
+	setintV(&ix.keyv, pos);
+	lj_record_idx(J, &ix);  /* Set new value. */
+      }
+    }
+  }  /* else: Interpreter will throw. */
+}
+
+static void LJ_FASTCALL recff_table_remove(jit_State *J, RecordFFData *rd)
+{
+  RecordIndex ix;
+  ix.tab = J->base[0];
+  rd->nres = 0;
+  if (tref_istab(ix.tab)) {
+    TRef trlen = lj_ir_call(J, IRCALL_lj_tab_len, ix.tab);
+    GCtab *t = tabV(&rd->argv[0]);
+    int32_t len = (int32_t)lj_tab_len(t), pos = len;
+    TRef trpos = trlen;
+    if (J->base[1] && !tref_isnil(J->base[1])) {
+      pos = argv2int(J, &rd->argv[1]);
+      trpos = lj_opt_narrow_toint(J, J->base[1]);
+    }
+    if (pos >= 1 && pos <= len) {
+      emitir(IRTGI(IR_GE), trpos, lj_ir_kint(J, 1));
+      if (trpos != trlen)
+	emitir(IRTGI(IR_LE), trpos, trlen);
+      ix.key = trpos;
+      settabV(J->L, &ix.tabv, t);
+      setintV(&ix.keyv, pos);
+      ix.val = 0; ix.idxchain = 0;
+      J->base[0] = lj_record_idx(J, &ix);  /* Load the old value. */
+      ix.val = TREF_NIL;
+      lj_record_idx(J, &ix);  /* Clear it. */
+      if (trpos != trlen)  /* Remove in the middle: rotate the gap out. */
+	lj_ir_call(J, IRCALL_lj_tab_rotate, ix.tab, trpos, trlen,
+		   lj_ir_kint(J, -1));
+      rd->nres = 1;
+    } else if (pos < 1) {  /* Out of bounds: nothing is removed. */
+      emitir(IRTGI(IR_LT), trpos, lj_ir_kint(J, 1));
+    } else {
+      emitir(IRTGI(IR_GT), trpos, trlen);
     }
   }  /* else: Interpreter will throw. */
 }
 
+static void LJ_FASTCALL recff_table_move(jit_State *J, RecordFFData *rd)
+{
+  TRef st = J->base[0], dt = J->base[4];
+  if (!dt || tref_isnil(dt)) dt = st;
+  if (tref_istab(st) && tref_istab(dt) && J->base[1] && J->base[2] &&
+      J->base[3]) {
+    TRef trf = lj_opt_narrow_toint(J, J->base[1]);
+    TRef tre = lj_opt_narrow_toint(J, J->base[2]);
+    TRef trt = lj_opt_narrow_toint(J, J->base[3]);
+    lj_ir_call(J, IRCALL_lj_tab_move, dt, st, trf, tre, trt);
+    J->base[0] = dt;
+  }  /* else: Interpreter will throw. */
+  UNUSED(rd);
+}
+
 static void LJ_FASTCALL recff_table_concat(jit_State *J, RecordFFData *rd)
 {
   TRef tab = J->base[0];
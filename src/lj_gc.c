@@ -11,6 +11,7 @@
 
 #include "lj_obj.h"
 #include "lj_gc.h"
+#include "lj_gcvisit.h"
 #include "lj_err.h"
 #include "lj_buf.h"
 #include "lj_str.h"
@@ -28,11 +29,25 @@
 #include "lj_dispatch.h"
 #include "lj_vm.h"
 #include "lj_vmevent.h"
+#include "lj_utils.h"
+#if LJ_HASGCTHREAD
+#include "lj_gcthread.h"
+#endif
 
 #define GCSTEPSIZE	1024u
 #define GCSWEEPMAX	40
 #define GCSWEEPCOST	10
 #define GCFINALIZECOST	100
+#define GCFINBATCH	64
+#define GCGENMINOR	20
+#define GCMINORMIN	64
+#define GCSOFTMUL	4
+#define GCTABCHUNK	1024
+#define GCSWEEPSTRBATCH	64
+#define GCSTRMOVE	64
+#define GCPARSTEP	(64u*1024u)
+#define GCPARBATCH	64
+#define GCPARCHECK	64
 
 /* Macros to set GCobj colors and flags. */
 #define white2gray(x)		((x)->gch.marked &= (uint8_t)~LJ_GC_WHITES)
@@ -41,42 +56,108 @@
 
 /* -- Mark phase ---------------------------------------------------------- */
 
+/* The marking functions push gray objects to the given gray list. This is
+** either the gray list of the collector or the local list of a parallel
+** marker (see gc_mark_par()).
+*/
+#define gc_gray(g)		(&(g)->gc.gray)
+
+#if LJ_HASGCTHREAD
+/* Parallel markers may reach the same object. The one that turns it gray
+** owns it, so only this transition needs to be atomic.
+*/
+#define gc_ispar(g, gray)	((gray) != gc_gray(g))
+
+/* Turn a white object gray. Returns 0 if it's marked by another marker. */
+static LJ_AINLINE int gc_claim(GCobj *o)
+{
+  uint8_t m = __atomic_load_n(&o->gch.marked, __ATOMIC_RELAXED);
+  do {
+    if (!(m & LJ_GC_WHITES))
+      return 0;
+  } while (!__atomic_compare_exchange_n(&o->gch.marked, &m,
+					(uint8_t)(m & ~LJ_GC_WHITES), 1,
+					__ATOMIC_RELAXED, __ATOMIC_RELAXED));
+  return 1;
+}
+
+#define gc_white2gray(g, gray, o) \
+  (gc_ispar(g, gray) ? gc_claim(o) : (white2gray(o), 1))
+#define gc_mark_strp(g, gray, s) \
+  (gc_ispar(g, gray) ? (void)__atomic_fetch_and(&(s)->marked, \
+		(uint8_t)~LJ_GC_WHITES, __ATOMIC_RELAXED) : (void)gc_mark_str(s))
+#else
+#define gc_ispar(g, gray)	(UNUSED(g), UNUSED(gray), 0)
+#define gc_white2gray(g, gray, o)	(UNUSED(gray), white2gray(o), 1)
+#define gc_mark_strp(g, gray, s)	gc_mark_str(s)
+#endif
+
 /* Mark a TValue (if needed). */
-#define gc_marktv(g, tv) \
+#define gc_marktv(g, gray, tv) \
   { lj_assertG(!tvisgcv(tv) || (~itype(tv) == gcval(tv)->gch.gct), \
 	       "TValue and GC type mismatch"); \
-    if (tviswhite(tv)) gc_mark(g, gcV(tv)); }
+    if (tviswhite(tv)) gc_mark(g, gray, gcV(tv)); }
 
 /* Mark a GCobj (if needed). */
-#define gc_markobj(g, o) \
-  { if (iswhite(obj2gco(o))) gc_mark(g, obj2gco(o)); }
+#define gc_markobj(g, gray, o) \
+  { if (iswhite(obj2gco(o))) gc_mark(g, gray, obj2gco(o)); }
 
 /* Mark a string object. */
 #define gc_mark_str(s)		((s)->marked &= (uint8_t)~LJ_GC_WHITES)
 
+static void gc_mark(global_State *g, GCRef *gray, GCobj *o);
+
+/* Context of the marking visitors. */
+typedef struct GCMarkCtx {
+  global_State *g;
+  GCRef *gray;
+} GCMarkCtx;
+
+/* Visitor of an object reference: mark the object. */
+static void gc_visitobj(void *ud, GCobj *o)
+{
+  GCMarkCtx *ctx = (GCMarkCtx *)ud;
+  global_State *g = ctx->g;
+#if LJ_HASJIT
+  lj_assertG(o->gch.gct != ~LJ_TTRACE ||
+	     gco2trace(o)->traceno != G2J(g)->cur.traceno,
+	     "active trace escaped");
+#endif
+  gc_markobj(g, ctx->gray, o);
+}
+
+/* Visitor of a value: mark it, unless the reference is weak. */
+static void gc_visittv(void *ud, cTValue *tv, int weak)
+{
+  GCMarkCtx *ctx = (GCMarkCtx *)ud;
+  global_State *g = ctx->g;
+  if (!weak) gc_marktv(g, ctx->gray, tv);
+}
+
 /* Mark a white GCobj. */
-static void gc_mark(global_State *g, GCobj *o)
+static void gc_mark(global_State *g, GCRef *gray, GCobj *o)
 {
   int gct = o->gch.gct;
-  lj_assertG(iswhite(o), "mark of non-white object");
+  lj_assertG(iswhite(o) || gc_ispar(g, gray), "mark of non-white object");
   lj_assertG(!isdead(g, o), "mark of dead object");
-  white2gray(o);
+  if (!gc_white2gray(g, gray, o))
+    return;  /* Already marked by another parallel marker. */
   if (LJ_UNLIKELY(gct == ~LJ_TUDATA)) {
-    GCtab *mt = tabref(gco2ud(o)->metatable);
+    GCMarkCtx ctx;
+    ctx.g = g; ctx.gray = gray;
     gray2black(o);  /* Userdata are never gray. */
-    if (mt) gc_markobj(g, mt);
-    gc_markobj(g, tabref(gco2ud(o)->env));
+    lj_gcvisit_udata(gco2ud(o), gc_visitobj, &ctx);
   } else if (LJ_UNLIKELY(gct == ~LJ_TUPVAL)) {
     GCupval *uv = gco2uv(o);
-    gc_marktv(g, uvval(uv));
+    gc_marktv(g, gray, uvval(uv));
     if (uv->closed)
       gray2black(o);  /* Closed upvalues are never gray. */
   } else if (gct != ~LJ_TSTR && gct != ~LJ_TCDATA) {
     lj_assertG(gct == ~LJ_TFUNC || gct == ~LJ_TTAB ||
 	       gct == ~LJ_TTHREAD || gct == ~LJ_TPROTO || gct == ~LJ_TTRACE,
 	       "bad GC type %d", gct);
-    setgcrefr(o->gch.gclist, g->gc.gray);
-    setgcref(g->gc.gray, o);
+    setgcrefr(o->gch.gclist, *gray);
+    setgcref(*gray, o);
   }
 }
 
@@ -86,18 +167,20 @@ static void gc_mark_gcroot(global_State *g)
   ptrdiff_t i;
   for (i = 0; i < GCROOT_MAX; i++)
     if (gcref(g->gcroot[i]) != NULL)
-      gc_markobj(g, gcref(g->gcroot[i]));
+      gc_markobj(g, gc_gray(g), gcref(g->gcroot[i]));
 }
 
 /* Start a GC cycle and mark the root set. */
 static void gc_mark_start(global_State *g)
 {
-  setgcrefnull(g->gc.gray);
-  setgcrefnull(g->gc.grayagain);
+  if (!g->gc.keepold) {  /* Full mark. Otherwise old objects stay marked. */
+    setgcrefnull(g->gc.gray);
+    setgcrefnull(g->gc.grayagain);
+  }
   setgcrefnull(g->gc.weak);
-  gc_markobj(g, mainthread(g));
-  gc_markobj(g, tabref(mainthread(g)->env));
-  gc_marktv(g, &g->registrytv);
+  gc_markobj(g, gc_gray(g), mainthread(g));
+  gc_markobj(g, gc_gray(g), tabref(mainthread(g)->env));
+  gc_marktv(g, gc_gray(g), &g->registrytv);
   gc_mark_gcroot(g);
   g->gc.state = GCSpropagate;
 }
@@ -110,7 +193,7 @@ static void gc_mark_uv(global_State *g)
     lj_assertG(uvprev(uvnext(uv)) == uv && uvnext(uvprev(uv)) == uv,
 	       "broken upvalue chain");
     if (isgray(obj2gco(uv)))
-      gc_marktv(g, uvval(uv));
+      gc_marktv(g, gc_gray(g), uvval(uv));
   }
 }
 
@@ -123,7 +206,7 @@ static void gc_mark_mmudata(global_State *g)
     do {
       u = gcnext(u);
       makewhite(g, u);  /* Could be from previous GC. */
-      gc_mark(g, u);
+      gc_mark(g, gc_gray(g), u);
     } while (u != root);
   }
 }
@@ -144,207 +227,239 @@ size_t lj_gc_separateudata(global_State *g, int all)
       m += sizeudata(gco2ud(o));
       markfinalized(o);
       *p = o->gch.nextgc;
-      if (gcref(g->gc.mmudata)) {  /* Link to end of mmudata list. */
-	GCobj *root = gcref(g->gc.mmudata);
-	setgcrefr(o->gch.nextgc, root->gch.nextgc);
-	setgcref(root->gch.nextgc, o);
-	setgcref(g->gc.mmudata, o);
-      } else {  /* Create circular list. */
-	setgcref(o->gch.nextgc, o);
-	setgcref(g->gc.mmudata, o);
-      }
+      lj_gc_finq_append(g, o);
     }
   }
   return m;
 }
 
+/*
+** Append an object to the finalization queue (the mmudata list).
+**
+** The objects are appended by the atomic phase and by the sweep steps. The
+** objects appended during one GC step share a mark with the time of the
+** first append, so the clock is checked once per step. The queue is FIFO,
+** so the oldest mark holds the time of the next object to be finalized.
+** When the ring of marks is full, the objects are added to the newest mark
+** and their time in the queue is overestimated.
+*/
+void lj_gc_finq_append(global_State *g, GCobj *o)
+{
+  size_t step = g->gc.state_count[GCSatomic] + g->gc.state_count[GCSsweep];
+  GCfinqMark *mark;
+  if (gcref(g->gc.mmudata)) {  /* Link to end of mmudata list. */
+    GCobj *root = gcref(g->gc.mmudata);
+    setgcrefr(o->gch.nextgc, root->gch.nextgc);
+    setgcref(root->gch.nextgc, o);
+    setgcref(g->gc.mmudata, o);
+  } else {  /* Create circular list. */
+    setgcref(o->gch.nextgc, o);
+    setgcref(g->gc.mmudata, o);
+  }
+  if (g->gc.finqnmark == 0 ||
+      (step != g->gc.finqstep && g->gc.finqnmark < GCFINQMARKS)) {
+    mark = &g->gc.finqmark[(g->gc.finqhead + g->gc.finqnmark++) %
+			   GCFINQMARKS];
+    mark->time = lj_utils_time_ns();
+    mark->n = 0;
+    g->gc.finqstep = step;
+  } else {
+    mark = &g->gc.finqmark[(g->gc.finqhead + g->gc.finqnmark - 1) %
+			   GCFINQMARKS];
+  }
+  mark->n++;
+  g->gc.finqlen++;
+}
+
 /* -- Propagation phase --------------------------------------------------- */
 
-/* Traverse a table. */
-static int gc_traverse_tab(global_State *g, GCtab *t)
+/* Link a table or a thread to a list shared by the parallel markers. */
+static void gc_linkshared(global_State *g, GCRef *gray, GCRef *list, GCobj *o)
 {
-  int weak = 0;
+#if LJ_HASGCTHREAD
+  if (gc_ispar(g, gray)) {
+    GCThread *gt = gcthread(g);
+    lj_gcthread_lock(gt);
+    setgcrefr(o->gch.gclist, *list);
+    setgcref(*list, o);
+    lj_gcthread_unlock(gt);
+    return;
+  }
+#else
+  UNUSED(g); UNUSED(gray);
+#endif
+  setgcrefr(o->gch.gclist, *list);
+  setgcref(*list, o);
+}
+
+/* Mark the metatable of a table and check its mode. Returns the weak mode. */
+static int gc_traverse_tabmode(global_State *g, GCRef *gray, GCtab *t)
+{
+  int weak;
   cTValue *mode;
   GCtab *mt = tabref(t->metatable);
   if (mt)
-    gc_markobj(g, mt);
-  mode = lj_meta_fastg(g, mt, MM_mode);
-  if (mode && tvisstr(mode)) {  /* Valid __mode field? */
-    const char *modestr = strVdata(mode);
-    int c;
-    while ((c = *modestr++)) {
-      if (c == 'k') weak |= LJ_GC_WEAKKEY;
-      else if (c == 'v') weak |= LJ_GC_WEAKVAL;
-    }
-    if (weak) {  /* Weak tables are cleared in the atomic phase. */
+    gc_markobj(g, gray, mt);
+  if (gc_ispar(g, gray))  /* Don't update the metamethod cache concurrently. */
+    mode = mt && !(mt->nomm & (1u<<MM_mode)) ?
+	   lj_tab_getstr(mt, mmname_str(g, MM_mode)) : NULL;
+  else
+    mode = lj_meta_fastg(g, mt, MM_mode);
+  weak = lj_gcvisit_weakmode(mode);
+  if (weak) {  /* Weak tables are cleared in the atomic phase. */
 #if LJ_HASFFI
-      CTState *cts = ctype_ctsG(g);
-      if (cts && cts->finalizer == t) {
-	weak = (int)(~0u & ~LJ_GC_WEAKVAL);
-      } else
+    CTState *cts = ctype_ctsG(g);
+    if (cts && cts->finalizer == t) {
+      weak = (int)(~0u & ~LJ_GC_WEAKVAL);
+    } else
 #endif
-      {
-	t->marked = (uint8_t)((t->marked & ~LJ_GC_WEAK) | weak);
-	setgcrefr(t->gclist, g->gc.weak);
-	setgcref(g->gc.weak, obj2gco(t));
-      }
-    }
-  }
-  if (weak == LJ_GC_WEAK)  /* Nothing to mark if both keys/values are weak. */
-    return 1;
-  if (!(weak & LJ_GC_WEAKVAL)) {  /* Mark array part. */
-    MSize i, asize = t->asize;
-    for (i = 0; i < asize; i++)
-      gc_marktv(g, arrayslot(t, i));
-  }
-  if (t->hmask > 0) {  /* Mark hash part. */
-    Node *node = noderef(t->node);
-    MSize i, hmask = t->hmask;
-    for (i = 0; i <= hmask; i++) {
-      Node *n = &node[i];
-      if (!tvisnil(&n->val)) {  /* Mark non-empty slot. */
-	lj_assertG(!tvisnil(&n->key), "mark of nil key in non-empty slot");
-	if (!(weak & LJ_GC_WEAKKEY)) gc_marktv(g, &n->key);
-	if (!(weak & LJ_GC_WEAKVAL)) gc_marktv(g, &n->val);
-      }
+    {
+      t->marked = (uint8_t)((t->marked & ~LJ_GC_WEAK) | weak);
+      gc_linkshared(g, gray, &g->gc.weak, obj2gco(t));
     }
   }
   return weak;
 }
 
-/* Traverse a function. */
-static void gc_traverse_func(global_State *g, GCfunc *fn)
-{
-  gc_markobj(g, tabref(fn->c.env));
-  if (isluafunc(fn)) {
-    uint32_t i;
-    lj_assertG(fn->l.nupvalues <= funcproto(fn)->sizeuv,
-	       "function upvalues out of range");
-    gc_markobj(g, funcproto(fn));
-    for (i = 0; i < fn->l.nupvalues; i++)  /* Mark Lua function upvalues. */
-      gc_markobj(g, &gcref(fn->l.uvptr[i])->uv);
-  } else {
-    uint32_t i;
-    for (i = 0; i < fn->c.nupvalues; i++)  /* Mark C function upvalues. */
-      gc_marktv(g, &fn->c.upvalue[i]);
+/* Mark the slots [start, end) of a table, see lj_gcvisit_tabslots(). */
+static void gc_traverse_tabslots(global_State *g, GCRef *gray, GCtab *t,
+				 int weak, MSize start, MSize end)
+{
+  GCMarkCtx ctx;
+  ctx.g = g; ctx.gray = gray;
+  lj_gcvisit_tabslots(t, weak, 0, start, end, gc_visittv, &ctx);
+}
+
+/* Traverse the next chunk of a large table. Returns the cost estimate. */
+static size_t gc_traverse_tabchunk(global_State *g)
+{
+  GCtab *t = gco2tab(gcref(g->gc.travtab));
+  MSize start = g->gc.travpos, end = lj_gcvisit_ntabslots(t);
+  MSize asize = t->asize;
+  if (!isblack(obj2gco(t))) {
+    /* Hit by a barrier or resized, it is retraversed in the atomic phase. */
+    setgcrefnull(g->gc.travtab);
+    return 0;
   }
+  if (end - start > GCTABCHUNK)
+    end = start + GCTABCHUNK;
+  else
+    setgcrefnull(g->gc.travtab);  /* Last chunk. */
+  gc_traverse_tabslots(g, gc_gray(g), t, 0, start, end);
+  g->gc.travpos = end;
+  if (start >= asize)
+    return sizeof(Node) * (end - start);
+  if (end <= asize)
+    return sizeof(TValue) * (end - start);
+  return sizeof(TValue) * (asize - start) + sizeof(Node) * (end - asize);
+}
+
+/* Traverse a function. */
+static void gc_traverse_func(global_State *g, GCRef *gray, GCfunc *fn)
+{
+  GCMarkCtx ctx;
+  ctx.g = g; ctx.gray = gray;
+  lj_assertG(!isluafunc(fn) || fn->l.nupvalues <= funcproto(fn)->sizeuv,
+	     "function upvalues out of range");
+  lj_gcvisit_func(fn, gc_visitobj, gc_visittv, &ctx);
 }
 
 #if LJ_HASJIT
 /* Mark a trace. */
-static void gc_marktrace(global_State *g, TraceNo traceno)
+static void gc_marktrace(global_State *g, GCRef *gray, TraceNo traceno)
 {
-  GCobj *o = obj2gco(traceref(G2J(g), traceno));
-  lj_assertG(traceno != G2J(g)->cur.traceno, "active trace escaped");
-  if (iswhite(o)) {
-    white2gray(o);
-    setgcrefr(o->gch.gclist, g->gc.gray);
-    setgcref(g->gc.gray, o);
-  }
+  GCMarkCtx ctx;
+  ctx.g = g; ctx.gray = gray;
+  gc_visitobj(&ctx, obj2gco(traceref(G2J(g), traceno)));
 }
 
 /* Traverse a trace. */
-static void gc_traverse_trace(global_State *g, GCtrace *T)
+static void gc_traverse_trace(global_State *g, GCRef *gray, GCtrace *T)
 {
-  IRRef ref;
-  if (T->traceno == 0) return;
-  for (ref = T->nk; ref < REF_TRUE; ref++) {
-    IRIns *ir = &T->ir[ref];
-    if (ir->o == IR_KGC)
-      gc_markobj(g, ir_kgc(ir));
-    if (irt_is64(ir->t) && ir->o != IR_KNULL)
-      ref++;
-  }
-  if (T->link) gc_marktrace(g, T->link);
-  if (T->nextroot) gc_marktrace(g, T->nextroot);
-  if (T->nextside) gc_marktrace(g, T->nextside);
-  gc_markobj(g, gcref(T->startpt));
+  GCMarkCtx ctx;
+  ctx.g = g; ctx.gray = gray;
+  lj_gcvisit_trace(g, T, gc_visitobj, &ctx);
 }
 
 /* The current trace is a GC root while not anchored in the prototype (yet). */
-#define gc_traverse_curtrace(g)	gc_traverse_trace(g, &G2J(g)->cur)
+#define gc_traverse_curtrace(g) \
+  gc_traverse_trace(g, gc_gray(g), &G2J(g)->cur)
 #else
 #define gc_traverse_curtrace(g)	UNUSED(g)
 #endif
 
 /* Traverse a prototype. */
-static void gc_traverse_proto(global_State *g, GCproto *pt)
+static void gc_traverse_proto(global_State *g, GCRef *gray, GCproto *pt)
 {
-  ptrdiff_t i;
-  gc_mark_str(proto_chunkname(pt));
-  for (i = -(ptrdiff_t)pt->sizekgc; i < 0; i++)  /* Mark collectable consts. */
-    gc_markobj(g, proto_kgc(pt, i));
-#if LJ_HASJIT
-  if (pt->trace) gc_marktrace(g, pt->trace);
-#endif
-}
-
-/* Traverse the frame structure of a stack. */
-static MSize gc_traverse_frames(global_State *g, lua_State *th)
-{
-  TValue *frame, *top = th->top-1, *bot = tvref(th->stack);
-  /* Note: extra vararg frame not skipped, marks function twice (harmless). */
-  for (frame = th->base-1; frame > bot+LJ_FR2; frame = frame_prev(frame)) {
-    GCfunc *fn = frame_func(frame);
-    TValue *ftop = frame;
-    if (isluafunc(fn)) ftop += funcproto(fn)->framesize;
-    if (ftop > top) top = ftop;
-    if (!LJ_FR2) gc_markobj(g, fn);  /* Need to mark hidden function (or L). */
-  }
-  top++;  /* Correct bias of -1 (frame == base-1). */
-  if (top > tvref(th->maxstack)) top = tvref(th->maxstack);
-  return (MSize)(top - bot);  /* Return minimum needed stack size. */
+  GCMarkCtx ctx;
+  ctx.g = g; ctx.gray = gray;
+  lj_gcvisit_proto(g, pt, gc_visitobj, &ctx);
 }
 
 /* Traverse a thread object. */
-static void gc_traverse_thread(global_State *g, lua_State *th)
+static void gc_traverse_thread(global_State *g, GCRef *gray, lua_State *th)
 {
-  TValue *o, *top = th->top;
-  for (o = tvref(th->stack)+1+LJ_FR2; o < top; o++)
-    gc_marktv(g, o);
+  GCMarkCtx ctx;
+  MSize size;
+  ctx.g = g; ctx.gray = gray;
+  lj_gcvisit_thread(th, gc_visitobj, gc_visittv, &ctx);
   if (g->gc.state == GCSatomic) {
-    top = tvref(th->stack) + th->stacksize;
-    for (; o < top; o++)  /* Clear unmarked slots. */
+    TValue *o, *top = tvref(th->stack) + th->stacksize;
+    for (o = th->top; o < top; o++)  /* Clear unmarked slots. */
       setnilV(o);
   }
-  gc_markobj(g, tabref(th->env));
-  lj_state_shrinkstack(th, gc_traverse_frames(g, th));
+  size = lj_gcvisit_frames(th, gc_visitobj, &ctx);
+  if (!gc_ispar(g, gray))  /* Parallel markers must not allocate. */
+    lj_state_shrinkstack(th, size);
 }
 
 /* Propagate one gray object. Traverse it and turn it black. */
-static size_t propagatemark(global_State *g)
+static size_t propagatemark(global_State *g, GCRef *gray)
 {
-  GCobj *o = gcref(g->gc.gray);
+  GCobj *o = gcref(*gray);
   int gct = o->gch.gct;
   lj_assertG(isgray(o), "propagation of non-gray object");
   gray2black(o);
-  setgcrefr(g->gc.gray, o->gch.gclist);  /* Remove from gray list. */
+  setgcrefr(*gray, o->gch.gclist);  /* Remove from gray list. */
   if (LJ_LIKELY(gct == ~LJ_TTAB)) {
     GCtab *t = gco2tab(o);
-    if (gc_traverse_tab(g, t) > 0)
+    int weak = gc_traverse_tabmode(g, gray, t);
+    if (weak == 0 && g->gc.budget && g->gc.state != GCSatomic &&
+	!gc_ispar(g, gray) && !tabiscow(t) &&
+	lj_gcvisit_ntabslots(t) > GCTABCHUNK) {
+      /* Traverse a large table in chunks to fit into the time budget. */
+      setgcref(g->gc.travtab, o);
+      g->gc.travpos = 0;
+      return sizeof(GCtab) + gc_traverse_tabchunk(g);
+    }
+    if (weak > 0)
       black2gray(o);  /* Keep weak tables gray. */
-    return sizeof(GCtab) + sizeof(TValue) * t->asize +
-			   (t->hmask ? sizeof(Node) * (t->hmask + 1) : 0);
+    /* Nothing to mark if both keys/values are weak, except the template. */
+    if (weak != LJ_GC_WEAK || tabiscow(t)) {
+      GCMarkCtx ctx;
+      ctx.g = g; ctx.gray = gray;
+      lj_gcvisit_tab(t, weak, 0, gc_visitobj, gc_visittv, &ctx);
+    }
+    return lj_gcvisit_tabsize(t);
   } else if (LJ_LIKELY(gct == ~LJ_TFUNC)) {
     GCfunc *fn = gco2func(o);
-    gc_traverse_func(g, fn);
+    gc_traverse_func(g, gray, fn);
     return isluafunc(fn) ? sizeLfunc((MSize)fn->l.nupvalues) :
 			   sizeCfunc((MSize)fn->c.nupvalues);
   } else if (LJ_LIKELY(gct == ~LJ_TPROTO)) {
     GCproto *pt = gco2pt(o);
-    gc_traverse_proto(g, pt);
+    gc_traverse_proto(g, gray, pt);
     return pt->sizept;
   } else if (LJ_LIKELY(gct == ~LJ_TTHREAD)) {
     lua_State *th = gco2th(o);
-    setgcrefr(th->gclist, g->gc.grayagain);
-    setgcref(g->gc.grayagain, o);
+    gc_linkshared(g, gray, &g->gc.grayagain, o);
     black2gray(o);  /* Threads are never black. */
-    gc_traverse_thread(g, th);
+    gc_traverse_thread(g, gray, th);
     return sizeof(lua_State) + sizeof(TValue) * th->stacksize;
   } else {
 #if LJ_HASJIT
     GCtrace *T = gco2trace(o);
-    gc_traverse_trace(g, T);
+    gc_traverse_trace(g, gray, T);
     return ((sizeof(GCtrace)+7)&~7) + (T->nins-T->nk)*sizeof(IRIns) +
 	   T->nsnap*sizeof(SnapShot) + T->nsnapmap*sizeof(SnapEntry);
 #else
@@ -359,10 +474,131 @@ static size_t gc_propagate_gray(global_State *g)
 {
   size_t m = 0;
   while (gcref(g->gc.gray) != NULL)
-    m += propagatemark(g);
+    m += propagatemark(g, gc_gray(g));
   return m;
 }
 
+#if LJ_HASGCTHREAD
+/* Move up to n objects from the head of a gray list to another one. */
+static void gc_graymove(GCRef *dst, GCRef *src, MSize n)
+{
+  GCobj *head = gcref(*src), *o = head;
+  if (o == NULL)
+    return;
+  while (--n > 0 && gcref(o->gch.gclist) != NULL)
+    o = gcref(o->gch.gclist);
+  setgcrefr(*src, o->gch.gclist);
+  setgcrefr(o->gch.gclist, *dst);
+  setgcref(*dst, head);
+}
+
+/* Account the work of a parallel marker. Returns 1 if the job is stopped. */
+static int gc_mark_par_account(GCThread *gt, size_t work)
+{
+  size_t total = __atomic_add_fetch(&gt->markwork, work, __ATOMIC_RELAXED);
+  if (total >= gt->marklim ||
+      (gt->markdeadline && lj_utils_time_ns() >= gt->markdeadline))
+    __atomic_store_n(&gt->markstop, 1, __ATOMIC_RELAXED);
+  return __atomic_load_n(&gt->markstop, __ATOMIC_RELAXED);
+}
+
+/* Propagate the local gray objects of a parallel marker, until there are
+** none left or the job is stopped. Shares them with the waiting markers.
+*/
+static void gc_mark_par_local(global_State *g, GCThread *gt, GCRef *gray)
+{
+  size_t work = 0;
+  MSize n = 0;
+  while (gcref(*gray) != NULL) {
+    work += propagatemark(g, gray);
+    if (++n < GCPARCHECK)
+      continue;
+    n = 0;
+    if (gc_mark_par_account(gt, work))
+      return;
+    work = 0;
+    if (__atomic_load_n(&gt->waiting, __ATOMIC_RELAXED) &&
+	gcref(*gray) != NULL && gcref(gcref(*gray)->gch.gclist) != NULL) {
+      /* Keep the head of the list, share the objects following it. */
+      lj_gcthread_lock(gt);
+      gc_graymove(&gt->markpool, &gcref(*gray)->gch.gclist, GCPARBATCH);
+      pthread_cond_broadcast(&gt->markshare);
+      lj_gcthread_unlock(gt);
+    }
+  }
+  gc_mark_par_account(gt, work);
+}
+
+/* Mark job run by the collector and the marker threads. A marker takes a
+** batch of gray objects from the shared pool and propagates them, pushing
+** the objects it marks to its local gray list. The job is finished when
+** all the markers are out of gray objects or the work limit is reached.
+*/
+static void gc_mark_par(global_State *g)
+{
+  GCThread *gt = gcthread(g);
+  GCRef gray;
+  setgcrefnull(gray);
+  lj_gcthread_lock(gt);
+  if (gt->markdone) {  /* Woken up too late. */
+    lj_gcthread_unlock(gt);
+    return;
+  }
+  gt->active++;
+  while (!__atomic_load_n(&gt->markstop, __ATOMIC_RELAXED)) {
+    if (gcref(gt->markpool) != NULL) {
+      gc_graymove(&gray, &gt->markpool, GCPARBATCH);
+      lj_gcthread_unlock(gt);
+      gc_mark_par_local(g, gt, &gray);
+      lj_gcthread_lock(gt);
+      gc_graymove(&gt->markpool, &gray, ~(MSize)0);  /* Return left-overs. */
+      continue;
+    }
+    if (gt->waiting + 1 == gt->active)
+      break;  /* All gray objects are propagated. */
+    __atomic_add_fetch(&gt->waiting, 1, __ATOMIC_RELAXED);
+    pthread_cond_wait(&gt->markshare, &gt->lock);
+    __atomic_sub_fetch(&gt->waiting, 1, __ATOMIC_RELAXED);
+    if (gt->markdone)
+      break;
+  }
+  if (!gt->markdone) {
+    gt->markdone = 1;
+    pthread_cond_broadcast(&gt->markshare);
+  }
+  if (--gt->active == 0)
+    pthread_cond_broadcast(&gt->markidle);
+  lj_gcthread_unlock(gt);
+}
+
+/* Propagate gray objects together with the marker threads. */
+static size_t gc_propagate_par(global_State *g)
+{
+  GCThread *gt = gcthread(g);
+  size_t work;
+  lj_gcthread_lock(gt);
+  setgcrefr(gt->markpool, g->gc.gray);
+  setgcrefnull(g->gc.gray);
+  gt->markwork = 0;
+  gt->marklim = GCPARSTEP * (gt->nmarkers + 1);
+  gt->markdeadline = g->gc.budget ?
+		     lj_utils_time_ns() + (uint64_t)g->gc.budget * 1000 : 0;
+  gt->markstop = 0;
+  gt->markdone = 0;
+  lj_gcthread_unlock(gt);
+  lj_gcthread_postmark(gt, gc_mark_par);
+  gc_mark_par(g);
+  lj_gcthread_lock(gt);
+  while (gt->active > 0)
+    pthread_cond_wait(&gt->markidle, &gt->lock);
+  setgcrefr(g->gc.gray, gt->markpool);  /* Left-overs for the next step. */
+  setgcrefnull(gt->markpool);
+  work = gt->markwork;
+  lj_gcthread_unlock(gt);
+  return work;
+}
+#endif
+
 /* -- Sweep phase --------------------------------------------------------- */
 
 /* Type of GC free functions. */
@@ -399,12 +635,22 @@ static GCRef *gc_sweep(global_State *g, GCRef *p, uint32_t lim)
   int ow = otherwhite(g);
   GCobj *o;
   while ((o = gcref(*p)) != NULL && lim-- > 0) {
+    if (g->gc.keepold && isold(o))
+      break;  /* Reached the old generation, which is not swept. */
     if (o->gch.gct == ~LJ_TTHREAD)  /* Need to sweep open upvalues, too. */
       gc_fullsweep(g, &gco2th(o)->openupval);
     if (((o->gch.marked ^ LJ_GC_WHITES) & ow)) {  /* Black or current white? */
       lj_assertG(!isdead(g, o) || (o->gch.marked & LJ_GC_FIXED),
 		 "sweep of undead object");
-      makewhite(g, o);  /* Value is alive, change to the current white. */
+      if (o->gch.gct == ~LJ_TCDATA) {
+	if (!g->gc.keepold)
+	  makewhite(g, o);  /* Cdata stay young, the bit is used for VLAs. */
+      } else if (!g->gc.keepold) {
+	makewhite(g, o);  /* Value is alive, change to the current white. */
+	o->gch.marked &= (uint8_t)~LJ_GC_OLD;
+      } else if (!iswhite(o)) {
+	o->gch.marked |= LJ_GC_OLD;  /* Marked value becomes old. */
+      }
       p = &o->gch.nextgc;
     } else {  /* Otherwise value is dead, free it. */
       lj_assertG(isdead(g, o) || ow == LJ_GC_SFIXED,
@@ -418,17 +664,36 @@ static GCRef *gc_sweep(global_State *g, GCRef *p, uint32_t lim)
   return p;
 }
 
-/* Full sweep of a string chain. */
-static GCRef *gc_sweep_str_chain(global_State *g, GCRef *p)
+#if LJ_HASGCTHREAD
+/* Whiten a string. Atomic, since fixstring() may race with the helper. */
+#define gc_makewhite_str(g, o) \
+  (__atomic_fetch_and(&(o)->gch.marked, (uint8_t)~(LJ_GC_COLORS|LJ_GC_OLD), \
+		      __ATOMIC_RELAXED), \
+   __atomic_fetch_or(&(o)->gch.marked, (uint8_t)curwhite(g), __ATOMIC_RELAXED))
+#else
+#define gc_makewhite_str(g, o) \
+  (makewhite(g, o), (o)->gch.marked &= (uint8_t)~LJ_GC_OLD)
+#endif
+
+/* Full sweep of a string chain. Dead strings are freed or, if the chain is
+** swept on the helper thread, moved to the dead list to be freed later.
+*/
+static GCRef *gc_sweep_str_chain(global_State *g, GCRef *p, GCRef *dead)
 {
   /* Mask with other white and LJ_GC_FIXED. Or LJ_GC_SFIXED on shutdown. */
   int ow = otherwhite(g);
   GCobj *o;
   while ((o = gcref(*p)) != NULL) {
+    if ((o->gch.marked & LJ_GC_OLD) && g->gc.keepold)
+      break;  /* New strings are prepended, the rest of the chain is old. */
     if (((o->gch.marked ^ LJ_GC_WHITES) & ow)) {  /* Black or current white? */
       lj_assertG(!isdead(g, o) || (o->gch.marked & LJ_GC_FIXED),
 		 "sweep of undead string");
-      makewhite(g, o);  /* Value is alive, change to the current white. */
+      if (!g->gc.keepold) {
+	gc_makewhite_str(g, o);  /* Value is alive, change to the current white. */
+      } else if (!iswhite(o)) {
+	o->gch.marked |= LJ_GC_OLD;  /* Marked value becomes old. */
+      }
 #if LUAJIT_SMART_STRINGS
       if (strsmart(&o->str)) {
 	/* must match lj_str_new */
@@ -441,12 +706,69 @@ static GCRef *gc_sweep_str_chain(global_State *g, GCRef *p)
       lj_assertG(isdead(g, o) || ow == LJ_GC_SFIXED,
 		 "sweep of unlive string");
       setgcrefr(*p, o->gch.nextgc);
-      lj_str_free(g, &o->str);
+      if (dead) {
+	setgcrefr(o->gch.nextgc, *dead);
+	setgcref(*dead, o);
+      } else {
+	lj_str_free(g, &o->str);
+      }
     }
   }
   return p;
 }
 
+#if LJ_HASGCTHREAD
+/* Sweep batches of string chains on the helper thread. */
+static void gc_sweepstr_job(global_State *g)
+{
+  GCThread *gt = gcthread(g);
+  for (;;) {
+    MSize i, n;
+    lj_gcthread_lock(gt);
+    i = g->gc.sweepstr;
+    n = lj_gcvisit_nstrchains(g);
+    if (i >= n) {
+      lj_gcthread_unlock(gt);
+      break;
+    }
+    if (n - i > GCSWEEPSTRBATCH)
+      n = i + GCSWEEPSTRBATCH;
+    g->gc.sweepstr = n;
+    for (; i < n; i++)
+      gc_sweep_str_chain(g, lj_gcvisit_strchain(g, i), &gt->deadstr);
+    lj_gcthread_unlock(gt);
+  }
+}
+
+/* Sweep one string chain along with the helper thread and free the strings
+** unlinked by it. Returns 1 if all string chains are swept.
+*/
+static int gc_sweepstr_shared(global_State *g)
+{
+  GCThread *gt = gcthread(g);
+  GCobj *o;
+  int done;
+  lj_gcthread_lock(gt);
+  if (g->gc.sweepstr < lj_gcvisit_nstrchains(g))
+    gc_sweep_str_chain(g, lj_gcvisit_strchain(g, g->gc.sweepstr++),
+		       &gt->deadstr);
+  done = g->gc.sweepstr >= lj_gcvisit_nstrchains(g);
+  if (done)
+    lj_gcthread_wait(gt);  /* Nothing is left, the helper finishes quickly. */
+  o = gcref(gt->deadstr);
+  setgcrefnull(gt->deadstr);
+  lj_gcthread_unlock(gt);
+  while (o) {  /* The allocator is called without holding the lock. */
+    GCobj *next = gcnext(o);
+    lj_str_free(g, &o->str);
+    o = next;
+  }
+  if (done)
+    g->gc.strlock = 0;
+  return done;
+}
+#endif
+
 /* Check whether we can clear a key or a value slot from a table. */
 static int gc_mayclear(cTValue *o, int val)
 {
@@ -463,6 +785,19 @@ static int gc_mayclear(cTValue *o, int val)
   return 0;  /* Cannot clear. */
 }
 
+/* Clear collected entries from the hash slots of a weak table. */
+static void gc_clearnodes(Node *node, MSize hmask)
+{
+  MSize i;
+  for (i = 0; i <= hmask; i++) {
+    Node *n = &node[i];
+    /* Clear hash slot when key or value is about to be collected. */
+    if (!tvisnil(&n->val) && (gc_mayclear(&n->key, 0) ||
+			      gc_mayclear(&n->val, 1)))
+      setnilV(&n->val);
+  }
+}
+
 /* Clear collected entries from weak tables. */
 static void gc_clearweak(global_State *g, GCobj *o)
 {
@@ -470,6 +805,10 @@ static void gc_clearweak(global_State *g, GCobj *o)
   while (o) {
     GCtab *t = gco2tab(o);
     lj_assertG((t->marked & LJ_GC_WEAK), "clear of non-weak table");
+    if (tabiscow(t)) {  /* The constants of the template are never cleared. */
+      o = gcref(t->gclist);
+      continue;
+    }
     if ((t->marked & LJ_GC_WEAKVAL)) {
       MSize i, asize = t->asize;
       for (i = 0; i < asize; i++) {
@@ -479,30 +818,50 @@ static void gc_clearweak(global_State *g, GCobj *o)
 	  setnilV(tv);
       }
     }
-    if (t->hmask > 0) {
-      Node *node = noderef(t->node);
-      MSize i, hmask = t->hmask;
-      for (i = 0; i <= hmask; i++) {
-	Node *n = &node[i];
-	/* Clear hash slot when key or value is about to be collected. */
-	if (!tvisnil(&n->val) && (gc_mayclear(&n->key, 0) ||
-				  gc_mayclear(&n->val, 1)))
-	  setnilV(&n->val);
-      }
-    }
+    if (t->hmask > 0)
+      gc_clearnodes(noderef(t->node), t->hmask);
+    if (t->oldhmask > 0)
+      gc_clearnodes(noderef(t->oldnode), t->oldhmask);
     o = gcref(t->gclist);
   }
 }
 
-/* Call a userdata or cdata finalizer. */
+/* Old weak tables are never black, so stores bypass the table barrier.
+** Put them on the gray-again list to retraverse them in the next cycle.
+*/
+static void gc_keepweak(global_State *g)
+{
+  GCobj *o = gcref(g->gc.weak);
+  while (o) {
+    GCtab *t = gco2tab(o);
+    o = gcref(t->gclist);
+    setgcrefr(t->gclist, g->gc.grayagain);
+    setgcref(g->gc.grayagain, obj2gco(t));
+  }
+  setgcrefnull(g->gc.weak);
+#if LJ_HASFFI
+  {  /* Ditto for the finalizer table, which is kept gray, too. */
+    CTState *cts = ctype_ctsG(g);
+    if (cts && isgray(obj2gco(cts->finalizer))) {
+      setgcrefr(cts->finalizer->gclist, g->gc.grayagain);
+      setgcref(g->gc.grayagain, obj2gco(cts->finalizer));
+    }
+  }
+#endif
+}
+
+/* Call a userdata or cdata finalizer for n objects. */
 static void gc_call_finalizer(global_State *g, lua_State *L,
-			      cTValue *mo, GCobj *o)
+			      cTValue *mo, GCobj **o, MSize n)
 {
   /* Save and restore lots of state around the __gc callback. */
   uint8_t oldh = hook_save(g);
   GCSize oldt = g->gc.threshold;
   int errcode;
   TValue *top;
+  MSize i;
+  if (n > 1)
+    lj_state_checkstack(L, 1+LJ_FR2+n);
   lj_trace_abort(g);
   hook_entergc(g);  /* Disable hooks and new traces during __gc. */
   if (LJ_HASPROFILE && (oldh & HOOK_PROFILE)) lj_dispatch_update(g);
@@ -510,9 +869,10 @@ static void gc_call_finalizer(global_State *g, lua_State *L,
   top = L->top;
   copyTV(L, top++, mo);
   if (LJ_FR2) setnilV(top++);
-  setgcV(L, top, o, ~o->gch.gct);
-  L->top = top+1;
-  errcode = lj_vm_pcall(L, top, 1+0, -1);  /* Stack: |mo|o| -> | */
+  for (i = 0; i < n; i++)
+    setgcV(L, top+i, o[i], ~o[i]->gch.gct);
+  L->top = top+n;
+  errcode = lj_vm_pcall(L, top, 1+0, -1);  /* Stack: |mo|o...| -> | */
   hook_restore(g, oldh);
   if (LJ_HASPROFILE && (oldh & HOOK_PROFILE)) lj_dispatch_update(g);
   g->gc.threshold = oldt;  /* Restore GC threshold. */
@@ -525,36 +885,99 @@ static void gc_call_finalizer(global_State *g, lua_State *L,
   }
 }
 
-/* Finalize one userdata or cdata object from the mmudata list. */
-static void gc_finalize(lua_State *L)
+/* Unchain the first object from the finalization queue. */
+static GCobj *gc_finq_pop(global_State *g)
 {
-  global_State *g = G(L);
   GCobj *o = gcnext(gcref(g->gc.mmudata));
-  cTValue *mo;
-  lj_assertG(tvref(g->jit_base) == NULL, "finalizer called on trace");
-  /* Unchain from list of userdata to be finalized. */
+  GCfinqMark *mark = &g->gc.finqmark[g->gc.finqhead];
+  uint64_t lat = lj_utils_time_ns() - mark->time;
+  lj_assertG(g->gc.finqnmark > 0 && mark->n > 0,
+	     "bad finalization queue mark");
+  if (--mark->n == 0) {  /* All objects of the oldest mark are taken. */
+    g->gc.finqhead = (g->gc.finqhead + 1) % GCFINQMARKS;
+    g->gc.finqnmark--;
+  }
   if (o == gcref(g->gc.mmudata))
     setgcrefnull(g->gc.mmudata);
   else
     setgcrefr(gcref(g->gc.mmudata)->gch.nextgc, o->gch.nextgc);
+  g->gc.finqlen--;
+  g->gc.finalized++;
+  g->gc.finlat += lat;
+  if (lat > g->gc.finlat_max)
+    g->gc.finlat_max = lat;
+  return o;
+}
+
+#if LJ_HASFFI
+/* Add cdata back to the GC list and make it white. */
+static void gc_cdata_revive(global_State *g, GCobj *o)
+{
+  setgcrefr(o->gch.nextgc, g->gc.root);
+  setgcref(g->gc.root, o);
+  makewhite(g, o);
+  o->gch.marked &= (uint8_t)~LJ_GC_CDATA_FIN;
+}
+
+/* Take the cdata objects following in the finalization queue, which have
+** the same batch finalizer. Returns the number of objects in the batch.
+*/
+static MSize gc_finalize_batch(lua_State *L, cTValue *fin, GCobj **batch)
+{
+  global_State *g = G(L);
+  GCtab *t = ctype_ctsG(g)->finalizer;
+  MSize n = 1;
+  while (n < GCFINBATCH && gcref(g->gc.mmudata) != NULL) {
+    GCobj *o = gcnext(gcref(g->gc.mmudata));
+    TValue key;
+    cTValue *tv;
+    if (o->gch.gct != ~LJ_TCDATA)
+      break;
+    setcdataV(L, &key, gco2cd(o));
+    tv = lj_tab_get(L, t, &key);
+    if (!tvisfunc(tv) || funcV(tv) != funcV(fin))
+      break;
+    setnilV((TValue *)tv);  /* Clear entry in finalizer table. */
+    gc_finq_pop(g);
+    gc_cdata_revive(g, o);
+    batch[n++] = o;
+  }
+  return n;
+}
+#endif
+
+/* Finalize one userdata or cdata object from the mmudata list. Cdata
+** objects with a batch finalizer are finalized along with the following
+** ones, which share the same finalizer.
+*/
+static MSize gc_finalize(lua_State *L)
+{
+  global_State *g = G(L);
+  GCobj *o;
+  cTValue *mo;
+  lj_assertG(tvref(g->jit_base) == NULL, "finalizer called on trace");
+  o = gc_finq_pop(g);  /* Unchain from list of userdata to be finalized. */
 #if LJ_HASFFI
   if (o->gch.gct == ~LJ_TCDATA) {
+    CTState *cts = ctype_ctsG(g);
     TValue tmp, *tv;
-    /* Add cdata back to the GC list and make it white. */
-    setgcrefr(o->gch.nextgc, g->gc.root);
-    setgcref(g->gc.root, o);
-    makewhite(g, o);
-    o->gch.marked &= (uint8_t)~LJ_GC_CDATA_FIN;
+    gc_cdata_revive(g, o);
     /* Resolve finalizer. */
     setcdataV(L, &tmp, gco2cd(o));
-    tv = lj_tab_set(L, ctype_ctsG(g)->finalizer, &tmp);
+    tv = lj_tab_set(L, cts->finalizer, &tmp);
     if (!tvisnil(tv)) {
+      GCobj *batch[GCFINBATCH];
+      MSize n = 1;
       g->gc.nocdatafin = 0;
       copyTV(L, &tmp, tv);
       setnilV(tv);  /* Clear entry in finalizer table. */
-      gc_call_finalizer(g, L, &tmp, o);
+      batch[0] = o;
+      if (tvisfunc(&tmp) && !tvisnil(lj_tab_get(L, cts->finbatch, &tmp)))
+	n = gc_finalize_batch(L, &tmp, batch);
+      gc_call_finalizer(g, L, &tmp, batch, n);
+      return n;
     }
-    return;
+    return 1;
   }
 #endif
   /* Add userdata back to the main userdata list and make it white. */
@@ -564,7 +987,8 @@ static void gc_finalize(lua_State *L)
   /* Resolve the __gc metamethod. */
   mo = lj_meta_fastg(g, tabref(gco2ud(o)->metatable), MM_gc);
   if (mo)
-    gc_call_finalizer(g, L, mo, o);
+    gc_call_finalizer(g, L, mo, &o, 1);
+  return 1;
 }
 
 /* Finalize all userdata objects from mmudata list. */
@@ -582,8 +1006,10 @@ void lj_gc_finalize_cdata(lua_State *L)
   CTState *cts = ctype_ctsG(g);
   if (cts) {
     GCtab *t = cts->finalizer;
-    Node *node = noderef(t->node);
+    Node *node;
     ptrdiff_t i;
+    lj_tab_finishresize(L, t);
+    node = noderef(t->node);
     setgcrefnull(t->metatable);  /* Mark finalizer table as disabled. */
     for (i = (ptrdiff_t)t->hmask; i >= 0; i--)
       if (!tvisnil(&node[i].val) && tviscdata(&node[i].key)) {
@@ -593,7 +1019,8 @@ void lj_gc_finalize_cdata(lua_State *L)
 	o->gch.marked &= (uint8_t)~LJ_GC_CDATA_FIN;
 	copyTV(L, &tmp, &node[i].val);
 	setnilV(&node[i].val);
-	gc_call_finalizer(g, L, &tmp, o);
+	g->gc.finalized++;
+	gc_call_finalizer(g, L, &tmp, &o, 1);
       }
   }
 }
@@ -602,13 +1029,18 @@ void lj_gc_finalize_cdata(lua_State *L)
 /* Free all remaining GC objects. */
 void lj_gc_freeall(global_State *g)
 {
-  MSize i, strmask;
+  MSize i, n;
   /* Free everything, except super-fixed objects (the main thread). */
+#if LJ_HASGCTHREAD
+  if (g->gc.strlock)  /* Finish the string sweep shared with the helper. */
+    while (!gc_sweepstr_shared(g)) ;
+#endif
   g->gc.currentwhite = LJ_GC_WHITES | LJ_GC_SFIXED;
+  g->gc.keepold = 0;
   gc_fullsweep(g, &g->gc.root);
-  strmask = g->strmask;
-  for (i = 0; i <= strmask; i++)  /* Free all string hash chains. */
-    gc_fullsweep(g, &g->strhash[i]);
+  n = lj_gcvisit_nstrchains(g);
+  for (i = 0; i < n; i++)  /* Free all string hash chains. */
+    gc_fullsweep(g, lj_gcvisit_strchain(g, i));
 }
 
 /* -- Collector ----------------------------------------------------------- */
@@ -624,7 +1056,7 @@ static void atomic(global_State *g, lua_State *L)
   setgcrefr(g->gc.gray, g->gc.weak);  /* Empty the list of weak tables. */
   setgcrefnull(g->gc.weak);
   lj_assertG(!iswhite(obj2gco(mainthread(g))), "main thread turned white");
-  gc_markobj(g, L);  /* Mark running thread. */
+  gc_markobj(g, gc_gray(g), L);  /* Mark running thread. */
   gc_traverse_curtrace(g);  /* Traverse current trace. */
   gc_mark_gcroot(g);  /* Mark GC roots (again). */
   gc_propagate_gray(g);  /* Propagate all of the above. */
@@ -647,6 +1079,46 @@ static void atomic(global_State *g, lua_State *L)
   g->strempty.marked = g->gc.currentwhite;
   setmref(g->gc.sweep, &g->gc.root);
   g->gc.estimate = g->gc.total - (GCSize)udsize;  /* Initial estimate. */
+  g->gc.sweepstr = 0;
+  g->gc.sweepbase = g->gc.total;
+  g->gc.sweepfreed = 0;
+
+  /* Decide whether the survivors of this cycle become the old generation. */
+  if (g->gc.mode != GCMgen) {
+    g->gc.keepold = 0;
+  } else if (!g->gc.keepold) {  /* Full mark: everything alive is old now. */
+    g->gc.keepold = 1;
+    g->gc.genbase = g->gc.estimate;
+  } else if (g->gc.total > (g->gc.genbase/100) * g->gc.pause) {
+    g->gc.keepold = 0;  /* Old generation grew too much: whiten it. */
+  } else if (g->gc.strmiss == g->strhash_miss) {
+    /* Minor cycle, no young strings. */
+    g->gc.sweepstr = lj_gcvisit_nstrchains(g);
+  }
+  g->gc.strmiss = g->strhash_miss;
+  if (g->gc.keepold)
+    gc_keepweak(g);
+}
+
+/* Step the GC as soon as the hard memory limit is reached. */
+#define gc_hardthreshold(g) \
+  { if ((g)->gc.threshold > (g)->gc.hardlimit) \
+      (g)->gc.threshold = (g)->gc.hardlimit; }
+
+/* Set the memory threshold for the start of the next GC cycle. */
+static void gc_setthreshold(global_State *g)
+{
+  if (g->gc.mode == GCMgen)  /* Minor cycle: only the young are marked. */
+    g->gc.threshold = g->gc.estimate + (g->gc.estimate/100) * GCGENMINOR;
+  else
+    g->gc.threshold = (g->gc.estimate/100) * g->gc.pause;
+  /* Don't pause above the soft limit: start the next cycle at once. */
+  if (g->gc.threshold > g->gc.softlimit)
+    g->gc.threshold = g->gc.softlimit > g->gc.estimate ?
+		      g->gc.softlimit : g->gc.estimate;
+  gc_hardthreshold(g);
+  if (g->gc.total < g->gc.softlimit)
+    g->gc.limflushed = 0;
 }
 
 /* GC state machine. Returns a cost estimate for each step performed. */
@@ -659,8 +1131,26 @@ static size_t gc_onestep(lua_State *L)
     gc_mark_start(g);  /* Start a new GC cycle by marking all GC roots. */
     return 0;
   case GCSpropagate:
-    if (gcref(g->gc.gray) != NULL)
-      return propagatemark(g);  /* Propagate one gray object. */
+  case GCSremark:
+    if (gcref(g->gc.travtab) != NULL)
+      return gc_traverse_tabchunk(g);  /* Continue with a large table. */
+    if (gcref(g->gc.gray) != NULL) {
+#if LJ_HASGCTHREAD
+      if (gcthread(g) && gcthread(g)->nmarkers)
+	return gc_propagate_par(g);  /* Propagate with the marker threads. */
+#endif
+      return propagatemark(g, gc_gray(g));  /* Propagate one gray object. */
+    }
+    if (g->gc.state == GCSpropagate && gcref(g->gc.grayagain) != NULL) {
+      /* Propagate the gray-again list incrementally. Tables and threads
+      ** changed in the meantime are put back on it, so only these are left
+      ** for the atomic phase.
+      */
+      setgcrefr(g->gc.gray, g->gc.grayagain);
+      setgcrefnull(g->gc.grayagain);
+      g->gc.state = GCSremark;
+      return 0;
+    }
     g->gc.state = GCSatomic;  /* End of mark phase. */
     return 0;
   case GCSatomic:
@@ -668,16 +1158,37 @@ static size_t gc_onestep(lua_State *L)
       return LJ_MAX_MEM;
     atomic(g, L);
     g->gc.state = GCSsweepstring;  /* Start of sweep phase. */
-    g->gc.sweepstr = 0;
 #if LUAJIT_SMART_STRINGS
-    g->strbloom.next[0] = 0;
-    g->strbloom.next[1] = 0;
+    if (g->gc.keepold) {  /* Old strings are not swept, keep their bits. */
+      g->strbloom.next[0] = g->strbloom.cur[0];
+      g->strbloom.next[1] = g->strbloom.cur[1];
+    } else {
+      g->strbloom.next[0] = 0;
+      g->strbloom.next[1] = 0;
+    }
+#endif
+#if LJ_HASGCTHREAD
+    /* The old generation is not swept, so only full sweeps are shared. */
+    if (g->gc.bgsweep && !g->gc.keepold && gcthread(g)) {
+      g->gc.strlock = 1;
+      lj_gcthread_post(gcthread(g), gc_sweepstr_job);
+    }
 #endif
     return 0;
   case GCSsweepstring: {
     GCSize old = g->gc.total;
-    gc_sweep_str_chain(g, &g->strhash[g->gc.sweepstr++]);  /* Sweep one chain. */
-    if (g->gc.sweepstr > g->strmask) {
+    int done;
+#if LJ_HASGCTHREAD
+    if (g->gc.strlock) {
+      done = gc_sweepstr_shared(g);
+    } else
+#endif
+    {
+      if (g->gc.sweepstr < lj_gcvisit_nstrchains(g))  /* Sweep one chain. */
+	gc_sweep_str_chain(g, lj_gcvisit_strchain(g, g->gc.sweepstr++), NULL);
+      done = g->gc.sweepstr >= lj_gcvisit_nstrchains(g);
+    }
+    if (done) {
       g->gc.state = GCSsweep;  /* All string hash chains sweeped. */
 #if LUAJIT_SMART_STRINGS
       g->strbloom.cur[0] = g->strbloom.next[0];
@@ -686,14 +1197,29 @@ static size_t gc_onestep(lua_State *L)
     }
     lj_assertG(old >= g->gc.total, "sweep increased memory");
     g->gc.estimate -= old - g->gc.total;
+    g->gc.sweepfreed += old - g->gc.total;
     return GCSWEEPCOST;
     }
   case GCSsweep: {
     GCSize old = g->gc.total;
-    setmref(g->gc.sweep, gc_sweep(g, mref(g->gc.sweep, GCRef), GCSWEEPMAX));
+    GCRef *p = gc_sweep(g, mref(g->gc.sweep, GCRef), GCSWEEPMAX);
+    GCobj *o = gcref(*p);
+    if (o && g->gc.keepold && isold(o)) {
+      /* Reached the old generation. Userdata are linked after main thread. */
+      if (o->gch.gct == ~LJ_TUDATA)
+	o = NULL;  /* Young userdata are swept, too. */
+      else
+	o = gcref(*(p = &mainthread(g)->nextgc));
+    }
+    setmref(g->gc.sweep, p);
     lj_assertG(old >= g->gc.total, "sweep increased memory");
     g->gc.estimate -= old - g->gc.total;
-    if (gcref(*mref(g->gc.sweep, GCRef)) == NULL) {
+    g->gc.sweepfreed += old - g->gc.total;
+    if (o == NULL) {
+      /* End of the sweep phase: account the survivors and the freed memory. */
+      g->gc.cycles++;
+      g->gc.marked += g->gc.sweepbase - g->gc.sweepfreed;
+      g->gc.swept += g->gc.sweepfreed;
       if (g->strnum <= (g->strmask >> 2) && g->strmask > LJ_MIN_STRTAB*2-1)
 	lj_str_resize(L, g->strmask >> 1);  /* Shrink string table. */
       if (gcref(g->gc.mmudata)) {  /* Need any finalizations? */
@@ -710,12 +1236,14 @@ static size_t gc_onestep(lua_State *L)
     }
   case GCSfinalize:
     if (gcref(g->gc.mmudata) != NULL) {
+      GCSize cost;
       if (tvref(g->jit_base))  /* Don't call finalizers on trace. */
 	return LJ_MAX_MEM;
-      gc_finalize(L);  /* Finalize one userdata object. */
-      if (g->gc.estimate > GCFINALIZECOST)
-	g->gc.estimate -= GCFINALIZECOST;
-      return GCFINALIZECOST;
+      /* Finalize one userdata object or a batch of cdata objects. */
+      cost = (GCSize)gc_finalize(L) * GCFINALIZECOST;
+      if (g->gc.estimate > cost)
+	g->gc.estimate -= cost;
+      return cost;
     }
 #if LJ_HASFFI
     if (!g->gc.nocdatafin) lj_tab_rehash(L, ctype_ctsG(g)->finalizer);
@@ -729,28 +1257,155 @@ static size_t gc_onestep(lua_State *L)
   }
 }
 
+/* Run finalizers until the finalization queue is empty, the finalizer
+** time budget is exhausted or their cost reaches the work limit of the
+** step. At least one finalizer is run. Returns the cost of the finalizers.
+*/
+static GCSize gc_finalize_budget(lua_State *L, GCSize lim)
+{
+  global_State *g = G(L);
+  uint64_t deadline;
+  GCSize cost = 0;
+  if (tvref(g->jit_base))  /* Don't call finalizers on trace. */
+    return LJ_MAX_MEM;
+  deadline = lj_utils_time_ns() + (uint64_t)g->gc.finbudget * 1000;
+  do {
+    cost += (GCSize)gc_onestep(L);
+  } while (cost < lim && g->gc.state == GCSfinalize &&
+	   gcref(g->gc.mmudata) != NULL && lj_utils_time_ns() < deadline);
+  return cost;
+}
+
+/* Account the duration of an incremental GC step. The time since mark is
+** spent in the given GC state.
+*/
+static void gc_steptime(global_State *g, uint64_t start, uint64_t mark,
+			int state)
+{
+  uint64_t now = lj_utils_time_ns();
+  uint64_t t = now - start, us = t / 1000;
+  g->gc.statetime[state] += now - mark;
+  g->gc.steptime += t;
+  if (t > g->gc.steptime_max)
+    g->gc.steptime_max = t;
+  /* Bucket i counts the steps shorter than 2^i us, except the last one. */
+  g->gc.pausehist[us == 0 ? 0 : us >= (1u << (GCPAUSEHIST-2)) ?
+		  GCPAUSEHIST-1 : lj_fls((uint32_t)us) + 1]++;
+}
+
+/* Account the time spent in the previous GC state on a state transition. */
+static LJ_AINLINE void gc_statemark(global_State *g, uint64_t *mark,
+				     int *state)
+{
+  if (LJ_UNLIKELY(g->gc.state != *state)) {
+    /* Check the clock on state transitions only to keep the steps cheap. */
+    uint64_t now = lj_utils_time_ns();
+    g->gc.statetime[*state] += now - *mark;
+    *mark = now;
+    *state = g->gc.state;
+  }
+}
+
+/* Handle the memory above the soft limit. The traces are flushed once per
+** crossing of the soft limit, if requested. Above the hard limit an emergency
+** full GC is performed and LUA_ERRMEM is raised if it doesn't help. This is
+** done on the next step outside of the JIT-compiled code, since neither the
+** finalizers nor the trace flush are allowed on trace. Returns 1 after the
+** emergency full GC.
+*/
+static int gc_memlimit(lua_State *L)
+{
+  global_State *g = G(L);
+  if (tvref(g->jit_base))
+    return 0;
+#if LJ_HASJIT
+  if (g->gc.limflush && !g->gc.limflushed &&
+      G2J(g)->state == LJ_TRACE_IDLE) {
+    g->gc.limflushed = 1;
+    lj_trace_flushall(L);
+  }
+#endif
+  if (g->gc.total >= g->gc.hardlimit) {
+    g->gc.emergency++;
+    lj_gc_fullgc(L);
+    if (g->gc.total >= g->gc.hardlimit)
+      lj_err_mem(L);
+    return 1;
+  }
+  return 0;
+}
+
+/* A minor cycle marks and sweeps only the young generation. Scale the work
+** limit of an explicit step down to the share of the young generation in the
+** heap, so the steps of a given size make the same progress through a minor
+** cycle as through a major one. The steps driven by the allocations aren't
+** scaled: a minor cycle is cheaper and finishes sooner.
+*/
+static GCSize gc_minorlim(global_State *g, GCSize lim)
+{
+  GCSize young = g->gc.total > g->gc.genbase ? g->gc.total - g->gc.genbase : 0;
+  lim = (GCSize)((uint64_t)lim * young / g->gc.total);
+  return lim > GCMINORMIN ? lim : GCMINORMIN;
+}
+
 /* Perform a limited amount of incremental GC steps. */
-int LJ_FASTCALL lj_gc_step(lua_State *L)
+static LJ_AINLINE int gc_step(lua_State *L, int user)
 {
   global_State *g = G(L);
   GCSize lim;
-  int32_t ostate = g->vmstate;
+  size_t work = 0;
+  uint64_t start, mark;
+  int state;
+  int32_t ostate;
+  if (LJ_UNLIKELY(g->gc.total >= g->gc.softlimit) && gc_memlimit(L))
+    return 1;  /* Finished an emergency full GC. */
+  start = mark = lj_utils_time_ns();
+  state = g->gc.state;
+  ostate = g->vmstate;
   setvmstate(g, GC);
   lim = (GCSTEPSIZE/100) * g->gc.stepmul;
   if (lim == 0)
     lim = LJ_MAX_MEM;
+  else if (g->gc.total >= g->gc.softlimit)
+    lim *= GCSOFTMUL;  /* Collect more aggressively. */
+  else if (user && g->gc.keepold)
+    lim = gc_minorlim(g, lim);
   if (g->gc.total > g->gc.threshold)
     g->gc.debt += g->gc.total - g->gc.threshold;
+  if (LJ_UNLIKELY(g->strold != NULL) && g->gc.state != GCSsweepstring)
+    lj_str_rehash(g, GCSTRMOVE);  /* Continue the string table resize. */
   do {
-    lim -= (GCSize)gc_onestep(L);
+    size_t cost;
+    if (g->gc.state == GCSfinalize && g->gc.finbudget &&
+	gcref(g->gc.mmudata) != NULL) {
+      /* Finalizers have their own time budget within the work limit. */
+      cost = gc_finalize_budget(L, lim);
+      if (gcref(g->gc.mmudata) != NULL) {  /* Out of time or work? */
+	gc_statemark(g, &mark, &state);
+	break;
+      }
+    } else {
+      cost = gc_onestep(L);
+    }
+    lim -= (GCSize)cost;
+    gc_statemark(g, &mark, &state);
     if (g->gc.state == GCSpause) {
-      g->gc.threshold = (g->gc.estimate/100) * g->gc.pause;
+      gc_setthreshold(g);
+      gc_steptime(g, start, mark, state);
       g->vmstate = ostate;
       return 1;  /* Finished a GC cycle. */
     }
+    if (g->gc.budget && (work += cost) >= GCSTEPSIZE) {
+      /* Check the clock after every GCSTEPSIZE units of work. */
+      if (lj_utils_time_ns() - start >= (uint64_t)g->gc.budget * 1000)
+	break;  /* Out of time. The rest of the debt is paid by next steps. */
+      work = 0;
+    }
   } while (sizeof(lim) == 8 ? ((int64_t)lim > 0) : ((int32_t)lim > 0));
+  gc_steptime(g, start, mark, state);
   if (g->gc.debt < GCSTEPSIZE) {
     g->gc.threshold = g->gc.total + GCSTEPSIZE;
+    gc_hardthreshold(g);
     g->vmstate = ostate;
     return -1;
   } else {
@@ -761,6 +1416,11 @@ int LJ_FASTCALL lj_gc_step(lua_State *L)
   }
 }
 
+int LJ_FASTCALL lj_gc_step(lua_State *L)
+{
+  return gc_step(L, 0);
+}
+
 /* Ditto, but fix the stack top first. */
 void LJ_FASTCALL lj_gc_step_fixtop(lua_State *L)
 {
@@ -768,6 +1428,80 @@ void LJ_FASTCALL lj_gc_step_fixtop(lua_State *L)
   lj_gc_step(L);
 }
 
+/* Perform GC steps while the VM is idle until the deadline (in terms of
+** lj_utils_time_ns()) or the end of the GC cycle. The work done is credited
+** to the allocation schedule. Returns 1 if a GC cycle has been finished.
+*/
+int lj_gc_idle(lua_State *L, uint64_t deadline)
+{
+  global_State *g = G(L);
+  GCSize work = 0, credit;
+  size_t check = 0;
+  uint64_t start, mark;
+  int state;
+  int32_t ostate;
+  if (g->gc.threshold == LJ_MAX_MEM)
+    return 0;  /* The GC is stopped. */
+  if (g->gc.state == GCSpause && g->gc.total < g->gc.threshold &&
+      g->gc.threshold - g->gc.total > (g->gc.threshold - g->gc.estimate) / 2)
+    return 0;  /* Too early to start a new GC cycle. */
+  start = mark = lj_utils_time_ns();
+  state = g->gc.state;
+  ostate = g->vmstate;
+  setvmstate(g, GC);
+  for (;;) {
+    size_t cost = gc_onestep(L);
+    work += (GCSize)cost;
+    gc_statemark(g, &mark, &state);
+    if (g->gc.state == GCSpause) {
+      gc_setthreshold(g);
+      gc_steptime(g, start, mark, state);
+      g->vmstate = ostate;
+      return 1;  /* Finished a GC cycle. */
+    }
+    if ((check += cost) >= GCSTEPSIZE) {
+      /* Check the clock after every GCSTEPSIZE units of work. */
+      if (lj_utils_time_ns() >= deadline)
+	break;
+      check = 0;
+    }
+  }
+  gc_steptime(g, start, mark, state);
+  /* The work is ahead of the schedule, so postpone the next steps. */
+  credit = g->gc.stepmul ? work / g->gc.stepmul * 100 : 0;
+  if (g->gc.debt > credit) {
+    g->gc.debt -= credit;
+  } else {
+    credit -= g->gc.debt;
+    g->gc.debt = 0;
+    if (credit < GCSTEPSIZE)
+      credit = GCSTEPSIZE;
+    if (g->gc.threshold < g->gc.total + credit)
+      g->gc.threshold = g->gc.total + credit;
+    gc_hardthreshold(g);
+  }
+  g->vmstate = ostate;
+  return 0;
+}
+
+/* Perform an explicit GC step of the given size in bytes, paying the debt of
+** the whole step. Returns 1 if a GC cycle has been finished.
+*/
+int lj_gc_stepsize(lua_State *L, GCSize size)
+{
+  global_State *g = G(L);
+  if (size <= g->gc.total) {
+    g->gc.threshold = g->gc.total - size;
+  } else {
+    g->gc.debt += size - g->gc.total;
+    g->gc.threshold = 0;
+  }
+  while (g->gc.total >= g->gc.threshold)
+    if (gc_step(L, 1) > 0)
+      return 1;
+  return 0;
+}
+
 #if LJ_HASJIT
 /* Perform multiple GC steps. Called from JIT-compiled code. */
 int LJ_FASTCALL lj_gc_step_jit(global_State *g, MSize steps)
@@ -777,33 +1511,61 @@ int LJ_FASTCALL lj_gc_step_jit(global_State *g, MSize steps)
   L->top = curr_topL(L);
   while (steps-- > 0 && lj_gc_step(L) == 0)
     ;
-  /* Return 1 to force a trace exit. */
-  return (G(L)->gc.state == GCSatomic || G(L)->gc.state == GCSfinalize);
+  /* Return 1 to force a trace exit. Also handle the memory limits outside. */
+  return (G(L)->gc.state == GCSatomic || G(L)->gc.state == GCSfinalize ||
+	  G(L)->gc.total >= G(L)->gc.hardlimit);
 }
 #endif
 
-/* Perform a full GC cycle. */
+/* Sweep everything (preserving it) and reset lists from partial propagation. */
+static void gc_sweep_start(global_State *g)
+{
+  setmref(g->gc.sweep, &g->gc.root);
+  setgcrefnull(g->gc.gray);
+  setgcrefnull(g->gc.grayagain);
+  setgcrefnull(g->gc.weak);
+  setgcrefnull(g->gc.travtab);
+  g->gc.state = GCSsweepstring;
+  g->gc.sweepstr = 0;
+  g->gc.sweepbase = g->gc.total;
+  g->gc.sweepfreed = 0;
+}
+
+/* Perform a full GC cycle. It's accounted as a single (long) GC step. */
 void lj_gc_fullgc(lua_State *L)
 {
   global_State *g = G(L);
   int32_t ostate = g->vmstate;
+  uint64_t start, mark;
+  int state = g->gc.state;
+  start = mark = lj_utils_time_ns();
   setvmstate(g, GC);
   if (g->gc.state <= GCSatomic) {  /* Caught somewhere in the middle. */
-    setmref(g->gc.sweep, &g->gc.root);  /* Sweep everything (preserving it). */
-    setgcrefnull(g->gc.gray);  /* Reset lists from partial propagation. */
-    setgcrefnull(g->gc.grayagain);
-    setgcrefnull(g->gc.weak);
-    g->gc.state = GCSsweepstring;  /* Fast forward to the sweep phase. */
-    g->gc.sweepstr = 0;
+    g->gc.keepold = 0;  /* Whiten the old generation, too. */
+    gc_sweep_start(g);  /* Fast forward to the sweep phase. */
   }
-  while (g->gc.state == GCSsweepstring || g->gc.state == GCSsweep)
+  while (g->gc.state == GCSsweepstring || g->gc.state == GCSsweep) {
     gc_onestep(L);  /* Finish sweep. */
+    gc_statemark(g, &mark, &state);
+  }
   lj_assertG(g->gc.state == GCSfinalize || g->gc.state == GCSpause,
 	     "bad GC state");
+  if (g->gc.keepold) {  /* Old generation is still marked, whiten it. */
+    g->gc.keepold = 0;
+    gc_sweep_start(g);
+    while (g->gc.state == GCSsweepstring || g->gc.state == GCSsweep) {
+      gc_onestep(L);
+      gc_statemark(g, &mark, &state);
+    }
+  }
   /* Now perform a full GC. */
   g->gc.state = GCSpause;
-  do { gc_onestep(L); } while (g->gc.state != GCSpause);
-  g->gc.threshold = (g->gc.estimate/100) * g->gc.pause;
+  do {
+    gc_onestep(L);
+    gc_statemark(g, &mark, &state);
+  } while (g->gc.state != GCSpause);
+  gc_setthreshold(g);
+  gc_steptime(g, start, mark, state);
   g->vmstate = ostate;
 }
 
@@ -814,12 +1576,13 @@ void lj_gc_barrierf(global_State *g, GCobj *o, GCobj *v)
 {
   lj_assertG(isblack(o) && iswhite(v) && !isdead(g, v) && !isdead(g, o),
 	     "bad object states for forward barrier");
-  lj_assertG(g->gc.state != GCSfinalize && g->gc.state != GCSpause,
+  lj_assertG(g->gc.keepold ||
+	     (g->gc.state != GCSfinalize && g->gc.state != GCSpause),
 	     "bad GC state");
   lj_assertG(o->gch.gct != ~LJ_TTAB, "barrier object is not a table");
-  /* Preserve invariant during propagation. Otherwise it doesn't matter. */
-  if (g->gc.state == GCSpropagate || g->gc.state == GCSatomic)
-    gc_mark(g, v);  /* Move frontier forward. */
+  /* Preserve invariant during propagation or for the old generation. */
+  if (keepinvariant(g))
+    gc_mark(g, gc_gray(g), v);  /* Move frontier forward. */
   else
     makewhite(g, o);  /* Make it white to avoid the following barrier. */
 }
@@ -829,8 +1592,8 @@ void LJ_FASTCALL lj_gc_barrieruv(global_State *g, TValue *tv)
 {
 #define TV2MARKED(x) \
   (*((uint8_t *)(x) - offsetof(GCupval, tv) + offsetof(GCupval, marked)))
-  if (g->gc.state == GCSpropagate || g->gc.state == GCSatomic)
-    gc_mark(g, gcV(tv));
+  if (keepinvariant(g))
+    gc_mark(g, gc_gray(g), gcV(tv));
   else
     TV2MARKED(tv) = (TV2MARKED(tv) & (uint8_t)~LJ_GC_COLORS) | curwhite(g);
 #undef TV2MARKED
@@ -846,8 +1609,9 @@ void lj_gc_closeuv(global_State *g, GCupval *uv)
   uv->closed = 1;
   setgcrefr(o->gch.nextgc, g->gc.root);
   setgcref(g->gc.root, o);
+  o->gch.marked &= (uint8_t)~LJ_GC_OLD;  /* Now in front of old objects. */
   if (isgray(o)) {  /* A closed upvalue is never gray, so fix this. */
-    if (g->gc.state == GCSpropagate || g->gc.state == GCSatomic) {
+    if (keepinvariant(g)) {
       gray2black(o);  /* Make it black and preserve invariant. */
       if (tviswhite(&uv->tv))
 	lj_gc_barrierf(g, o, gcV(&uv->tv));
@@ -863,8 +1627,8 @@ void lj_gc_closeuv(global_State *g, GCupval *uv)
 /* Mark a trace if it's saved during the propagation phase. */
 void lj_gc_barriertrace(global_State *g, uint32_t traceno)
 {
-  if (g->gc.state == GCSpropagate || g->gc.state == GCSatomic)
-    gc_marktrace(g, traceno);
+  if (keepinvariant(g))
+    gc_marktrace(g, gc_gray(g), traceno);
 }
 #endif
 
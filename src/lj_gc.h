@@ -18,6 +18,7 @@
 #define LJ_GC_CDATA_FIN	0x10
 #define LJ_GC_FIXED	0x20
 #define LJ_GC_SFIXED	0x40
+#define LJ_GC_OLD	0x80	/* Not for cdata, see cdataisv(). */
 
 #define LJ_GC_WHITES	(LJ_GC_WHITE0 | LJ_GC_WHITE1)
 #define LJ_GC_COLORS	(LJ_GC_WHITES | LJ_GC_BLACK)
@@ -30,6 +31,8 @@
 #define tviswhite(x)	(tvisgcv(x) && iswhite(gcV(x)))
 #define otherwhite(g)	(g->gc.currentwhite ^ LJ_GC_WHITES)
 #define isdead(g, v)	((v)->gch.marked & otherwhite(g) & LJ_GC_WHITES)
+#define isold(x) \
+  (((x)->gch.marked & LJ_GC_OLD) && (x)->gch.gct != ~LJ_TCDATA)
 
 #define curwhite(g)	((g)->gc.currentwhite & LJ_GC_WHITES)
 #define newwhite(g, x)	(obj2gco(x)->gch.marked = (uint8_t)curwhite(g))
@@ -37,11 +40,23 @@
   ((x)->gch.marked = ((x)->gch.marked & (uint8_t)~LJ_GC_COLORS) | curwhite(g))
 #define flipwhite(x)	((x)->gch.marked ^= LJ_GC_WHITES)
 #define black2gray(x)	((x)->gch.marked &= (uint8_t)~LJ_GC_BLACK)
+#if LJ_HASGCTHREAD
+/* The string may be swept on the helper thread concurrently. */
+#define fixstring(s) \
+  ((void)__atomic_fetch_or(&(s)->marked, LJ_GC_FIXED, __ATOMIC_RELAXED))
+#else
 #define fixstring(s)	((s)->marked |= LJ_GC_FIXED)
+#endif
 #define markfinalized(x)	((x)->gch.marked |= LJ_GC_FINALIZED)
 
+/* The invariant must hold while marking or while old objects stay marked. */
+#define keepinvariant(g) \
+  ((g)->gc.state == GCSpropagate || (g)->gc.state == GCSremark || \
+   (g)->gc.state == GCSatomic || (g)->gc.keepold)
+
 /* Collector. */
 LJ_FUNC size_t lj_gc_separateudata(global_State *g, int all);
+LJ_FUNC void lj_gc_finq_append(global_State *g, GCobj *o);
 LJ_FUNC void lj_gc_finalize_udata(lua_State *L);
 #if LJ_HASFFI
 LJ_FUNC void lj_gc_finalize_cdata(lua_State *L);
@@ -51,6 +66,8 @@ LJ_FUNC void lj_gc_finalize_cdata(lua_State *L);
 LJ_FUNC void lj_gc_freeall(global_State *g);
 LJ_FUNCA int LJ_FASTCALL lj_gc_step(lua_State *L);
 LJ_FUNCA void LJ_FASTCALL lj_gc_step_fixtop(lua_State *L);
+LJ_FUNC int lj_gc_stepsize(lua_State *L, GCSize size);
+LJ_FUNC int lj_gc_idle(lua_State *L, uint64_t deadline);
 #if LJ_HASJIT
 LJ_FUNC int LJ_FASTCALL lj_gc_step_jit(global_State *g, MSize steps);
 #endif
@@ -78,7 +95,8 @@ static LJ_AINLINE void lj_gc_barrierback(global_State *g, GCtab *t)
   GCobj *o = obj2gco(t);
   lj_assertG(isblack(o) && !isdead(g, o),
 	     "bad object states for backward barrier");
-  lj_assertG(g->gc.state != GCSfinalize && g->gc.state != GCSpause,
+  lj_assertG(g->gc.keepold ||
+	     (g->gc.state != GCSfinalize && g->gc.state != GCSpause),
 	     "bad GC state");
   black2gray(o);
   setgcrefr(t->gclist, g->gc.grayagain);
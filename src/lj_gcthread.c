@@ -0,0 +1,185 @@
+/*
+** Helper thread of the garbage collector.
+**
+** The helper thread runs jobs posted by the collector on the mutator
+** thread. A job must not allocate or free memory, since the allocator is
+** not thread-safe. The data shared with a job is protected by the helper
+** lock.
+**
+** Optionally, the marker threads help the collector to propagate gray
+** objects. They run a mark job posted for each propagation step, while the
+** mutator thread runs it, too.
+*/
+
+#define lj_gcthread_c
+#define LUA_CORE
+
+#include "lj_obj.h"
+
+#if LJ_HASGCTHREAD
+
+#include <signal.h>
+
+#include "lj_gc.h"
+#include "lj_gcthread.h"
+
+/* Main loop of the helper thread. */
+static void *gcthread_main(void *arg)
+{
+  GCThread *gt = (GCThread *)arg;
+  lj_gcthread_lock(gt);
+  for (;;) {
+    GCThreadJob job;
+    while (gt->job == NULL && !gt->quit)
+      pthread_cond_wait(&gt->wake, &gt->lock);
+    if (gt->quit)
+      break;
+    job = gt->job;
+    lj_gcthread_unlock(gt);
+    job(gt->g);
+    lj_gcthread_lock(gt);
+    gt->job = NULL;
+    pthread_cond_broadcast(&gt->idle);
+  }
+  lj_gcthread_unlock(gt);
+  return NULL;
+}
+
+/* Main loop of a marker thread. */
+static void *gcthread_marker(void *arg)
+{
+  GCThread *gt = (GCThread *)arg;
+  uint32_t gen;
+  lj_gcthread_lock(gt);
+  gen = gt->markgen;
+  for (;;) {
+    while (gt->markgen == gen && !gt->markquit)
+      pthread_cond_wait(&gt->markwake, &gt->lock);
+    if (gt->markquit)
+      break;
+    gen = gt->markgen;
+    lj_gcthread_unlock(gt);
+    gt->markjob(gt->g);
+    lj_gcthread_lock(gt);
+  }
+  lj_gcthread_unlock(gt);
+  return NULL;
+}
+
+/* Create a thread with all signals blocked. */
+static int gcthread_create(pthread_t *thread, void *(*f)(void *), void *arg)
+{
+  sigset_t all, old;
+  int err;
+  /* Profiler signals must be delivered to the mutator thread only. */
+  sigfillset(&all);
+  pthread_sigmask(SIG_SETMASK, &all, &old);
+  err = pthread_create(thread, NULL, f, arg);
+  pthread_sigmask(SIG_SETMASK, &old, NULL);
+  return err;
+}
+
+/* Start the helper thread. Returns NULL if the thread cannot be created. */
+GCThread *lj_gcthread_start(lua_State *L)
+{
+  global_State *g = G(L);
+  GCThread *gt = lj_mem_newt(L, sizeof(GCThread), GCThread);
+  memset(gt, 0, sizeof(GCThread));
+  gt->g = g;
+  pthread_mutex_init(&gt->lock, NULL);
+  pthread_cond_init(&gt->wake, NULL);
+  pthread_cond_init(&gt->idle, NULL);
+  pthread_cond_init(&gt->markwake, NULL);
+  pthread_cond_init(&gt->markshare, NULL);
+  pthread_cond_init(&gt->markidle, NULL);
+  if (gcthread_create(&gt->thread, gcthread_main, gt)) {
+    pthread_cond_destroy(&gt->markidle);
+    pthread_cond_destroy(&gt->markshare);
+    pthread_cond_destroy(&gt->markwake);
+    pthread_cond_destroy(&gt->idle);
+    pthread_cond_destroy(&gt->wake);
+    pthread_mutex_destroy(&gt->lock);
+    lj_mem_freet(g, gt);
+    return NULL;
+  }
+  setmref(g->gc.thread, gt);
+  return gt;
+}
+
+/* Stop the helper thread. The running job is finished first. */
+void lj_gcthread_stop(global_State *g)
+{
+  GCThread *gt = gcthread(g);
+  if (gt == NULL)
+    return;
+  lj_gcthread_markers(gt, 1);
+  lj_gcthread_lock(gt);
+  gt->quit = 1;
+  pthread_cond_signal(&gt->wake);
+  lj_gcthread_unlock(gt);
+  pthread_join(gt->thread, NULL);
+  lj_assertG(gcref(gt->deadstr) == NULL, "leaked dead strings");
+  pthread_cond_destroy(&gt->markidle);
+  pthread_cond_destroy(&gt->markshare);
+  pthread_cond_destroy(&gt->markwake);
+  pthread_cond_destroy(&gt->idle);
+  pthread_cond_destroy(&gt->wake);
+  pthread_mutex_destroy(&gt->lock);
+  setmref(g->gc.thread, NULL);
+  lj_mem_freet(g, gt);
+}
+
+/* Post a job to the idle helper thread. */
+void lj_gcthread_post(GCThread *gt, GCThreadJob job)
+{
+  lj_gcthread_lock(gt);
+  lj_assertG_(gt->g, gt->job == NULL, "helper thread is busy");
+  gt->job = job;
+  pthread_cond_signal(&gt->wake);
+  lj_gcthread_unlock(gt);
+}
+
+/* Wait until the helper thread finishes its job. Must hold the lock. */
+void lj_gcthread_wait(GCThread *gt)
+{
+  while (gt->job != NULL)
+    pthread_cond_wait(&gt->idle, &gt->lock);
+}
+
+/* Set the number of parallel markers, including the collector itself.
+** Must not be called during marking. Returns the number of markers.
+*/
+int lj_gcthread_markers(GCThread *gt, int n)
+{
+  uint32_t i, nmarkers = gt->nmarkers;
+  if (n < 1) n = 1;
+  if (n > GCMARKERS_MAX) n = GCMARKERS_MAX;
+  if ((uint32_t)n == nmarkers + 1)
+    return n;
+  /* Stop the running marker threads. */
+  lj_gcthread_lock(gt);
+  gt->markquit = 1;
+  pthread_cond_broadcast(&gt->markwake);
+  lj_gcthread_unlock(gt);
+  for (i = 0; i < nmarkers; i++)
+    pthread_join(gt->markers[i], NULL);
+  gt->markquit = 0;
+  /* And start the new ones. */
+  for (i = 0; i < (uint32_t)n-1; i++)
+    if (gcthread_create(&gt->markers[i], gcthread_marker, gt))
+      break;
+  gt->nmarkers = i;
+  return (int)i + 1;
+}
+
+/* Post a mark job to the marker threads. */
+void lj_gcthread_postmark(GCThread *gt, GCThreadJob job)
+{
+  lj_gcthread_lock(gt);
+  gt->markjob = job;
+  gt->markgen++;
+  pthread_cond_broadcast(&gt->markwake);
+  lj_gcthread_unlock(gt);
+}
+
+#endif
@@ -0,0 +1,63 @@
+/*
+** Helper thread of the garbage collector.
+*/
+
+#ifndef _LJ_GCTHREAD_H
+#define _LJ_GCTHREAD_H
+
+#include "lj_obj.h"
+
+#if LJ_HASGCTHREAD
+
+#include <pthread.h>
+
+/* Job of the helper thread. It's called without holding the lock. */
+typedef void (*GCThreadJob)(global_State *g);
+
+/* Max. number of parallel markers, including the collector itself. */
+#define GCMARKERS_MAX	8
+
+/* Helper thread state. */
+typedef struct GCThread {
+  pthread_t thread;	/* Helper thread. */
+  pthread_mutex_t lock;	/* Protects the data shared with the helper thread. */
+  pthread_cond_t wake;	/* Signalled when a job is posted or on shutdown. */
+  pthread_cond_t idle;	/* Signalled when a job is finished. */
+  GCThreadJob job;	/* Posted or running job, NULL if idle. */
+  int quit;		/* Terminate the helper thread. */
+  global_State *g;	/* Owning global state. */
+  GCRef deadstr;	/* Dead strings unlinked by the helper, to be freed. */
+  /* Parallel marking, see gc_mark_par(). */
+  pthread_cond_t markwake;	/* Signalled when a mark job is posted. */
+  pthread_cond_t markshare;	/* Signalled when gray objects are shared. */
+  pthread_cond_t markidle;	/* Signalled when the last marker is done. */
+  GCThreadJob markjob;	/* Mark job of the marker threads. */
+  uint32_t markgen;	/* Incremented for each posted mark job. */
+  uint32_t nmarkers;	/* Number of marker threads. */
+  uint32_t active;	/* Number of markers running the mark job. */
+  uint32_t waiting;	/* Number of markers waiting for gray objects. */
+  int markquit;		/* Terminate the marker threads. */
+  int markdone;		/* The mark job is finished. */
+  int markstop;		/* Stop the mark job early. */
+  GCRef markpool;	/* Gray objects shared between the markers. */
+  size_t markwork;	/* Work done by the mark job. */
+  size_t marklim;	/* Work limit of the mark job. */
+  uint64_t markdeadline;	/* Deadline of the mark job or 0. */
+  pthread_t markers[GCMARKERS_MAX-1];	/* Marker threads. */
+} GCThread;
+
+#define gcthread(g)	(mref((g)->gc.thread, GCThread))
+
+#define lj_gcthread_lock(gt)	pthread_mutex_lock(&(gt)->lock)
+#define lj_gcthread_unlock(gt)	pthread_mutex_unlock(&(gt)->lock)
+
+LJ_FUNC GCThread *lj_gcthread_start(lua_State *L);
+LJ_FUNC void lj_gcthread_stop(global_State *g);
+LJ_FUNC void lj_gcthread_post(GCThread *gt, GCThreadJob job);
+LJ_FUNC void lj_gcthread_wait(GCThread *gt);
+LJ_FUNC int lj_gcthread_markers(GCThread *gt, int n);
+LJ_FUNC void lj_gcthread_postmark(GCThread *gt, GCThreadJob job);
+
+#endif
+
+#endif
@@ -0,0 +1,219 @@
+/*
+** Visitors of the references between GC objects.
+**
+** The collector marks the objects and the heap dump writes the references
+** with the same walkers, so both see the same object graph. The walkers are
+** inlined and call the visitor functions passed as constants, so the calls
+** are resolved at compile time in the marking loops.
+*/
+
+#ifndef _LJ_GCVISIT_H
+#define _LJ_GCVISIT_H
+
+#include "lj_obj.h"
+#include "lj_tab.h"
+#include "lj_frame.h"
+#if LJ_HASJIT
+#include "lj_dispatch.h"
+#endif
+
+/* Visitor of a reference to a GC object. The object is never NULL. */
+typedef void (*GCVisitObj)(void *ud, GCobj *o);
+/* Visitor of a value. Weak references are the slots of weak tables. */
+typedef void (*GCVisitTV)(void *ud, cTValue *tv, int weak);
+
+/* Get the weak mode of a table from its __mode field. */
+static LJ_AINLINE int lj_gcvisit_weakmode(cTValue *mode)
+{
+  int weak = 0;
+  if (mode && tvisstr(mode)) {  /* Valid __mode field? */
+    const char *modestr = strVdata(mode);
+    int c;
+    while ((c = *modestr++)) {
+      if (c == 'k') weak |= LJ_GC_WEAKKEY;
+      else if (c == 'v') weak |= LJ_GC_WEAKVAL;
+    }
+  }
+  return weak;
+}
+
+/* Number of array, hash and old hash slots of a table. */
+#define lj_gcvisit_ntabslots(t) \
+  ((t)->asize + ((t)->hmask ? (t)->hmask + 1 : 0) + \
+   ((t)->oldhmask ? (t)->oldhmask + 1 : 0))
+
+/* Size of a table with its slots. The shared slots of a copy-on-write table
+** belong to the template.
+*/
+#define lj_gcvisit_tabsize(t) \
+  (tabiscow(t) ? sizeof(GCtab) : \
+   sizeof(GCtab) + sizeof(TValue) * (t)->asize + \
+   ((t)->hmask ? sizeof(Node) * ((t)->hmask + 1) : 0) + \
+   ((t)->oldhmask ? sizeof(Node) * ((t)->oldhmask + 1) : 0))
+
+/* Visit the non-empty hash slots [start, end) of a node array. */
+static LJ_AINLINE void lj_gcvisit_nodes(Node *node, int weak, MSize start,
+					MSize end, GCVisitTV vtv, void *ud)
+{
+  MSize i;
+  for (i = start; i < end; i++) {
+    Node *n = &node[i];
+    if (!tvisnil(&n->val)) {
+      lj_assertX(!tvisnil(&n->key), "nil key in non-empty slot");
+      vtv(ud, &n->key, weak & LJ_GC_WEAKKEY);
+      vtv(ud, &n->val, weak & LJ_GC_WEAKVAL);
+    }
+  }
+}
+
+/* Visit the slots [start, end) of a table. Hash slots follow array slots,
+** old hash slots of an incremental resize follow hash slots. The array part
+** is skipped, if its values are weak and weak references aren't visited.
+*/
+static LJ_AINLINE void lj_gcvisit_tabslots(GCtab *t, int weak, int visitweak,
+					   MSize start, MSize end,
+					   GCVisitTV vtv, void *ud)
+{
+  MSize asize = t->asize;
+  lj_assertX(!tabiscow(t), "visit of shared table slots");
+  if (visitweak || !(weak & LJ_GC_WEAKVAL)) {  /* Visit array part. */
+    MSize i, aend = end < asize ? end : asize;
+    for (i = start; i < aend; i++)
+      vtv(ud, arrayslot(t, i), weak & LJ_GC_WEAKVAL);
+  }
+  if (end > asize) {  /* Visit hash part. */
+    MSize hsize = t->hmask ? t->hmask + 1 : 0, hend = end - asize;
+    MSize hstart = start > asize ? start - asize : 0;
+    lj_gcvisit_nodes(noderef(t->node), weak,
+		     hstart < hsize ? hstart : hsize,
+		     hend < hsize ? hend : hsize, vtv, ud);
+    if (hend > hsize)  /* Visit old hash part. */
+      lj_gcvisit_nodes(noderef(t->oldnode), weak,
+		       hstart > hsize ? hstart - hsize : 0, hend - hsize,
+		       vtv, ud);
+  }
+}
+
+/* Visit the slots of a table, but not its metatable. A copy-on-write table
+** refers to its template instead of the shared slots.
+*/
+static LJ_AINLINE void lj_gcvisit_tab(GCtab *t, int weak, int visitweak,
+				      GCVisitObj vobj, GCVisitTV vtv, void *ud)
+{
+  if (tabiscow(t))
+    vobj(ud, obj2gco(tabcowref(t)));
+  else
+    lj_gcvisit_tabslots(t, weak, visitweak, 0, lj_gcvisit_ntabslots(t),
+			vtv, ud);
+}
+
+/* Visit the metatable and the environment of a userdata. */
+static LJ_AINLINE void lj_gcvisit_udata(GCudata *u, GCVisitObj vobj, void *ud)
+{
+  GCtab *mt = tabref(u->metatable);
+  if (mt) vobj(ud, obj2gco(mt));
+  vobj(ud, obj2gco(tabref(u->env)));
+}
+
+/* Visit the environment, the prototype and the upvalues of a function. */
+static LJ_AINLINE void lj_gcvisit_func(GCfunc *fn, GCVisitObj vobj,
+				       GCVisitTV vtv, void *ud)
+{
+  uint32_t i;
+  vobj(ud, obj2gco(tabref(fn->c.env)));
+  if (isluafunc(fn)) {
+    vobj(ud, obj2gco(funcproto(fn)));
+    for (i = 0; i < fn->l.nupvalues; i++)  /* Lua function upvalues. */
+      vobj(ud, gcref(fn->l.uvptr[i]));
+  } else {
+    for (i = 0; i < fn->c.nupvalues; i++)  /* C function upvalues. */
+      vtv(ud, &fn->c.upvalue[i], 0);
+  }
+}
+
+/* Visit the chunk name, the collectable constants and the trace of a
+** prototype.
+*/
+static LJ_AINLINE void lj_gcvisit_proto(global_State *g, GCproto *pt,
+					GCVisitObj vobj, void *ud)
+{
+  ptrdiff_t i;
+  vobj(ud, obj2gco(proto_chunkname(pt)));
+  for (i = -(ptrdiff_t)pt->sizekgc; i < 0; i++)
+    vobj(ud, proto_kgc(pt, i));
+#if LJ_HASJIT
+  if (pt->trace) vobj(ud, obj2gco(traceref(G2J(g), pt->trace)));
+#else
+  UNUSED(g);
+#endif
+}
+
+#if LJ_HASJIT
+/* Visit the constants, the linked traces and the start prototype of a
+** trace.
+*/
+static LJ_AINLINE void lj_gcvisit_trace(global_State *g, GCtrace *T,
+					GCVisitObj vobj, void *ud)
+{
+  jit_State *J = G2J(g);
+  IRRef ref;
+  if (T->traceno == 0) return;
+  for (ref = T->nk; ref < REF_TRUE; ref++) {
+    IRIns *ir = &T->ir[ref];
+    if (ir->o == IR_KGC)
+      vobj(ud, ir_kgc(ir));
+    if (irt_is64(ir->t) && ir->o != IR_KNULL)
+      ref++;
+  }
+  if (T->link) vobj(ud, obj2gco(traceref(J, T->link)));
+  if (T->nextroot) vobj(ud, obj2gco(traceref(J, T->nextroot)));
+  if (T->nextside) vobj(ud, obj2gco(traceref(J, T->nextside)));
+  vobj(ud, gcref(T->startpt));
+}
+#endif
+
+/* Visit the stack slots below the top and the environment of a thread. */
+static LJ_AINLINE void lj_gcvisit_thread(lua_State *th, GCVisitObj vobj,
+					 GCVisitTV vtv, void *ud)
+{
+  TValue *o, *top = th->top;
+  for (o = tvref(th->stack)+1+LJ_FR2; o < top; o++)
+    vtv(ud, o, 0);
+  vobj(ud, obj2gco(tabref(th->env)));
+}
+
+/* Visit the frames of a thread. The functions of the frames are hidden from
+** the stack slots without LJ_FR2, so they are visited here. Returns the
+** minimum needed stack size.
+*/
+static LJ_AINLINE MSize lj_gcvisit_frames(lua_State *th, GCVisitObj vobj,
+					  void *ud)
+{
+  TValue *frame, *top = th->top-1, *bot = tvref(th->stack);
+  /* Note: extra vararg frame not skipped, visits function twice. */
+  for (frame = th->base-1; frame > bot+LJ_FR2; frame = frame_prev(frame)) {
+    GCfunc *fn = frame_func(frame);
+    TValue *ftop = frame;
+    if (isluafunc(fn)) ftop += funcproto(fn)->framesize;
+    if (ftop > top) top = ftop;
+    if (!LJ_FR2)  /* Need to visit hidden function (or L). */
+      vobj(ud, obj2gco(fn));
+  }
+  top++;  /* Correct bias of -1 (frame == base-1). */
+  if (top > tvref(th->maxstack)) top = tvref(th->maxstack);
+  return (MSize)(top - bot);
+}
+
+/* The string chains: the chains of the old string table follow the chains
+** of the new one, while the table is resized (see lj_str.c).
+*/
+#define lj_gcvisit_nstrchains(g) \
+  ((g)->strmask + 1 + ((g)->strold ? (g)->stroldmask + 1 : 0))
+
+/* Get the anchor of a string chain. */
+static LJ_AINLINE GCRef *lj_gcvisit_strchain(global_State *g, MSize i)
+{
+  return i <= g->strmask ? &g->strhash[i] : &g->strold[i - g->strmask - 1];
+}
+
+#endif
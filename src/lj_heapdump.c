@@ -0,0 +1,320 @@
+/*
+** Implementation of heap dump.
+**
+** The dump is streamed through the write buffer while walking the lists of
+** GC objects, so it needs no memory proportional to the heap size. Nothing
+** is allocated during the walk, hence the heap doesn't change meanwhile.
+*/
+
+#define lj_heapdump_c
+#define LUA_CORE
+
+#include <errno.h>
+
+#include "lj_arch.h"
+#include "lj_heapdump.h"
+
+#if LJ_HASMEMPROF
+
+#include "lj_obj.h"
+#include "lj_gc.h"
+#include "lj_gcvisit.h"
+#include "lj_tab.h"
+#include "lj_meta.h"
+#include "lj_frame.h"
+#include "lj_symtab.h"
+#if LJ_HASJIT
+#include "lj_jit.h"
+#endif
+#if LJ_HASFFI
+#include "lj_ctype.h"
+#endif
+
+static const unsigned char ljh_header[] = {'l', 'j', 'h',
+					   LJH_CURRENT_FORMAT_VERSION,
+					   0x0, 0x0, 0x0};
+
+/* Size of a GC object in bytes, like the collector accounts it. */
+static size_t heapdump_objsize(global_State *g, GCobj *o)
+{
+  switch (o->gch.gct) {
+  case ~LJ_TSTR:
+    return sizestring(gco2str(o));
+  case ~LJ_TUPVAL:
+    return sizeof(GCupval);
+  case ~LJ_TTHREAD:
+    return sizeof(lua_State) + sizeof(TValue) * gco2th(o)->stacksize;
+  case ~LJ_TPROTO:
+    return gco2pt(o)->sizept;
+  case ~LJ_TFUNC: {
+    GCfunc *fn = gco2func(o);
+    return isluafunc(fn) ? sizeLfunc((MSize)fn->l.nupvalues) :
+			   sizeCfunc((MSize)fn->c.nupvalues);
+    }
+#if LJ_HASJIT
+  case ~LJ_TTRACE: {
+    GCtrace *T = gco2trace(o);
+    return ((sizeof(GCtrace)+7)&~7) + (T->nins-T->nk)*sizeof(IRIns) +
+	   T->nsnap*sizeof(SnapShot) + T->nsnapmap*sizeof(SnapEntry);
+    }
+#endif
+#if LJ_HASFFI
+  case ~LJ_TCDATA: {
+    GCcdata *cd = gco2cd(o);
+    CType *ct;
+    if (cdataisv(cd))
+      return sizecdatav(cd);
+    ct = ctype_raw(ctype_ctsG(g), cd->ctypeid);
+    return sizeof(GCcdata) + (ctype_hassize(ct->info) ? ct->size : CTSIZE_PTR);
+    }
+#endif
+  case ~LJ_TTAB:
+    return lj_gcvisit_tabsize(gco2tab(o));
+  case ~LJ_TUDATA:
+    return sizeudata(gco2ud(o));
+  default:
+    lj_assertG(0, "bad GC type %d", o->gch.gct);
+    UNUSED(g);
+    return 0;
+  }
+}
+
+/* Write a reference to a GC object. */
+static LJ_AINLINE void heapdump_ref(struct lj_wbuf *out, const void *o)
+{
+  if (o != NULL)
+    lj_wbuf_addu64(out, (uintptr_t)o);
+}
+
+/* Write a reference to a GC object stored in a TValue. */
+static LJ_AINLINE void heapdump_reftv(struct lj_wbuf *out, cTValue *tv)
+{
+  if (tvisgcv(tv))
+    lj_wbuf_addu64(out, (uintptr_t)gcV(tv));
+}
+
+/* Ditto, but for a weak reference. Strings are never cleared from weak tables,
+** so these references are kept.
+*/
+static LJ_AINLINE void heapdump_reftv_weak(struct lj_wbuf *out, cTValue *tv)
+{
+  if (tvisstr(tv))
+    lj_wbuf_addu64(out, (uintptr_t)strV(tv));
+}
+
+/* Visitor of an object reference. */
+static void heapdump_visitobj(void *ud, GCobj *o)
+{
+  heapdump_ref((struct lj_wbuf *)ud, o);
+}
+
+/* Visitor of a value. */
+static void heapdump_visittv(void *ud, cTValue *tv, int weak)
+{
+  if (weak)
+    heapdump_reftv_weak((struct lj_wbuf *)ud, tv);
+  else
+    heapdump_reftv((struct lj_wbuf *)ud, tv);
+}
+
+/*
+** Get the weak mode of a table like the collector does, but don't touch
+** the metamethod cache.
+*/
+static int heapdump_tabmode(global_State *g, GCtab *t)
+{
+  GCtab *mt = tabref(t->metatable);
+  return lj_gcvisit_weakmode(mt ? lj_tab_getstr(mt, mmname_str(g, MM_mode)) :
+			     NULL);
+}
+
+/* Write the references of a table. */
+static void heapdump_tab(struct lj_wbuf *out, global_State *g, GCtab *t)
+{
+  heapdump_ref(out, tabref(t->metatable));
+  lj_gcvisit_tab(t, heapdump_tabmode(g, t), 1, heapdump_visitobj,
+		 heapdump_visittv, out);
+}
+
+/* Write the references of a thread. */
+static void heapdump_thread(struct lj_wbuf *out, lua_State *th)
+{
+  lj_gcvisit_thread(th, heapdump_visitobj, heapdump_visittv, out);
+  lj_gcvisit_frames(th, heapdump_visitobj, out);
+}
+
+/* Write a GC object along with its references. */
+static void heapdump_object(struct lj_wbuf *out, global_State *g, GCobj *o)
+{
+  uint8_t header = o->gch.gct;
+  uint64_t aux = 0;
+  switch (o->gch.gct) {
+  case ~LJ_TSTR:
+    aux = gco2str(o)->len;
+    break;
+  case ~LJ_TUPVAL:
+    if (gco2uv(o)->closed)
+      header |= HEAPDUMP_FLAG;
+    break;
+  case ~LJ_TFUNC: {
+    GCfunc *fn = gco2func(o);
+    if (isluafunc(fn)) {
+      aux = (uintptr_t)funcproto(fn);
+    } else {
+      header |= HEAPDUMP_FLAG;
+      aux = (uintptr_t)fn->c.f;
+    }
+    break;
+    }
+#if LJ_HASJIT
+  case ~LJ_TTRACE:
+    aux = gco2trace(o)->traceno;
+    break;
+#endif
+#if LJ_HASFFI
+  case ~LJ_TCDATA:
+    aux = gco2cd(o)->ctypeid;
+    break;
+#endif
+  case ~LJ_TTAB:
+    aux = gco2tab(o)->asize;
+    break;
+  case ~LJ_TUDATA:
+    aux = gco2ud(o)->len;
+    break;
+  default:
+    break;
+  }
+  lj_wbuf_addbyte(out, header);
+  lj_wbuf_addu64(out, (uintptr_t)o);
+  lj_wbuf_addu64(out, (uint64_t)heapdump_objsize(g, o));
+  lj_wbuf_addu64(out, aux);
+  switch (o->gch.gct) {
+  case ~LJ_TSTR: {
+    GCstr *s = gco2str(o);
+    MSize len = s->len < HEAPDUMP_STRMAX ? s->len : HEAPDUMP_STRMAX;
+    lj_wbuf_addu64(out, (uint64_t)len);
+    lj_wbuf_addn(out, strdata(s), len);
+    break;
+    }
+  case ~LJ_TUPVAL:
+    heapdump_reftv(out, uvval(gco2uv(o)));
+    break;
+  case ~LJ_TTHREAD:
+    heapdump_thread(out, gco2th(o));
+    break;
+  case ~LJ_TPROTO:
+    lj_gcvisit_proto(g, gco2pt(o), heapdump_visitobj, out);
+    break;
+  case ~LJ_TFUNC:
+    lj_gcvisit_func(gco2func(o), heapdump_visitobj, heapdump_visittv, out);
+    break;
+#if LJ_HASJIT
+  case ~LJ_TTRACE:
+    lj_gcvisit_trace(g, gco2trace(o), heapdump_visitobj, out);
+    break;
+#endif
+  case ~LJ_TTAB:
+    heapdump_tab(out, g, gco2tab(o));
+    break;
+  case ~LJ_TUDATA:
+    lj_gcvisit_udata(gco2ud(o), heapdump_visitobj, out);
+    break;
+  default:
+    break;
+  }
+  lj_wbuf_addbyte(out, 0);
+}
+
+/* Write a GC root. */
+static void heapdump_root(struct lj_wbuf *out, GCobj *o)
+{
+  if (o == NULL)
+    return;
+  lj_wbuf_addbyte(out, HEAPDUMP_ROOT | o->gch.gct);
+  lj_wbuf_addu64(out, (uintptr_t)o);
+}
+
+/* Write the GC roots, i.e. the objects the collector starts marking from. */
+static void heapdump_roots(struct lj_wbuf *out, global_State *g,
+			   lua_State *L)
+{
+  MSize i;
+  heapdump_root(out, obj2gco(mainthread(g)));
+  heapdump_root(out, obj2gco(tabref(mainthread(g)->env)));
+  if (tvisgcv(&g->registrytv))
+    heapdump_root(out, gcV(&g->registrytv));
+  heapdump_root(out, obj2gco(L));
+  for (i = 0; i < GCROOT_MAX; i++)
+    heapdump_root(out, gcref(g->gcroot[i]));
+}
+
+/* Walk all GC objects. Stop early if the stream is stopped. */
+static void heapdump_objects(struct lj_wbuf *out, global_State *g)
+{
+  GCobj *o;
+  MSize i;
+  for (o = gcref(g->gc.root); o != NULL; o = gcnext(o)) {
+    heapdump_object(out, g, o);
+    if (LJ_UNLIKELY(lj_wbuf_test_flag(out, STREAM_STOP)))
+      return;
+  }
+  if ((o = gcref(g->gc.mmudata)) != NULL) {  /* Circular list. */
+    GCobj *root = o;
+    do {
+      o = gcnext(o);
+      heapdump_object(out, g, o);
+    } while (o != root);
+  }
+  for (i = 0; i < lj_gcvisit_nstrchains(g); i++) {
+    for (o = gcref(*lj_gcvisit_strchain(g, i)); o != NULL; o = gcnext(o)) {
+      heapdump_object(out, g, o);
+      if ((o->gch.marked & LJ_GC_FIXED))  /* Never collected. */
+	heapdump_root(out, o);
+    }
+    if (LJ_UNLIKELY(lj_wbuf_test_flag(out, STREAM_STOP)))
+      return;
+  }
+}
+
+int lj_heapdump(struct lua_State *L, const struct luam_Heapdump_Options *opt)
+{
+  global_State *g = G(L);
+  struct lj_wbuf out;
+  uint32_t lib_adds = 0;
+  const size_t ljh_header_len = sizeof(ljh_header) / sizeof(ljh_header[0]);
+
+  lj_assertL(opt->writer != NULL, "uninitialized heapdump writer");
+  lj_assertL(opt->buf != NULL, "uninitialized heapdump writer buffer");
+  lj_assertL(opt->len != 0, "bad heapdump writer buffer length");
+
+  /* Leave only live objects in the heap. */
+  lj_gc_fullgc(L);
+
+  lj_wbuf_init(&out, opt->writer, opt->ctx, opt->buf, opt->len);
+  lj_symtab_dump(&out, g, &lib_adds);
+  lj_wbuf_addn(&out, ljh_header, ljh_header_len);
+  heapdump_roots(&out, g, L);
+  heapdump_objects(&out, g);
+  lj_wbuf_addbyte(&out, LJH_EPILOGUE_HEADER);
+  lj_wbuf_flush(&out);
+
+  if (LJ_UNLIKELY(lj_wbuf_test_flag(&out, STREAM_ERRIO|STREAM_STOP))) {
+    errno = lj_wbuf_errno(&out);
+    lj_wbuf_terminate(&out);
+    return PROFILE_ERRIO;
+  }
+  lj_wbuf_terminate(&out);
+  return PROFILE_SUCCESS;
+}
+
+#else /* LJ_HASMEMPROF */
+
+int lj_heapdump(struct lua_State *L, const struct luam_Heapdump_Options *opt)
+{
+  UNUSED(L);
+  UNUSED(opt);
+  return PROFILE_ERRUSE;
+}
+
+#endif /* LJ_HASMEMPROF */
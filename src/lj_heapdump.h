@@ -0,0 +1,87 @@
+/*
+** Heap dump.
+*/
+
+#ifndef _LJ_HEAPDUMP_H
+#define _LJ_HEAPDUMP_H
+
+#include "lj_def.h"
+#include "lj_wbuf.h"
+#include "lmisclib.h"
+
+#define LJH_CURRENT_FORMAT_VERSION 0x01
+
+/*
+** Heap dump stream format:
+**
+** stream         := symtab heapdump
+** symtab         := see symtab description
+** heapdump       := prologue record* epilogue
+** prologue       := 'l' 'j' 'h' version reserved
+** version        := <BYTE>
+** reserved       := <BYTE> <BYTE> <BYTE>
+** record         := root | object
+** root           := record-header obj-addr
+** object         := record-header obj-addr obj-size obj-aux obj-str? refs
+** obj-addr       := <ULEB128>
+** obj-size       := <ULEB128>
+** obj-aux        := <ULEB128>
+** obj-str        := string
+** refs           := ref-addr* ref-end
+** ref-addr       := <ULEB128>
+** ref-end        := <BYTE> (0x0)
+** string         := string-len string-payload
+** string-len     := <ULEB128>
+** string-payload := <BYTE> {string-len}
+** epilogue       := record-header
+**
+** <BYTE>   :  A single byte (no surprises here)
+** <ULEB128>:  Unsigned integer represented in ULEB128 encoding
+**
+** (Order of bits below is hi -> lo)
+**
+** version: [VVVVVVVV]
+**  * VVVVVVVV: Byte interpreted as a plain integer version number
+**
+** record-header: [FRXTTTTT]
+**  * TTTTT: 5 bits for representing the GC type of the object, i.e.
+**           the bitwise negation of its internal type tag (~LJ_TSTR etc.)
+**  * X    : type-specific flag: a C function for functions, a closed
+**           upvalue for upvalues
+**  * R    : 1 for a GC root, 0 for a GC object
+**  * F    : 0 for regular records, 1 for epilogue's *F*inal header
+**           (if F is set to 1, all other bits are currently ignored)
+**
+** obj-aux is type-specific: the length for strings and userdata, the
+** prototype or the C function address for functions (see the symtab),
+** the array size for tables, the ctype ID for cdata and the trace number
+** for traces. It is 0 for other objects.
+**
+** obj-str is present for strings only and contains at most the first
+** HEAPDUMP_STRMAX bytes of the string.
+**
+** refs are the addresses of the GC objects, which are referenced by the
+** object and kept alive by it, i.e. the weak references are omitted
+** (except for strings, which are never cleared from weak tables). Note that
+** a reference may point to a static object, which is not dumped.
+*/
+
+#define HEAPDUMP_GCT_MASK ((uint8_t)0x1f)
+#define HEAPDUMP_FLAG     ((uint8_t)0x20)
+#define HEAPDUMP_ROOT     ((uint8_t)0x40)
+
+#define LJH_EPILOGUE_HEADER 0x80
+
+/* Max length of the string contents in the dump. */
+#define HEAPDUMP_STRMAX 64
+
+/* Avoid to provide additional interfaces described in other headers. */
+struct lua_State;
+
+/*
+** Finishes a full GC cycle and dumps all live GC objects. Returns
+** PROFILE_SUCCESS on success and one of PROFILE_ERR* codes otherwise.
+*/
+int lj_heapdump(struct lua_State *L, const struct luam_Heapdump_Options *opt);
+
+#endif
@@ -190,6 +190,7 @@ IRFPMDEF(FPMENUM)
 /* FLOAD fields. */
 #define IRFLDEF(_) \
   _(STR_LEN,	offsetof(GCstr, len)) \
+  _(STR_FLAGS,	offsetof(GCstr, strflags)) \
   _(FUNC_ENV,	offsetof(GCfunc, l.env)) \
   _(FUNC_PC,	offsetof(GCfunc, l.pc)) \
   _(FUNC_FFID,	offsetof(GCfunc, l.ffid)) \
@@ -199,6 +200,8 @@ IRFPMDEF(FPMENUM)
   _(TAB_NODE,	offsetof(GCtab, node)) \
   _(TAB_ASIZE,	offsetof(GCtab, asize)) \
   _(TAB_HMASK,	offsetof(GCtab, hmask)) \
+  _(TAB_OLDHMASK, offsetof(GCtab, oldhmask)) \
+  _(TAB_COLO,	offsetof(GCtab, colo)) \
   _(TAB_NOMM,	offsetof(GCtab, nomm)) \
   _(UDATA_META,	offsetof(GCudata, metatable)) \
   _(UDATA_UDTYPE, offsetof(GCudata, udtype)) \
@@ -137,7 +137,8 @@ typedef struct CCallInfo {
 
 /* Function definitions for CALL* instructions. */
 #define IRCALLDEF(_) \
-  _(ANY,	lj_str_cmp,		2,  FN, INT, CCI_NOFPRCLOBBER) \
+  _(ANY,	lj_str_cmp,		2,  FN, INT, 0) \
+  _(ANY,	lj_str_equal,		2,  FN, INT, 0) \
   _(ANY,	lj_str_find,		4,   N, PGC, 0) \
   _(ANY,	lj_str_new,		3,   S, STR, CCI_L) \
   _(ANY,	lj_strscan_num,		2,  FN, INT, 0) \
@@ -165,8 +166,11 @@ typedef struct CCallInfo {
   _(ANY,	lj_tab_new_ah,		3,   A, TAB, CCI_L) \
   _(ANY,	lj_tab_new1,		2,  FS, TAB, CCI_L) \
   _(ANY,	lj_tab_dup,		2,  FS, TAB, CCI_L) \
-  _(ANY,	lj_tab_clear,		1,  FS, NIL, 0) \
+  _(ANY,	lj_tab_clear,		2,  FS, NIL, CCI_L) \
+  _(ANY,	lj_tab_unshare,		2,  FS, NIL, CCI_L) \
   _(ANY,	lj_tab_newkey,		3,   S, PGC, CCI_L) \
+  _(ANY,	lj_tab_move,		6,   S, NIL, CCI_L) \
+  _(ANY,	lj_tab_rotate,		5,   S, NIL, CCI_L) \
   _(ANY,	lj_tab_len,		1,  FL, INT, 0) \
   _(ANY,	lj_gc_step_jit,		2,  FS, NIL, CCI_L) \
   _(ANY,	lj_gc_barrieruv,	2,  FS, NIL, 0) \
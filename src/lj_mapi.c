@@ -12,13 +12,17 @@
 #include "lmisclib.h"
 
 #include "lj_obj.h"
+#include "lj_gc.h"
 #include "lj_dispatch.h"
+#include "lj_alloc.h"
 
 #if LJ_HASJIT
 #include "lj_jit.h"
+#include "lj_trace.h"
 #endif
 
 #include "lj_sysprof.h"
+#include "lj_heapdump.h"
 
 LUAMISC_API void luaM_metrics(lua_State *L, struct luam_Metrics *metrics)
 {
@@ -64,6 +68,194 @@ LUAMISC_API void luaM_metrics(lua_State *L, struct luam_Metrics *metrics)
   metrics->jit_mcode_size = 0;
   metrics->jit_trace_num = 0;
 #endif
+
+  metrics->gc_steps_time = gc->steptime;
+  metrics->gc_steps_time_max = gc->steptime_max;
+  metrics->gc_steps_remark = gc->state_count[GCSremark];
+
+  metrics->gc_finq_len = gc->finqlen;
+  metrics->gc_finalized = gc->finalized;
+  metrics->gc_finq_latency = gc->finlat;
+  metrics->gc_finq_latency_max = gc->finlat_max;
+
+  metrics->gc_time_pause = gc->statetime[GCSpause];
+  metrics->gc_time_propagate = gc->statetime[GCSpropagate];
+  metrics->gc_time_remark = gc->statetime[GCSremark];
+  metrics->gc_time_atomic = gc->statetime[GCSatomic];
+  metrics->gc_time_sweepstring = gc->statetime[GCSsweepstring];
+  metrics->gc_time_sweep = gc->statetime[GCSsweep];
+  metrics->gc_time_finalize = gc->statetime[GCSfinalize];
+  LJ_STATIC_ASSERT(LUAM_GC_PAUSE_HIST == GCPAUSEHIST);
+  memcpy(metrics->gc_pause_hist, gc->pausehist, sizeof(gc->pausehist));
+  metrics->gc_cycles = gc->cycles;
+  metrics->gc_marked = gc->marked;
+  metrics->gc_swept = gc->swept;
+
+#ifndef LUAJIT_USE_SYSMALLOC
+  if (g->allocf == lj_alloc_f) {
+    AllocStats st;
+    lj_alloc_getstats(g->allocd, &st);
+    metrics->alloc_mapped = st.mapped;
+    metrics->alloc_mmap = st.nmmap;
+    metrics->alloc_munmap = st.nmunmap;
+    metrics->alloc_mremap = st.nmremap;
+    metrics->alloc_madvise = st.nmadvise;
+    metrics->alloc_released = st.released;
+    metrics->alloc_segments = st.nsegs;
+    metrics->alloc_segments_size = st.segsize;
+    metrics->alloc_free = st.free;
+    metrics->alloc_direct = st.ndirect;
+    metrics->alloc_direct_size = st.direct;
+    metrics->alloc_slabs_size = st.slabmapped;
+    metrics->alloc_slabs_used = st.slabused;
+    LJ_STATIC_ASSERT(LUAM_ALLOC_SIZE_HIST == ALLOC_SIZEHIST);
+    memcpy(metrics->alloc_size_hist, st.sizehist, sizeof(st.sizehist));
+    metrics->alloc_reclaimq_len = st.reclaimqlen;
+    metrics->alloc_reclaimq_size = st.reclaimqsize;
+    metrics->alloc_reclaimed = st.reclaimed;
+    metrics->alloc_reclaimq_latency = st.reclaimlat;
+    metrics->alloc_reclaimq_latency_max = st.reclaimlat_max;
+    metrics->alloc_hugepages_size = st.hugemapped;
+  } else
+#endif
+  {
+    metrics->alloc_mapped = 0;
+    metrics->alloc_mmap = 0;
+    metrics->alloc_munmap = 0;
+    metrics->alloc_mremap = 0;
+    metrics->alloc_madvise = 0;
+    metrics->alloc_released = 0;
+    metrics->alloc_segments = 0;
+    metrics->alloc_segments_size = 0;
+    metrics->alloc_free = 0;
+    metrics->alloc_direct = 0;
+    metrics->alloc_direct_size = 0;
+    metrics->alloc_slabs_size = 0;
+    metrics->alloc_slabs_used = 0;
+    memset(metrics->alloc_size_hist, 0, sizeof(metrics->alloc_size_hist));
+    metrics->alloc_reclaimq_len = 0;
+    metrics->alloc_reclaimq_size = 0;
+    metrics->alloc_reclaimed = 0;
+    metrics->alloc_reclaimq_latency = 0;
+    metrics->alloc_reclaimq_latency_max = 0;
+    metrics->alloc_hugepages_size = 0;
+  }
+
+  metrics->gc_emergency = gc->emergency;
+
+  metrics->strhash_nointern = g->strhash_nointern;
+}
+
+/* --- Idle-time garbage collection --------------------------------------- */
+
+LUAMISC_API int luaM_gc_idle(lua_State *L, uint64_t deadline_ns)
+{
+  int res = lj_gc_idle(L, deadline_ns);
+#ifndef LUAJIT_USE_SYSMALLOC
+  /* Release the pages freed by the GC with the lazy trimming. */
+  if (G(L)->allocf == lj_alloc_f)
+    lj_alloc_idle(G(L)->allocd);
+#endif
+  return res;
+}
+
+/* --- Memory limits ----------------------------------------------------- */
+
+LUAMISC_API int luaM_setmemlimit(lua_State *L, size_t soft, size_t hard,
+				 int flags)
+{
+  global_State *g = G(L);
+  GCSize hlim = hard == 0 || hard > LJ_MAX_MEM ? LJ_MAX_MEM : (GCSize)hard;
+  GCSize slim = soft == 0 || soft > hlim ? hlim : (GCSize)soft;
+  if (soft != 0 && hard != 0 && soft > hard)
+    return -1;
+  g->gc.softlimit = slim;
+  g->gc.hardlimit = hlim;
+  g->gc.limflush = (flags & LUAM_MEMLIMIT_FLUSH) != 0;
+  g->gc.limflushed = 0;
+  /* Apply the limits on the next GC check, unless the GC is stopped. */
+  if (g->gc.threshold != LJ_MAX_MEM && g->gc.threshold > slim)
+    g->gc.threshold = slim;
+  return 0;
+}
+
+/* --- Allocator trimming ------------------------------------------------ */
+
+LUAMISC_API int luaM_alloc_decay(lua_State *L, uint64_t decay_ns)
+{
+#ifndef LUAJIT_USE_SYSMALLOC
+  global_State *g = G(L);
+  if (g->allocf == lj_alloc_f)
+    return lj_alloc_setdecay(g->allocd, decay_ns);
+#else
+  UNUSED(L); UNUSED(decay_ns);
+#endif
+  return -1;
+}
+
+LUAMISC_API size_t luaM_alloc_trim(lua_State *L)
+{
+#ifndef LUAJIT_USE_SYSMALLOC
+  global_State *g = G(L);
+  if (g->allocf == lj_alloc_f)
+    return lj_alloc_trim(g->allocd);
+#else
+  UNUSED(L);
+#endif
+  return 0;
+}
+
+LUAMISC_API int luaM_alloc_reclaim(lua_State *L, int enable)
+{
+#ifndef LUAJIT_USE_SYSMALLOC
+  global_State *g = G(L);
+  if (g->allocf == lj_alloc_f)
+    return lj_alloc_setreclaim(g->allocd, enable);
+#else
+  UNUSED(L); UNUSED(enable);
+#endif
+  return -1;
+}
+
+/* --- Huge pages --------------------------------------------------------- */
+
+LUAMISC_API int luaM_hugepages(lua_State *L, int mode)
+{
+#ifndef LUAJIT_USE_SYSMALLOC
+  global_State *g = G(L);
+  LJ_STATIC_ASSERT(LUAM_HUGEPAGES_OFF == LJ_ALLOC_HUGE_OFF);
+  LJ_STATIC_ASSERT(LUAM_HUGEPAGES_THP == LJ_ALLOC_HUGE_THP);
+  LJ_STATIC_ASSERT(LUAM_HUGEPAGES_HUGETLB == LJ_ALLOC_HUGE_HUGETLB);
+  if (g->allocf == lj_alloc_f && mode <= LUAM_HUGEPAGES_HUGETLB)
+    return lj_alloc_hugepages(g->allocd, mode);
+#else
+  UNUSED(L); UNUSED(mode);
+#endif
+  return -1;
+}
+
+/* --- Uninterned strings ------------------------------------------------- */
+
+LUAMISC_API long luaM_strnointern(lua_State *L, size_t threshold)
+{
+#if LJ_HASSTRNOINTERN
+  global_State *g = G(L);
+  MSize old = g->strnointern;
+  MSize new = (threshold == 0 || threshold >= LJ_MAX_STR) ?
+	      LJ_MAX_STR : (MSize)threshold;
+  if (new != old) {
+#if LJ_HASJIT
+    /* The traces don't guard against uninterned strings before the mode. */
+    if (lj_trace_flushall(L))
+      return -1;
+#endif
+    g->strnointern = new;
+  }
+  return old == LJ_MAX_STR ? 0 : (long)old;
+#else
+  UNUSED(L); UNUSED(threshold);
+  return -1;
+#endif
 }
 
 /* --- Platform and Lua profiler ------------------------------------------ */
@@ -98,3 +290,11 @@ LUAMISC_API int luaM_sysprof_report(struct luam_Sysprof_Counters *counters)
 {
   return lj_sysprof_report(counters);
 }
+
+/* --- Heap dump ---------------------------------------------------------- */
+
+LUAMISC_API int luaM_heapdump(lua_State *L,
+                              const struct luam_Heapdump_Options *opt)
+{
+  return lj_heapdump(L, opt);
+}
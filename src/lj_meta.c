@@ -166,7 +166,9 @@ TValue *lj_meta_tset(lua_State *L, cTValue *o, cTValue *k)
     cTValue *mo;
     if (LJ_LIKELY(tvistab(o))) {
       GCtab *t = tabV(o);
-      cTValue *tv = lj_tab_get(L, t, k);
+      cTValue *tv;
+      lj_tab_unsharecow(L, t);
+      tv = lj_tab_get(L, t, k);
       if (LJ_LIKELY(!tvisnil(tv))) {
 	t->nomm = 0;  /* Invalidate negative metamethod cache. */
 	lj_gc_anybarriert(L, t);
@@ -296,7 +298,7 @@ TValue *lj_meta_cat(lua_State *L, TValue *top, int left)
 	  lj_strfmt_putfnum(sb, STRFMT_G14, numV(o));
 	}
       }
-      setstrV(L, top, lj_buf_str(L, sb));
+      setstrV(L, top, lj_buf_strdata(L, sb));
     }
   } while (left >= 1);
   if (LJ_UNLIKELY(G(L)->gc.total >= G(L)->gc.threshold)) {
@@ -323,8 +325,11 @@ TValue * LJ_FASTCALL lj_meta_len(lua_State *L, cTValue *o)
 /* Helper for equality comparisons. __eq metamethod. */
 TValue *lj_meta_equal(lua_State *L, GCobj *o1, GCobj *o2, int ne)
 {
+  cTValue *mo;
+  if (o1->gch.gct == ~LJ_TSTR)  /* Different strings, one is uninterned. */
+    return (TValue *)(intptr_t)(lj_str_equal(&o1->str, &o2->str) ^ ne);
   /* Field metatable must be at same offset for GCtab and GCudata! */
-  cTValue *mo = lj_meta_fast(L, tabref(o1->gch.metatable), MM_eq);
+  mo = lj_meta_fast(L, tabref(o1->gch.metatable), MM_eq);
   if (mo) {
     TValue *top;
     uint32_t it;
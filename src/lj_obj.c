@@ -7,6 +7,7 @@
 #define LUA_CORE
 
 #include "lj_obj.h"
+#include "lj_str.h"
 
 /* Object type names. */
 LJ_DATADEF const char *const lj_obj_typename[] = {  /* ORDER LUA_T */
@@ -26,7 +27,9 @@ int LJ_FASTCALL lj_obj_equal(cTValue *o1, cTValue *o2)
     if (tvispri(o1))
       return 1;
     if (!tvisnum(o1))
-      return gcrefeq(o1->gcr, o2->gcr);
+      return gcrefeq(o1->gcr, o2->gcr) ||
+	     (LJ_HASSTRNOINTERN && tvisstr(o1) &&
+	      lj_str_equal(strV(o1), strV(o2)));
   } else if (!tvisnumber(o1) || !tvisnumber(o2)) {
     return 0;
   }
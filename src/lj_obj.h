@@ -298,7 +298,7 @@ typedef const TValue cTValue;
 typedef struct GCstr {
   GCHeader;
   uint8_t reserved;	/* Used by lexer for fast lookup of reserved words. */
-  uint8_t strflags;	/* If LUAJIT_SMART_STRINGS: hash function used(+). */
+  uint8_t strflags;	/* Hash function used(+) or uninterned string. */
   MSize hash;		/* Hash of string. */
   MSize len;		/* Size of string. */
 } GCstr;
@@ -310,6 +310,11 @@ typedef struct GCstr {
 #define sizestring(s)	(sizeof(struct GCstr)+(s)->len+1)
 #define strsmart(s)	((s)->strflags >= 0xc0)
 
+/* The string is not in the string hash table, see lj_str_newdata(). */
+#define LJ_STR_NOINTERN	0x80
+#define strnointern(s) \
+  (LJ_HASSTRNOINTERN && (s)->strflags == LJ_STR_NOINTERN)
+
 /* -- Userdata object ----------------------------------------------------- */
 
 /* Userdata object. Payload follows. */
@@ -490,7 +495,7 @@ LJ_STATIC_ASSERT(offsetof(Node, val) == 0);
 typedef struct GCtab {
   GCHeader;
   uint8_t nomm;		/* Negative cache for fast metamethods. */
-  int8_t colo;		/* Array colocation. */
+  int8_t colo;		/* Array and hash colocation. */
   MRef array;		/* Array part. */
   GCRef gclist;
   GCRef metatable;	/* Must be at same offset in GCudata. */
@@ -499,10 +504,41 @@ typedef struct GCtab {
   uint32_t hmask;	/* Hash part mask (size of hash part - 1). */
 #if LJ_GC64
   MRef freetop;		/* Top of free elements. */
+#endif
+  MRef oldnode;		/* Old hash part during an incremental resize or
+			** template of a copy-on-write table. */
+  uint32_t oldhmask;	/* Old hash part mask or 0 (no resize in progress). */
+#if LJ_GC64
+  uint32_t oldpos;	/* Next old hash slot to move. */
 #endif
 } GCtab;
 
-#define sizetabcolo(n)	((n)*sizeof(TValue) + sizeof(GCtab))
+/*
+** Colocation of the array and hash parts: the bits 0-4 of t->colo hold the
+** size of the colocated array part, the bits 5-6 hold the hash bits of the
+** colocated hash part. The bit 7 is set, if the colocated array part has
+** been separated. The colocated hash part is separated, if t->node points
+** elsewhere.
+**
+** A copy-on-write table has only the bit 7 set, which never happens for a
+** colocated table. It shares the array or the hash part of the template
+** in t->oldnode until its first store, see lj_tab_dupcow().
+*/
+#define TAB_COLO_AMASK	0x1f
+#define TAB_COLO_HSHIFT	5
+#define TAB_COLO_SEP	0x80
+#define TAB_COLO_COW	0x80
+#define sizetabcolo(n, hbits) \
+  ((n)*sizeof(TValue) + ((hbits) ? sizeof(Node) << (hbits) : 0) + \
+   sizeof(GCtab))
+#define tabcoloasize(t)	((uint32_t)(t)->colo & TAB_COLO_AMASK)
+#define tabcolohbits(t)	(((uint32_t)(t)->colo >> TAB_COLO_HSHIFT) & 3)
+#define tabcolonode(t) \
+  ((Node *)((char *)(t) + sizeof(GCtab) + tabcoloasize(t)*sizeof(TValue)))
+#define tabisacolo(t) \
+  (tabcoloasize(t) != 0 && !((t)->colo & TAB_COLO_SEP))
+#define tabishcolo(t) \
+  (tabcolohbits(t) != 0 && noderef((t)->node) == tabcolonode(t))
 #define tabref(r)	(&gcref((r))->tab)
 #define noderef(r)	(mref((r), Node))
 #define nextnode(n)	(mref((n)->next, Node))
@@ -513,6 +549,18 @@ typedef struct GCtab {
 #define getfreetop(t, n)	(noderef((n)->freetop))
 #define setfreetop(t, n, v)	(setmref((n)->freetop, (v)))
 #endif
+#if LJ_GC64
+#define getoldpos(t, n)		((t)->oldpos)
+#define setoldpos(t, n, v)	((t)->oldpos = (v))
+#else
+/* Stored in the unused free top of the old hash part. */
+#define getoldpos(t, n)		((n)->freetop.ptr32)
+#define setoldpos(t, n, v)	((n)->freetop.ptr32 = (v))
+#endif
+#define tabresizing(t)		(LJ_HASTABINCR && (t)->oldhmask != 0)
+#define tabiscow(t) \
+  (LJ_HASTABCOW && (uint8_t)(t)->colo == TAB_COLO_COW)
+#define tabcowref(t)		(mref((t)->oldnode, GCtab))
 
 /* -- State objects ------------------------------------------------------- */
 
@@ -591,6 +639,7 @@ typedef enum {
 enum {
   GCSpause,		/* Start a GC cycle and mark the root set.*/
   GCSpropagate,		/* One gray object is processed. */
+  GCSremark,		/* One object from the gray-again list is processed. */
   GCSatomic,		/* Atomic transition from mark to sweep phase. */
   GCSsweepstring,	/* Sweep one chain of strings. */
   GCSsweep,		/* Sweep few objects from root. */
@@ -598,6 +647,24 @@ enum {
   GCSmax
 };
 
+/* Number of buckets in the log-scale histogram of GC step durations. */
+#define GCPAUSEHIST	20
+
+/* Objects appended to the finalization queue during one GC step. */
+typedef struct GCfinqMark {
+  uint64_t time;	/* Time of the first append (ns). */
+  size_t n;		/* Number of these objects left in the queue. */
+} GCfinqMark;
+
+/* Number of GC steps with appends tracked in the finalization queue. */
+#define GCFINQMARKS	16
+
+/* Garbage collector modes. */
+enum {
+  GCMinc,		/* Incremental: every cycle marks the whole heap. */
+  GCMgen		/* Generational: survivors of a cycle become old. */
+};
+
 struct lj_sysprof_topframe {
   uint8_t ffid; /* FFID of the fast function VM is about to execute. */
   TValue *top_frame; /* Top frame for sysprof. */
@@ -609,11 +676,15 @@ typedef struct GCState {
   uint8_t currentwhite;	/* Current white color. */
   uint8_t state;	/* GC state. */
   uint8_t nocdatafin;	/* No cdata finalizer called. */
+  uint8_t mode;		/* GC mode: incremental or generational. */
+  uint8_t keepold;	/* Survivors keep their marks (old generation). */
 #if LJ_64
   uint8_t lightudnum;	/* Number of lightuserdata segments - 1. */
 #else
   uint8_t unused1;
 #endif
+  uint8_t bgsweep;	/* Sweep strings on the helper thread. */
+  uint8_t strlock;	/* String table is shared with the helper thread. */
   MSize sweepstr;	/* Sweep position in string table. */
   GCRef root;		/* List of all collectable objects. */
   MRef sweep;		/* Sweep position in root list. */
@@ -625,6 +696,12 @@ typedef struct GCState {
   GCSize estimate;	/* Estimate of memory actually in use. */
   MSize stepmul;	/* Incremental GC step granularity. */
   MSize pause;		/* Pause between successive GC cycles. */
+  GCSize genbase;	/* Estimate after the last full mark. */
+  size_t strmiss;	/* strhash_miss at the last atomic phase. */
+  MSize budget;		/* Time budget of an incremental step (us). */
+  MSize travpos;	/* Traversal position in travtab. */
+  GCRef travtab;	/* Large table traversed in chunks. */
+  MRef thread;		/* Helper thread or NULL (see lj_gcthread.c). */
 #if LJ_64
   MRef lightudseg;	/* Upper bits of lightuserdata segments. */
 #endif
@@ -632,11 +709,34 @@ typedef struct GCState {
   size_t freed;		/* Total amount of freed memory. */
   size_t allocated;	/* Total amount of allocated memory. */
   size_t state_count[GCSmax]; /* Count of incremental GC steps per state. */
+  uint64_t steptime;	/* Total time of incremental GC steps (ns). */
+  uint64_t steptime_max;	/* Time of the longest incremental GC step (ns). */
   size_t tabnum;	/* Amount of allocated table objects. */
   size_t udatanum;	/* Amount of allocated udata objects. */
 #ifdef LJ_HASFFI
   size_t cdatanum;	/* Amount of allocated cdata objects. */
 #endif
+  MSize finbudget;	/* Time budget of finalizers per step (us). */
+  size_t finqlen;	/* Number of objects in the finalization queue. */
+  size_t finalized;	/* Total number of finalized objects. */
+  GCfinqMark finqmark[GCFINQMARKS]; /* Ring of the appends to the queue. */
+  uint32_t finqhead;	/* Ring index of the oldest mark. */
+  uint32_t finqnmark;	/* Number of marks in the ring. */
+  size_t finqstep;	/* GC step of the newest mark. */
+  uint64_t finlat;	/* Total time of finalized objects in the queue (ns). */
+  uint64_t finlat_max;	/* Longest time of an object in the queue (ns). */
+  uint64_t statetime[GCSmax]; /* Time of incremental GC steps per state (ns). */
+  size_t pausehist[GCPAUSEHIST]; /* Histogram of GC step durations. */
+  GCSize sweepbase;	/* Memory in use at the start of the sweep phase. */
+  GCSize sweepfreed;	/* Memory freed in the current sweep phase. */
+  size_t cycles;	/* Number of finished sweep phases. */
+  size_t marked;	/* Total amount of memory surviving the sweep phases. */
+  size_t swept;		/* Total amount of memory freed by the sweep phases. */
+  GCSize softlimit;	/* Accelerated collection above this limit. */
+  GCSize hardlimit;	/* Emergency full GC above this limit. */
+  uint8_t limflush;	/* Flush the traces above the soft limit. */
+  uint8_t limflushed;	/* Traces are flushed above the soft limit. */
+  size_t emergency;	/* Number of emergency full GCs. */
 } GCState;
 
 /* Global state, shared by all threads of a Lua universe. */
@@ -644,6 +744,12 @@ typedef struct global_State {
   GCRef *strhash;	/* String hash table (hash chain anchors). */
   MSize strmask;	/* String hash mask (size of hash table - 1). */
   MSize strnum;		/* Number of strings in hash table. */
+  GCRef *strold;	/* Old string hash table while resizing or NULL. */
+  MSize stroldmask;	/* Old string hash mask. */
+  MSize strmove;	/* Next old hash chain to move to the new table. */
+#if LUAJIT_SEEDED_STRHASH
+  uint64_t strseed;	/* Seed of the string hash function. */
+#endif
 #if LUAJIT_SMART_STRINGS
   struct {
     BloomFilter cur[2];
@@ -652,6 +758,8 @@ typedef struct global_State {
 #endif
   size_t strhash_hit;	/* Strings amount found in string hash. */
   size_t strhash_miss;	/* Strings amount allocated and put into string hash. */
+  size_t strhash_nointern;  /* Strings amount allocated without interning. */
+  MSize strnointern;	/* Min. length of uninterned strings or LJ_MAX_STR. */
   lua_Alloc allocf;	/* Memory allocator. */
   void *allocd;		/* Memory allocator data. */
   GCState gc;		/* Garbage collector. */
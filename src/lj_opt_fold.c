@@ -669,7 +669,7 @@ LJFOLDF(bufput_kfold_op)
 						       ir_kstr(IR(fleft->op2)));
     fins->o = IR_BUFPUT;
     fins->op1 = fleft->op1;
-    fins->op2 = lj_ir_kstr(J, lj_buf_tostr(sb));
+    fins->op2 = lj_ir_kstr(J, lj_buf_str(J->L, sb));
     return RETRYFOLD;
   }
   return EMITFOLD;  /* Always emit, CSE later. */
@@ -685,7 +685,7 @@ LJFOLDF(bufput_kfold_rep)
       sb = lj_buf_putstr_rep(sb, ir_kstr(IR(irc->op2)), IR(fleft->op2)->i);
       fins->o = IR_BUFPUT;
       fins->op1 = irc->op1;
-      fins->op2 = lj_ir_kstr(J, lj_buf_tostr(sb));
+      fins->op2 = lj_ir_kstr(J, lj_buf_str(J->L, sb));
       return RETRYFOLD;
     }
   }
@@ -728,7 +728,7 @@ LJFOLDF(bufput_kfold_fmt)
     }
     fins->o = IR_BUFPUT;
     fins->op1 = irc->op1;
-    fins->op2 = lj_ir_kstr(J, lj_buf_tostr(sb));
+    fins->op2 = lj_ir_kstr(J, lj_buf_str(J->L, sb));
     return RETRYFOLD;
   }
   return EMITFOLD;  /* Always emit, CSE later. */
@@ -2193,11 +2193,23 @@ LJFOLDF(fload_tab_tdup_hmask)
   return NEXTFOLD;
 }
 
+/* A new table has no incremental resize in progress until a NEWREF. */
+LJFOLD(FLOAD TNEW IRFL_TAB_OLDHMASK)
+LJFOLD(FLOAD TDUP IRFL_TAB_OLDHMASK)
+LJFOLDF(fload_tab_tnew_oldhmask)
+{
+  if (LJ_LIKELY(J->flags & JIT_F_OPT_FOLD) && lj_opt_fwd_tptr(J, fins->op1))
+    return INTFOLD(0);
+  return NEXTFOLD;
+}
+
 LJFOLD(HREF any any)
 LJFOLD(FLOAD any IRFL_TAB_ARRAY)
 LJFOLD(FLOAD any IRFL_TAB_NODE)
 LJFOLD(FLOAD any IRFL_TAB_ASIZE)
 LJFOLD(FLOAD any IRFL_TAB_HMASK)
+LJFOLD(FLOAD any IRFL_TAB_OLDHMASK)
+LJFOLD(FLOAD any IRFL_TAB_COLO)
 LJFOLDF(fload_tab_ah)
 {
   TRef tr = lj_opt_cse(J);
@@ -2277,6 +2289,7 @@ LJFOLDF(fload_cdata_ptr_int64_cnew)
 }
 
 LJFOLD(FLOAD any IRFL_STR_LEN)
+LJFOLD(FLOAD any IRFL_STR_FLAGS)
 LJFOLD(FLOAD any IRFL_FUNC_ENV)
 LJFOLD(FLOAD any IRFL_THREAD_ENV)
 LJFOLD(FLOAD any IRFL_CDATA_CTYPEID)
@@ -72,21 +72,29 @@ static AliasRet aa_table(jit_State *J, IRRef ta, IRRef tb)
   return aa_escape(J, taba, tabb);
 }
 
-/* Check whether there's no aliasing table.clear. */
+/* Check whether there's no aliasing table.clear, unshare or slot move. */
 static int fwd_aa_tab_clear(jit_State *J, IRRef lim, IRRef ta)
 {
   IRRef ref = J->chain[IR_CALLS];
   while (ref > lim) {
     IRIns *calls = IR(ref);
-    if (calls->op2 == IRCALL_lj_tab_clear &&
-	(ta == calls->op1 || aa_table(J, ta, calls->op1) != ALIAS_NO))
-      return 0;  /* Conflict. */
+    if (calls->op2 == IRCALL_lj_tab_clear ||
+	calls->op2 == IRCALL_lj_tab_unshare ||
+	calls->op2 == IRCALL_lj_tab_move ||
+	calls->op2 == IRCALL_lj_tab_rotate) {
+      IRRef tb = calls->op1;  /* The modified table is the first argument. */
+      while (IR(tb)->o == IR_CARG) tb = IR(tb)->op1;
+      if (ta == tb || aa_table(J, ta, tb) != ALIAS_NO)
+	return 0;  /* Conflict. */
+    }
     ref = calls->prev;
   }
   return 1;  /* No conflict. Can safely FOLD/CSE. */
 }
 
-/* Check whether there's no aliasing NEWREF/table.clear for the left operand. */
+/* Check whether there's no aliasing NEWREF/table.clear/unshare/move for the
+** left operand.
+*/
 int LJ_FASTCALL lj_opt_fwd_tptr(jit_State *J, IRRef lim)
 {
   IRRef ta = fins->op1;
@@ -1378,6 +1378,7 @@ static void fs_fixup_k(FuncState *fs, GCproto *pt, void *kptr)
       else
 	setnumV(tv, (lua_Number)i);
     }
+  lj_tab_finishresize(fs->L, kt);
   node = noderef(kt->node);
   hmask = kt->hmask;
   for (i = 0; i <= hmask; i++) {
@@ -1823,6 +1824,7 @@ static void expr_table(LexState *ls, ExpDesc *e)
   } else {
     if (needarr && t->asize < narr)
       lj_tab_reasize(fs->L, t, narr-1);
+    lj_tab_finishresize(fs->L, t);  /* Template tables are copied as is. */
     if (fixt) {  /* Fix value for dummy keys in template table. */
       Node *node = noderef(t->node);
       uint32_t i, hmask = t->hmask;
@@ -216,6 +216,21 @@ static TRef getcurrf(jit_State *J)
   return sloadt(J, -1-LJ_FR2, IRT_FUNC, IRSLOAD_READONLY);
 }
 
+#if LJ_HASSTRNOINTERN
+/* Uninterned strings may exist once the mode has been enabled. */
+#define rec_strnointern(J) \
+  (J2G(J)->strnointern != LJ_MAX_STR || J2G(J)->strhash_nointern != 0)
+
+/* Guard that a string is interned, i.e. it's unique for its contents. */
+static void rec_strinterned(jit_State *J, TRef tr)
+{
+  if (!tref_isk(tr)) {
+    TRef tmp = emitir(IRT(IR_FLOAD, IRT_U8), tr, IRFL_STR_FLAGS);
+    emitir(IRTGI(IR_NE), tmp, lj_ir_kint(J, LJ_STR_NOINTERN));
+  }
+}
+#endif
+
 /* Compare for raw object equality.
 ** Returns 0 if the objects are the same.
 ** Returns 1 if they are different, but the same type.
@@ -239,6 +254,18 @@ int lj_record_objcmp(jit_State *J, TRef a, TRef b, cTValue *av, cTValue *bv)
 	return 2;  /* Two different types are never equal. */
       }
     }
+#if LJ_HASSTRNOINTERN
+    if (ta == IRT_STR && rec_strnointern(J)) {
+      if (strnointern(strV(av)) || strnointern(strV(bv))) {
+	/* Uninterned strings are compared by contents. */
+	TRef tr = lj_ir_call(J, IRCALL_lj_str_equal, a, b);
+	emitir(IRTGI(diff ? IR_EQ : IR_NE), tr, lj_ir_kint(J, 0));
+	return diff;
+      }
+      rec_strinterned(J, a);
+      rec_strinterned(J, b);
+    }
+#endif
     emitir(IRTG(diff ? IR_NE : IR_EQ, ta), a, b);
   }
   return diff;
@@ -1370,6 +1397,15 @@ static TRef rec_idx_key(jit_State *J, RecordIndex *ix, IRRef *rbref,
     }
   }
 
+#if LJ_HASSTRNOINTERN
+  if (tref_isstr(key) && rec_strnointern(J)) {
+    /* The hash part has only interned keys, which are compared by pointer. */
+    if (strnointern(strV(&ix->keyv)))
+      lj_trace_err(J, LJ_TRERR_NYISTRKEY);
+    rec_strinterned(J, key);
+  }
+#endif
+
   /* Otherwise the key is located in the hash part. */
   if (t->hmask == 0) {  /* Shortcut for empty hash part. */
     /* Guard that the hash part stays empty. */
@@ -1398,6 +1434,22 @@ static TRef rec_idx_key(jit_State *J, RecordIndex *ix, IRRef *rbref,
   return emitir(IRT(IR_HREF, IRT_PGC), ix->tab, key);
 }
 
+#if LJ_HASTABCOW
+/* Unshare a copy-on-write table before a store. */
+static void rec_idx_unshare(jit_State *J, RecordIndex *ix)
+{
+  IRIns *ir = IR(tref_ref(ix->tab));
+  if (ir->o == IR_TNEW || ir->o == IR_TDUP)
+    return;  /* The tables created on the trace are never shared. */
+  if (tabiscow(tabV(&ix->tabv))) {
+    lj_ir_call(J, IRCALL_lj_tab_unshare, ix->tab);
+  } else {  /* Otherwise guard that the table isn't shared. */
+    TRef tmp = emitir(IRT(IR_FLOAD, IRT_U8), ix->tab, IRFL_TAB_COLO);
+    emitir(IRTGI(IR_NE), tmp, lj_ir_kint(J, TAB_COLO_COW));
+  }
+}
+#endif
+
 /* Determine whether a key is NOT one of the fast metamethod names. */
 static int nommstr(jit_State *J, TRef key)
 {
@@ -1466,12 +1518,24 @@ TRef lj_record_idx(jit_State *J, RecordIndex *ix)
     }
   }
 
+#if LJ_HASTABCOW
+  if (ix->val)
+    rec_idx_unshare(J, ix);
+#endif
+
   /* Record the key lookup. */
   xref = rec_idx_key(J, ix, &rbref, &rbguard);
   xrefop = IR(tref_ref(xref))->o;
   loadop = xrefop == IR_AREF ? IR_ALOAD : IR_HLOAD;
   /* The lj_meta_tset() inconsistency is gone, but better play safe. */
   oldv = xrefop == IR_KKPTR ? (cTValue *)ir_kptr(IR(tref_ref(xref))) : ix->oldv;
+#if LJ_HASTABINCR
+  if (oldv == niltvg(J2G(J)) && xrefop == IR_HREF) {
+    /* HREF doesn't look into the old hash part of an incremental resize. */
+    TRef tmp = emitir(IRTI(IR_FLOAD), ix->tab, IRFL_TAB_OLDHMASK);
+    emitir(IRTGI(IR_EQ), tmp, lj_ir_kint(J, 0));
+  }
+#endif
 
   if (ix->val == 0) {  /* Indexed load */
     IRType t = itype2irt(oldv);
@@ -27,6 +27,9 @@
 #include "lj_vm.h"
 #include "lj_lex.h"
 #include "lj_alloc.h"
+#if LJ_HASGCTHREAD
+#include "lj_gcthread.h"
+#endif
 #include "luajit.h"
 
 #if LJ_HASMEMPROF
@@ -193,11 +196,16 @@ static void close_state(lua_State *L)
   lj_assertG(gcref(g->gc.root) == obj2gco(L),
 	     "main thread is not first GC object");
   lj_assertG(g->strnum == 0, "leaked %d strings", g->strnum);
+#if LJ_HASGCTHREAD
+  lj_gcthread_stop(g);
+#endif
   lj_trace_freestate(g);
 #if LJ_HASFFI
   lj_ctype_freestate(g);
 #endif
   lj_mem_freevec(g, g->strhash, g->strmask+1, GCRef);
+  if (g->strold)
+    lj_mem_freevec(g, g->strold, g->stroldmask+1, GCRef);
   lj_buf_free(g, &g->tmpbuf);
   lj_mem_freevec(g, tvref(L->stack), L->stacksize, TValue);
 #if LJ_64
@@ -241,6 +249,10 @@ LUA_API lua_State *lua_newstate(lua_Alloc f, void *ud)
   setgcref(g->uvhead.prev, obj2gco(&g->uvhead));
   setgcref(g->uvhead.next, obj2gco(&g->uvhead));
   g->strmask = ~(MSize)0;
+  g->strnointern = LJ_MAX_STR;
+#if LUAJIT_SEEDED_STRHASH
+  lj_str_initseed(g);
+#endif
   setnilV(registry(L));
   setnilV(&g->nilnode.val);
   setnilV(&g->nilnode.key);
@@ -254,6 +266,7 @@ LUA_API lua_State *lua_newstate(lua_Alloc f, void *ud)
   g->gc.allocated = g->gc.total = sizeof(GG_State);
   g->gc.pause = LUAI_GCPAUSE;
   g->gc.stepmul = LUAI_GCMUL;
+  g->gc.softlimit = g->gc.hardlimit = LJ_MAX_MEM;
   lj_dispatch_init((GG_State *)L);
   L->status = LUA_ERRERR+1;  /* Avoid touching the stack upon memory error. */
   if (lj_vm_cpcall(L, NULL, NULL, cpluaopen) != 0) {
@@ -11,6 +11,37 @@
 #include "lj_err.h"
 #include "lj_str.h"
 #include "lj_char.h"
+#if LJ_HASGCTHREAD
+#include "lj_gcthread.h"
+#endif
+#if LJ_TARGET_X64
+#include "lj_vm.h"
+#endif
+#if LUAJIT_SEEDED_STRHASH
+#include "lj_utils.h"
+#if LJ_TARGET_POSIX
+#include <fcntl.h>
+#include <unistd.h>
+#if LJ_TARGET_LINUX
+#include <sys/syscall.h>
+#endif
+#endif
+#endif
+
+/* SSE2 is always available on x64, AVX2 is detected at runtime. */
+#if LJ_TARGET_X64 && defined(__GNUC__) && !defined(LUAJIT_DISABLE_STRSIMD)
+#define LJ_STR_SSE2	1
+#if (__GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 9)) || \
+    defined(__clang__)
+#define LJ_STR_AVX2	1
+#endif
+#include <immintrin.h>
+#elif LJ_TARGET_ARM64 && defined(__ARM_NEON) && \
+      !defined(LUAJIT_DISABLE_STRSIMD)
+#define LJ_STR_NEON	1
+#include <arm_neon.h>
+#endif
+#define LJ_STR_SIMD	(LJ_STR_SSE2 || LJ_STR_NEON)
 
 #if LUAJIT_USE_ASAN
 /* These functions may read past a buffer end, that's ok. */
@@ -24,13 +55,205 @@ static LJ_AINLINE int str_fastcmp(const char *a, const char *b, MSize len)
   __attribute__((no_sanitize_address));
 #endif
 
+/* -- SIMD kernels -------------------------------------------------------- */
+
+/*
+** The kernels never read past the given lengths, so the callers keep their
+** own guarantees for the remaining bytes. The comparison kernels scan the
+** first n & ~15 bytes and return the index of the first mismatching byte or
+** n & ~15 if they are all equal.
+*/
+
+#if LJ_STR_AVX2
+#define STR_AVX2_MIN	64	/* Don't bother with AVX2 for shorter data. */
+
+static int str_avx2 = -1;
+
+/* Check for AVX2 support by the CPU and the OS. */
+static LJ_NOINLINE int str_detect_avx2(void)
+{
+  uint32_t vendor[4], features[4], xfeatures[4];
+  int avx2 = 0;
+  if (lj_vm_cpuid(0, vendor) && vendor[0] >= 7 &&
+      lj_vm_cpuid(1, features) &&
+      (features[2] & (1u << 27)) && (features[2] & (1u << 28))) {
+    uint32_t xcr0, xcr0hi;
+    /* The OS must save the YMM registers (XCR0 bits 1 and 2). */
+    __asm__ volatile("xgetbv" : "=a" (xcr0), "=d" (xcr0hi) : "c" (0));
+    UNUSED(xcr0hi);
+    lj_vm_cpuid(7, xfeatures);
+    avx2 = (xcr0 & 6) == 6 && (xfeatures[1] & (1u << 5)) != 0;
+  }
+  str_avx2 = avx2;
+  return avx2;
+}
+
+#define str_hasavx2()	(LJ_LIKELY(str_avx2 >= 0) ? str_avx2 : str_detect_avx2())
+
+__attribute__((target("avx2")))
+static MSize str_mismatch_avx2(const char *a, const char *b, MSize n)
+{
+  MSize i = 0;
+  for (; i + 64 <= n; i += 64) {  /* Unrolled main loop. */
+    __m256i e0 = _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i *)(a+i)),
+				   _mm256_loadu_si256((const __m256i *)(b+i)));
+    __m256i e1 = _mm256_cmpeq_epi8(
+      _mm256_loadu_si256((const __m256i *)(a+i+32)),
+      _mm256_loadu_si256((const __m256i *)(b+i+32)));
+    if (LJ_UNLIKELY(_mm256_movemask_epi8(_mm256_and_si256(e0, e1)) != -1)) {
+      uint32_t m = ~(uint32_t)_mm256_movemask_epi8(e0);
+      if (m) return i + lj_ffs(m);
+      return i + 32 + lj_ffs(~(uint32_t)_mm256_movemask_epi8(e1));
+    }
+  }
+  if (i + 32 <= n) {
+    __m256i va = _mm256_loadu_si256((const __m256i *)(a+i));
+    __m256i vb = _mm256_loadu_si256((const __m256i *)(b+i));
+    uint32_t m = ~(uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(va, vb));
+    if (m) return i + lj_ffs(m);
+    i += 32;
+  }
+  if (i + 16 <= n) {
+    __m128i va = _mm_loadu_si128((const __m128i *)(a+i));
+    __m128i vb = _mm_loadu_si128((const __m128i *)(b+i));
+    uint32_t m = (uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(va, vb)) ^ 0xffff;
+    if (m) return i + lj_ffs(m);
+    i += 16;
+  }
+  return i;
+}
+
+/* Search the first n & ~31 candidates of p in s by the first and the last
+** characters of p. Returns NULL if there is no match among them.
+*/
+__attribute__((target("avx2")))
+static const char *str_find_avx2(const char *s, const char *p,
+				 MSize n, MSize plen)
+{
+  __m256i first = _mm256_set1_epi8(p[0]);
+  __m256i last = _mm256_set1_epi8(p[plen-1]);
+  MSize i;
+  for (i = 0; i + 32 <= n; i += 32) {
+    __m256i bf = _mm256_loadu_si256((const __m256i *)(s+i));
+    __m256i bl = _mm256_loadu_si256((const __m256i *)(s+i+plen-1));
+    uint32_t m = (uint32_t)_mm256_movemask_epi8(
+      _mm256_and_si256(_mm256_cmpeq_epi8(bf, first),
+		       _mm256_cmpeq_epi8(bl, last)));
+    while (m) {
+      const char *q = s + i + lj_ffs(m);
+      if (memcmp(q+1, p+1, plen-2) == 0) return q;
+      m &= m - 1;
+    }
+  }
+  return NULL;
+}
+#endif
+
+#if LJ_STR_SSE2
+static LJ_AINLINE MSize str_mismatch(const char *a, const char *b, MSize n)
+{
+  MSize i = 0;
+#if LJ_STR_AVX2
+  if (n >= STR_AVX2_MIN && str_hasavx2())
+    return str_mismatch_avx2(a, b, n);
+#endif
+  for (; i + 16 <= n; i += 16) {
+    __m128i va = _mm_loadu_si128((const __m128i *)(a+i));
+    __m128i vb = _mm_loadu_si128((const __m128i *)(b+i));
+    uint32_t m = (uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(va, vb)) ^ 0xffff;
+    if (m) return i + lj_ffs(m);
+  }
+  return i;
+}
+
+/* Plain substring search. Requires plen >= 2 and n = slen-plen+1 >= 16. */
+static const char *str_find_simd(const char *s, const char *p,
+				 MSize slen, MSize plen)
+{
+  const char *e = s + (slen - plen + 1);  /* End of the candidates. */
+  __m128i first = _mm_set1_epi8(p[0]);
+  __m128i last = _mm_set1_epi8(p[plen-1]);
+#if LJ_STR_AVX2
+  if (slen - plen + 1 >= STR_AVX2_MIN && str_hasavx2()) {
+    MSize n = slen - plen + 1;
+    const char *q = str_find_avx2(s, p, n, plen);
+    if (q) return q;
+    s += n & ~(MSize)31;  /* Continue with the rest of the candidates. */
+  }
+#endif
+  for (; s + 16 <= e; s += 16) {
+    __m128i bf = _mm_loadu_si128((const __m128i *)s);
+    __m128i bl = _mm_loadu_si128((const __m128i *)(s+plen-1));
+    uint32_t m = (uint32_t)_mm_movemask_epi8(
+      _mm_and_si128(_mm_cmpeq_epi8(bf, first), _mm_cmpeq_epi8(bl, last)));
+    while (m) {
+      const char *q = s + lj_ffs(m);
+      if (memcmp(q+1, p+1, plen-2) == 0) return q;
+      m &= m - 1;
+    }
+  }
+  for (; s < e; s++)
+    if (*s == *p && memcmp(s+1, p+1, plen-1) == 0) return s;
+  return NULL;
+}
+#elif LJ_STR_NEON
+/* Bitmask with 4 bits per byte of a byte-wise comparison result. */
+#define str_neonmask(v) \
+  vget_lane_u64(vreinterpret_u64_u8(vshrn_n_u16(vreinterpretq_u16_u8(v), 4)), 0)
+
+static LJ_AINLINE MSize str_mismatch(const char *a, const char *b, MSize n)
+{
+  MSize i;
+  for (i = 0; i + 16 <= n; i += 16) {
+    uint8x16_t eq = vceqq_u8(vld1q_u8((const uint8_t *)(a+i)),
+			     vld1q_u8((const uint8_t *)(b+i)));
+    uint64_t m = ~str_neonmask(eq);
+    if (m) return i + (MSize)(__builtin_ctzll(m) >> 2);
+  }
+  return i;
+}
+
+/* Plain substring search. Requires plen >= 2 and n = slen-plen+1 >= 16. */
+static const char *str_find_simd(const char *s, const char *p,
+				 MSize slen, MSize plen)
+{
+  const char *e = s + (slen - plen + 1);  /* End of the candidates. */
+  uint8x16_t first = vdupq_n_u8((uint8_t)p[0]);
+  uint8x16_t last = vdupq_n_u8((uint8_t)p[plen-1]);
+  for (; s + 16 <= e; s += 16) {
+    uint8x16_t bf = vld1q_u8((const uint8_t *)s);
+    uint8x16_t bl = vld1q_u8((const uint8_t *)(s+plen-1));
+    uint64_t m = str_neonmask(vandq_u8(vceqq_u8(bf, first),
+				       vceqq_u8(bl, last)));
+    while (m) {
+      uint32_t k = (uint32_t)__builtin_ctzll(m) >> 2;
+      const char *q = s + k;
+      if (memcmp(q+1, p+1, plen-2) == 0) return q;
+      m &= ~((uint64_t)0xf << (k << 2));
+    }
+  }
+  for (; s < e; s++)
+    if (*s == *p && memcmp(s+1, p+1, plen-1) == 0) return s;
+  return NULL;
+}
+#endif
+
 /* -- String helpers ------------------------------------------------------ */
 
 /* Ordered compare of strings. Assumes string data is 4-byte aligned. */
 int32_t LJ_FASTCALL lj_str_cmp(GCstr *a, GCstr *b)
 {
-  MSize i, n = a->len > b->len ? b->len : a->len;
-  for (i = 0; i < n; i += 4) {
+  MSize i = 0, n = a->len > b->len ? b->len : a->len;
+#if LJ_STR_SIMD
+  if (n >= 16) {
+    i = str_mismatch(strdata(a), strdata(b), n);
+    if (i < (n & ~(MSize)15)) {
+      uint8_t ca = (uint8_t)strdata(a)[i], cb = (uint8_t)strdata(b)[i];
+      return ca < cb ? -1 : 1;
+    }
+  }
+#endif
+  for (; i < n; i += 4) {
     /* Note: innocuous access up to end of string + 3. */
     uint32_t va = *(const uint32_t *)(strdata(a)+i);
     uint32_t vb = *(const uint32_t *)(strdata(b)+i);
@@ -56,6 +279,13 @@ static LJ_AINLINE int str_fastcmp(const char *a, const char *b, MSize len)
   lj_assertX(len > 0, "fast string compare with zero length");
   lj_assertX((((uintptr_t)a+len-1) & (LJ_PAGESIZE-1)) <= LJ_PAGESIZE-4,
 	     "fast string compare crossing page boundary");
+#if LJ_STR_SIMD
+  if (len >= 16) {
+    i = str_mismatch(a, b, len);
+    if (i < (len & ~(MSize)15)) return 1;
+    if (i == len) return 0;
+  }
+#endif
   do {  /* Note: innocuous access up to end of string + 3. */
     uint32_t v = lj_getu32(a+i) ^ *(const uint32_t *)(b+i);
     if (v) {
@@ -77,6 +307,10 @@ const char *lj_str_find(const char *s, const char *p, MSize slen, MSize plen)
   if (plen <= slen) {
     if (plen == 0) {
       return s;
+#if LJ_STR_SIMD
+    } else if (plen >= 2 && slen - plen >= 15) {
+      return str_find_simd(s, p, slen, plen);
+#endif
     } else {
       int c = *(const uint8_t *)p++;
       plen--; slen -= plen;
@@ -105,28 +339,73 @@ int lj_str_haspattern(GCstr *s)
 
 /* -- String interning ---------------------------------------------------- */
 
+/*
+** The string hash table is resized incrementally. The old table is kept
+** along with the new one, and its hash chains are moved to the new table
+** a few at a time on each interning of a new string and on each GC step.
+** A string is looked up in both tables until all the chains are moved.
+** The chains are not moved during the string sweep, which walks the
+** chains of both tables by index.
+*/
+
+#define STR_MOVESTEP	32	/* Old hash chains moved per new string. */
+
+/* Link a string into a hash chain. The young strings are kept in front of
+** the old ones, see gc_sweep_str_chain().
+*/
+static void str_link(GCRef *chain, GCobj *o)
+{
+  if ((o->gch.marked & LJ_GC_OLD)) {
+    GCobj *p;
+    while ((p = gcref(*chain)) != NULL && !(p->gch.marked & LJ_GC_OLD))
+      chain = &p->gch.nextgc;
+  }
+  /* NOBARRIER: The string table is a GC root. */
+  setgcrefr(o->gch.nextgc, *chain);
+  setgcref(*chain, o);
+}
+
+/* Move up to n hash chains from the old to the new string hash table. */
+void LJ_FASTCALL lj_str_rehash(global_State *g, MSize n)
+{
+  GCRef *oldhash = g->strold;
+  MSize i = g->strmove, oldmask = g->stroldmask;
+  lj_assertG(oldhash != NULL, "no string table resize in progress");
+  lj_assertG(g->gc.state != GCSsweepstring, "string table resize in sweep");
+  for (; n > 0 && i <= oldmask; n--, i++) {
+    GCobj *p = gcref(oldhash[i]);
+    setgcrefnull(oldhash[i]);
+    while (p) {  /* Follow the hash chain and reinsert all strings. */
+      GCobj *next = gcnext(p);
+      str_link(&g->strhash[gco2str(p)->hash & g->strmask], p);
+      p = next;
+    }
+  }
+  if (i > oldmask) {  /* All chains are moved. */
+    lj_mem_freevec(g, oldhash, oldmask+1, GCRef);
+    g->strold = NULL;
+    g->strmove = 0;
+  } else {
+    g->strmove = i;
+  }
+}
+
 /* Resize the string hash table (grow and shrink). */
 void lj_str_resize(lua_State *L, MSize newmask)
 {
   global_State *g = G(L);
   GCRef *newhash;
-  MSize i;
   if (g->gc.state == GCSsweepstring || newmask >= LJ_MAX_STRTAB-1)
     return;  /* No resizing during GC traversal or if already too big. */
+  if (g->strold)  /* Finish the previous resize first. */
+    lj_str_rehash(g, LJ_MAX_STRTAB);
   newhash = lj_mem_newvec(L, newmask+1, GCRef);
   memset(newhash, 0, (newmask+1)*sizeof(GCRef));
-  for (i = g->strmask; i != ~(MSize)0; i--) {  /* Rehash old table. */
-    GCobj *p = gcref(g->strhash[i]);
-    while (p) {  /* Follow each hash chain and reinsert all strings. */
-      MSize h = gco2str(p)->hash & newmask;
-      GCobj *next = gcnext(p);
-      /* NOBARRIER: The string table is a GC root. */
-      setgcrefr(p->gch.nextgc, newhash[h]);
-      setgcref(newhash[h], p);
-      p = next;
-    }
+  if (g->strhash) {  /* Move the chains of the old table incrementally. */
+    g->strold = g->strhash;
+    g->stroldmask = g->strmask;
+    g->strmove = 0;
   }
-  lj_mem_freevec(g, g->strhash, g->strmask+1, GCRef);
   g->strmask = newmask;
   g->strhash = newhash;
 }
@@ -165,26 +444,6 @@ lj_fullhash(const uint8_t *v, MSize len)
 }
 #endif
 
-/* Intern a string and return string object. */
-GCstr *lj_str_new(lua_State *L, const char *str, size_t lenx)
-{
-  global_State *g;
-  GCstr *s;
-  GCobj *o;
-  MSize len = (MSize)lenx;
-  uint8_t strflags = 0;
-#if LUAJIT_SMART_STRINGS
-  unsigned collisions = 0;
-#endif
-  if (lenx >= LJ_MAX_STR)
-    lj_err_msg(L, LJ_ERR_STROV);
-  g = G(L);
-  if (len == 0)
-    return &g->strempty;
-  /* Compute string hash. Constants taken from lookup3 hash by Bob Jenkins. */
-  MSize h = lua_hash(str, len);
-  /* Check if the string has already been interned. */
-  o = gcref(g->strhash[h & g->strmask]);
 #if LUAJIT_SMART_STRINGS
 /*
 ** The default "fast" string hash function samples only a few positions
@@ -209,23 +468,25 @@ GCstr *lj_str_new(lua_State *L, const char *str, size_t lenx)
 ** an anomaly.
 **/
 #define max_collisions 40
-#define inc_collision_soft() (collisions++)
+#define inc_collision_soft() ((*collisions)++)
 /* If different strings yield the same hash sum, grow counter faster. */
-#define inc_collision_hard() (collisions+=1+(len>>4), 1)
+#define inc_collision_hard() (*collisions+=1+(len>>4), 1)
 #else
 #define inc_collision_hard() (1)
 #define inc_collision_soft()
 #endif
+
+/* Find an interned string in a hash chain. */
+static LJ_AINLINE GCstr *str_lookup(GCobj *o, const char *str, MSize len,
+				    MSize h, unsigned *collisions)
+{
+  UNUSED(collisions);
   if (LJ_LIKELY((((uintptr_t)str+len-1) & (LJ_PAGESIZE-1)) <= LJ_PAGESIZE-4)) {
     while (o != NULL) {
       GCstr *sx = gco2str(o);
       if (sx->hash == h && sx->len == len && inc_collision_hard() &&
-                      str_fastcmp(str, strdata(sx), len) == 0) {
-	/* Resurrect if dead. Can only happen with fixstring() (keywords). */
-	if (isdead(g, o)) flipwhite(o);
-	g->strhash_hit++;
-	return sx;  /* Return existing string. */
-      }
+                      str_fastcmp(str, strdata(sx), len) == 0)
+	return sx;
       o = gcnext(o);
       inc_collision_soft();
     }
@@ -233,19 +494,185 @@ GCstr *lj_str_new(lua_State *L, const char *str, size_t lenx)
     while (o != NULL) {
       GCstr *sx = gco2str(o);
       if (sx->hash == h && sx->len == len && inc_collision_hard() &&
-                      memcmp(str, strdata(sx), len) == 0) {
-	/* Resurrect if dead. Can only happen with fixstring() (keywords). */
-	if (isdead(g, o)) flipwhite(o);
-	g->strhash_hit++;
-	return sx;  /* Return existing string. */
-      }
+                      memcmp(str, strdata(sx), len) == 0)
+	return sx;
       o = gcnext(o);
       inc_collision_soft();
     }
   }
+  return NULL;
+}
+
+/* Find an interned string in the string hash table(s). */
+static LJ_AINLINE GCstr *str_find(global_State *g, const char *str, MSize len,
+				  MSize h, unsigned *collisions)
+{
+  GCstr *sx = str_lookup(gcref(g->strhash[h & g->strmask]), str, len, h,
+			 collisions);
+  if (LJ_UNLIKELY(g->strold != NULL) && sx == NULL &&
+      (h & g->stroldmask) >= g->strmove)  /* Chain not moved yet? */
+    sx = str_lookup(gcref(g->strold[h & g->stroldmask]), str, len, h,
+		    collisions);
+  return sx;
+}
+
+#if LUAJIT_SEEDED_STRHASH
+/*
+** Seeded hash of all bytes of a string, after wyhash by Wang Yi (public
+** domain). The strings up to 16 bytes are read with a few overlapping
+** loads. The longer strings are consumed by three independent lanes of
+** 128 bit multiplications, 48 bytes per round, which is faster than a
+** vector loop on both x64 and arm64. The per-VM seed makes the hash sums
+** unpredictable, so the chains can't be flooded with the crafted keys.
+*/
+
+static const uint64_t str_wyp[4] = {
+  U64x(2d358dcc,aa6c78a5), U64x(8bb84b93,962eacc9),
+  U64x(4b33a62e,d433d4a3), U64x(4d5a2da5,1de1aa47)
+};
+
+/* 64x64 -> 128 bit multiplication. Returns the low half, sets the high. */
+static LJ_AINLINE uint64_t str_wymum(uint64_t a, uint64_t b, uint64_t *hi)
+{
+#if defined(__SIZEOF_INT128__)
+  unsigned __int128 r = (unsigned __int128)a * b;
+  *hi = (uint64_t)(r >> 64);
+  return (uint64_t)r;
+#else
+  uint64_t ha = a >> 32, hb = b >> 32, la = (uint32_t)a, lb = (uint32_t)b;
+  uint64_t rh = ha*hb, rm0 = ha*lb, rm1 = hb*la, rl = la*lb;
+  uint64_t t = rl + (rm0 << 32), lo;
+  uint64_t c = t < rl;
+  lo = t + (rm1 << 32);
+  c += lo < t;
+  *hi = rh + (rm0 >> 32) + (rm1 >> 32) + c;
+  return lo;
+#endif
+}
+
+static LJ_AINLINE uint64_t str_wymix(uint64_t a, uint64_t b)
+{
+  uint64_t hi, lo = str_wymum(a, b, &hi);
+  return lo ^ hi;
+}
+
+static LJ_AINLINE uint64_t str_getu64(const uint8_t *p)
+{
+  uint64_t v;
+  memcpy(&v, p, sizeof(v));
+  return v;
+}
+
+static LJ_AINLINE MSize str_hash(global_State *g, const char *str, MSize len)
+{
+  const uint8_t *p = (const uint8_t *)str;
+  uint64_t seed = g->strseed, a, b;
+  if (LJ_LIKELY(len <= 16)) {
+    if (LJ_LIKELY(len >= 4)) {
+      MSize k = (len >> 3) << 2;
+      a = ((uint64_t)lj_getu32(p) << 32) | lj_getu32(p + k);
+      b = ((uint64_t)lj_getu32(p + len - 4) << 32) |
+	  lj_getu32(p + len - 4 - k);
+    } else {  /* The empty string is never hashed. */
+      a = ((uint64_t)p[0] << 16) | ((uint64_t)p[len >> 1] << 8) | p[len-1];
+      b = 0;
+    }
+  } else {
+    MSize i = len;
+    if (LJ_UNLIKELY(i >= 48)) {
+      uint64_t see1 = seed, see2 = seed;
+      do {
+	seed = str_wymix(str_getu64(p) ^ str_wyp[1], str_getu64(p+8) ^ seed);
+	see1 = str_wymix(str_getu64(p+16) ^ str_wyp[2],
+			 str_getu64(p+24) ^ see1);
+	see2 = str_wymix(str_getu64(p+32) ^ str_wyp[3],
+			 str_getu64(p+40) ^ see2);
+	p += 48; i -= 48;
+      } while (LJ_LIKELY(i >= 48));
+      seed ^= see1 ^ see2;
+    }
+    while (LJ_UNLIKELY(i > 16)) {
+      seed = str_wymix(str_getu64(p) ^ str_wyp[1], str_getu64(p+8) ^ seed);
+      p += 16; i -= 16;
+    }
+    a = str_getu64(p + i - 16);
+    b = str_getu64(p + i - 8);
+  }
+  a = str_wymum(a ^ str_wyp[1], b ^ seed, &b);
+  a = str_wymix(a ^ str_wyp[0] ^ len, b ^ str_wyp[1]);
+  return (MSize)(a ^ (a >> 32));
+}
+
+/* Fill the buffer with random bytes. Returns 0 on failure. */
+static int str_random(void *buf, size_t sz)
+{
+#if LJ_TARGET_POSIX
+  int fd;
+  ssize_t n;
+#if LJ_TARGET_LINUX && defined(SYS_getrandom)
+  if (syscall(SYS_getrandom, buf, sz, 0) == (long)sz)
+    return 1;
+#endif
+  fd = open("/dev/urandom", O_RDONLY | O_CLOEXEC);
+  if (fd < 0)
+    return 0;
+  n = read(fd, buf, sz);
+  close(fd);
+  return n == (ssize_t)sz;
+#else
+  UNUSED(buf); UNUSED(sz);
+  return 0;
+#endif
+}
+
+/* Initialize the per-VM seed of the string hash. */
+void lj_str_initseed(global_State *g)
+{
+  uint64_t seed;
+  if (!str_random(&seed, sizeof(seed))) {
+    /* No entropy source: mix the clock with the address of the state. */
+    seed = lj_utils_time_ns() ^ ((uint64_t)(uintptr_t)g << 16);
+  }
+  g->strseed = seed ^ str_wymix(seed ^ str_wyp[0], str_wyp[1]);
+}
+#else
+#define str_hash(g, str, len)	lua_hash((str), (len))
+#endif
+
+#if LJ_HASGCTHREAD
+/* The string table is shared with the helper thread during the sweep. */
+#define str_lock(g, shared) \
+  { if (LJ_UNLIKELY(shared)) lj_gcthread_lock(gcthread(g)); }
+#define str_unlock(g, shared) \
+  { if (LJ_UNLIKELY(shared)) lj_gcthread_unlock(gcthread(g)); }
+#else
+#define str_lock(g, shared)	UNUSED(shared)
+#define str_unlock(g, shared)	UNUSED(shared)
+#endif
+
+/* Intern a string and return string object. */
+GCstr *lj_str_new(lua_State *L, const char *str, size_t lenx)
+{
+  global_State *g;
+  GCstr *s;
+  MSize len = (MSize)lenx;
+  uint8_t strflags = 0;
+  int shared;
+  unsigned collisions = 0;
+  if (lenx >= LJ_MAX_STR)
+    lj_err_msg(L, LJ_ERR_STROV);
+  g = G(L);
+  if (len == 0)
+    return &g->strempty;
+  /* Compute string hash. Constants taken from lookup3 hash by Bob Jenkins. */
+  MSize h = str_hash(g, str, len);
+  shared = g->gc.strlock;
+  str_lock(g, shared);
+  /* Check if the string has already been interned. */
+  s = str_find(g, str, len, h, &collisions);
 #if LUAJIT_SMART_STRINGS
   /* "Fast" hash function consumes all bytes of a string <= 12 bytes. */
-  if (len > 12) {
+  if (s == NULL && len > 12) {
     /*
     ** The bloom filter is keyed with the high 12 bits of the fast
     ** hash sum. The filter is rebuilt during GC cycle. It's beneficial
@@ -262,32 +689,10 @@ GCstr *lj_str_new(lua_State *L, const char *str, size_t lenx)
       fh = (fh >> 6) | (h & high6mask);
       if (search_fullh) {
 	/* Recheck if the string has already been interned with "harder" hash. */
-	o = gcref(g->strhash[fh & g->strmask]);
-	if (LJ_LIKELY((((uintptr_t)str+len-1) & (LJ_PAGESIZE-1)) <= LJ_PAGESIZE-4)) {
-	  while (o != NULL) {
-	    GCstr *sx = gco2str(o);
-	    if (sx->hash == fh && sx->len == len && str_fastcmp(str, strdata(sx), len) == 0) {
-	      /* Resurrect if dead. Can only happen with fixstring() (keywords). */
-	      if (isdead(g, o)) flipwhite(o);
-	      g->strhash_hit++;
-	      return sx;  /* Return existing string. */
-	    }
-	    o = gcnext(o);
-	  }
-	} else {  /* Slow path: end of string is too close to a page boundary. */
-	  while (o != NULL) {
-	    GCstr *sx = gco2str(o);
-	    if (sx->hash == fh && sx->len == len && memcmp(str, strdata(sx), len) == 0) {
-	      /* Resurrect if dead. Can only happen with fixstring() (keywords). */
-	      if (isdead(g, o)) flipwhite(o);
-	      g->strhash_hit++;
-	      return sx;  /* Return existing string. */
-	    }
-	    o = gcnext(o);
-	  }
-	}
+	unsigned fcollisions = 0;
+	s = str_find(g, str, len, fh, &fcollisions);
       }
-      if (collisions > max_collisions) {
+      if (s == NULL && collisions > max_collisions) {
 	strflags = 0xc0 | ((h>>(sizeof(h)*8-12))&0x3f);
 	bloomset(g->strbloom.cur[0], h>>(sizeof(h)*8- 6));
 	bloomset(g->strbloom.cur[1], h>>(sizeof(h)*8-12));
@@ -298,7 +703,16 @@ GCstr *lj_str_new(lua_State *L, const char *str, size_t lenx)
     }
   }
 #endif
+  if (s != NULL) {
+    /* Resurrect if dead. Can only happen with fixstring() (keywords). */
+    if (isdead(g, obj2gco(s))) flipwhite(obj2gco(s));
+    g->strhash_hit++;
+    str_unlock(g, shared);
+    return s;  /* Return existing string. */
+  }
   g->strhash_miss++;
+  /* The allocation may throw, so it's done without holding the lock. */
+  str_unlock(g, shared);
   /* Nope, create a new string. */
   s = lj_mem_newt(L, sizeof(GCstr)+len+1, GCstr);
   newwhite(g, s);
@@ -310,18 +724,92 @@ GCstr *lj_str_new(lua_State *L, const char *str, size_t lenx)
   memcpy(strdatawr(s), str, len);
   strdatawr(s)[len] = '\0';  /* Zero-terminate string. */
   /* Add it to string hash table. */
+  str_lock(g, shared);
   h &= g->strmask;
   s->nextgc = g->strhash[h];
   /* NOBARRIER: The string table is a GC root. */
   setgcref(g->strhash[h], obj2gco(s));
+  str_unlock(g, shared);
   if (g->strnum++ > g->strmask)  /* Allow a 100% load factor. */
     lj_str_resize(L, (g->strmask<<1)+1);  /* Grow string table. */
+  else if (LJ_UNLIKELY(g->strold != NULL) && g->gc.state != GCSsweepstring)
+    lj_str_rehash(g, STR_MOVESTEP);  /* Continue the resize. */
   return s;  /* Return newly interned string. */
 }
 
 void LJ_FASTCALL lj_str_free(global_State *g, GCstr *s)
 {
-  g->strnum--;
+  if (LJ_LIKELY(!strnointern(s)))
+    g->strnum--;
   lj_mem_free(g, s, sizestring(s));
 }
 
+/* -- Uninterned strings -------------------------------------------------- */
+
+#if LJ_HASSTRNOINTERN
+/*
+** Create a string from data, which is rarely compared or used as a table
+** key, e.g. the result of I/O or concatenation. The strings of at least
+** g->strnointern bytes are not interned: they are linked to the root list
+** like any other GC object and their hash is computed on demand.
+*/
+GCstr *lj_str_newdata(lua_State *L, const char *str, size_t lenx)
+{
+  global_State *g = G(L);
+  GCstr *s;
+  MSize len;
+  if (LJ_LIKELY(lenx < g->strnointern))
+    return lj_str_new(L, str, lenx);
+  if (lenx >= LJ_MAX_STR)
+    lj_err_msg(L, LJ_ERR_STROV);
+  len = (MSize)lenx;
+  s = (GCstr *)lj_mem_newgco(L, sizeof(GCstr)+len+1);
+  s->gct = ~LJ_TSTR;
+  s->len = len;
+  s->hash = 0;  /* Computed by lj_str_lookup(). */
+  s->reserved = 0;
+  s->strflags = LJ_STR_NOINTERN;
+  memcpy(strdatawr(s), str, len);
+  strdatawr(s)[len] = '\0';  /* Zero-terminate string. */
+  g->strhash_nointern++;
+  return s;
+}
+#endif
+
+/* Find the interned string with the contents of an uninterned one. */
+GCstr *lj_str_lookup(global_State *g, GCstr *s)
+{
+  const char *str = strdata(s);
+  MSize len = s->len, h = s->hash;
+  unsigned collisions = 0;
+  int shared = g->gc.strlock;
+  GCstr *sx;
+  lj_assertG(strnointern(s), "lookup of interned string");
+  if (h == 0)  /* Hash it on the first use, the result is kept. */
+    s->hash = h = str_hash(g, str, len);
+  str_lock(g, shared);
+  sx = str_find(g, str, len, h, &collisions);
+#if LUAJIT_SMART_STRINGS
+  /* Same as in lj_str_new(): the bloom filter tells about a "harder" hash. */
+  if (sx == NULL && len > 12 &&
+      bloomtest(g->strbloom.cur[0], h>>(sizeof(h)*8- 6)) != 0 &&
+      bloomtest(g->strbloom.cur[1], h>>(sizeof(h)*8-12)) != 0) {
+    MSize fh = lj_fullhash((const uint8_t*)str, len);
+    fh = (fh >> 6) | (h & high6mask);
+    sx = str_find(g, str, len, fh, &collisions);
+  }
+#endif
+  /* A dead string can't be a table key, don't resurrect it. */
+  if (sx != NULL && isdead(g, obj2gco(sx)))
+    sx = NULL;
+  str_unlock(g, shared);
+  return sx;
+}
+
+/* Check strings for equality. Only the uninterned ones may be copies. */
+int LJ_FASTCALL lj_str_equal(GCstr *a, GCstr *b)
+{
+  return a == b || ((strnointern(a) || strnointern(b)) && a->len == b->len &&
+		    memcmp(strdata(a), strdata(b), a->len) == 0);
+}
+
@@ -18,8 +18,27 @@ LJ_FUNC int lj_str_haspattern(GCstr *s);
 
 /* String interning. */
 LJ_FUNC void lj_str_resize(lua_State *L, MSize newmask);
+LJ_FUNC void LJ_FASTCALL lj_str_rehash(global_State *g, MSize n);
 LJ_FUNCA GCstr *lj_str_new(lua_State *L, const char *str, size_t len);
 LJ_FUNC void LJ_FASTCALL lj_str_free(global_State *g, GCstr *s);
+#if LUAJIT_SEEDED_STRHASH
+LJ_FUNC void lj_str_initseed(global_State *g);
+#endif
+
+/* Uninterned strings. */
+#if LJ_HASSTRNOINTERN
+LJ_FUNCA GCstr *lj_str_newdata(lua_State *L, const char *str, size_t len);
+#else
+#define lj_str_newdata(L, str, len)	lj_str_new(L, str, len)
+#endif
+LJ_FUNC GCstr *lj_str_lookup(global_State *g, GCstr *s);
+LJ_FUNC int LJ_FASTCALL lj_str_equal(GCstr *a, GCstr *b);
+
+/* Return the interned string with the same contents. */
+static LJ_AINLINE GCstr *lj_str_intern(lua_State *L, GCstr *s)
+{
+  return LJ_UNLIKELY(strnointern(s)) ? lj_str_new(L, strdata(s), s->len) : s;
+}
 
 #define lj_str_newz(L, s)	(lj_str_new(L, s, strlen(s)))
 #define lj_str_newlit(L, s)	(lj_str_new(L, "" s, sizeof(s)-1))
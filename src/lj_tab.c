@@ -12,6 +12,7 @@
 #include "lj_obj.h"
 #include "lj_gc.h"
 #include "lj_err.h"
+#include "lj_str.h"
 #include "lj_tab.h"
 
 /* -- Object hashing ------------------------------------------------------ */
@@ -100,47 +101,46 @@ static LJ_AINLINE void clearapart(GCtab *t)
 static GCtab *newtab(lua_State *L, uint32_t asize, uint32_t hbits)
 {
   GCtab *t;
-  /* First try to colocate the array part. */
-  if (LJ_MAX_COLOSIZE != 0 && asize > 0 && asize <= LJ_MAX_COLOSIZE) {
-    Node *nilnode;
+  Node *nilnode;
+  uint32_t acolo = asize <= LJ_MAX_COLOSIZE ? asize : 0;
+  uint32_t hcolo = hbits <= LJ_MAX_COLOHBITS ? hbits : 0;
+  /* First try to colocate the array and hash parts. */
+  if (LJ_MAX_COLOSIZE != 0 && (acolo | hcolo) != 0) {
     lj_assertL((sizeof(GCtab) & 7) == 0, "bad GCtab size");
-    t = (GCtab *)lj_mem_newgco(L, sizetabcolo(asize));
-    t->gct = ~LJ_TTAB;
-    t->nomm = (uint8_t)~0;
-    t->colo = (int8_t)asize;
-    setmref(t->array, (TValue *)((char *)t + sizeof(GCtab)));
-    setgcrefnull(t->metatable);
-    t->asize = asize;
-    t->hmask = 0;
-    nilnode = &G(L)->nilnode;
-    setmref(t->node, nilnode);
-#if LJ_GC64
-    setmref(t->freetop, nilnode);
-#endif
-  } else {  /* Otherwise separately allocate the array part. */
-    Node *nilnode;
+    t = (GCtab *)lj_mem_newgco(L, sizetabcolo(acolo, hcolo));
+    t->colo = (int8_t)(acolo | (hcolo << TAB_COLO_HSHIFT));
+  } else {
+    acolo = hcolo = 0;
     t = lj_mem_newobj(L, GCtab);
-    t->gct = ~LJ_TTAB;
-    t->nomm = (uint8_t)~0;
     t->colo = 0;
-    setmref(t->array, NULL);
-    setgcrefnull(t->metatable);
-    t->asize = 0;  /* In case the array allocation fails. */
-    t->hmask = 0;
-    nilnode = &G(L)->nilnode;
-    setmref(t->node, nilnode);
+  }
+  t->gct = ~LJ_TTAB;
+  t->nomm = (uint8_t)~0;
+  setmref(t->array, acolo ? (TValue *)((char *)t + sizeof(GCtab)) : NULL);
+  setgcrefnull(t->metatable);
+  t->asize = acolo;  /* In case the array allocation fails. */
+  t->hmask = 0;
+  nilnode = &G(L)->nilnode;
+  setmref(t->node, nilnode);
 #if LJ_GC64
-    setmref(t->freetop, nilnode);
+  setmref(t->freetop, nilnode);
 #endif
-    if (asize > 0) {
-      if (asize > LJ_MAX_ASIZE)
-	lj_err_msg(L, LJ_ERR_TABOV);
-      setmref(t->array, lj_mem_newvec(L, asize, TValue));
-      t->asize = asize;
-    }
+  setmref(t->oldnode, NULL);
+  t->oldhmask = 0;
+  if (asize > acolo) {  /* Otherwise separately allocate the array part. */
+    if (asize > LJ_MAX_ASIZE)
+      lj_err_msg(L, LJ_ERR_TABOV);
+    setmref(t->array, lj_mem_newvec(L, asize, TValue));
+    t->asize = asize;
   }
-  if (hbits)
+  if (hcolo) {
+    Node *node = tabcolonode(t);
+    setmref(t->node, node);
+    setfreetop(t, node, &node[1u << hcolo]);
+    t->hmask = (1u << hcolo)-1;
+  } else if (hbits) {
     newhpart(L, t, hbits);
+  }
   G(L)->gc.tabnum++;
   return t;
 }
@@ -185,6 +185,7 @@ GCtab * LJ_FASTCALL lj_tab_dup(lua_State *L, const GCtab *kt)
 {
   GCtab *t;
   uint32_t asize, hmask;
+  lj_assertL(!tabresizing(kt), "resize of template table in progress");
   t = newtab(L, kt->asize, kt->hmask > 0 ? lj_fls(kt->hmask)+1 : 0);
   lj_assertL(kt->asize == t->asize && kt->hmask == t->hmask,
 	     "mismatched size of table and template");
@@ -220,26 +221,109 @@ GCtab * LJ_FASTCALL lj_tab_dup(lua_State *L, const GCtab *kt)
   return t;
 }
 
+/* -- Copy-on-write tables ------------------------------------------------ */
+
+/*
+** BC_TDUP duplicates a template table on every execution of a table
+** constructor, even if the result is only read. A template with a single
+** large part shares it with the duplicate instead: the copy-on-write table
+** points to the slots of the template and keeps the template alive. The
+** slots are copied on the first store, so every setter and every store
+** path of the VM must unshare the table first.
+**
+** The templates with both parts or with small parts are still copied, the
+** latter fit into a single colocated allocation anyway. The tables created
+** on traces are always copied, too, see lj_tab_dup().
+*/
+
+/* Duplicate a table for BC_TDUP. */
+GCtab * LJ_FASTCALL lj_tab_dupcow(lua_State *L, const GCtab *kt)
+{
+#if LJ_HASTABCOW
+  if (kt->hmask == 0 ? kt->asize > LJ_MAX_COLOSIZE :
+      kt->asize == 0 && kt->hmask >= (1u << LJ_MAX_COLOHBITS)) {
+    GCtab *t = newtab(L, 0, 0);
+    lj_assertL(!tabresizing(kt), "resize of template table in progress");
+    t->colo = (int8_t)TAB_COLO_COW;
+    t->nomm = 0;  /* Keys with metamethod names may be present. */
+    setmrefr(t->array, kt->array);
+    t->asize = kt->asize;
+    setmrefr(t->node, kt->node);
+    t->hmask = kt->hmask;
+#if LJ_GC64
+    setmrefr(t->freetop, kt->freetop);
+#endif
+    setmref(t->oldnode, kt);
+    return t;
+  }
+#endif
+  return lj_tab_dup(L, kt);
+}
+
+/* Copy the shared part of a copy-on-write table. */
+void LJ_FASTCALL lj_tab_unshare(lua_State *L, GCtab *t)
+{
+  if (!tabiscow(t))
+    return;  /* Traces call it for any table. */
+  /* NOBARRIER: A black table has marked the template with the values. */
+  if (t->asize > 0) {
+    TValue *array = lj_mem_newvec(L, t->asize, TValue);
+    memcpy(array, tvref(t->array), t->asize*sizeof(TValue));
+    setmref(t->array, array);
+  } else {
+    uint32_t i, hmask = t->hmask;
+    Node *knode = noderef(t->node);
+    Node *node = lj_mem_newvec(L, hmask+1, Node);
+    ptrdiff_t d = (char *)node - (char *)knode;
+    setfreetop(t, node, (Node *)((char *)getfreetop(t, knode) + d));
+    for (i = 0; i <= hmask; i++) {
+      Node *kn = &knode[i];
+      Node *n = &node[i];
+      Node *next = nextnode(kn);
+      n->val = kn->val; n->key = kn->key;
+      setmref(n->next, next == NULL? next : (Node *)((char *)next + d));
+    }
+    setmref(t->node, node);
+  }
+  t->colo = 0;
+  setmref(t->oldnode, NULL);
+}
+
 /* Clear a table. */
-void LJ_FASTCALL lj_tab_clear(GCtab *t)
+void LJ_FASTCALL lj_tab_clear(lua_State *L, GCtab *t)
 {
+  lj_tab_unsharecow(L, t);
   clearapart(t);
   if (t->hmask > 0) {
     Node *node = noderef(t->node);
     setfreetop(t, node, &node[t->hmask+1]);
     clearhpart(t);
   }
+  if (tabresizing(t)) {  /* Drop the old slots, which are not moved yet. */
+    Node *oldnode = noderef(t->oldnode);
+    uint32_t i, oldhmask = t->oldhmask;
+    for (i = getoldpos(t, oldnode); i <= oldhmask; i++)
+      setnilV(&oldnode[i].val);
+    setoldpos(t, oldnode, oldhmask+1);  /* Free it on the next move. */
+  }
 }
 
 /* Free a table. */
 void LJ_FASTCALL lj_tab_free(global_State *g, GCtab *t)
 {
-  if (t->hmask > 0)
+  if (tabiscow(t)) {  /* The slots belong to the template. */
+    lj_mem_freet(g, t);
+    g->gc.tabnum--;
+    return;
+  }
+  if (t->hmask > 0 && !tabishcolo(t))
     lj_mem_freevec(g, noderef(t->node), t->hmask+1, Node);
-  if (t->asize > 0 && LJ_MAX_COLOSIZE != 0 && t->colo <= 0)
+  if (tabresizing(t))
+    lj_mem_freevec(g, noderef(t->oldnode), t->oldhmask+1, Node);
+  if (t->asize > 0 && LJ_MAX_COLOSIZE != 0 && !tabisacolo(t))
     lj_mem_freevec(g, tvref(t->array), t->asize, TValue);
   if (LJ_MAX_COLOSIZE != 0 && t->colo)
-    lj_mem_free(g, t, sizetabcolo((uint32_t)t->colo & 0x7f));
+    lj_mem_free(g, t, sizetabcolo(tabcoloasize(t), tabcolohbits(t)));
   else
     lj_mem_freet(g, t);
   g->gc.tabnum--;
@@ -250,19 +334,29 @@ void LJ_FASTCALL lj_tab_free(global_State *g, GCtab *t)
 /* Resize a table to fit the new array/hash part sizes. */
 void lj_tab_resize(lua_State *L, GCtab *t, uint32_t asize, uint32_t hbits)
 {
-  Node *oldnode = noderef(t->node);
-  uint32_t oldasize = t->asize;
-  uint32_t oldhmask = t->hmask;
+  Node *oldnode, *movenode;
+  uint32_t oldasize, oldhmask, movehmask;
+  int oldhcolo;
+  lj_tab_unsharecow(L, t);
+  oldnode = noderef(t->node);
+  oldasize = t->asize;
+  oldhmask = t->hmask;
+  oldhcolo = tabishcolo(t);
+  movenode = noderef(t->oldnode);
+  movehmask = t->oldhmask;
+  if (LJ_UNLIKELY(gcref(G(L)->gc.travtab) == obj2gco(t)) &&
+      isblack(obj2gco(t)))
+    lj_gc_barrierback(G(L), t);  /* Slots are moved, stop chunked traversal. */
   if (asize > oldasize) {  /* Array part grows? */
     TValue *array;
     uint32_t i;
     if (asize > LJ_MAX_ASIZE)
       lj_err_msg(L, LJ_ERR_TABOV);
-    if (LJ_MAX_COLOSIZE != 0 && t->colo > 0) {
+    if (LJ_MAX_COLOSIZE != 0 && tabisacolo(t)) {
       /* A colocated array must be separated and copied. */
       TValue *oarray = tvref(t->array);
       array = lj_mem_newvec(L, asize, TValue);
-      t->colo = (int8_t)(t->colo | 0x80);  /* Mark as separated (colo < 0). */
+      t->colo = (int8_t)(t->colo | TAB_COLO_SEP);  /* Mark as separated. */
       for (i = 0; i < oldasize; i++)
 	copyTV(L, &array[i], &oarray[i]);
     } else {
@@ -286,6 +380,10 @@ void lj_tab_resize(lua_State *L, GCtab *t, uint32_t asize, uint32_t hbits)
 #endif
     t->hmask = 0;
   }
+  if (movehmask > 0) {  /* Take over the pending incremental resize. */
+    setmref(t->oldnode, NULL);
+    t->oldhmask = 0;
+  }
   if (asize < oldasize) {  /* Array part shrinks? */
     TValue *array = tvref(t->array);
     uint32_t i;
@@ -294,7 +392,7 @@ void lj_tab_resize(lua_State *L, GCtab *t, uint32_t asize, uint32_t hbits)
       if (!tvisnil(&array[i]))
 	copyTV(L, lj_tab_setinth(L, t, (int32_t)i), &array[i]);
     /* Physically shrink only separated arrays. */
-    if (LJ_MAX_COLOSIZE != 0 && t->colo <= 0)
+    if (LJ_MAX_COLOSIZE != 0 && !tabisacolo(t))
       setmref(t->array, lj_mem_realloc(L, array,
 	      oldasize*sizeof(TValue), asize*sizeof(TValue)));
   }
@@ -307,7 +405,17 @@ void lj_tab_resize(lua_State *L, GCtab *t, uint32_t asize, uint32_t hbits)
 	copyTV(L, lj_tab_set(L, t, &n->key), &n->val);
     }
     g = G(L);
-    lj_mem_freevec(g, oldnode, oldhmask+1, Node);
+    if (!oldhcolo)  /* A colocated hash part is left unused. */
+      lj_mem_freevec(g, oldnode, oldhmask+1, Node);
+  }
+  if (movehmask > 0) {  /* Reinsert the slots, which are not moved yet. */
+    uint32_t i;
+    for (i = getoldpos(t, movenode); i <= movehmask; i++) {
+      Node *n = &movenode[i];
+      if (!tvisnil(&n->val))
+	copyTV(L, lj_tab_set(L, t, &n->key), &n->val);
+    }
+    lj_mem_freevec(G(L), movenode, movehmask+1, Node);
   }
 }
 
@@ -358,6 +466,16 @@ static uint32_t counthash(const GCtab *t, uint32_t *bins, uint32_t *narray)
       total++;
     }
   }
+  if (tabresizing(t)) {  /* Count the old slots, which are not moved yet. */
+    Node *oldnode = noderef(t->oldnode);
+    for (i = getoldpos(t, oldnode); i <= t->oldhmask; i++) {
+      Node *n = &oldnode[i];
+      if (!tvisnil(&n->val)) {
+	na += countint(&n->key, bins);
+	total++;
+      }
+    }
+  }
   *narray += na;
   return total;
 }
@@ -374,10 +492,57 @@ static uint32_t bestasize(uint32_t bins[], uint32_t *narray)
   return na;
 }
 
+/* -- Incremental resizing ----------------------------------------------- */
+
+/*
+** The hash part of a large table is resized incrementally, unless the
+** array part is resized as well. The new hash part replaces the old one,
+** which is kept until all of its slots are moved to the new one, a few
+** at a time on each insertion of a new key. A key, which is not found
+** in the new hash part, is looked up in the old one. The old slots are
+** moved only on insertions, so neither lookups nor stores to the keys,
+** which are present, move the keys during a traversal.
+**
+** The new hash part is at least as large as the old one, so the main
+** position of a key in the old hash part is derived from the new one. It
+** has enough free nodes for all the old keys and for the new keys, which
+** are inserted until the last old slot is moved.
+*/
+
+#define TAB_INCRHBITS	16	/* Min. hash bits of an incremental resize. */
+#define TAB_MOVESTEP	32	/* Old hash slots moved per new key. */
+
+/* Find a key in the old hash part given its main node in the new one. */
+static TValue *getold(const GCtab *t, Node *mn, cTValue *key)
+{
+  Node *n = noderef(t->oldnode);
+  n += (uint32_t)(mn - noderef(t->node)) & t->oldhmask;
+  do {
+    if (!tvisnil(&n->val) && lj_obj_equal(&n->key, key))
+      return &n->val;
+  } while ((n = nextnode(n)));
+  return NULL;
+}
+
+/* Start an incremental resize of the hash part. */
+static void resizehpart(lua_State *L, GCtab *t, uint32_t hbits)
+{
+  Node *oldnode = noderef(t->node);
+  uint32_t oldhmask = t->hmask;
+  if (LJ_UNLIKELY(gcref(G(L)->gc.travtab) == obj2gco(t)) &&
+      isblack(obj2gco(t)))
+    lj_gc_barrierback(G(L), t);  /* Slots are moved, stop chunked traversal. */
+  newhpart(L, t, hbits);
+  clearhpart(t);
+  setmref(t->oldnode, oldnode);
+  t->oldhmask = oldhmask;
+  setoldpos(t, oldnode, 0);
+}
+
 static void rehashtab(lua_State *L, GCtab *t, cTValue *ek)
 {
   uint32_t bins[LJ_MAX_ABITS];
-  uint32_t total, asize, na, i;
+  uint32_t total, asize, na, i, hbits;
   for (i = 0; i < LJ_MAX_ABITS; i++) bins[i] = 0;
   asize = countarray(t, bins);
   total = 1 + asize;
@@ -385,7 +550,45 @@ static void rehashtab(lua_State *L, GCtab *t, cTValue *ek)
   asize += countint(ek, bins);
   na = bestasize(bins, &asize);
   total -= na;
-  lj_tab_resize(L, t, asize, hsize2hbits(total));
+  hbits = hsize2hbits(total);
+  if (LJ_HASTABINCR && asize == t->asize && !tabresizing(t) &&
+      t->hmask >= (1u << TAB_INCRHBITS)-1 && hbits <= LJ_MAX_HBITS &&
+      (1u << hbits) > t->hmask &&
+      total + (t->hmask+1) / TAB_MOVESTEP < (1u << hbits))
+    resizehpart(L, t, hbits);
+  else
+    lj_tab_resize(L, t, asize, hbits);
+}
+
+static TValue *newkey(lua_State *L, GCtab *t, cTValue *key);
+
+/* Move up to n slots from the old to the new hash part. */
+void lj_tab_movenodes(lua_State *L, GCtab *t, uint32_t n)
+{
+  Node *oldnode = noderef(t->oldnode);
+  uint32_t i = getoldpos(t, oldnode), oldhmask = t->oldhmask;
+  lj_assertL(tabresizing(t), "no table resize in progress");
+  for (; n > 0 && i <= oldhmask; n--, i++) {
+    Node *o = &oldnode[i];
+    if (!tvisnil(&o->val)) {
+      TValue *tv = newkey(L, t, &o->key);
+      if (LJ_UNLIKELY(tv == NULL)) {  /* No free node left? */
+	setoldpos(t, oldnode, i);
+	rehashtab(L, t, niltv(L));  /* Takes over the remaining slots. */
+	return;
+      }
+      copyTV(L, tv, &o->val);
+      setnilV(&o->val);
+    }
+  }
+  lj_gc_anybarriert(L, t);  /* The moved values may be white. */
+  if (i > oldhmask) {  /* All slots are moved. */
+    setmref(t->oldnode, NULL);
+    t->oldhmask = 0;
+    lj_mem_freevec(G(L), oldnode, oldhmask+1, Node);
+  } else {
+    setoldpos(t, oldnode, i);
+  }
 }
 
 #if LJ_HASFFI
@@ -397,7 +600,10 @@ void lj_tab_rehash(lua_State *L, GCtab *t)
 
 void lj_tab_reasize(lua_State *L, GCtab *t, uint32_t nasize)
 {
-  lj_tab_resize(L, t, nasize+1, t->hmask > 0 ? lj_fls(t->hmask)+1 : 0);
+  if (tabiscow(t) && nasize <= t->asize)  /* BC_TSETM into a shared array? */
+    lj_tab_unshare(L, t);
+  else
+    lj_tab_resize(L, t, nasize+1, t->hmask > 0 ? lj_fls(t->hmask)+1 : 0);
 }
 
 /* -- Table getters ------------------------------------------------------- */
@@ -405,30 +611,43 @@ void lj_tab_reasize(lua_State *L, GCtab *t, uint32_t nasize)
 cTValue * LJ_FASTCALL lj_tab_getinth(GCtab *t, int32_t key)
 {
   TValue k;
-  Node *n;
+  Node *n, *mn;
   k.n = (lua_Number)key;
-  n = hashnum(t, &k);
+  n = mn = hashnum(t, &k);
   do {
     if (tvisnum(&n->key) && n->key.n == k.n)
       return &n->val;
   } while ((n = nextnode(n)));
+  if (tabresizing(t))
+    return getold(t, mn, &k);
   return NULL;
 }
 
 cTValue *lj_tab_getstr(GCtab *t, GCstr *key)
 {
-  Node *n = hashstr(t, key);
+  Node *n = hashstr(t, key), *mn = n;
+  lj_assertX(!strnointern(key), "lookup of uninterned string key");
   do {
     if (tvisstr(&n->key) && strV(&n->key) == key)
       return &n->val;
   } while ((n = nextnode(n)));
+  if (tabresizing(t)) {
+    TValue k;
+    setgcVraw(&k, obj2gco(key), LJ_TSTR);
+    return getold(t, mn, &k);
+  }
   return NULL;
 }
 
 cTValue *lj_tab_get(lua_State *L, GCtab *t, cTValue *key)
 {
   if (tvisstr(key)) {
-    cTValue *tv = lj_tab_getstr(t, strV(key));
+    GCstr *s = strV(key);
+    cTValue *tv;
+    /* Uninterned keys are stored as their interned copies, if at all. */
+    if (LJ_UNLIKELY(strnointern(s)) && !(s = lj_str_lookup(G(L), s)))
+      return niltv(L);
+    tv = lj_tab_getstr(t, s);
     if (tv)
       return tv;
   } else if (tvisint(key)) {
@@ -446,21 +665,28 @@ cTValue *lj_tab_get(lua_State *L, GCtab *t, cTValue *key)
       goto genlookup;  /* Else use the generic lookup. */
     }
   } else if (!tvisnil(key)) {
-    Node *n;
+    Node *n, *mn;
   genlookup:
-    n = hashkey(t, key);
+    n = mn = hashkey(t, key);
     do {
       if (lj_obj_equal(&n->key, key))
 	return &n->val;
     } while ((n = nextnode(n)));
+    if (tabresizing(t)) {
+      cTValue *tv = getold(t, mn, key);
+      if (tv)
+	return tv;
+    }
   }
   return niltv(L);
 }
 
 /* -- Table setters ------------------------------------------------------- */
 
-/* Insert new key. Use Brent's variation to optimize the chain length. */
-TValue *lj_tab_newkey(lua_State *L, GCtab *t, cTValue *key)
+/* Insert new key. Use Brent's variation to optimize the chain length.
+** Returns NULL if there's no free node left.
+*/
+static TValue *newkey(lua_State *L, GCtab *t, cTValue *key)
 {
   Node *n = hashkey(t, key);
   if (!tvisnil(&n->val) || t->hmask == 0) {
@@ -469,10 +695,8 @@ TValue *lj_tab_newkey(lua_State *L, GCtab *t, cTValue *key)
     lj_assertL(freenode >= nodebase && freenode <= nodebase+t->hmask+1,
 	       "bad freenode");
     do {
-      if (freenode == nodebase) {  /* No free node found? */
-	rehashtab(L, t, key);  /* Rehash table. */
-	return lj_tab_set(L, t, key);  /* Retry key insertion. */
-      }
+      if (freenode == nodebase)  /* No free node found? */
+	return NULL;
     } while (!tvisnil(&(--freenode)->key));
     setfreetop(t, nodebase, freenode);
     lj_assertL(freenode != &G(L)->nilnode, "store to fallback hash");
@@ -561,6 +785,28 @@ TValue *lj_tab_newkey(lua_State *L, GCtab *t, cTValue *key)
   return &n->val;
 }
 
+TValue *lj_tab_newkey(lua_State *L, GCtab *t, cTValue *key)
+{
+  TValue k, *tv;
+  lj_tab_unsharecow(L, t);
+  if (tvisstr(key) && LJ_UNLIKELY(strnointern(strV(key)))) {
+    setstrV(L, &k, lj_str_intern(L, strV(key)));  /* Keys are interned. */
+    key = &k;
+  }
+  if (tabresizing(t)) {
+    /* The callers from the VM and traces don't look into the old slots. */
+    if ((tv = getold(t, hashkey(t, key), key)))
+      return tv;
+    lj_tab_movenodes(L, t, TAB_MOVESTEP);
+  }
+  tv = newkey(L, t, key);
+  if (LJ_UNLIKELY(tv == NULL)) {
+    rehashtab(L, t, key);  /* Rehash table. */
+    return lj_tab_set(L, t, key);  /* Retry key insertion. */
+  }
+  return tv;
+}
+
 TValue *lj_tab_setinth(lua_State *L, GCtab *t, int32_t key)
 {
   TValue k;
@@ -577,7 +823,10 @@ TValue *lj_tab_setinth(lua_State *L, GCtab *t, int32_t key)
 TValue *lj_tab_setstr(lua_State *L, GCtab *t, GCstr *key)
 {
   TValue k;
-  Node *n = hashstr(t, key);
+  Node *n;
+  lj_tab_unsharecow(L, t);
+  key = lj_str_intern(L, key);  /* Keys are interned. */
+  n = hashstr(t, key);
   do {
     if (tvisstr(&n->key) && strV(&n->key) == key)
       return &n->val;
@@ -589,6 +838,7 @@ TValue *lj_tab_setstr(lua_State *L, GCtab *t, GCstr *key)
 TValue *lj_tab_set(lua_State *L, GCtab *t, cTValue *key)
 {
   Node *n;
+  lj_tab_unsharecow(L, t);
   t->nomm = 0;  /* Invalidate negative metamethod cache. */
   if (tvisstr(key)) {
     return lj_tab_setstr(L, t, strV(key));
@@ -613,6 +863,83 @@ TValue *lj_tab_set(lua_State *L, GCtab *t, cTValue *key)
   return lj_tab_newkey(L, t, key);
 }
 
+/* -- Table slot moves ---------------------------------------------------- */
+
+/* Set an integer key to a copy of a value. Nil doesn't create a new key. */
+static void setintv(lua_State *L, GCtab *t, int32_t key, cTValue *o)
+{
+  if (tvisnil(o)) {
+    TValue *tv = (TValue *)lj_tab_getint(t, key);
+    if (tv) setnilV(tv);
+  } else {
+    copyTV(L, lj_tab_setint(L, t, key), o);
+  }
+}
+
+/* Move the integer keys [f, e] of st to the keys [t, t+e-f] of dt.
+** This is a raw table.move(): the overlapping keys are moved in order and
+** the write barrier for the moved values is handled once per call.
+*/
+void lj_tab_move(lua_State *L, GCtab *dt, GCtab *st, int32_t f, int32_t e,
+		 int32_t t)
+{
+  uint32_t n, i;
+  if (e < f) return;
+  if ((uint32_t)e - (uint32_t)f >= 0x7fffffffu)
+    lj_err_msg(L, LJ_ERR_TABMOVE);
+  n = (uint32_t)(e - f) + 1;
+  if (t > 0x7fffffff - (int32_t)(n - 1))
+    lj_err_msg(L, LJ_ERR_TABWRAP);
+  lj_tab_unsharecow(L, dt);
+  if (f >= 0 && (uint32_t)e < st->asize) {  /* Source in the array part? */
+    uint32_t last = (uint32_t)t + n - 1;
+    /* Grow the destination array part if it is simply appended to. */
+    if (last >= dt->asize && last < LJ_MAX_ASIZE &&
+	(t == 1 || (uint32_t)t <= dt->asize))
+      lj_tab_reasize(L, dt, last);
+    if (t >= 0 && last < dt->asize) {
+      memmove(arrayslot(dt, t), arrayslot(st, f), n*sizeof(TValue));
+      lj_gc_anybarriert(L, dt);
+      return;
+    }
+  }
+  if (dt != st || t > e || t <= f) {  /* Move the keys up from f. */
+    for (i = 0; i < n; i++) {
+      cTValue *o = lj_tab_getint(st, f + (int32_t)i);
+      TValue tmp;
+      if (o) copyTV(L, &tmp, o); else setnilV(&tmp);
+      setintv(L, dt, t + (int32_t)i, &tmp);
+    }
+  } else {  /* Overlapping move to the higher keys: move down from e. */
+    for (i = n; i-- > 0; ) {
+      cTValue *o = lj_tab_getint(st, f + (int32_t)i);
+      TValue tmp;
+      if (o) copyTV(L, &tmp, o); else setnilV(&tmp);
+      setintv(L, dt, t + (int32_t)i, &tmp);
+    }
+  }
+  lj_gc_anybarriert(L, dt);
+}
+
+/* Rotate the integer keys [f, e] of a table by one key up (dir > 0) or
+** down. Used by table.insert() and table.remove() in the middle.
+*/
+void lj_tab_rotate(lua_State *L, GCtab *t, int32_t f, int32_t e, int32_t dir)
+{
+  if (f < e) {
+    cTValue *o = lj_tab_getint(t, dir > 0 ? e : f);
+    TValue tmp;
+    if (o) copyTV(L, &tmp, o); else setnilV(&tmp);
+    if (dir > 0) {
+      lj_tab_move(L, t, t, f, e-1, f+1);
+      setintv(L, t, f, &tmp);
+    } else {
+      lj_tab_move(L, t, t, f+1, e, f);
+      setintv(L, t, e, &tmp);
+    }
+  }
+}
+
 /* -- Table traversal ----------------------------------------------------- */
 
 /* Get the traversal index of a key. */
@@ -630,14 +957,28 @@ static uint32_t keyindex(lua_State *L, GCtab *t, cTValue *key)
     int32_t k = lj_num2int(nk);
     if ((uint32_t)k < t->asize && nk == (lua_Number)k)
       return (uint32_t)k;  /* Array key indexes: [0..t->asize-1] */
+  } else if (tvisstr(key) && LJ_UNLIKELY(strnointern(strV(key)))) {
+    GCstr *s = lj_str_lookup(G(L), strV(key));
+    if (s == NULL)
+      lj_err_msg(L, LJ_ERR_NEXTIDX);
+    setstrV(L, &tmp, s);
+    key = &tmp;
   }
   if (!tvisnil(key)) {
-    Node *n = hashkey(t, key);
+    Node *n = hashkey(t, key), *mn = n;
     do {
       if (lj_obj_equal(&n->key, key))
 	return t->asize + (uint32_t)(n - noderef(t->node));
 	/* Hash key indexes: [t->asize..t->asize+t->nmask] */
     } while ((n = nextnode(n)));
+    if (tabresizing(t)) {  /* Old hash key indexes follow the hash ones. */
+      Node *oldnode = noderef(t->oldnode);
+      n = &oldnode[(uint32_t)(mn - noderef(t->node)) & t->oldhmask];
+      do {
+	if (lj_obj_equal(&n->key, key))
+	  return t->asize + t->hmask+1 + (uint32_t)(n - oldnode);
+      } while ((n = nextnode(n)));
+    }
     if (key->u32.hi == 0xfffe7fff)  /* ITERN was despecialized while running. */
       return key->u32.lo - 1;
     lj_err_msg(L, LJ_ERR_NEXTIDX);
@@ -664,6 +1005,16 @@ int lj_tab_next(lua_State *L, GCtab *t, TValue *key)
       return 1;
     }
   }
+  if (tabresizing(t)) {  /* Then traverse the old hash keys. */
+    for (i -= t->hmask+1; i <= t->oldhmask; i++) {
+      Node *n = &noderef(t->oldnode)[i];
+      if (!tvisnil(&n->val)) {
+	copyTV(L, key, &n->key);
+	copyTV(L, key+1, &n->val);
+	return 1;
+      }
+    }
+  }
   return 0;  /* End of traversal. */
 }
 
@@ -39,13 +39,24 @@ LJ_FUNC GCtab *lj_tab_new_ah(lua_State *L, int32_t a, int32_t h);
 LJ_FUNC GCtab * LJ_FASTCALL lj_tab_new1(lua_State *L, uint32_t ahsize);
 #endif
 LJ_FUNCA GCtab * LJ_FASTCALL lj_tab_dup(lua_State *L, const GCtab *kt);
-LJ_FUNC void LJ_FASTCALL lj_tab_clear(GCtab *t);
+LJ_FUNCA GCtab * LJ_FASTCALL lj_tab_dupcow(lua_State *L, const GCtab *kt);
+LJ_FUNCA void LJ_FASTCALL lj_tab_unshare(lua_State *L, GCtab *t);
+LJ_FUNC void LJ_FASTCALL lj_tab_clear(lua_State *L, GCtab *t);
 LJ_FUNC void LJ_FASTCALL lj_tab_free(global_State *g, GCtab *t);
 #if LJ_HASFFI
 LJ_FUNC void lj_tab_rehash(lua_State *L, GCtab *t);
 #endif
 LJ_FUNC void lj_tab_resize(lua_State *L, GCtab *t, uint32_t asize, uint32_t hbits);
 LJ_FUNCA void lj_tab_reasize(lua_State *L, GCtab *t, uint32_t nasize);
+LJ_FUNCA void lj_tab_movenodes(lua_State *L, GCtab *t, uint32_t n);
+
+/* Finish an incremental resize of the hash part. */
+#define lj_tab_finishresize(L, t) \
+  { if (tabresizing((t))) lj_tab_movenodes((L), (t), ~0u); }
+
+/* Copy the shared part of a copy-on-write table before a store. */
+#define lj_tab_unsharecow(L, t) \
+  (tabiscow((t)) ? lj_tab_unshare((L), (t)) : (void)0)
 
 /* Caveat: all getters except lj_tab_get() can return NULL! */
 
@@ -59,13 +70,18 @@ LJ_FUNCA TValue *lj_tab_newkey(lua_State *L, GCtab *t, cTValue *key);
 LJ_FUNCA TValue *lj_tab_setinth(lua_State *L, GCtab *t, int32_t key);
 LJ_FUNC TValue *lj_tab_setstr(lua_State *L, GCtab *t, GCstr *key);
 LJ_FUNC TValue *lj_tab_set(lua_State *L, GCtab *t, cTValue *key);
+LJ_FUNC void lj_tab_move(lua_State *L, GCtab *dt, GCtab *st, int32_t f,
+			 int32_t e, int32_t t);
+LJ_FUNC void lj_tab_rotate(lua_State *L, GCtab *t, int32_t f, int32_t e,
+			   int32_t dir);
 
 #define inarray(t, key)		((MSize)(key) < (MSize)(t)->asize)
 #define arrayslot(t, i)		(&tvref((t)->array)[(i)])
 #define lj_tab_getint(t, key) \
   (inarray((t), (key)) ? arrayslot((t), (key)) : lj_tab_getinth((t), (key)))
 #define lj_tab_setint(L, t, key) \
-  (inarray((t), (key)) ? arrayslot((t), (key)) : lj_tab_setinth(L, (t), (key)))
+  (lj_tab_unsharecow(L, (t)), \
+   inarray((t), (key)) ? arrayslot((t), (key)) : lj_tab_setinth(L, (t), (key)))
 
 LJ_FUNCA int lj_tab_next(lua_State *L, GCtab *t, TValue *key);
 LJ_FUNCA MSize LJ_FASTCALL lj_tab_len(GCtab *t);
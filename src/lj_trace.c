@@ -820,6 +820,17 @@ static TValue *trace_exit_cp(lua_State *L, lua_CFunction dummy, void *ud)
   return NULL;
 }
 
+/* Protected callback for the GC step at the hard memory limit. */
+static TValue *trace_exit_gc_cp(lua_State *L, lua_CFunction dummy, void *ud)
+{
+  /* Always catch error here and don't call error function. */
+  cframe_errfunc(L->cframe) = 0;
+  cframe_nres(L->cframe) = -2*LUAI_MAXSTACK*(int)sizeof(TValue);
+  lj_gc_step(L);
+  UNUSED(dummy); UNUSED(ud);
+  return NULL;
+}
+
 #ifndef LUAJIT_DISABLE_VMEVENT
 /* Push all registers from exit state. */
 static void trace_exit_regs(lua_State *L, ExitState *ex)
@@ -917,6 +928,11 @@ int LJ_FASTCALL lj_trace_exit(jit_State *J, void *exptr)
   } else if (G(L)->gc.state == GCSatomic || G(L)->gc.state == GCSfinalize) {
     if (!(G(L)->hookmask & HOOK_GC))
       lj_gc_step(L);  /* Exited because of GC: drive GC forward. */
+  } else if (G(L)->gc.total >= G(L)->gc.hardlimit) {
+    /* Exited because of the hard memory limit: run the emergency GC. */
+    errcode = lj_vm_cpcall(L, NULL, NULL, trace_exit_gc_cp);
+    if (errcode)
+      return -errcode;  /* Return negated error code. */
   } else if ((J->flags & JIT_F_ON)) {
     trace_hotside(J, pc);
   }
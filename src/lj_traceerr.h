@@ -33,6 +33,7 @@ TREDEF(STORENN,	"store with nil or NaN key")
 TREDEF(NOMM,	"missing metamethod")
 TREDEF(IDXLOOP,	"looping index lookup")
 TREDEF(NYITMIX,	"NYI: mixed sparse/dense table")
+TREDEF(NYISTRKEY,	"NYI: uninterned string key")
 
 /* Recording C data operations. */
 TREDEF(NOCACHE,	"symbol not in cache")
@@ -1,5 +1,5 @@
 /*
-** Interfaces for working with LEB128/ULEB128 encoding.
+** Interfaces for working with LEB128/ULEB128 encoding and the monotonic clock.
 **
 ** Major portions taken verbatim or adapted from the LuaVela.
 ** Copyright (C) 2015-2019 IPONWEB Ltd.
@@ -55,4 +55,10 @@ size_t LJ_FASTCALL lj_utils_write_leb128(uint8_t *buffer, int64_t value);
 */
 size_t LJ_FASTCALL lj_utils_write_uleb128(uint8_t *buffer, uint64_t value);
 
+/*
+** Returns the current value of a monotonic clock in nanoseconds. The origin
+** is unspecified, so only differences between the values are meaningful.
+*/
+uint64_t lj_utils_time_ns(void);
+
 #endif
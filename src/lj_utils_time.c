@@ -0,0 +1,36 @@
+/*
+** Monotonic clock.
+*/
+
+#define lj_utils_time_c
+#define LUA_CORE
+
+#include "lj_utils.h"
+#include "lj_arch.h"
+
+#if LJ_TARGET_WINDOWS
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <time.h>
+#endif
+
+uint64_t lj_utils_time_ns(void)
+{
+#if LJ_TARGET_WINDOWS
+  static LARGE_INTEGER freq;
+  LARGE_INTEGER cnt;
+  if (freq.QuadPart == 0)
+    QueryPerformanceFrequency(&freq);
+  QueryPerformanceCounter(&cnt);
+  return (uint64_t)(cnt.QuadPart / freq.QuadPart) * 1000000000u +
+	 (uint64_t)(cnt.QuadPart % freq.QuadPart) * 1000000000u /
+	 (uint64_t)freq.QuadPart;
+#elif LJ_TARGET_POSIX
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+#else
+  return (uint64_t)clock() * (1000000000u / CLOCKS_PER_SEC);
+#endif
+}
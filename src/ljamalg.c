@@ -30,6 +30,7 @@
 
 #include "lj_assert.c"
 #include "lj_gc.c"
+#include "lj_gcthread.c"
 #include "lj_err.c"
 #include "lj_char.c"
 #include "lj_bc.c"
@@ -55,6 +56,7 @@
 #include "lj_profile_timer.c"
 #include "lj_symtab.c"
 #include "lj_memprof.c"
+#include "lj_heapdump.c"
 #include "lj_lex.c"
 #include "lj_parse.c"
 #include "lj_bcread.c"
@@ -87,6 +89,7 @@
 #include "lj_gdbjit.c"
 #include "lj_alloc.c"
 #include "lj_utils_leb128.c"
+#include "lj_utils_time.c"
 
 #include "lib_aux.c"
 #include "lib_base.c"
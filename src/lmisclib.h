@@ -12,6 +12,11 @@
 
 /* API for obtaining various platform metrics. */
 
+/* Number of buckets in the histogram of incremental GC step durations. */
+#define LUAM_GC_PAUSE_HIST 20
+/* Number of buckets in the allocation size histogram. */
+#define LUAM_ALLOC_SIZE_HIST 32
+
 struct luam_Metrics {
   /*
   ** Number of strings being interned (i.e. the string with the
@@ -56,10 +61,206 @@ struct luam_Metrics {
   size_t jit_mcode_size;
   /* Amount of JIT traces. */
   unsigned int jit_trace_num;
+
+  /*
+  ** Total time spent in incremental GC steps (nanoseconds). The
+  ** steps done by misc.gc_idle() are accounted as well, and each
+  ** full GC cycle (including the emergency one) counts as a step.
+  ** The same holds for the per-state times and the histogram below.
+  */
+  uint64_t gc_steps_time;
+  /* Duration of the longest incremental GC step (nanoseconds). */
+  uint64_t gc_steps_time_max;
+  /* Count of incremental GC steps in the remark state. */
+  size_t gc_steps_remark;
+
+  /* Amount of objects in the finalization queue. */
+  size_t gc_finq_len;
+  /* Overall number of finalized objects. */
+  size_t gc_finalized;
+  /*
+  ** Total time the finalized objects spent in the finalization
+  ** queue (nanoseconds). It's measured from the GC step, which
+  ** has queued the object.
+  */
+  uint64_t gc_finq_latency;
+  /* The longest time an object spent in the queue (nanoseconds). */
+  uint64_t gc_finq_latency_max;
+
+  /* Time spent in incremental GC steps per state (nanoseconds). */
+  uint64_t gc_time_pause;
+  uint64_t gc_time_propagate;
+  uint64_t gc_time_remark;
+  uint64_t gc_time_atomic;
+  uint64_t gc_time_sweepstring;
+  uint64_t gc_time_sweep;
+  uint64_t gc_time_finalize;
+  /*
+  ** Log-scale histogram of incremental GC step durations. The i-th
+  ** bucket counts the steps shorter than 2^i microseconds, which do
+  ** not fit in the previous buckets. The last bucket counts all the
+  ** longer steps.
+  */
+  size_t gc_pause_hist[LUAM_GC_PAUSE_HIST];
+  /* Number of GC cycles, which have finished the sweep phase. */
+  size_t gc_cycles;
+  /* Total amount of memory surviving the sweep phases of GC cycles. */
+  size_t gc_marked;
+  /* Total amount of memory freed by the sweep phases of GC cycles. */
+  size_t gc_swept;
+
+  /*
+  ** Memory mapped from the system by the bundled allocator. All the
+  ** alloc_* metrics are 0 if a custom allocator is used.
+  */
+  size_t alloc_mapped;
+  /* Number of mmap(), munmap(), mremap() and madvise() calls. */
+  size_t alloc_mmap;
+  size_t alloc_munmap;
+  size_t alloc_mremap;
+  size_t alloc_madvise;
+  /* Total amount of memory released with madvise() and kept mapped. */
+  size_t alloc_released;
+
+  /* Number and total size of the segments with the heap chunks. */
+  size_t alloc_segments;
+  size_t alloc_segments_size;
+  /*
+  ** Free memory in the segments (in the bins and the top chunk). Large
+  ** amounts of it with the low gc_total mean the fragmentation.
+  */
+  size_t alloc_free;
+  /* Number and total size of the large directly mapped chunks. */
+  size_t alloc_direct;
+  size_t alloc_direct_size;
+  /* Memory mapped for the slabs and used by the small objects in them. */
+  size_t alloc_slabs_size;
+  size_t alloc_slabs_used;
+  /*
+  ** Power-of-two histogram of allocation sizes. The i-th bucket counts
+  ** the allocations of [2^i, 2^(i+1)) bytes, the last bucket counts all
+  ** the larger ones as well.
+  */
+  size_t alloc_size_hist[LUAM_ALLOC_SIZE_HIST];
+  /* Number of emergency full GC cycles run at the hard memory limit. */
+  size_t gc_emergency;
+  /* Number and total size of the chunks queued to the reclaim thread. */
+  size_t alloc_reclaimq_len;
+  size_t alloc_reclaimq_size;
+  /* Overall number of the chunks unmapped by the reclaim thread. */
+  size_t alloc_reclaimed;
+  /*
+  ** Total time the unmapped chunks spent in the reclaim queue including
+  ** the unmapping (nanoseconds).
+  */
+  uint64_t alloc_reclaimq_latency;
+  /* The longest time a chunk spent in the queue (nanoseconds). */
+  uint64_t alloc_reclaimq_latency_max;
+  /* Number of strings created without interning, see luaM_strnointern(). */
+  size_t strhash_nointern;
+  /*
+  ** Bytes of the heap segments and the slab spans mapped with huge pages,
+  ** see luaM_hugepages().
+  */
+  size_t alloc_hugepages_size;
 };
 
 LUAMISC_API void luaM_metrics(lua_State *L, struct luam_Metrics *metrics);
 
+/* --- Idle-time garbage collection --------------------------------------- */
+
+/*
+** Performs incremental GC steps until the given deadline or the end of the
+** current GC cycle. The deadline is an absolute time in nanoseconds of the
+** monotonic clock (CLOCK_MONOTONIC on POSIX systems). The work done is
+** subtracted from the GC work performed on the following allocations.
+** Does nothing if the GC is stopped or it is too early to start a new GC
+** cycle. Returns 1 if the GC cycle has been finished, 0 otherwise. With the
+** lazy trimming (see luaM_alloc_decay()) the free memory of the bundled
+** allocator is released as well, if the decay time has passed.
+*/
+LUAMISC_API int luaM_gc_idle(lua_State *L, uint64_t deadline_ns);
+
+/* --- Memory limits ----------------------------------------------------- */
+
+/* Flush the JIT traces, when the soft memory limit is crossed. */
+#define LUAM_MEMLIMIT_FLUSH	0x01
+
+/*
+** Sets the limits of the memory allocated by the platform (gc_total) in
+** bytes, 0 means no limit. Above the soft limit the GC doesn't pause between
+** the cycles and performs 4 times more work per step. The traces are flushed
+** once per crossing of the soft limit with LUAM_MEMLIMIT_FLUSH. Once the hard
+** limit is reached, the next GC step performs an emergency full GC and raises
+** LUA_ERRMEM if the memory is still above the limit. The limit may be
+** overshot by the allocations made before the next GC check. The hard limit
+** is not enforced while the GC is stopped. Returns 0 on success or -1 if the
+** soft limit exceeds the hard one.
+*/
+LUAMISC_API int luaM_setmemlimit(lua_State *L, size_t soft, size_t hard,
+				 int flags);
+
+/* --- Allocator trimming ------------------------------------------------ */
+
+/*
+** Sets the decay time of the lazy trimming of the bundled allocator in
+** nanoseconds. With the lazy trimming the free memory is kept mapped and
+** its pages are released with madvise() at most once per the decay time.
+** The time is checked on frees and in luaM_gc_idle(). 0 restores the default eager trimming, which unmaps the free memory at
+** once. Returns 0 on success or -1 if the lazy trimming is not supported
+** (a custom allocator is used or the platform has no madvise()).
+*/
+LUAMISC_API int luaM_alloc_decay(lua_State *L, uint64_t decay_ns);
+
+/*
+** Unmaps the unused memory of the bundled allocator and releases the pages
+** of the rest of the free memory with the lazy trimming. Returns the amount
+** of memory returned to the system.
+*/
+LUAMISC_API size_t luaM_alloc_trim(lua_State *L);
+
+/*
+** Enables or disables the reclaim thread of the bundled allocator. With the
+** reclaim thread, the large directly mapped chunks (1 MB and more) are
+** unmapped on that thread instead of the one running Lua, so the page-table
+** teardown doesn't stall it. Disabling waits until the queued chunks are
+** unmapped. Returns the previous state or -1 if the reclaim thread is not
+** supported or can't be started.
+*/
+LUAMISC_API int luaM_alloc_reclaim(lua_State *L, int enable);
+
+/* --- Huge pages --------------------------------------------------------- */
+
+/* Huge page modes of the bundled allocator. */
+#define LUAM_HUGEPAGES_OFF	0
+/* Transparent huge pages (madvise(MADV_HUGEPAGE)). */
+#define LUAM_HUGEPAGES_THP	1
+/* Pages from hugetlbfs (MAP_HUGETLB), THP if none are available. */
+#define LUAM_HUGEPAGES_HUGETLB	2
+
+/*
+** Sets the huge page mode of the memory mapped by the bundled allocator from
+** now on. In the huge page modes the heap segments are mapped in 2 MB aligned
+** chunks backed by huge pages. A negative mode only queries the current one.
+** Returns the previous mode or -1 if the mode is invalid or huge pages are not
+** supported (a custom allocator is used or the platform is not Linux).
+*/
+LUAMISC_API int luaM_hugepages(lua_State *L, int mode);
+
+/* --- Uninterned strings ------------------------------------------------- */
+
+/*
+** Sets the length threshold of uninterned strings, 0 disables them. The
+** strings of at least the given length, which are produced by I/O,
+** concatenation, the string library and lua_pushlstring(), are not
+** interned and are hashed only on their use as a table key. Such strings
+** are compared by contents instead of by reference. Changing the threshold
+** flushes the JIT traces. Returns the previous threshold or -1 if
+** uninterned strings are not supported (non-x86/x64 platforms) or the
+** threshold can't be changed from a __gc metamethod.
+*/
+LUAMISC_API long luaM_strnointern(lua_State *L, size_t threshold);
+
 /* --- Sysprof - platform and lua profiler -------------------------------- */
 
 /* Profiler configurations. */
@@ -155,6 +356,38 @@ LUAMISC_API int luaM_sysprof_stop(lua_State *L);
 
 LUAMISC_API int luaM_sysprof_report(struct luam_Sysprof_Counters *counters);
 
+/* --- Heap dump ---------------------------------------------------------- */
+
+/*
+** Writer function for the heap dump stream.
+** Should return amount of written bytes on success or zero in case of error.
+** Setting *data to NULL stops the dump.
+** For details see <lj_wbuf.h>.
+*/
+typedef size_t (*luam_Heapdump_writer)(const void **data, size_t len,
+                                       void *ctx);
+
+/* Heap dump options. */
+struct luam_Heapdump_Options {
+  /* Writer function for the dump. */
+  luam_Heapdump_writer writer;
+  /* Context for the writer. */
+  void *ctx;
+  /* Custom buffer to write data. */
+  uint8_t *buf;
+  /* The buffer's size. */
+  size_t len;
+};
+
+/*
+** Finishes a full GC cycle and streams the graph of all live GC objects
+** in format described in <lj_heapdump.h>. Returns PROFILE_SUCCESS on
+** success, PROFILE_ERRUSE if heap dumps are not supported on the platform
+** and PROFILE_ERRIO if writing has failed (errno is set).
+*/
+LUAMISC_API int luaM_heapdump(lua_State *L,
+                              const struct luam_Heapdump_Options *opt);
+
 
 #define LUAM_MISCLIBNAME "misc"
 LUALIB_API int luaopen_misc(lua_State *L);
@@ -230,6 +230,12 @@ LUA_API int  (lua_status) (lua_State *L);
 #define LUA_GCSETPAUSE		6
 #define LUA_GCSETSTEPMUL	7
 #define LUA_GCISRUNNING		9
+#define LUA_GCGEN		10
+#define LUA_GCINC		11
+#define LUA_GCBUDGET		12
+#define LUA_GCBGSWEEP		13
+#define LUA_GCMARKERS		14
+#define LUA_GCFINBUDGET		15
 
 LUA_API int (lua_gc) (lua_State *L, int what, int data);
 
@@ -488,11 +488,12 @@ def gc_state(g):
     return {
         0: 'PAUSE',
         1: 'PROPAGATE',
-        2: 'ATOMIC',
-        3: 'SWEEPSTRING',
-        4: 'SWEEP',
-        5: 'FINALIZE',
-        6: 'LAST',
+        2: 'REMARK',
+        3: 'ATOMIC',
+        4: 'SWEEPSTRING',
+        5: 'SWEEP',
+        6: 'FINALIZE',
+        7: 'LAST',
     }.get(g.gc.state, 'INVALID')
 
 
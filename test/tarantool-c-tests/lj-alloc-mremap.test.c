@@ -0,0 +1,175 @@
+#include "lua.h"
+#include "lauxlib.h"
+#include "lmisclib.h"
+
+#include <stdint.h>
+#include <string.h>
+
+#include "test.h"
+#include "utils.h"
+
+/* <lj_arch.h> is needed for LUAJIT_OS. */
+#include "lj_arch.h"
+
+#if LUAJIT_OS == LUAJIT_OS_LINUX
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+/*
+ * Test the growth of the large objects, which are mapped directly
+ * by the bundled allocator and are remapped on realloc instead of
+ * being copied.
+ */
+
+#define NSTEPS 6
+
+static void fill(unsigned char *p, size_t from, size_t to, unsigned char seed)
+{
+	size_t i;
+	for (i = from; i < to; i++)
+		p[i] = (unsigned char)(seed + i * 7);
+}
+
+static int check(const unsigned char *p, size_t sz, unsigned char seed)
+{
+	size_t i;
+	for (i = 0; i < sz; i++)
+		if (p[i] != (unsigned char)(seed + i * 7))
+			return 0;
+	return 1;
+}
+
+static int grow_interleaved(void *test_state)
+{
+	lua_State *L = test_state;
+	void *ud;
+	lua_Alloc allocf = lua_getallocf(L, &ud);
+	/* Both objects are grown in turn, so they block each other. */
+	unsigned char *a, *b;
+	size_t sz = 256 * 1024;
+	int i;
+
+	a = allocf(ud, NULL, 0, sz);
+	b = allocf(ud, NULL, 0, sz);
+	assert_true(a != NULL && b != NULL);
+	fill(a, 0, sz, 0x11);
+	fill(b, 0, sz, 0x77);
+	for (i = 0; i < NSTEPS; i++) {
+		size_t nsz = sz * 2;
+		a = allocf(ud, a, sz, nsz);
+		assert_true(a != NULL);
+		assert_true(check(a, sz, 0x11));
+		fill(a, sz, nsz, 0x11);
+		b = allocf(ud, b, sz, nsz);
+		assert_true(b != NULL);
+		assert_true(check(b, sz, 0x77));
+		fill(b, sz, nsz, 0x77);
+		sz = nsz;
+	}
+	/* Shrink both objects back. */
+	a = allocf(ud, a, sz, sz / 8);
+	b = allocf(ud, b, sz, sz / 8);
+	assert_true(a != NULL && b != NULL);
+	assert_true(check(a, sz / 8, 0x11));
+	assert_true(check(b, sz / 8, 0x77));
+	allocf(ud, a, sz / 8, 0);
+	allocf(ud, b, sz / 8, 0);
+	return TEST_EXIT_SUCCESS;
+}
+
+static int grow_from_segment(void *test_state)
+{
+	lua_State *L = test_state;
+	void *ud;
+	lua_Alloc allocf = lua_getallocf(L, &ud);
+	/* From the segments to the direct mappings and back. */
+	const size_t sizes[] = {1000, 60000, 200000, 3000000, 100000, 500};
+	size_t osz = sizes[0];
+	unsigned char *p = allocf(ud, NULL, 0, osz);
+	size_t i;
+
+	assert_true(p != NULL);
+	fill(p, 0, osz, 0x5a);
+	for (i = 1; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+		size_t nsz = sizes[i];
+		p = allocf(ud, p, osz, nsz);
+		assert_true(p != NULL);
+		assert_true(((uintptr_t)p & 7) == 0);
+		assert_true(check(p, osz < nsz ? osz : nsz, 0x5a));
+		if (nsz > osz)
+			fill(p, osz, nsz, 0x5a);
+		osz = nsz;
+	}
+	allocf(ud, p, osz, 0);
+	return TEST_EXIT_SUCCESS;
+}
+
+#if LUAJIT_OS == LUAJIT_OS_LINUX && defined(MAP_FIXED_NOREPLACE)
+/* Take the first free page after the given address. */
+static void *block_after(char *p)
+{
+	size_t pagesz = (size_t)sysconf(_SC_PAGESIZE);
+	char *addr = (char *)(((uintptr_t)p + pagesz - 1) & ~(pagesz - 1));
+	int i;
+	for (i = 0; i < 4; i++, addr += pagesz) {
+		void *q = mmap(addr, pagesz, PROT_NONE,
+			       MAP_PRIVATE | MAP_ANONYMOUS |
+			       MAP_FIXED_NOREPLACE, -1, 0);
+		if (q == addr)
+			return q;
+		if (q != MAP_FAILED)  /* Old kernels treat it as a hint. */
+			munmap(q, pagesz);
+	}
+	return NULL;  /* Taken by the mapping itself or by others. */
+}
+#endif
+
+static int move_blocked(void *test_state)
+{
+#if LUAJIT_OS == LUAJIT_OS_LINUX && defined(MAP_FIXED_NOREPLACE)
+	lua_State *L = test_state;
+	void *ud;
+	lua_Alloc allocf = lua_getallocf(L, &ud);
+	struct luam_Metrics old, new;
+	size_t sz = 1024 * 1024;
+	unsigned char *p = allocf(ud, NULL, 0, sz);
+	unsigned char *np;
+	void *guard;
+
+	assert_true(p != NULL);
+	fill(p, 0, sz, 0x33);
+	/* The mapping can't be extended in place. */
+	guard = block_after((char *)p + sz);
+	luaM_metrics(L, &old);
+	np = allocf(ud, p, sz, sz * 4);
+	luaM_metrics(L, &new);
+	if (guard != NULL)
+		munmap(guard, (size_t)sysconf(_SC_PAGESIZE));
+	assert_true(np != NULL);
+	assert_true(np != p);
+	assert_true(check(np, sz, 0x33));
+	/* The pages are moved by mremap(): the old mapping isn't freed. */
+	assert_true(new.alloc_mremap > old.alloc_mremap);
+	assert_true(new.alloc_munmap == old.alloc_munmap);
+	assert_true(new.alloc_direct == old.alloc_direct);
+	allocf(ud, np, sz * 4, 0);
+	return TEST_EXIT_SUCCESS;
+#else
+	(void)test_state;
+	return skip("Blocking of the mappings is implemented for Linux only");
+#endif
+}
+
+int main(void)
+{
+	lua_State *L = utils_lua_init();
+	const struct test_unit tgroup[] = {
+		test_unit_def(grow_interleaved),
+		test_unit_def(grow_from_segment),
+		test_unit_def(move_blocked)
+	};
+	const int test_result = test_run_group(tgroup, L);
+	utils_lua_close(L);
+	return test_result;
+}
@@ -0,0 +1,145 @@
+#include "lua.h"
+#include "lauxlib.h"
+
+#include <stdint.h>
+#include <string.h>
+
+#include "test.h"
+#include "utils.h"
+
+/*
+ * Test the allocation of small objects, which are served from
+ * the size-class slabs by the bundled allocator, and their
+ * moving between the slabs and the bins on realloc.
+ */
+
+#define NOBJECTS 10000
+
+static void fill(unsigned char *p, size_t sz, unsigned char seed)
+{
+	size_t i;
+	for (i = 0; i < sz; i++)
+		p[i] = (unsigned char)(seed + i);
+}
+
+static int check(const unsigned char *p, size_t sz, unsigned char seed)
+{
+	size_t i;
+	for (i = 0; i < sz; i++)
+		if (p[i] != (unsigned char)(seed + i))
+			return 0;
+	return 1;
+}
+
+static int realloc_contents(void *test_state)
+{
+	lua_State *L = test_state;
+	void *ud;
+	lua_Alloc allocf = lua_getallocf(L, &ud);
+	/* Within a class, between classes, to the bins and back. */
+	const size_t sizes[] = {20, 24, 100, 256, 257, 4000, 200, 8, 1};
+	size_t osz = sizes[0];
+	unsigned char *p = allocf(ud, NULL, 0, osz);
+	size_t i;
+
+	assert_true(p != NULL);
+	fill(p, osz, 0x5a);
+	for (i = 1; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+		size_t nsz = sizes[i];
+		p = allocf(ud, p, osz, nsz);
+		assert_true(p != NULL);
+		assert_true(((uintptr_t)p & 7) == 0);
+		assert_true(check(p, osz < nsz ? osz : nsz, 0x5a));
+		fill(p, nsz, 0x5a);
+		osz = nsz;
+	}
+	allocf(ud, p, osz, 0);
+	return TEST_EXIT_SUCCESS;
+}
+
+static int inexact_sizes(void *test_state)
+{
+	lua_State *L = test_state;
+	void *ud;
+	lua_Alloc allocf = lua_getallocf(L, &ud);
+	/* The neighbours of the first object in the slab. */
+	unsigned char *objs[32];
+	unsigned char *p;
+	size_t i;
+
+	for (i = 0; i < 32; i++) {
+		objs[i] = allocf(ud, NULL, 0, 8);
+		assert_true(objs[i] != NULL);
+		fill(objs[i], 8, (unsigned char)i);
+	}
+	/*
+	 * The old size is larger than the object. The object must be
+	 * moved to the slab of the new size anyway.
+	 */
+	p = allocf(ud, objs[0], 100, 100);
+	assert_true(p != NULL);
+	assert_true(check(p, 8, 0));
+	fill(p, 100, 0x33);
+	for (i = 1; i < 32; i++)
+		assert_true(check(objs[i], 8, (unsigned char)i));
+	/* The old size is smaller than the object. */
+	allocf(ud, p, 90, 0);
+	for (i = 1; i < 32; i++)
+		allocf(ud, objs[i], 1, 0);
+	return TEST_EXIT_SUCCESS;
+}
+
+static int many_objects(void *test_state)
+{
+	lua_State *L = test_state;
+	void *ud;
+	lua_Alloc allocf = lua_getallocf(L, &ud);
+	static unsigned char *objs[NOBJECTS];
+	size_t sz, i;
+
+	for (sz = 8; sz <= 256; sz += 56) {
+		uint32_t seed = 1;
+		for (i = 0; i < NOBJECTS; i++) {
+			objs[i] = allocf(ud, NULL, 0, sz);
+			assert_true(objs[i] != NULL);
+			fill(objs[i], sz, (unsigned char)i);
+		}
+		/* Free a half of the objects in a pseudo-random order. */
+		for (i = 0; i < NOBJECTS / 2; i++) {
+			size_t k;
+			seed = seed * 1103515245 + 12345;
+			k = (seed >> 8) % NOBJECTS;
+			if (objs[k] != NULL) {
+				allocf(ud, objs[k], sz, 0);
+				objs[k] = NULL;
+			}
+		}
+		/* Reuse the freed ones. */
+		for (i = 0; i < NOBJECTS; i++) {
+			if (objs[i] == NULL) {
+				objs[i] = allocf(ud, NULL, 0, sz);
+				assert_true(objs[i] != NULL);
+				fill(objs[i], sz, (unsigned char)i);
+			}
+		}
+		/* No object is overwritten by another one. */
+		for (i = 0; i < NOBJECTS; i++) {
+			assert_true(check(objs[i], sz, (unsigned char)i));
+			allocf(ud, objs[i], sz, 0);
+		}
+	}
+	return TEST_EXIT_SUCCESS;
+}
+
+int main(void)
+{
+	lua_State *L = utils_lua_init();
+	const struct test_unit tgroup[] = {
+		test_unit_def(realloc_contents),
+		test_unit_def(inexact_sizes),
+		test_unit_def(many_objects)
+	};
+	const int test_result = test_run_group(tgroup, L);
+	utils_lua_close(L);
+	return test_result;
+}
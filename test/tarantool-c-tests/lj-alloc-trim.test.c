@@ -0,0 +1,78 @@
+#include "lua.h"
+#include "lauxlib.h"
+#include "lmisclib.h"
+
+#include <stdint.h>
+
+#include "test.h"
+#include "utils.h"
+
+/*
+ * Test the lazy trimming of the bundled allocator with the
+ * transparent huge pages: the released ranges are rounded to
+ * whole huge pages, so the huge pages are not split, and the
+ * free segments are unmapped instead.
+ */
+
+#define HUGEPAGE_SIZE (2 * 1024 * 1024)
+#define NCHUNKS 64
+/* Less than the direct mapping threshold, so it's in a segment. */
+#define CHUNK_SIZE (100 * 1000)
+
+/* Returns the memory mapped with huge pages at the peak. */
+static size_t burst(lua_State *L)
+{
+	struct luam_Metrics m;
+	void *ud;
+	lua_Alloc allocf = lua_getallocf(L, &ud);
+	void *chunks[NCHUNKS];
+	int i;
+	for (i = 0; i < NCHUNKS; i++) {
+		chunks[i] = allocf(ud, NULL, 0, CHUNK_SIZE);
+		assert_true(chunks[i] != NULL);
+	}
+	luaM_metrics(L, &m);
+	for (i = 0; i < NCHUNKS; i++)
+		allocf(ud, chunks[i], CHUNK_SIZE, 0);
+	return m.alloc_hugepages_size;
+}
+
+static int thp_release(void *test_state)
+{
+	lua_State *L = test_state;
+	struct luam_Metrics old, new;
+	size_t peak, released;
+
+	/* Release everything, which was freed before. */
+	burst(L);
+	luaM_gc_idle(L, 0);
+	luaM_metrics(L, &old);
+	if (old.alloc_hugepages_size == 0)
+		return skip("Transparent huge pages are not supported");
+
+	peak = burst(L);
+	luaM_gc_idle(L, 0);
+	luaM_metrics(L, &new);
+	released = new.alloc_released - old.alloc_released;
+	assert_true(released % HUGEPAGE_SIZE == 0);
+	/* Either the pages are released or the segments are unmapped. */
+	assert_true(released > 0 || new.alloc_hugepages_size < peak);
+	return TEST_EXIT_SUCCESS;
+}
+
+int main(void)
+{
+	lua_State *L = utils_lua_init();
+	const struct test_unit tgroup[] = {
+		test_unit_def(thp_release)
+	};
+	int test_result;
+	if (luaM_hugepages(L, LUAM_HUGEPAGES_THP) < 0 ||
+	    luaM_alloc_decay(L, 1) != 0) {
+		utils_lua_close(L);
+		return skip_all("Lazy trimming with huge pages is not supported");
+	}
+	test_result = test_run_group(tgroup, L);
+	utils_lua_close(L);
+	return test_result;
+}
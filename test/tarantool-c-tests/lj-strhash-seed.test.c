@@ -0,0 +1,68 @@
+#include "lua.h"
+#include "lauxlib.h"
+
+#include <string.h>
+
+#include "test.h"
+#include "utils.h"
+
+/*
+ * Test the seeded string hash (LUAJIT_SEEDED_STRHASH): each VM
+ * has its own seed, so the hashes of the same strings and hence
+ * the traversal order of a table with string keys differ between
+ * two VMs. Without the seed the order is the same.
+ */
+
+#define NKEYS 64
+
+/* Fill the table with NKEYS string keys. */
+static const char fill_chunk[] =
+	"local t = {}\n"
+	"for i = 1, 64 do t['key' .. i] = i end\n"
+	"return t\n";
+
+/* Store the values of the table in the order of lua_next(). */
+static int traverse(lua_State *L, int order[NKEYS])
+{
+	int n = 0;
+	if (luaL_dostring(L, fill_chunk) != 0)
+		return -1;
+	lua_pushnil(L);
+	while (lua_next(L, -2) != 0) {
+		if (n < NKEYS)
+			order[n] = (int)lua_tointeger(L, -1);
+		n++;
+		lua_pop(L, 1);
+	}
+	lua_pop(L, 1);
+	return n;
+}
+
+static int pairs_order(void *test_state)
+{
+	lua_State *L1 = test_state;
+	lua_State *L2 = utils_lua_init();
+	int order1[NKEYS], order2[NKEYS];
+	int n1 = traverse(L1, order1);
+	int n2 = traverse(L2, order2);
+	utils_lua_close(L2);
+
+	assert_true(n1 == NKEYS && n2 == NKEYS);
+#if LUAJIT_SEEDED_STRHASH
+	assert_true(memcmp(order1, order2, sizeof(order1)) != 0);
+#else
+	assert_true(memcmp(order1, order2, sizeof(order1)) == 0);
+#endif
+	return TEST_EXIT_SUCCESS;
+}
+
+int main(void)
+{
+	lua_State *L = utils_lua_init();
+	const struct test_unit tgroup[] = {
+		test_unit_def(pairs_order)
+	};
+	const int test_result = test_run_group(tgroup, L);
+	utils_lua_close(L);
+	return test_result;
+}
@@ -43,6 +43,49 @@ static int base(void *test_state)
 	(void)metrics.jit_mcode_size;
 	(void)metrics.jit_trace_num;
 
+	(void)metrics.gc_steps_time;
+	(void)metrics.gc_steps_time_max;
+	(void)metrics.gc_steps_remark;
+
+	(void)metrics.gc_finq_len;
+	(void)metrics.gc_finalized;
+	(void)metrics.gc_finq_latency;
+	(void)metrics.gc_finq_latency_max;
+
+	(void)metrics.gc_time_pause;
+	(void)metrics.gc_time_propagate;
+	(void)metrics.gc_time_remark;
+	(void)metrics.gc_time_atomic;
+	(void)metrics.gc_time_sweepstring;
+	(void)metrics.gc_time_sweep;
+	(void)metrics.gc_time_finalize;
+	(void)metrics.gc_pause_hist[LUAM_GC_PAUSE_HIST - 1];
+	(void)metrics.gc_cycles;
+	(void)metrics.gc_marked;
+	(void)metrics.gc_swept;
+	(void)metrics.alloc_mapped;
+	(void)metrics.alloc_mmap;
+	(void)metrics.alloc_munmap;
+	(void)metrics.alloc_mremap;
+	(void)metrics.alloc_madvise;
+	(void)metrics.alloc_released;
+	(void)metrics.alloc_segments;
+	(void)metrics.alloc_segments_size;
+	(void)metrics.alloc_free;
+	(void)metrics.alloc_direct;
+	(void)metrics.alloc_direct_size;
+	(void)metrics.alloc_slabs_size;
+	(void)metrics.alloc_slabs_used;
+	(void)metrics.alloc_size_hist;
+	(void)metrics.gc_emergency;
+	(void)metrics.alloc_reclaimq_len;
+	(void)metrics.alloc_reclaimq_size;
+	(void)metrics.alloc_reclaimed;
+	(void)metrics.alloc_reclaimq_latency;
+	(void)metrics.alloc_reclaimq_latency_max;
+	(void)metrics.strhash_nointern;
+	(void)metrics.alloc_hugepages_size;
+
 	return TEST_EXIT_SUCCESS;
 }
 
@@ -81,6 +124,8 @@ static int gc_steps(void *test_state)
 	luaM_metrics(L, &oldm);
 	assert_true(oldm.gc_steps_pause > 0);
 	assert_true(oldm.gc_steps_propagate > 0);
+	/* The main thread is always left for the remark. */
+	assert_true(oldm.gc_steps_remark > 0);
 	assert_true(oldm.gc_steps_atomic > 0);
 	assert_true(oldm.gc_steps_sweepstring > 0);
 	assert_true(oldm.gc_steps_sweep > 0);
@@ -94,6 +139,7 @@ static int gc_steps(void *test_state)
 	luaM_metrics(L, &newm);
 	assert_sizet_equal(newm.gc_steps_pause, oldm.gc_steps_pause);
 	assert_sizet_equal(newm.gc_steps_propagate, oldm.gc_steps_propagate);
+	assert_sizet_equal(newm.gc_steps_remark, oldm.gc_steps_remark);
 	assert_sizet_equal(newm.gc_steps_atomic, oldm.gc_steps_atomic);
 	assert_sizet_equal(newm.gc_steps_sweepstring,
 			   oldm.gc_steps_sweepstring);
@@ -110,6 +156,7 @@ static int gc_steps(void *test_state)
 	luaM_metrics(L, &newm);
 	assert_true(newm.gc_steps_pause - oldm.gc_steps_pause == 1);
 	assert_true(newm.gc_steps_propagate - oldm.gc_steps_propagate >= 1);
+	assert_true(newm.gc_steps_remark - oldm.gc_steps_remark >= 1);
 	assert_true(newm.gc_steps_atomic - oldm.gc_steps_atomic == 1);
 	assert_true(newm.gc_steps_sweepstring - oldm.gc_steps_sweepstring >= 1);
 	assert_true(newm.gc_steps_sweep - oldm.gc_steps_sweep >= 1);
@@ -127,6 +174,7 @@ static int gc_steps(void *test_state)
 	luaM_metrics(L, &newm);
 	assert_true(newm.gc_steps_pause - oldm.gc_steps_pause == 3);
 	assert_true(newm.gc_steps_propagate - oldm.gc_steps_propagate >= 3);
+	assert_true(newm.gc_steps_remark - oldm.gc_steps_remark >= 3);
 	assert_true(newm.gc_steps_atomic - oldm.gc_steps_atomic == 3);
 	assert_true(newm.gc_steps_sweepstring - oldm.gc_steps_sweepstring >= 3);
 	assert_true(newm.gc_steps_sweep - oldm.gc_steps_sweep >= 3);
@@ -0,0 +1,70 @@
+local tap = require('tap')
+
+-- Test file to check the string sweep on the GC helper thread.
+local test = tap.test('gc-bgsweep')
+
+test:plan(5)
+
+test:is(collectgarbage('bgsweep', 1), 0, 'bgsweep is disabled by default')
+local enabled = collectgarbage('bgsweep', 1)
+if enabled == 0 then
+  test:skip('no GC helper thread on this platform')
+  test:skip('no GC helper thread on this platform')
+  test:skip('no GC helper thread on this platform')
+  test:skip('no GC helper thread on this platform')
+  test:done(true)
+  return
+end
+test:is(enabled, 1, 'bgsweep is enabled')
+
+-- Keep some strings alive and drop the others, while interning
+-- new strings and resurrecting dead ones between the GC steps.
+local N = 2e5
+local alive = {}
+for i = 1, N do
+  alive[i] = 'alive' .. i
+end
+local strnum = misc.getmetrics().gc_strnum
+for i = 1, N do
+  local _ = 'dead' .. i
+end
+
+local cycles = 0
+local i = 0
+while cycles < 4 do
+  i = i + 1
+  local k = i % N + 1
+  -- Intern a dead string and a new one.
+  local _ = 'dead' .. k
+  alive[k] = 'new' .. k
+  if collectgarbage('step', 0) then cycles = cycles + 1 end
+end
+-- At most one 'dead' and one 'new' string per iteration are kept.
+test:ok(misc.getmetrics().gc_strnum <= strnum + 2 * i,
+        'dead strings are freed')
+
+local broken = 0
+for k = 1, N do
+  local s = alive[k]
+  if s ~= 'alive' .. k and s ~= 'new' .. k then broken = broken + 1 end
+end
+test:is(broken, 0, 'live strings are kept')
+
+-- Interned strings are fixed by ffi.cdef() in the middle of the
+-- sweep and must survive the following cycles.
+local ffi = require('ffi')
+for j = 1, N do
+  local _ = 'garbage' .. j
+end
+for j = 1, 100 do
+  ffi.cdef(('struct gc_bgsweep_%d { int field_%d; };'):format(j, j))
+  collectgarbage('step', 0)
+end
+collectgarbage()
+collectgarbage()
+test:ok(ffi.new('struct gc_bgsweep_42').field_42 == 0,
+        'fixed strings survive the sweep')
+
+collectgarbage('bgsweep', 0)
+
+test:done(true)
@@ -0,0 +1,89 @@
+local tap = require('tap')
+local ffi = require('ffi')
+
+-- Test file to check the time budget of finalizers and the batch
+-- finalizers of cdata objects.
+local test = tap.test('gc-finalizer-budget')
+
+test:plan(8)
+
+test:is(collectgarbage('finbudget', 100), 0,
+        'finbudget is disabled by default')
+test:is(collectgarbage('finbudget', 100), 100, 'finbudget is set')
+
+collectgarbage()
+local finalized = misc.getmetrics().gc_finalized
+
+-- Batch finalizers get several cdata objects at once.
+local N = 1e3
+local ncalls, nbatch, maxbatch = 0, 0, 0
+local function fin_batch(...)
+  local n = select('#', ...)
+  ncalls = ncalls + 1
+  nbatch = nbatch + n
+  if n > maxbatch then maxbatch = n end
+  for i = 1, n do
+    assert(ffi.istype('int *', (select(i, ...))))
+  end
+end
+-- Plain finalizers are interleaved with the batch ones.
+local nplain = 0
+local function fin_plain(cd)
+  assert(ffi.istype('int *', cd))
+  nplain = nplain + 1
+end
+for i = 1, N do
+  ffi.gc(ffi.new('int *'), i % 10 == 0 and fin_plain or fin_batch, i % 10 ~= 0)
+end
+
+-- Finalize the objects in the incremental steps.
+repeat until collectgarbage('step', 0)
+repeat until collectgarbage('step', 0)
+
+test:is(nbatch, N * 9 / 10, 'all objects with a batch finalizer are finalized')
+test:ok(maxbatch > 1 and ncalls < nbatch, 'finalizers are batched')
+test:is(nplain, N / 10, 'all objects with a plain finalizer are finalized')
+
+local metrics = misc.getmetrics()
+test:is(metrics.gc_finq_len, 0, 'finalization queue is empty')
+test:ok(metrics.gc_finalized - finalized >= N, 'finalized objects are counted')
+
+-- One step runs the finalizers until the time budget is spent,
+-- but the finalizers are charged against the work limit of the
+-- step as well: GCFINALIZECOST (100) units each. With the step
+-- multiplier 100 the limit of a step is 1000 units, so no more
+-- than 10 plain finalizers are run per step, like without the
+-- time budget.
+collectgarbage('finbudget', 1e6)
+local stepmul = collectgarbage('setstepmul', 100)
+collectgarbage()
+local nfin, perstep, maxperstep = 0, 0, 0
+local function fin_count()
+  nfin = nfin + 1
+  perstep = perstep + 1
+end
+-- Run it in the interpreter: the trace exits drive the GC in the
+-- finalize state too, and the traces may reuse the same immutable
+-- cdata object instead of creating new ones.
+local function run_steps()
+  for _ = 1, 100 do
+    ffi.gc(ffi.new('int *'), fin_count)
+  end
+  for _ = 1, 2 do
+    local finished
+    repeat
+      perstep = 0
+      finished = collectgarbage('step', 0)
+      if perstep > maxperstep then maxperstep = perstep end
+    until finished
+  end
+end
+jit.off(run_steps)
+run_steps()
+test:ok(nfin == 100 and maxperstep == 10,
+        'finalizers are limited by the work of the step')
+
+collectgarbage('setstepmul', stepmul)
+collectgarbage('finbudget', 0)
+
+test:done(true)
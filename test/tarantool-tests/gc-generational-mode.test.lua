@@ -0,0 +1,76 @@
+local tap = require('tap')
+
+-- Test file to check the generational mode of the collector.
+local test = tap.test('gc-generational-mode')
+
+test:plan(8)
+
+local ffi = require('ffi')
+
+-- Switching the mode returns the previous one.
+test:is(collectgarbage('generational'), 'incremental',
+        'default mode is incremental')
+test:is(collectgarbage('generational'), 'generational',
+        'mode is switched to generational')
+
+-- Build the old generation and let it survive a full cycle.
+local old = {}
+for i = 1, 1000 do
+  old[i] = {tostring(i), ffi.new('int[?]', i % 8 + 1)}
+end
+collectgarbage()
+
+-- Young objects referenced only from the old ones must survive
+-- the minor cycles (i.e. the barriers must work for old objects).
+local weak = setmetatable({}, {__mode = 'v'})
+for i = 1, 1000 do
+  old[i][3] = {i}
+  weak[i] = {i}
+end
+local sink
+for i = 1, 1e5 do sink = {i} end -- luacheck: no unused
+for _ = 1, 10 do collectgarbage('step') end
+
+local young_ok = true
+for i = 1, 1000 do
+  local t = old[i]
+  if t[1] ~= tostring(i) or t[3][1] ~= i or ffi.sizeof(t[2]) ~= 4 * (i % 8 + 1)
+  then
+    young_ok = false
+    break
+  end
+end
+test:ok(young_ok, 'old and young objects are alive')
+
+-- Objects referenced only by the old weak table are collected.
+collectgarbage()
+test:is(next(weak), nil, 'weak values are cleared')
+
+-- Dead strings are collected by the full cycle.
+local function new_strings()
+  for i = 1, 1e4 do sink = 'young string ' .. i end
+  collectgarbage()
+end
+-- Grow the string hash table first.
+new_strings()
+local count = collectgarbage('count')
+new_strings()
+test:ok(collectgarbage('count') <= count, 'young strings are freed')
+
+-- The dead old generation is collected by the full cycle.
+old = nil
+collectgarbage()
+test:ok(collectgarbage('count') < count / 2, 'old generation is freed')
+
+-- Finalizers are called for young userdata.
+local finalized = false
+local u = newproxy(true)
+getmetatable(u).__gc = function() finalized = true end
+u = nil -- luacheck: no unused
+collectgarbage()
+test:ok(finalized, 'finalizer is called')
+
+test:is(collectgarbage('incremental'), 'generational',
+        'mode is switched back to incremental')
+
+test:done(true)
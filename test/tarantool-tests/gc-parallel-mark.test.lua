@@ -0,0 +1,79 @@
+local tap = require('tap')
+
+-- Test file to check the parallel marking of gray objects.
+local test = tap.test('gc-parallel-mark')
+
+test:plan(5)
+
+test:is(collectgarbage('markers', 4), 1, 'parallel marking is disabled')
+local markers = collectgarbage('markers', 4)
+if markers == 1 then
+  test:skip('no marker threads on this platform')
+  test:skip('no marker threads on this platform')
+  test:skip('no marker threads on this platform')
+  test:skip('no marker threads on this platform')
+  test:done(true)
+  return
+end
+test:is(markers, 4, 'marker threads are started')
+
+-- The heap is shared by the markers: objects are reachable from
+-- several places, so the markers race for them.
+local N = 2e4
+local shared = {}
+for i = 1, N do
+  shared[i] = {i}
+end
+local objs = {}
+local weak = setmetatable({}, {__mode = 'k'})
+local mt = {__index = function(_, k) return k end}
+for i = 1, N do
+  local s = shared[i % 100 + 1]
+  local co = coroutine.wrap(function(v)
+    while true do v = coroutine.yield(s[1] + v) end
+  end)
+  co(0)
+  objs[i] = {
+    tab = setmetatable({s, shared[i], tostring(i)}, mt),
+    fn = function() return s, i end,
+    co = co,
+    ud = newproxy(true),
+  }
+  weak[objs[i].tab] = true
+end
+
+-- Mutate the heap between the incremental steps.
+local cycles = 0
+local i = 0
+while cycles < 3 do
+  i = i + 1
+  local k = i % N + 1
+  objs[k].tab[4] = {k}
+  objs[k].fn = function() return shared[k % 100 + 1], k end
+  if collectgarbage('step', 0) then cycles = cycles + 1 end
+end
+
+local broken = 0
+for k = 1, N do
+  local o = objs[k]
+  local s = o.fn()
+  if o.tab[2][1] ~= k or o.tab[3] ~= tostring(k) or o.tab.key ~= 'key' or
+     s[1] ~= k % 100 + 1 or o.co(1) ~= o.tab[1][1] + 1 or
+     type(o.ud) ~= 'userdata' then
+    broken = broken + 1
+  end
+end
+test:is(broken, 0, 'reachable objects are alive')
+
+for k = N / 2 + 1, N do
+  objs[k] = nil
+end
+collectgarbage()
+collectgarbage()
+local alive = 0
+for _ in pairs(weak) do alive = alive + 1 end
+test:is(alive, N / 2, 'unreachable objects are collected')
+
+test:is(collectgarbage('markers', 1), 4, 'parallel marking is disabled again')
+
+test:done(true)
@@ -0,0 +1,57 @@
+local tap = require('tap')
+
+-- Test file to check the incremental remark of the gray-again
+-- list.
+local test = tap.test('gc-remark')
+
+test:plan(3)
+
+-- Coroutines and tables are put on the gray-again list during
+-- the propagation. Both are changed between the remark steps,
+-- the new values must not be lost.
+local N = 1e3
+local cos, tabs = {}, {}
+local weak = setmetatable({}, {__mode = 'v'})
+for i = 1, N do
+  tabs[i] = {}
+  cos[i] = coroutine.wrap(function(v)
+    while true do
+      local new = {v}
+      weak[#weak + 1] = new
+      v = coroutine.yield(new)
+    end
+  end)
+  cos[i](i)
+end
+
+local remark = misc.getmetrics().gc_steps_remark
+local cycles = 0
+local i = 0
+while cycles < 4 do
+  i = i + 1
+  local k = i % N + 1
+  -- Keep the new value on the coroutine stack only.
+  cos[k](k)
+  -- Store the new value to a table, which may be black already.
+  local new = {k}
+  tabs[k][#tabs[k] % 4 + 1] = new
+  weak[#weak + 1] = new
+  if collectgarbage('step', 0) then cycles = cycles + 1 end
+end
+test:ok(misc.getmetrics().gc_steps_remark > remark, 'remark is incremental')
+
+-- Values on the stacks of the suspended coroutines and in the
+-- tables must be alive, so all the fields must be in place.
+local broken = 0
+for _, v in pairs(weak) do
+  if type(v[1]) ~= 'number' then broken = broken + 1 end
+end
+test:is(broken, 0, 'objects changed during the remark are alive')
+
+collectgarbage()
+local alive = 0
+for _ in pairs(weak) do alive = alive + 1 end
+-- One value per coroutine and up to four values per table.
+test:ok(alive <= 5 * N, 'unreachable objects are collected')
+
+test:done(true)
@@ -0,0 +1,54 @@
+local tap = require('tap')
+
+-- Test file to check the time-budgeted incremental GC steps.
+local test = tap.test('gc-step-budget')
+
+test:plan(5)
+
+test:is(collectgarbage('budget', 10), 0, 'budget is disabled by default')
+test:is(collectgarbage('budget', 10), 10, 'budget is set')
+
+-- Large tables are traversed in chunks within the budget. Objects
+-- stored in the already traversed slots, or moved by the resize
+-- of the table, must not be lost.
+local N = 1e5
+local big, weak = {}, setmetatable({}, {__mode = 'v'})
+for i = 1, N do
+  big[i] = {i}
+  big['k' .. i] = {i}
+end
+collectgarbage()
+
+local cycles = 0
+local i = 0
+while cycles < 4 do
+  -- Mutate the table between the steps.
+  i = i + 1
+  local k = i % N + 1
+  big[k] = {k}
+  weak[k] = big[k]
+  big['k' .. k] = {k}
+  weak['k' .. k] = big['k' .. k]
+  if i % 5000 == 0 then
+    -- Trigger resize of the array and the hash parts.
+    big[#big + 1] = {#big + 1}
+    big['new' .. i] = {i}
+  end
+  if collectgarbage('step', 0) then cycles = cycles + 1 end
+end
+
+local lost = 0
+for k, v in pairs(weak) do
+  if big[k] ~= v then lost = lost + 1 end
+end
+test:is(lost, 0, 'objects stored during chunked traversal are alive')
+
+local metrics = misc.getmetrics()
+test:ok(metrics.gc_steps_time > 0, 'steps time is reported')
+test:ok(metrics.gc_steps_time_max > 0 and
+        metrics.gc_steps_time_max <= metrics.gc_steps_time,
+        'max step time is reported')
+
+collectgarbage('budget', 0)
+
+test:done(true)
@@ -0,0 +1,77 @@
+local tap = require('tap')
+
+-- Test file to check the incremental resizing of the string hash
+-- table.
+local test = tap.test('gc-strtab-resize')
+
+test:plan(5)
+
+-- Intern the strings with the given prefix and use them as the
+-- keys, so a string, which is not found in the string table
+-- while it's resized, is interned twice and misses the key.
+local function fill(t, prefix, n, step)
+  for i = 1, n do
+    t[prefix .. i] = i
+    if i % step == 0 then collectgarbage('step', 0) end
+  end
+end
+
+local function check(t, prefix, n)
+  for i = 1, n do
+    if t[prefix .. i] ~= i then return false end
+  end
+  return true
+end
+
+local N = 2e5
+
+local t = {}
+fill(t, 'inc', N, 1000)
+test:ok(check(t, 'inc', N), 'strings are found during the resize')
+
+-- The young strings are kept in front of the old ones in the
+-- moved chains, so the minor sweeps free them.
+collectgarbage('generational')
+fill(t, 'gen', N, 777)
+local strnum = misc.getmetrics().gc_strnum
+for i = 1, N do
+  local _ = 'garbage' .. i
+  if i % 777 == 0 then collectgarbage('step', 0) end
+end
+for _ = 1, 20 do collectgarbage('step', 0) end
+test:ok(check(t, 'gen', N) and check(t, 'inc', N) and
+        misc.getmetrics().gc_strnum < strnum + N / 2,
+        'generational mode')
+collectgarbage('incremental')
+
+-- The strings with the colliding "fast" hash sums are interned
+-- with the "full" hash sum.
+local function collide(i)
+  return ('x'):rep(4) .. ('%08d'):format(i) .. ('y'):rep(48)
+end
+local c = {}
+for i = 1, 2000 do
+  c[collide(i)] = i
+  if i % 100 == 0 then collectgarbage('step', 0) end
+end
+local ok = true
+for i = 1, 2000 do
+  if c[collide(i)] ~= i then ok = false end
+end
+test:ok(ok, 'colliding strings are found during the resize')
+
+-- The string sweep on the helper thread walks both tables.
+local bgsweep = collectgarbage('bgsweep', 1)
+fill(t, 'bg', N, 500)
+test:ok(check(t, 'bg', N), 'strings are found with the helper thread')
+collectgarbage('bgsweep', bgsweep)
+
+-- Shrink the table.
+t, c = nil, nil
+collectgarbage()
+collectgarbage()
+t = {}
+fill(t, 'shrink', 1000, 100)
+test:ok(check(t, 'shrink', 1000), 'strings are found after the shrink')
+
+test:done(true)
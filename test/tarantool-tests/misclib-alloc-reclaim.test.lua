@@ -0,0 +1,58 @@
+local tap = require('tap')
+
+-- Test file to check the reclaim thread of the bundled allocator.
+local test = tap.test('misclib-alloc-reclaim'):skipcond({
+  ['Reclaim thread is not supported'] = misc.alloc_reclaim(false) == nil,
+})
+
+test:plan(8)
+
+test:ok(not pcall(misc.alloc_reclaim), 'argument is required')
+test:is(misc.alloc_reclaim(true), false, 'previous state is returned')
+test:is(misc.alloc_reclaim(true), true, 'reclaim thread is enabled')
+
+-- The strings are large enough to be mapped directly.
+local N = 16
+local function burst(size)
+  local t = {}
+  for i = 1, N do
+    t[i] = ('x'):rep(size) .. ('%4d'):format(i)
+  end
+  for i = 1, N do
+    local s = t[i]
+    if #s ~= size + 4 or tonumber(s:sub(-4)) ~= i or
+       s:sub(1, 1) ~= 'x' then
+      return false
+    end
+  end
+  t = nil -- luacheck: no unused
+  collectgarbage()
+  return true
+end
+
+local old = misc.getmetrics()
+local ok = burst(2^22)
+test:ok(ok, 'contents are kept with the reclaim thread')
+
+-- Disabling waits until the queue is drained.
+misc.alloc_reclaim(false)
+local new = misc.getmetrics()
+test:ok(new.alloc_reclaimed - old.alloc_reclaimed >= N,
+        'large chunks are unmapped by the reclaim thread')
+test:ok(new.alloc_reclaimq_len == 0 and new.alloc_reclaimq_size == 0,
+        'queue is drained')
+test:ok(new.alloc_reclaimq_latency_max > 0 and
+        new.alloc_reclaimq_latency >= new.alloc_reclaimq_latency_max,
+        'latency is reported')
+
+-- The smaller direct chunks are unmapped at once.
+misc.alloc_reclaim(true)
+old = misc.getmetrics()
+burst(2^18)
+new = misc.getmetrics()
+misc.alloc_reclaim(false)
+test:ok(new.alloc_munmap - old.alloc_munmap >= N and
+        new.alloc_reclaimed == old.alloc_reclaimed,
+        'small chunks are unmapped at once')
+
+test:done(true)
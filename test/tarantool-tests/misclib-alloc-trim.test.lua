@@ -0,0 +1,76 @@
+local tap = require('tap')
+local table_new = require('table.new')
+
+-- Test file to check the lazy trimming of the bundled allocator.
+local test = tap.test('misclib-alloc-trim'):skipcond({
+  ['Lazy trimming is not supported'] = misc.alloc_decay(0) == nil,
+})
+
+test:plan(10)
+
+-- Allocate and free the array parts of the tables, which are too
+-- large for the slabs, but small enough to be served from the
+-- segments. 16 Mb of them are much more than DEFAULT_TRIM_THRESHOLD,
+-- so the top of the segments or the whole segments are freed
+-- regardless of the memory layout. The tables aren't interned
+-- like strings, so nothing else survives the burst. Returns the
+-- mapped memory at the peak.
+local function burst()
+  local t = table_new(16e3, 0)
+  for i = 1, 16e3 do
+    t[i] = table_new(120, 0)
+  end
+  local peak = misc.getmetrics().alloc_mapped
+  t = nil -- luacheck: no unused
+  collectgarbage()
+  collectgarbage()
+  return peak
+end
+
+test:ok(not pcall(misc.alloc_decay), 'decay is required')
+test:ok(misc.alloc_decay(math.huge) and misc.alloc_decay(0),
+        'huge decay is clamped')
+
+local peak = burst()
+test:ok(misc.getmetrics().alloc_mapped < peak - 8 * 1024 * 1024,
+        'eager trimming unmaps memory')
+
+-- The decay time is too long to expire during the test.
+test:ok(misc.alloc_decay(3600 * 1e6), 'lazy trimming is set')
+burst()
+local old = misc.getmetrics()
+burst()
+burst()
+local new = misc.getmetrics()
+test:is(new.alloc_munmap, old.alloc_munmap, 'lazy trimming keeps mappings')
+test:is(new.alloc_mmap, old.alloc_mmap, 'mappings are reused')
+
+local released = misc.alloc_trim()
+new = misc.getmetrics()
+test:ok(released > 0 and new.alloc_mapped < old.alloc_mapped,
+        'explicit trimming returns memory')
+test:is(misc.alloc_trim(), 0, 'released memory is not released again')
+
+-- Release the free memory on each trimming check.
+misc.alloc_decay(1)
+burst()
+old = misc.getmetrics()
+burst()
+new = misc.getmetrics()
+test:ok(new.alloc_released > old.alloc_released, 'pages are released')
+
+-- The pages freed last are released by the idle GC after the
+-- decay time, even if nothing is freed after them.
+misc.alloc_decay(3600 * 1e6)
+burst()
+misc.alloc_decay(1e4)
+local t0 = os.clock()
+while os.clock() - t0 < 0.02 do end
+old = misc.getmetrics()
+misc.gc_idle(0)
+new = misc.getmetrics()
+test:ok(new.alloc_released > old.alloc_released, 'idle GC releases pages')
+
+misc.alloc_decay(0)
+
+test:done(true)
@@ -0,0 +1,57 @@
+local tap = require('tap')
+
+-- Test file to check the idle-time GC API.
+local test = tap.test('misclib-gc-idle')
+
+test:plan(6)
+
+local function gc_steps()
+  local m = misc.getmetrics()
+  return m.gc_steps_pause + m.gc_steps_propagate + m.gc_steps_atomic +
+         m.gc_steps_sweepstring + m.gc_steps_sweep + m.gc_steps_finalize
+end
+
+local sink = {}
+local function make_garbage()
+  for i = 1, 1e5 do sink[1] = {i} end
+end
+
+test:ok(not pcall(misc.gc_idle), 'timeout is required')
+
+-- Nothing is done while the GC is stopped.
+collectgarbage()
+collectgarbage('stop')
+make_garbage()
+local steps = gc_steps()
+test:ok(not misc.gc_idle(1e6) and gc_steps() == steps,
+        'no steps while GC is stopped')
+collectgarbage('restart')
+
+-- The GC cycle is finished while idle.
+local finished = false
+for _ = 1, 100 do
+  finished = misc.gc_idle(1e6)
+  if finished then break end
+end
+test:ok(finished, 'GC cycle is finished')
+
+-- A new GC cycle is not started right after the previous one.
+steps = gc_steps()
+test:ok(not misc.gc_idle(1e6) and gc_steps() == steps,
+        'no new cycle is started too early')
+
+-- A new GC cycle is started when there is enough garbage.
+collectgarbage('stop')
+make_garbage()
+collectgarbage('restart')
+steps = gc_steps()
+misc.gc_idle(0)
+test:ok(gc_steps() > steps, 'new cycle is started')
+
+-- The huge timeouts are clamped.
+collectgarbage('stop')
+make_garbage()
+collectgarbage('restart')
+test:ok(misc.gc_idle(math.huge), 'infinite timeout')
+
+test:done(true)
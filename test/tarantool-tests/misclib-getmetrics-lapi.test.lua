@@ -8,7 +8,7 @@ local test = tap.test("lib-misc-getmetrics"):skipcond({
   ['Disabled on *BSD due to #4819'] = jit.os == 'BSD',
 })
 
-test:plan(10)
+test:plan(12)
 
 local MAXNINS = require('utils').jit.const.maxnins
 local jit_opt_default = {
@@ -20,7 +20,7 @@ local jit_opt_default = {
 
 -- Test Lua API.
 test:test("base", function(subtest)
-    subtest:plan(19)
+    subtest:plan(61)
     local metrics = misc.getmetrics()
     subtest:ok(metrics.strhash_hit >= 0)
     subtest:ok(metrics.strhash_miss >= 0)
@@ -45,6 +45,51 @@ test:test("base", function(subtest)
     subtest:ok(metrics.jit_trace_abort >= 0)
     subtest:ok(metrics.jit_mcode_size >= 0)
     subtest:ok(metrics.jit_trace_num >= 0)
+
+    subtest:ok(metrics.gc_steps_time >= 0)
+    subtest:ok(metrics.gc_steps_time_max >= 0)
+    subtest:ok(metrics.gc_steps_remark >= 0)
+
+    subtest:ok(metrics.gc_finq_len >= 0)
+    subtest:ok(metrics.gc_finalized >= 0)
+    subtest:ok(metrics.gc_finq_latency >= 0)
+    subtest:ok(metrics.gc_finq_latency_max >= 0)
+
+    subtest:ok(metrics.gc_time_pause >= 0)
+    subtest:ok(metrics.gc_time_propagate >= 0)
+    subtest:ok(metrics.gc_time_remark >= 0)
+    subtest:ok(metrics.gc_time_atomic >= 0)
+    subtest:ok(metrics.gc_time_sweepstring >= 0)
+    subtest:ok(metrics.gc_time_sweep >= 0)
+    subtest:ok(metrics.gc_time_finalize >= 0)
+    subtest:is(#metrics.gc_pause_hist, 20)
+    subtest:ok(metrics.gc_pause_hist[1] >= 0)
+    subtest:ok(metrics.gc_cycles >= 0)
+    subtest:ok(metrics.gc_marked >= 0)
+    subtest:ok(metrics.gc_swept >= 0)
+    subtest:ok(metrics.alloc_mapped >= 0)
+    subtest:ok(metrics.alloc_mmap >= 0)
+    subtest:ok(metrics.alloc_munmap >= 0)
+    subtest:ok(metrics.alloc_mremap >= 0)
+    subtest:ok(metrics.alloc_madvise >= 0)
+    subtest:ok(metrics.alloc_released >= 0)
+    subtest:ok(metrics.alloc_segments >= 0)
+    subtest:ok(metrics.alloc_segments_size >= 0)
+    subtest:ok(metrics.alloc_free >= 0)
+    subtest:ok(metrics.alloc_direct >= 0)
+    subtest:ok(metrics.alloc_direct_size >= 0)
+    subtest:ok(metrics.alloc_slabs_size >= 0)
+    subtest:ok(metrics.alloc_slabs_used >= 0)
+    subtest:is(#metrics.alloc_size_hist, 32)
+    subtest:ok(metrics.alloc_size_hist[1] >= 0)
+    subtest:ok(metrics.gc_emergency >= 0)
+    subtest:ok(metrics.alloc_reclaimq_len >= 0)
+    subtest:ok(metrics.alloc_reclaimq_size >= 0)
+    subtest:ok(metrics.alloc_reclaimed >= 0)
+    subtest:ok(metrics.alloc_reclaimq_latency >= 0)
+    subtest:ok(metrics.alloc_reclaimq_latency_max >= 0)
+    subtest:ok(metrics.strhash_nointern >= 0)
+    subtest:ok(metrics.alloc_hugepages_size >= 0)
 end)
 
 test:test("gc-allocated-freed", function(subtest)
@@ -225,12 +270,14 @@ test:test("objcount", function(subtest)
     -- Check that amount of objects not increased.
     subtest:is(new_metrics.gc_strnum, old_metrics.gc_strnum,
                "strnum don't change")
-    -- When we call getmetrics, we create table for metrics first.
-    -- So, when we save old_metrics there are x + 1 tables,
-    -- when we save new_metrics there are x + 2 tables, because
-    -- old table hasn't been collected yet (it is still
+    -- When we call getmetrics, we create table for metrics and
+    -- the nested tables for the GC pause and the allocation size
+    -- histograms first.
+    -- So, when we save old_metrics there are x + 3 tables,
+    -- when we save new_metrics there are x + 6 tables, because
+    -- old tables haven't been collected yet (they are still
     -- reachable).
-    subtest:is(new_metrics.gc_tabnum - old_metrics.gc_tabnum, 1,
+    subtest:is(new_metrics.gc_tabnum - old_metrics.gc_tabnum, 3,
                "tabnum don't change")
     subtest:is(new_metrics.gc_udatanum, old_metrics.gc_udatanum,
                "udatanum don't change")
@@ -383,26 +430,26 @@ test:test("strhash", function(subtest)
 
     local new_metrics = misc.getmetrics()
     -- Do not use test:ok to avoid extra strhash hits/misses.
-    assert(new_metrics.strhash_hit - old_metrics.strhash_hit == 19)
+    assert(new_metrics.strhash_hit - old_metrics.strhash_hit == 59)
     assert(new_metrics.strhash_miss - old_metrics.strhash_miss == 0)
     old_metrics = new_metrics
 
     local _ = "strhash".."_hit"
 
     new_metrics = misc.getmetrics()
-    assert(new_metrics.strhash_hit - old_metrics.strhash_hit == 20)
+    assert(new_metrics.strhash_hit - old_metrics.strhash_hit == 60)
     assert(new_metrics.strhash_miss - old_metrics.strhash_miss == 0)
     old_metrics = new_metrics
 
     new_metrics = misc.getmetrics()
-    assert(new_metrics.strhash_hit - old_metrics.strhash_hit == 19)
+    assert(new_metrics.strhash_hit - old_metrics.strhash_hit == 59)
     assert(new_metrics.strhash_miss - old_metrics.strhash_miss == 0)
     old_metrics = new_metrics
 
     local _ = "new".."string"
 
     new_metrics = misc.getmetrics()
-    assert(new_metrics.strhash_hit - old_metrics.strhash_hit == 19)
+    assert(new_metrics.strhash_hit - old_metrics.strhash_hit == 59)
     assert(new_metrics.strhash_miss - old_metrics.strhash_miss == 1)
     subtest:ok(true, "no assertion failed")
 end)
@@ -430,4 +477,105 @@ test:test("tracenum-base", function(subtest)
     subtest:is(metrics.jit_trace_num, 0)
 end)
 
+test:test("gc-phase-timing", function(subtest)
+    subtest:plan(7)
+
+    local function nsteps(metrics)
+        local n = 0
+        for _, count in ipairs(metrics.gc_pause_hist) do
+            n = n + count
+        end
+        return n
+    end
+
+    collectgarbage("collect")
+    local old_metrics = misc.getmetrics()
+    -- Finish a GC cycle with the incremental steps.
+    local garbage = {}
+    for i = 1, 1000 do garbage[i] = {} end
+    garbage = nil
+    repeat until collectgarbage("step")
+    local new_metrics = misc.getmetrics()
+
+    local time = 0
+    for _, state in ipairs({"pause", "propagate", "remark", "atomic",
+                            "sweepstring", "sweep", "finalize"}) do
+        time = time + new_metrics["gc_time_"..state] -
+                      old_metrics["gc_time_"..state]
+    end
+    subtest:is(time, new_metrics.gc_steps_time - old_metrics.gc_steps_time,
+               "time of the states sums up to the time of the steps")
+    subtest:ok(nsteps(new_metrics) > nsteps(old_metrics),
+               "steps are counted in the histogram")
+    subtest:is(new_metrics.gc_cycles - old_metrics.gc_cycles, 1,
+               "GC cycle is counted")
+    subtest:ok(new_metrics.gc_swept - old_metrics.gc_swept >= 1000 * 32,
+               "garbage is swept")
+    subtest:ok(new_metrics.gc_marked - old_metrics.gc_marked > 0,
+               "survivors are accounted")
+
+    -- The full GC cycle is accounted as a single step.
+    old_metrics = misc.getmetrics()
+    collectgarbage("collect")
+    new_metrics = misc.getmetrics()
+    time = 0
+    for _, state in ipairs({"pause", "propagate", "remark", "atomic",
+                            "sweepstring", "sweep", "finalize"}) do
+        time = time + new_metrics["gc_time_"..state] -
+                      old_metrics["gc_time_"..state]
+    end
+    subtest:ok(nsteps(new_metrics) == nsteps(old_metrics) + 1 and
+               time == new_metrics.gc_steps_time - old_metrics.gc_steps_time,
+               "full GC is accounted")
+
+    -- The idle steps are accounted too. Start the next GC cycle
+    -- at once, so it's never too early for the idle steps.
+    local pause = collectgarbage("setpause", 100)
+    collectgarbage("collect")
+    old_metrics = misc.getmetrics()
+    misc.gc_idle(1e3)
+    new_metrics = misc.getmetrics()
+    collectgarbage("setpause", pause)
+    subtest:ok(nsteps(new_metrics) > nsteps(old_metrics) and
+               new_metrics.gc_steps_time > old_metrics.gc_steps_time,
+               "idle steps are accounted")
+end)
+
+test:test("allocator", function(subtest)
+    local metrics = misc.getmetrics()
+    if metrics.alloc_mapped == 0 then
+        subtest:skip_all("Custom allocator is used")
+    end
+    subtest:plan(6)
+
+    subtest:ok(metrics.alloc_segments > 0 and
+               metrics.alloc_free <= metrics.alloc_segments_size,
+               "free memory is in the segments")
+
+    local old_metrics = misc.getmetrics()
+    local big = ("x"):rep(2^20)
+    local new_metrics = misc.getmetrics()
+    -- The string buffer may be mapped directly as well.
+    subtest:ok(new_metrics.alloc_direct - old_metrics.alloc_direct >= 1,
+               "large chunk is mapped directly")
+    subtest:ok(new_metrics.alloc_direct_size -
+               old_metrics.alloc_direct_size > #big,
+               "direct chunk size is accounted")
+    -- The string object with the 1 MB payload is in [2^20, 2^21).
+    subtest:ok(new_metrics.alloc_size_hist[21] >
+               old_metrics.alloc_size_hist[21],
+               "allocation is counted in the histogram")
+    big = nil -- luacheck: no unused
+    collectgarbage("collect")
+    subtest:ok(misc.getmetrics().alloc_direct < new_metrics.alloc_direct,
+               "direct chunk is unmapped")
+
+    old_metrics = misc.getmetrics()
+    local small = {}
+    for i = 1, 1000 do small[i] = {} end
+    new_metrics = misc.getmetrics()
+    subtest:ok(new_metrics.alloc_slabs_used - old_metrics.alloc_slabs_used >=
+               1000 * 32, "small objects are in the slabs")
+end)
+
 test:done(true)
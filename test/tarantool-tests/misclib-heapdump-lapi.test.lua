@@ -0,0 +1,112 @@
+local tap = require('tap')
+local test = tap.test('misclib-heapdump-lapi'):skipcond({
+  ['Disabled on *BSD due to #4819'] = jit.os == 'BSD',
+  ['Heap dump is implemented for x86_64 only'] = jit.arch ~= 'x86' and
+                                                 jit.arch ~= 'x64',
+})
+
+test:plan(10)
+
+local bufread = require('utils.bufread')
+local symtab = require('utils.symtab')
+local heapdump = require('heapdump.parse')
+local process = require('heapdump.process')
+local profilename = require('utils').tools.profilename
+
+local TMP_BINFILE = profilename('heapdumpdata.tmp.bin')
+local BAD_PATH = profilename('heapdumpdata/tmp.bin')
+
+local function addr(obj)
+  return tonumber(tostring(obj):match('0x%x+'))
+end
+
+-- The payload: the holder retains all the items, while the items
+-- are also referenced from a weak table.
+local N = 100
+local holder = {}
+local weak = setmetatable({}, {__mode = 'v'})
+for i = 1, N do
+  holder[i] = {('heapdump-payload-%d'):format(i)}
+  weak[i] = holder[i]
+end
+local function getholder() return holder end
+
+-- The duplicate of a large template shares its slots with the
+-- template, so it refers to the template instead of the slots.
+local function cowtemplate()
+  return {'cow-1', 'cow-2', 'cow-3', 'cow-4', 'cow-5', 'cow-6', 'cow-7',
+          'cow-8', 'cow-9', 'cow-10', 'cow-11', 'cow-12', 'cow-13', 'cow-14',
+          'cow-15', 'cow-16', 'cow-17', 'cow-18', 'cow-19', 'cow-20'}
+end
+jit.off(cowtemplate)
+local cow = cowtemplate()
+
+local res, err, errno = misc.heapdump(BAD_PATH)
+test:ok(res == nil and err:match('No such file or directory') and
+        type(errno) == 'number', 'bad path')
+
+res, err = misc.heapdump(TMP_BINFILE)
+test:ok(res == true, 'heap is dumped')
+assert(res, err)
+
+local reader = bufread.new(TMP_BINFILE)
+local symbols = symtab.parse(reader)
+local heap = heapdump.parse(reader)
+os.remove(TMP_BINFILE)
+local idom, retained = process.dominators(heap)
+
+local iholder = heap.index[addr(holder)]
+local ifunc = heap.index[addr(getholder)]
+test:ok(iholder and heap.size[iholder] > 0, 'table is dumped')
+local info = debug.getinfo(getholder, 'S')
+test:is(ifunc and symtab.demangle(symbols, symtab.loc({
+  addr = heap.aux[ifunc],
+  line = symbols.lfunc[heap.aux[ifunc]].linedefined,
+})), ('%s:%d'):format(info.source, info.linedefined),
+        'function location is resolved')
+
+local nitems, nstrings = 0, 0
+local size = 0
+for i = 1, N do
+  local item = heap.index[addr(holder[i])]
+  if item and idom[item] == iholder then
+    nitems = nitems + 1
+    size = size + heap.size[item]
+  end
+end
+for i = 1, heap.n do
+  local s = heap.str[i]
+  if s and s:match('^heapdump%-payload%-%d+$') then
+    nstrings = nstrings + 1
+    size = size + heap.size[i]
+  end
+end
+test:is(nitems, N, 'items are dominated by the holder despite weak refs')
+test:is(nstrings, N, 'strings are dumped')
+test:ok(retained[iholder] >= size + heap.size[iholder],
+        'holder retains the items')
+
+-- The template is the only reference of the duplicate, and it
+-- refers to the strings.
+local icow = heap.index[addr(cow)]
+local icowrefs = icow and heap.refstart[icow + 1] - heap.refstart[icow]
+local itemplate = icow and heap.index[heap.refs[heap.refstart[icow]]]
+local ncowstrings = 0
+if itemplate then
+  for r = heap.refstart[itemplate], heap.refstart[itemplate + 1] - 1 do
+    local s = heap.str[heap.index[heap.refs[r]]]
+    if s and s:match('^cow%-%d+$') then ncowstrings = ncowstrings + 1 end
+  end
+end
+test:ok(icowrefs == 1 and itemplate ~= icow and ncowstrings == 20,
+        'copy-on-write table refers to its template')
+
+local unreachable = 0
+for i = 1, heap.n do
+  if not idom[i] then unreachable = unreachable + 1 end
+end
+test:is(unreachable, 0, 'all objects are reachable from the roots')
+
+test:ok(not pcall(misc.heapdump), 'no path')
+
+test:done(true)
@@ -0,0 +1,64 @@
+local tap = require('tap')
+
+-- Test file to check the huge page modes of the bundled allocator.
+local test = tap.test('misclib-hugepages'):skipcond({
+  ['Huge pages are supported on Linux only'] = jit.os ~= 'Linux',
+  ['Huge pages are not supported by the allocator'] =
+    misc.hugepages('off') == nil,
+})
+
+test:plan(11)
+
+test:ok(not pcall(misc.hugepages, 'huge'), 'invalid mode')
+test:is(misc.hugepages(), 'off', 'mode is queried')
+
+test:is(misc.hugepages('thp'), 'off', 'previous mode is returned')
+test:is(misc.hugepages(), 'thp', 'query does not change the mode')
+test:is(misc.hugepages('thp'), 'thp', 'mode is set')
+
+-- Allocate enough memory to map new segments and slab spans in the
+-- given mode and check that nothing is overwritten.
+local function fill(mode)
+  misc.hugepages(mode)
+  local big, small = {}, {}
+  for i = 1, 3e5 do
+    small[i] = {i}
+  end
+  for i = 1, 8 do
+    big[i] = ('%d'):format(i):rep(2^20)
+  end
+  for i = 1, #small do
+    if small[i][1] ~= i then return false end
+  end
+  for i = 1, #big do
+    if big[i] ~= ('%d'):format(i):rep(2^20) then return false end
+  end
+  return true
+end
+
+local HUGEPAGE_SIZE = 2^21
+local old = misc.getmetrics()
+test:ok(fill('thp'), 'allocations with transparent huge pages')
+local new = misc.getmetrics()
+
+-- The kernel may be built without THP, then madvise() fails and
+-- the memory is mapped with the normal pages.
+local thp = io.open('/sys/kernel/mm/transparent_hugepage/enabled')
+if thp then
+  thp:close()
+  test:ok(new.alloc_hugepages_size > old.alloc_hugepages_size,
+          'memory is mapped with huge pages')
+  test:is(new.alloc_hugepages_size % HUGEPAGE_SIZE, 0,
+          'huge page mappings are whole huge pages')
+  test:ok(new.alloc_madvise > old.alloc_madvise, 'huge pages are advised')
+else
+  test:skip('transparent huge pages are not supported')
+  test:skip('transparent huge pages are not supported')
+  test:skip('transparent huge pages are not supported')
+end
+test:ok(fill('hugetlb'), 'allocations with hugetlbfs pages')
+collectgarbage()
+
+test:is(misc.hugepages('off'), 'hugetlb', 'mode is restored')
+
+test:done(true)
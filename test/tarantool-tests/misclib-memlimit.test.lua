@@ -0,0 +1,74 @@
+local tap = require('tap')
+
+-- Test file to check the soft and hard memory limits.
+local test = tap.test('misclib-memlimit')
+
+test:plan(11)
+
+test:ok(not pcall(misc.setmemlimit, 2^30, 2^29), 'soft limit exceeds hard')
+test:ok(not pcall(misc.setmemlimit, -1), 'negative limit')
+test:ok(not pcall(misc.setmemlimit, 0/0), 'NaN limit')
+test:ok(pcall(misc.setmemlimit, math.huge, math.huge) and
+        pcall(misc.setmemlimit), 'huge limits mean no limit')
+
+collectgarbage()
+local base = collectgarbage('count') * 1024
+
+-- The garbage reaching the hard limit is collected without errors.
+-- The long pause makes the garbage reach the limit.
+local pause = collectgarbage('setpause', 1e5)
+misc.setmemlimit(nil, base + 2^24)
+collectgarbage()
+local emergency = misc.getmetrics().gc_emergency
+local ok = pcall(function()
+  for i = 1, 2e3 do
+    local _ = {('x'):rep(2^14) .. i} -- luacheck: no unused
+  end
+end)
+collectgarbage('setpause', pause)
+test:ok(ok, 'garbage is collected under the hard limit')
+
+-- The live data above the hard limit raises an error.
+local t = {}
+local err
+ok, err = pcall(function()
+  for i = 1, 1e5 do
+    t[i] = ('x'):rep(2^14) .. i
+  end
+end)
+-- Release the data before the reporting, which allocates too.
+local nt = #t
+t = nil -- luacheck: no unused
+collectgarbage()
+test:ok(not ok and err == 'not enough memory', 'hard limit is reached')
+test:ok(misc.getmetrics().gc_emergency > emergency, 'emergency GC is run')
+test:ok(nt * 2^14 < 2^25, 'hard limit is not overshot much')
+
+-- The memory is available again after the data is released.
+test:ok(pcall(function() return ('y'):rep(2^20) end),
+        'memory is available after the release')
+
+-- The soft limit speeds up the GC.
+local function churn()
+  local old = misc.getmetrics().gc_cycles
+  local live = {}
+  for i = 1, 2e4 do
+    live[i % 500 + 1] = ('x'):rep(2^10) .. i
+  end
+  return misc.getmetrics().gc_cycles - old
+end
+
+misc.setmemlimit()
+local cycles = churn()
+misc.setmemlimit(base, 2^30, true)
+test:ok(churn() > cycles, 'soft limit speeds up the GC')
+
+misc.setmemlimit()
+test:ok(pcall(function()
+  local tt = {}
+  for i = 1, 3e3 do
+    tt[i] = ('z'):rep(2^14) .. i
+  end
+end), 'limits are reset')
+
+test:done(true)
@@ -0,0 +1,60 @@
+local tap = require('tap')
+
+-- Test file to check the semantics of the uninterned long strings:
+-- they must be indistinguishable from the interned ones.
+local test = tap.test('string-nointern'):skipcond({
+  ['Uninterned strings are not supported'] = misc.strnointern(0) == nil,
+})
+
+test:plan(11)
+
+test:ok(not pcall(misc.strnointern), 'threshold is required')
+test:is(misc.strnointern(16), 0, 'previous threshold is returned')
+test:is(misc.strnointern(16), 16, 'threshold is set')
+
+local old = misc.getmetrics()
+local a = ('x'):rep(20)
+local b = ('x'):rep(10) .. ('x'):rep(10)
+local new = misc.getmetrics()
+test:ok(new.strhash_nointern > old.strhash_nointern,
+        'long strings are not interned')
+
+test:ok(a == b and not (a ~= b) and rawequal(a, b), 'equality')
+test:ok(a == 'xxxxxxxxxxxxxxxxxxxx' and b ~= 'xxxxxxxxxxxxxxxxxxxy',
+        'equality with a constant')
+
+local t = {}
+t[a] = 1
+t[b] = t[b] + 1
+local n = 0
+for _ in pairs(t) do n = n + 1 end
+test:ok(n == 1 and t.xxxxxxxxxxxxxxxxxxxx == 2 and next(t, b) == nil,
+        'table keys')
+test:is(rawget(t, ('y'):rep(20)), nil, 'missing key')
+
+-- The same checks on traces.
+jit.opt.start('hotloop=1')
+local keys = {}
+for i = 1, 200 do keys[i] = ('k'):rep(20) .. (i % 4) end
+
+local counts = {}
+for i = 1, 200 do counts[keys[i]] = (counts[keys[i]] or 0) + 1 end
+local ok = true
+n = 0
+for _, v in pairs(counts) do
+  n = n + 1
+  ok = ok and v == 50
+end
+test:ok(ok and n == 4, 'table keys on trace')
+
+local hits1, hits2 = 0, 0
+local k1 = ('k'):rep(20) .. 1
+for i = 1, 200 do
+  if keys[i] == 'kkkkkkkkkkkkkkkkkkkk1' then hits1 = hits1 + 1 end
+  if keys[i] == k1 then hits2 = hits2 + 1 end
+end
+test:ok(hits1 == 50 and hits2 == 50, 'equality on trace')
+
+test:is(misc.strnointern(0), 16, 'threshold is reset')
+
+test:done(true)
@@ -0,0 +1,104 @@
+local tap = require('tap')
+
+-- Test file to check the vectorized string comparison and search
+-- against the byte-by-byte reference implementations.
+local test = tap.test('string-simd')
+
+test:plan(6)
+
+local byte, sub = string.byte, string.sub
+
+local function ref_cmp(a, b)
+  local n = math.min(#a, #b)
+  for i = 1, n do
+    local ca, cb = byte(a, i), byte(b, i)
+    if ca ~= cb then return ca < cb end
+  end
+  return #a < #b
+end
+
+local function ref_find(s, p, init)
+  for i = init, #s - #p + 1 do
+    if sub(s, i, i + #p - 1) == p then return i end
+  end
+  return nil
+end
+
+-- A string of the given length over the small alphabet to get many
+-- partial matches. The byte 0x80 checks the unsigned comparison.
+local seed = 1
+local function randstr(len, alphabet)
+  local t = {}
+  for i = 1, len do
+    seed = seed * 16807 % 2147483647
+    t[i] = alphabet[seed % #alphabet + 1]
+  end
+  return table.concat(t)
+end
+
+local alphabet = {'a', 'b', '\128', '\0'}
+local lens = {0, 1, 15, 16, 17, 31, 32, 33, 63, 64, 65, 100, 127, 128, 129,
+              1000, 4099}
+
+local ok_cmp, ok_eq = true, true
+for _, len in ipairs(lens) do
+  local a = randstr(len, alphabet)
+  for pos = 1, len, math.max(1, math.floor(len / 37)) do
+    -- Differ at the given position, the rest is equal.
+    for _, c in ipairs({'a', '\128', '\0'}) do
+      local b = sub(a, 1, pos - 1) .. c .. sub(a, pos + 1)
+      if (a < b) ~= ref_cmp(a, b) or (b < a) ~= ref_cmp(b, a) then
+        ok_cmp = false
+      end
+      -- The equal string is interned to the same object.
+      local b2 = sub(b, 1, pos) .. sub(b, pos + 1)
+      if b2 ~= b or (b2 == a) ~= (a == b) then ok_eq = false end
+    end
+  end
+  -- Prefixes.
+  local p = sub(a, 1, len - 1)
+  if (p < a) ~= ref_cmp(p, a) or (a < p) ~= ref_cmp(a, p) then
+    ok_cmp = false
+  end
+end
+test:ok(ok_cmp, 'ordered comparison')
+test:ok(ok_eq, 'interning of equal strings')
+
+local ok_find = true
+for _, len in ipairs(lens) do
+  local s = randstr(len, {'a', 'b'})
+  for plen = 1, 40, 3 do
+    local p = randstr(plen, {'a', 'b'})
+    for _, init in ipairs({1, 2, 17}) do
+      if s:find(p, init, true) ~= ref_find(s, p, init) then
+        ok_find = false
+      end
+    end
+  end
+  -- The match at the very end of the string.
+  local p = sub(s, -33)
+  if #p > 0 and s:find(p .. '', 1, true) ~= ref_find(s, p, 1) then
+    ok_find = false
+  end
+end
+test:ok(ok_find, 'plain substring search')
+
+local ok_pat = true
+local text = randstr(5000, {'x', 'y', 'z', ' ', '1', '2'})
+for _, pat in ipairs({'x1', 'z%d+', 'y[xz]', '1.2', 'x%s', ' %d-z',
+                      'q', 'xyz', '2$'}) do
+  -- Reference: no literal first character to scan for.
+  local s1, e1 = text:find(pat)
+  local s2, e2 = text:find('()' .. pat)
+  if s1 ~= s2 or e1 ~= e2 then ok_pat = false end
+  local n1, n2 = 0, 0
+  for _ in text:gmatch(pat) do n1 = n1 + 1 end
+  for _ in text:gmatch('()' .. pat) do n2 = n2 + 1 end
+  if n1 ~= n2 then ok_pat = false end
+end
+test:ok(ok_pat, 'pattern search with a literal first character')
+
+test:is(('abc'):find('c', 4), nil, 'no match past the end')
+test:ok(not pcall(string.match, 'abc', ')'), 'invalid pattern capture')
+
+test:done(true)
@@ -0,0 +1,83 @@
+local tap = require('tap')
+local count = require('utils').table.count
+
+-- Test file to check the tables with the small hash parts, which
+-- are colocated with the table object: the hash part is moved out
+-- on resize.
+local test = tap.test('table-colocated-hash')
+
+test:plan(7)
+
+-- The template tables with 2 to 8 string keys have their hash parts
+-- colocated.
+local function record(i)
+  return {id = i, name = 'n' .. i, x = 1, y = 2, z = 3}
+end
+
+local ok = true
+for i = 1, 100 do
+  local r = record(i)
+  if r.id ~= i or r.name ~= 'n' .. i or count(r) ~= 5 then ok = false end
+end
+test:ok(ok, 'template tables')
+
+-- Both the array and the hash parts are colocated.
+local function mixed(i)
+  return {i, i + 1, i + 2, a = i, b = -i}
+end
+ok = true
+for i = 1, 100 do
+  local r = mixed(i)
+  if r[3] ~= i + 2 or r.b ~= -i or count(r) ~= 5 then ok = false end
+end
+test:ok(ok, 'colocated array and hash parts')
+
+-- Grow the hash part out of the table object, then shrink it.
+local r = record(0)
+for i = 1, 100 do r['k' .. i] = i end
+ok = count(r) == 105
+for i = 1, 100 do r['k' .. i] = nil end
+collectgarbage()
+for i = 1, 10 do r[{}] = i end
+test:ok(ok and count(r) == 15 and r.name == 'n0', 'hash part is moved out')
+
+-- Grow the array part out of the table object, then the hash part.
+local m = mixed(1)
+for i = 4, 100 do m[i] = i end
+for i = 1, 20 do m['k' .. i] = i end
+test:ok(#m == 100 and m.a == 1 and count(m) == 122,
+        'array part is moved out')
+
+local c = record(1)
+require('table.clear')(c)
+ok = count(c) == 0
+c.x, c.y = 1, 2
+test:ok(ok and count(c) == 2, 'table.clear')
+
+-- The tables are freed by the GC in any state.
+local keep = {}
+for i = 1, 1e4 do
+  local t = i % 2 == 0 and record(i) or mixed(i)
+  if i % 3 == 0 then t.extra1, t.extra2, t.extra3, t.extra4 = 1, 2, 3, 4 end
+  if i % 5 == 0 then keep[#keep + 1] = t end
+end
+collectgarbage()
+collectgarbage()
+ok = true
+for _, t in ipairs(keep) do
+  if t[1] == nil and t.id == nil then ok = false end
+end
+test:ok(ok, 'GC of the tables')
+
+-- The same on traces.
+jit.opt.start('hotloop=1')
+local sum = 0
+for i = 1, 1000 do
+  local t = record(i)
+  t.w = i
+  local u = {a = i, b = 2}
+  sum = sum + t.id + t.w + u.a + u.b
+end
+test:is(sum, 2 * 500500 + 500500 + 2000, 'traces')
+
+test:done(true)
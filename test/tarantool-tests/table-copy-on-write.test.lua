@@ -0,0 +1,131 @@
+local tap = require('tap')
+local utils = require('utils')
+local count = utils.table.count
+
+-- Test file to check the copy-on-write tables: the duplicates of
+-- the large templates share their slots with the template until
+-- the first store.
+local test = tap.test('table-copy-on-write')
+
+test:plan(11)
+
+-- The templates with a single large part are shared. The
+-- constructors are called by the interpreter only, since the
+-- tables created on traces are always copied.
+local function array()
+  return {1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15, 16, 17, 18, 19, 20}
+end
+local function record()
+  return {a = 1, b = 2, c = 3, d = 4, e = 5, f = 6, g = 7, h = 8, i = 9, j = 10}
+end
+local function multres(...)
+  return {1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15, 16, 17, 18, ...}
+end
+jit.off(array)
+jit.off(record)
+jit.off(multres)
+
+local a1, a2 = array(), array()
+local ok = #a1 == 20 and a1[20] == 20 and count(a1) == 20
+a1[1] = 100
+a1[30] = 30
+test:ok(ok and a1[1] == 100 and a1[30] == 30 and a2[1] == 1 and
+        array()[1] == 1 and count(array()) == 20, 'array part')
+
+local r1, r2 = record(), record()
+ok = r1.j == 10 and count(r1) == 10
+r1.a = 100
+r1.z = 26
+test:ok(ok and r1.a == 100 and r1.z == 26 and r2.a == 1 and r2.z == nil and
+        record().a == 1 and count(record()) == 10, 'hash part')
+
+local m = multres(19, 20, 21)
+test:ok(#m == 21 and m[21] == 21 and #multres() == 18, 'multiple results')
+
+local t = array()
+table.insert(t, 1, 0)
+local u = record()
+rawset(u, 'b', -2)
+test:ok(t[1] == 0 and t[21] == 20 and u.b == -2 and array()[1] == 1 and
+        record().b == 2, 'table.insert and rawset')
+
+local c = record()
+require('table.clear')(c)
+ok = next(c) == nil
+c.x = 1
+test:ok(ok and count(c) == 1 and count(record()) == 10, 'table.clear')
+
+local mt = setmetatable(record(), {__newindex = function(tab, k, v)
+  rawset(tab, k, v * 2)
+end})
+mt.a = 5
+mt.z = 5
+test:ok(mt.a == 5 and mt.z == 10 and record().a == 1, '__newindex')
+
+-- Bytecode TSETR is emitted for the built-ins written in Lua only,
+-- see <src/host/genlibbc.lua>. It stores into the array part of
+-- the table directly, unless the table is shared.
+local tsetr = utils.frontend.rawbc(function(tab, k, v) tab[k] = v end)
+local s1, s2 = array(), array()
+tsetr(s1, 1, 100)
+tsetr(s2, 30, 30)
+test:ok(utils.frontend.hasbc(tsetr, 'TSETR') and s1[1] == 100 and
+        s2[30] == 30 and s2[1] == 1 and array()[1] == 1 and
+        array()[30] == nil, 'TSETR')
+
+-- The template is kept alive by its duplicates.
+local w = setmetatable(record(), {__mode = 'kv'})
+local keep = {}
+for i = 1, 1e4 do
+  local d = i % 2 == 0 and record() or array()
+  if i % 3 == 0 then d[1], d.a = -1, -1 end
+  if i % 5 == 0 then keep[#keep + 1] = d end
+end
+record, array = nil, nil
+collectgarbage()
+collectgarbage()
+ok = count(w) == 10
+for _, d in ipairs(keep) do
+  if d[1] == nil and d.a == nil or count(d) < 10 then ok = false end
+end
+test:ok(ok, 'GC of the tables')
+
+-- The stores on traces: first recorded on a shared table, then
+-- on an unshared one.
+local function record2()
+  return {a = 1, b = 2, c = 3, d = 4, e = 5, f = 6, g = 7, h = 8, i = 9, j = 10}
+end
+jit.off(record2)
+jit.opt.start('hotloop=1', 'hotexit=2')
+
+local ts = {}
+for i = 1, 100 do ts[i] = record2() end
+for i = 1, 100 do
+  local d = ts[i]
+  d.a = d.a + i
+  d.z = i
+end
+ok = true
+for i = 1, 100 do
+  if ts[i].a ~= 1 + i or ts[i].z ~= i then ok = false end
+end
+test:ok(ok and record2().a == 1 and record2().z == nil, 'shared table on trace')
+
+for i = 1, 100 do ts[i] = i <= 5 and {a = 1} or record2() end
+for i = 1, 100 do ts[i].a = -i end
+ok = true
+for i = 1, 100 do
+  if ts[i].a ~= -i then ok = false end
+end
+test:ok(ok and record2().a == 1, 'unshared table on trace')
+
+-- The tables created on traces are copied and sunk as usual.
+local sum = 0
+for i = 1, 100 do
+  local d = {a = 1, b = 2, c = 3, d = 4, e = 5, f = 6, g = 7, h = 8, i = 9}
+  d.a = i
+  sum = sum + d.a + d.i
+end
+test:is(sum, 5050 + 900, 'tables created on traces')
+
+test:done(true)
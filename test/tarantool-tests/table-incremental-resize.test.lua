@@ -0,0 +1,104 @@
+local tap = require('tap')
+local count = require('utils').table.count
+
+-- Test file to check the semantics of the table during the
+-- incremental resize of its hash part: the keys must be found in
+-- either part until all of them are moved.
+local test = tap.test('table-incremental-resize'):skipcond({
+  ['Incremental resize is x86/x64 only'] = jit.arch ~= 'x86' and
+                                           jit.arch ~= 'x64',
+})
+
+test:plan(12)
+
+-- The hash part is resized incrementally starting from 2^16
+-- slots. Both string and non-integer number keys are used to
+-- avoid the array part.
+local NKEYS = 2^15
+
+local function fill(t, from, to)
+  for i = from, to do
+    t['k' .. i] = i
+    t[-i] = i
+  end
+end
+
+local function check(t, from, to)
+  for i = from, to do
+    if t['k' .. i] ~= i or t[-i] ~= i then return false end
+  end
+  return true
+end
+
+-- Start the resize by the first insert, which doesn't fit into
+-- the full hash part of 2^16 slots. A few more inserts move only
+-- a part of the old slots.
+local t = {[0.5] = 0}
+fill(t, 1, NKEYS)
+fill(t, NKEYS + 1, NKEYS + 16)
+test:ok(check(t, 1, NKEYS + 16), 'lookups in both parts')
+test:ok(rawget(t, 'k0') == nil and t[-0.5] == nil, 'missing keys')
+
+-- Overwrite and delete the keys, which are not moved yet.
+t['k' .. NKEYS] = 0
+t[-NKEYS] = nil
+test:ok(t['k' .. NKEYS] == 0 and t[-NKEYS] == nil, 'stores to old part')
+t['k' .. NKEYS] = NKEYS
+t[-NKEYS] = NKEYS
+
+-- The traversal with next() doesn't move the keys.
+local n, key = 0, nil
+repeat
+  key = next(t, key)
+  n = n + 1
+until key == nil
+test:is(n - 1, 2 * (NKEYS + 16) + 1, 'next traverses both parts')
+test:is(table.maxn(t), 0.5, 'table.maxn')
+
+-- The pairs() loop finishes the resize first.
+test:is(count(t), 2 * (NKEYS + 16) + 1, 'pairs traverses all keys')
+test:ok(check(t, 1, NKEYS + 16), 'lookups after the resize')
+
+-- The weak table is swept in both parts.
+local weak = setmetatable({}, {__mode = 'k'})
+for i = 1, 2 * NKEYS + 16 do weak[{}] = i end
+collectgarbage()
+collectgarbage()
+test:is(next(weak), nil, 'weak keys are swept')
+
+-- The table is cleared in both parts.
+local c = {}
+fill(c, 1, NKEYS + 16)
+require('table.clear')(c)
+test:is(next(c), nil, 'table.clear')
+
+-- The same checks on traces.
+jit.opt.start('hotloop=1')
+
+local r = {}
+fill(r, 1, NKEYS)
+local ok = true
+for i = NKEYS + 1, NKEYS + 16 do
+  r['k' .. i] = i
+  r[-i] = i
+  -- The keys in the old part are found and stored.
+  ok = ok and r.k1 == 1 and r[-1] == 1 and r.k0 == nil
+  r.k2 = i
+end
+test:ok(ok and r.k2 == NKEYS + 16, 'traces with the old part')
+
+local s = {}
+fill(s, 1, NKEYS)
+for i = NKEYS + 1, 2 * NKEYS do
+  s['k' .. i] = i
+  s[-i] = i
+end
+test:ok(check(s, 1, 2 * NKEYS), 'traces with the inserts')
+
+local u = {}
+for i = 1, 2 * NKEYS + 16 do
+  u[{}] = i
+end
+test:is(count(u), 2 * NKEYS + 16, 'traces with the table keys')
+
+test:done(true)
@@ -0,0 +1,150 @@
+local tap = require('tap')
+
+-- Test file to check table.move(), table.remove() and
+-- table.insert() in the middle, which move the table slots in a
+-- single call both in the interpreter and on traces.
+local test = tap.test('table-move-insert-remove')
+
+test:plan(12)
+
+local function seq(n)
+  local t = {}
+  for i = 1, n do t[i] = i end
+  return t
+end
+
+local function same(t, expected)
+  for k, v in pairs(t) do
+    if expected[k] ~= v then return false end
+  end
+  for k, v in pairs(expected) do
+    if t[k] ~= v then return false end
+  end
+  return true
+end
+
+-- The overlapping moves in both directions, both in the array
+-- and the hash parts, and to another table.
+local t = table.move(seq(5), 2, 5, 1)
+local ok = same(t, {2, 3, 4, 5, 5})
+t = table.move(seq(5), 1, 4, 2)
+ok = ok and same(t, {1, 1, 2, 3, 4})
+t = table.move({[-1] = 'a', [0] = 'b', 'c', nil, 'e'}, -1, 3, 1)
+ok = ok and same(t, {[-1] = 'a', [0] = 'b', 'a', 'b', 'c', nil, 'e'})
+local d = {x = 'x'}
+ok = ok and table.move(seq(3), 1, 3, 1e6, d) == d and
+     same(d, {x = 'x', [1e6] = 1, [1e6 + 1] = 2, [1e6 + 2] = 3})
+test:ok(ok and table.move(seq(3), 3, 1, 1, d) == d, 'table.move')
+
+test:ok(not pcall(table.move, {}, 1, 2, 2^31 - 1) and
+        not pcall(table.move, {}, -2^31, 2^31 - 1, 1) and
+        not pcall(table.move, {}, 1, 2, 3, 4), 'table.move errors')
+
+-- The removes in the middle, at the border and out of bounds.
+t = seq(5)
+ok = table.remove(t, 2) == 2 and same(t, {1, 3, 4, 5})
+ok = ok and table.remove(t) == 5 and same(t, {1, 3, 4})
+ok = ok and select('#', table.remove(t, 5)) == 0 and
+     select('#', table.remove(t, 0)) == 0 and same(t, {1, 3, 4})
+ok = ok and select('#', table.remove({})) == 0
+t = {1, 2, 3, [5] = 5}
+test:ok(ok and table.remove(t, 1) == 1 and t[2] == 3 and t[3] == nil,
+        'table.remove')
+
+t = seq(3)
+table.insert(t, 1, 0)
+ok = same(t, {0, 1, 2, 3})
+table.insert(t, 5, 4)
+table.insert(t, 7, 6)
+ok = ok and same(t, {0, 1, 2, 3, 4, [7] = 6})
+table.insert(t, 0, -1)
+test:ok(ok and same(t, {[0] = -1, nil, 0, 1, 2, 3, 4, 6}),
+        'table.insert in the middle')
+
+-- The tables shared with a template are copied on the move.
+local function tmpl()
+  return {1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15, 16, 17, 18}
+end
+jit.off(tmpl)
+t = tmpl()
+table.insert(t, 1, 0)
+local u = tmpl()
+table.remove(u, 1)
+test:ok(t[1] == 0 and u[1] == 2 and tmpl()[1] == 1 and
+        table.move(tmpl(), 1, 18, 2)[2] == 1 and tmpl()[2] == 2,
+        'copy-on-write tables')
+
+-- The moved values are marked by the GC.
+t = {}
+for i = 1, 100 do t[i] = {i} end
+for i = 1, 100 do
+  table.insert(t, 1, table.remove(t))
+  d = table.move(t, 1, 100, 1, {})
+  if i % 10 == 0 then collectgarbage() end
+end
+collectgarbage()
+ok = true
+for i = 1, 100 do
+  if t[i][1] ~= i or d[i][1] ~= i then ok = false end
+end
+test:ok(ok, 'write barrier')
+
+-- The same on traces.
+jit.opt.start('hotloop=1', 'hotexit=2')
+
+t = {}
+for i = 1, 100 do table.insert(t, 1, i) end
+ok = #t == 100
+for i = 1, 100 do
+  if t[i] ~= 101 - i then ok = false end
+end
+local sum = 0
+for _ = 1, 100 do sum = sum + table.remove(t, 1) end
+test:ok(ok and sum == 5050 and #t == 0, 'queue on trace')
+
+-- The loads after the moves see the moved values.
+t = seq(10)
+ok = true
+for i = 1, 50 do
+  local a = t[3]
+  table.insert(t, 3, -i)
+  if t[3] ~= -i or t[4] ~= a then ok = false end
+  if table.remove(t, 3) ~= -i or t[3] ~= a then ok = false end
+end
+test:ok(ok and same(t, seq(10)), 'loads after the moves on trace')
+
+t, u = seq(10), {}
+local n = 0
+for i = 1, 50 do
+  n = n + select('#', table.remove(t, 10 + i)) +
+      select('#', table.remove(t, 1 - i))
+  table.insert(u, 2 * i, i)
+end
+test:ok(n == 0 and same(t, seq(10)) and u[100] == 50 and u[99] == nil,
+        'out of bounds on trace')
+
+t = seq(10)
+sum = 0
+for _ = 1, 50 do
+  local len = #t
+  table.move(t, 1, len, 2)
+  t[1] = 0
+  sum = sum + #t - len
+end
+test:ok(sum == 50 and #t == 60 and t[60] == 10, 'length after the moves')
+
+d = {}
+for i = 1, 50 do
+  if table.move(t, 51, 60, 10 * i - 9, d) ~= d then d = nil end
+end
+test:ok(#d == 500 and d[500] == 10, 'table.move to another table')
+
+-- The table.move() errors on trace.
+ok = true
+for i = 1, 50 do
+  local e = i == 50 and 2^31 - 1 or 1
+  if pcall(table.move, {}, 1, 2, e) ~= (i < 50) then ok = false end
+end
+test:ok(ok, 'table.move error on trace')
+
+test:done(true)
@@ -6,6 +6,8 @@ local vmdef = require('jit.vmdef')
 local bcnames = vmdef.bcnames
 local band, rshift = bit.band, bit.rshift
 
+local isbe = (string.byte(string.dump(function() end), 5) % 2 == 1)
+
 function M.hasbc(f, bytecode)
   assert(type(f) == 'function', 'argument #1 should be a function')
   assert(type(bytecode) == 'string', 'argument #2 should be a string')
@@ -46,4 +48,46 @@ function M.gettraceno(func)
   return rshift(func_ins, RD_SHIFT)
 end
 
+-- Get the copy of the given function with TGETV and TSETV
+-- bytecodes replaced by TGETR and TSETR. The same fixup is
+-- done by <src/host/genlibbc.lua> for the built-ins written in
+-- Lua, which index the tables checked by CHECK_tab(). Hence, the
+-- tables and integer keys only are allowed in the indexing
+-- operations of the function. Upvalues aren't supported.
+function M.rawbc(f)
+  assert(type(f) == 'function', 'argument #1 should be a function')
+  local function opcode(name)
+    return (bcnames:find(('%-6s'):format(name), 1, true) - 1) / 6
+  end
+  local raw = {
+    [opcode('TGETV')] = opcode('TGETR'),
+    [opcode('TSETV')] = opcode('TSETR'),
+  }
+  -- The dump contains the bytecode without the function header.
+  local code, ops = {}, {}
+  local pc = 1
+  while true do
+    local ins = jutil.funcbc(f, pc)
+    if not ins then break end
+    local bytes = {}
+    for i = 0, 3 do
+      bytes[isbe and 4 - i or i + 1] = band(rshift(ins, 8 * i), 0xff)
+    end
+    code[pc] = string.char(unpack(bytes))
+    ops[pc] = raw[band(ins, 0xff)]
+    pc = pc + 1
+  end
+  local dump = string.dump(f, true)
+  local base = dump:find(table.concat(code), 1, true)
+  assert(base, 'bytecode is not found in the dump')
+  for i = 1, #code do
+    if ops[i] then
+      -- The opcode is the lowest byte of the instruction.
+      local pos = base + 4 * (i - 1) + (isbe and 3 or 0)
+      dump = dump:sub(1, pos - 1) .. string.char(ops[i]) .. dump:sub(pos + 1)
+    end
+  end
+  return assert(loadstring(dump))
+end
+
 return M
@@ -0,0 +1,10 @@
+local M = {}
+
+-- Count the keys of the table, which are visited by pairs().
+function M.count(t)
+  local n = 0
+  for _ in pairs(t) do n = n + 1 end
+  return n
+end
+
+return M
@@ -0,0 +1,127 @@
+-- A tool for parsing and visualisation of LuaJIT's heap dumps.
+-- Reports the retained sizes of the objects based on the
+-- dominator tree of the object graph.
+
+local heapdump = require "heapdump.parse"
+local process = require "heapdump.process"
+local evread = require "utils.evread"
+local view = require "heapdump.humanize"
+
+local stdout, stderr = io.stdout, io.stderr
+local match, gmatch = string.match, string.gmatch
+
+-- Program options.
+local opt_map = {}
+
+-- Default config for the heap dump parser.
+local config = {
+  human_readable = false,
+  top = 20,
+}
+
+function opt_map.help()
+  stdout:write [[
+luajit-parse-heapdump - parser of the heap dump collected
+                        with LuaJIT's misc.heapdump().
+
+SYNOPSIS
+
+luajit-parse-heapdump [options] heapdump.bin
+
+Supported options are:
+
+  --help                            Show this help and exit
+  --human-readable                  Use KiB/MiB/GiB notation instead of bytes
+  --top N                           Report N top retainers (default 20)
+]]
+  os.exit(0)
+end
+
+opt_map["human-readable"] = function()
+  config.human_readable = true
+end
+
+-- Print error and exit with error status.
+local function opterror(...)
+  stderr:write("luajit-parse-heapdump.lua: ERROR: ", ...)
+  stderr:write("\n")
+  os.exit(1)
+end
+
+opt_map.top = function(args)
+  local top = tonumber(args[args.argn])
+  if not top or top < 1 then
+    opterror("bad value for `--top'. Try `--help'.")
+  end
+  config.top = top
+  args.argn = args.argn + 1
+end
+
+-- Parse single option.
+local function parseopt(opt, args)
+  local opt_current = #opt == 1 and "-"..opt or "--"..opt
+  local f = opt_map[opt]
+  if not f then
+    opterror("unrecognized option `", opt_current, "'. Try `--help'.\n")
+  end
+  f(args)
+end
+
+-- Parse arguments.
+local function parseargs(args)
+  -- Process all option arguments.
+  args.argn = 1
+  repeat
+    local a = args[args.argn]
+    if not a then
+      break
+    end
+    local lopt, opt = match(a, "^%-(%-?)(.+)")
+    if not opt then
+      break
+    end
+    args.argn = args.argn + 1
+    if lopt == "" then
+      -- Loop through short options.
+      for o in gmatch(opt, ".") do
+        parseopt(o, args)
+      end
+    else
+      -- Long option.
+      parseopt(opt, args)
+    end
+  until false
+
+  -- Check for proper number of arguments.
+  local nargs = #args - args.argn + 1
+  if nargs ~= 1 then
+    opt_map.help()
+  end
+
+  -- Translate a single input file.
+  -- TODO: Handle multiple files?
+  return args[args.argn]
+end
+
+local function dump(inputfile)
+  -- XXX: This function exits with a non-zero exit code and
+  -- prints an error message if it encounters any failure during
+  -- the process of parsing.
+  local heap, symbols = evread(heapdump.parse, inputfile)
+  local idom, retained = process.dominators(heap)
+
+  view.summary(heap, idom, config)
+  view.retainers(heap, symbols, idom, retained, config)
+  -- XXX: The second argument is required to properly close Lua
+  -- universe (i.e. invoke <lua_close> before exiting).
+  os.exit(0, true)
+end
+
+-- XXX: When this script is used as a preloaded module by an
+-- application, it should return one function for correct parsing
+-- of command line flags and dumping the report.
+local function dump_wrapped(...)
+  return dump(parseargs(...))
+end
+
+return dump_wrapped
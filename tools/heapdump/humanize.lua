@@ -0,0 +1,137 @@
+-- Simple human-readable renderer of LuaJIT's heap dump.
+
+local symtab = require "utils.symtab"
+local parse = require "heapdump.parse"
+
+local string_format = string.format
+
+local GCT_NAMES = parse.GCT_NAMES
+
+-- Max length of the dominator chain to show.
+local CHAIN_MAX = 8
+
+local M = {}
+
+local function human_readable_bytes(bytes)
+  local units = {"B", "KiB", "MiB", "GiB"}
+  local magnitude = 1
+
+  while bytes >= 1024 and magnitude < #units do
+    bytes = bytes / 1024
+    magnitude = magnitude + 1
+  end
+  local is_int = math.floor(bytes) == bytes
+  local fmt = is_int and "%d%s" or "%.2f%s"
+
+  return string_format(fmt, bytes, units[magnitude])
+end
+
+local function format_bytes(bytes, config)
+  if config.human_readable then
+    return human_readable_bytes(bytes)
+  else
+    return string_format("%dB", bytes)
+  end
+end
+
+local function describe_lfunc(symbols, addr)
+  local sym = symbols.lfunc[addr]
+  return symtab.demangle(symbols, symtab.loc({
+    addr = addr,
+    line = sym and sym.linedefined or 0,
+  }))
+end
+
+-- Short description of the i-th object.
+function M.describe(heap, symbols, i)
+  local name = GCT_NAMES[heap.gct[i]]
+  local addr = heap.addr[i]
+  local aux = heap.aux[i]
+
+  if name == "string" then
+    local s = heap.str[i]
+    return string_format("string %q%s", s, #s < aux and "..." or "")
+  elseif name == "function" then
+    if heap.flag[i] then
+      return "function "..symtab.demangle(symbols, symtab.loc({addr = aux}))
+    end
+    return "function "..describe_lfunc(symbols, aux)
+  elseif name == "proto" then
+    return "proto "..describe_lfunc(symbols, addr)
+  elseif name == "table" then
+    return string_format("table %#x (asize %d)", addr, aux)
+  elseif name == "userdata" then
+    return string_format("userdata %#x (len %d)", addr, aux)
+  elseif name == "cdata" then
+    return string_format("cdata %#x (ctypeid %d)", addr, aux)
+  elseif name == "trace" then
+    return string_format("TRACE [%d]", aux)
+  end
+  return string_format("%s %#x", name, addr)
+end
+
+function M.summary(heap, idom, config)
+  local count, size = {}, {}
+  local unreachable = 0
+
+  for i = 1, heap.n do
+    local gct = heap.gct[i]
+    count[gct] = (count[gct] or 0) + 1
+    size[gct] = (size[gct] or 0) + heap.size[i]
+    if not idom[i] then
+      unreachable = unreachable + 1
+    end
+  end
+
+  local total = 0
+  print("HEAP SUMMARY")
+  for gct, name in pairs(GCT_NAMES) do
+    if count[gct] then
+      print(string_format("%s: %d objects\t%s",
+        name, count[gct], format_bytes(size[gct], config)
+      ))
+      total = total + size[gct]
+    end
+  end
+  print(string_format("TOTAL: %d objects\t%s", heap.n,
+                      format_bytes(total, config)))
+  if unreachable > 0 then
+    print(string_format("UNREACHABLE: %d objects", unreachable))
+  end
+  print("")
+end
+
+function M.retainers(heap, symbols, idom, retained, config)
+  local ids = {}
+
+  for i in pairs(retained) do
+    table.insert(ids, i)
+  end
+
+  table.sort(ids, function(i1, i2)
+    return retained[i1] > retained[i2]
+  end)
+
+  print("TOP RETAINERS")
+  for k = 1, math.min(config.top, #ids) do
+    local i = ids[k]
+    print(string_format("%s: retained %s\tsize %s",
+      M.describe(heap, symbols, i),
+      format_bytes(retained[i], config),
+      format_bytes(heap.size[i], config)
+    ))
+    local d = idom[i]
+    local depth = 0
+    while d and d ~= 0 and depth < CHAIN_MAX do
+      print("\tdominated by "..M.describe(heap, symbols, d))
+      d = idom[d]
+      depth = depth + 1
+    end
+    if d and d ~= 0 then
+      print("\t...")
+    end
+  end
+  print("")
+end
+
+return M
@@ -0,0 +1,130 @@
+-- Parser of LuaJIT's heap dump binary stream.
+-- The format spec can be found in <src/lj_heapdump.h>.
+
+local bit = require "bit"
+local band = bit.band
+
+local string_format = string.format
+
+local LJH_MAGIC = "ljh"
+local LJH_CURRENT_VERSION = 0x01
+
+local LJH_EPILOGUE_HEADER = 0x80
+
+local HEAPDUMP_GCT_MASK = 0x1f
+local HEAPDUMP_FLAG = 0x20
+local HEAPDUMP_ROOT = 0x40
+
+local GCT_STR = 4
+
+local M = {}
+
+-- Names of the GC types, indexed by the bitwise negation of the
+-- internal type tag.
+M.GCT_NAMES = {
+  [4] = "string",
+  [5] = "upvalue",
+  [6] = "thread",
+  [7] = "proto",
+  [8] = "function",
+  [9] = "trace",
+  [10] = "cdata",
+  [11] = "table",
+  [12] = "userdata",
+}
+
+-- The objects are stored column-wise to keep the memory footprint
+-- of the parser low for large heaps. The references of the i-th
+-- object are refs[refstart[i]] .. refs[refstart[i + 1] - 1].
+local function new_heap()
+  return {
+    n = 0,
+    addr = {},
+    gct = {},
+    flag = {},
+    size = {},
+    aux = {},
+    str = {},
+    refs = {},
+    refstart = {[1] = 1},
+    roots = {},
+    index = {},
+  }
+end
+
+local function parse_object(reader, heap, header)
+  local i = heap.n + 1
+  local addr = reader:read_uleb128()
+  local gct = band(header, HEAPDUMP_GCT_MASK)
+
+  heap.n = i
+  heap.index[addr] = i
+  heap.addr[i] = addr
+  heap.gct[i] = gct
+  heap.flag[i] = band(header, HEAPDUMP_FLAG) ~= 0
+  heap.size[i] = reader:read_uleb128()
+  heap.aux[i] = reader:read_uleb128()
+  if gct == GCT_STR then
+    heap.str[i] = reader:read_string()
+  end
+
+  local refs = heap.refs
+  local nrefs = #refs
+  while true do
+    local ref = reader:read_uleb128()
+    if ref == 0 then
+      break
+    end
+    nrefs = nrefs + 1
+    refs[nrefs] = ref
+  end
+  heap.refstart[i + 1] = nrefs + 1
+end
+
+local function parse_record(reader, heap)
+  local header = reader:read_octet()
+
+  if header == LJH_EPILOGUE_HEADER then
+    return false
+  end
+
+  if band(header, HEAPDUMP_ROOT) ~= 0 then
+    table.insert(heap.roots, reader:read_uleb128())
+  else
+    assert(M.GCT_NAMES[band(header, HEAPDUMP_GCT_MASK)],
+           "Bad record header "..header)
+    parse_object(reader, heap, header)
+  end
+
+  return true
+end
+
+function M.parse(reader)
+  local heap = new_heap()
+
+  local magic = reader:read_octets(3)
+  local version = reader:read_octets(1)
+  -- Dummy-consume reserved bytes.
+  local _ = reader:read_octets(3)
+
+  if magic ~= LJH_MAGIC then
+    error("Bad heap dump format prologue: "..magic)
+  end
+
+  if string.byte(version) ~= LJH_CURRENT_VERSION then
+    error(string_format(
+      "Heap dump format version mismatch:"..
+      " the tool expects %d, but your data is %d",
+      LJH_CURRENT_VERSION,
+      string.byte(version)
+    ))
+  end
+
+  while parse_record(reader, heap) do
+    -- Empty body.
+  end
+
+  return heap
+end
+
+return M
@@ -0,0 +1,159 @@
+-- LuaJIT's heap dump post-processing module: the dominator tree
+-- of the object graph and the retained sizes.
+--
+-- An object A dominates an object B, if every path from the GC
+-- roots to B goes through A, so B is freed as soon as A is gone.
+-- The retained size of an object is the total size of all the
+-- objects it dominates (including itself).
+
+local M = {}
+
+-- Build the successors of each object as a compressed list of
+-- object indices. The node 0 is a virtual root, which references
+-- all the GC roots. The references to the objects, which are not
+-- dumped (e.g. static ones), are dropped.
+local function build_succ(heap)
+  local index, refs, refstart = heap.index, heap.refs, heap.refstart
+  local succ, succstart = {}, {}
+  local nsucc = 0
+
+  succstart[0] = 1
+  for _, addr in ipairs(heap.roots) do
+    local w = index[addr]
+    if w then
+      nsucc = nsucc + 1
+      succ[nsucc] = w
+    end
+  end
+  for v = 1, heap.n do
+    succstart[v] = nsucc + 1
+    for k = refstart[v], refstart[v + 1] - 1 do
+      local w = index[refs[k]]
+      if w then
+        nsucc = nsucc + 1
+        succ[nsucc] = w
+      end
+    end
+  end
+  succstart[heap.n + 1] = nsucc + 1
+  return succ, succstart
+end
+
+-- Number the reachable nodes in the depth-first postorder.
+local function postorder(succ, succstart)
+  local order, po = {}, {}
+  local stack_node, stack_pos = {0}, {succstart[0]}
+  local sp = 1
+  local visited = {[0] = true}
+
+  while sp > 0 do
+    local v = stack_node[sp]
+    local pos = stack_pos[sp]
+    if pos < succstart[v + 1] then
+      stack_pos[sp] = pos + 1
+      local w = succ[pos]
+      if not visited[w] then
+        visited[w] = true
+        sp = sp + 1
+        stack_node[sp] = w
+        stack_pos[sp] = succstart[w]
+      end
+    else
+      sp = sp - 1
+      local k = #order + 1
+      order[k] = v
+      po[v] = k
+    end
+  end
+  return order, po
+end
+
+-- Build the predecessors of the reachable nodes.
+local function build_pred(succ, succstart, n, po)
+  local pred, predstart = {}, {}
+  local count = {}
+
+  for v = 0, n do
+    count[v] = 0
+  end
+  for v = 0, n do
+    if po[v] then
+      for k = succstart[v], succstart[v + 1] - 1 do
+        local w = succ[k]
+        count[w] = count[w] + 1
+      end
+    end
+  end
+  local pos = 1
+  for v = 0, n do
+    predstart[v] = pos
+    pos = pos + count[v]
+    count[v] = predstart[v]
+  end
+  predstart[n + 1] = pos
+  for v = 0, n do
+    if po[v] then
+      for k = succstart[v], succstart[v + 1] - 1 do
+        local w = succ[k]
+        pred[count[w]] = v
+        count[w] = count[w] + 1
+      end
+    end
+  end
+  return pred, predstart
+end
+
+-- Compute the immediate dominators with the iterative algorithm by
+-- Cooper, Harvey and Kennedy ("A Simple, Fast Dominance Algorithm").
+-- Returns the table of immediate dominators (0 for the objects
+-- dominated by the virtual root only) and the retained sizes.
+function M.dominators(heap)
+  local n = heap.n
+  local succ, succstart = build_succ(heap)
+  local order, po = postorder(succ, succstart)
+  local pred, predstart = build_pred(succ, succstart, n, po)
+  local idom = {[0] = 0}
+
+  local function intersect(b1, b2)
+    while b1 ~= b2 do
+      while po[b1] < po[b2] do b1 = idom[b1] end
+      while po[b2] < po[b1] do b2 = idom[b2] end
+    end
+    return b1
+  end
+
+  local changed = true
+  while changed do
+    changed = false
+    -- Reverse postorder without the virtual root.
+    for k = #order - 1, 1, -1 do
+      local b = order[k]
+      local new
+      for j = predstart[b], predstart[b + 1] - 1 do
+        local p = pred[j]
+        if idom[p] then
+          new = new and intersect(p, new) or p
+        end
+      end
+      if idom[b] ~= new then
+        idom[b] = new
+        changed = true
+      end
+    end
+  end
+
+  -- Dominated objects precede their dominators in the postorder.
+  local retained = {}
+  for k = 1, #order - 1 do
+    local v = order[k]
+    retained[v] = (retained[v] or 0) + heap.size[v]
+    local d = idom[v]
+    retained[d] = (retained[d] or 0) + retained[v]
+  end
+  idom[0] = nil
+  retained[0] = nil
+
+  return idom, retained
+end
+
+return M